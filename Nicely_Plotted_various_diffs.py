@@ -31,10 +31,26 @@ PAIR_CHANNELS = {
 }
 
 
+def event_file(base_dir: Path, pair: str):
+    """<pair>.csv, or the binary <pair>.bin from --dump-format bin."""
+    for suffix in (".csv", ".bin"):
+        path = base_dir / f"{pair}{suffix}"
+        if path.exists():
+            return path
+    return base_dir / f"{pair}.csv"
+
+
 def load_events(path: Path):
     if not path.exists():
         return None
-    df = pd.read_csv(path)
+    if path.suffix == ".bin":
+        with open(path, "rb") as f:
+            if f.read(8) != b"CFHITS01":
+                raise ValueError(f"{path} is not a CoincPairs binary dump")
+            rec = np.fromfile(f, dtype=[("second", "<i8"), ("t1_ps", "<i8"), ("t2_ps", "<i8")])
+        df = pd.DataFrame(rec)
+    else:
+        df = pd.read_csv(path)
     expected = {"second", "t1_ps", "t2_ps"}
     if not expected.issubset(df.columns):
         raise ValueError(f"{path} missing expected columns {expected}")
@@ -168,7 +184,7 @@ def summarize_pair(pair, df, window_ps):
 
 def process_pair(pair: str, window_ps: float | None, max_lag: int,
                  channel_widths, base_dir: Path):
-    path = base_dir / f"{pair}.csv"
+    path = event_file(base_dir, pair)
     df = load_events(path)
     if df is None:
         print(f"{pair}: no events")
@@ -271,7 +287,7 @@ def main():
         print(f"Run directory not found: {run_dir}")
         return
 
-    available = [p for p in PAIRS if (run_dir / f"{p}.csv").exists()]
+    available = [p for p in PAIRS if event_file(run_dir, p).exists()]
     if not available:
         print(f"No <pair>.csv files found in {run_dir}. Run CoincPairs with --dump-events first.")
         return
@@ -0,0 +1,144 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// @file
+/// Planning pieces of the `CoincBatch` driver: input expansion, sharding of
+/// files and second ranges across nodes, a memory budget for concurrent
+/// loads, and the per-shard summaries that are merged into one report.
+///
+/// Every node expands the same inputs to the same ordered file list and
+/// plans independently, so shards need no coordination beyond a shared
+/// output directory. A shard summary is a CSV with the columns
+///   pair,delay_ps,first_second,last_second,seconds,coincidences,file
+/// (the path goes last so paths containing commas still parse). The
+/// aggregated report uses the same columns, so reports can be merged again.
+
+/// Shard `index` of `count` (0 <= index < count).
+struct ShardSpec {
+    int index = 0;
+    int count = 1;
+};
+
+/// How a shard selects its work.
+enum class ShardMode {
+    Files,   ///< Whole files, dealt round-robin over the shards.
+    Seconds, ///< Every file, each shard taking one contiguous part of its seconds.
+};
+
+/// Parses "k/n"; throws std::invalid_argument unless 0 <= k < n.
+ShardSpec parseShardSpec(const std::string &spec);
+
+/// Expands CLI inputs into an ordered, duplicate-free file list. An entry is
+/// a path, a pattern with `*` or `?` in its last component (matches sorted
+/// by name), or `@list.txt` naming a file with one such entry per line
+/// (blank lines and lines starting with '#' are skipped). Throws
+/// std::runtime_error for a missing path or a pattern matching nothing.
+std::vector<std::string> expandInputPatterns(const std::vector<std::string> &inputs);
+
+/// Seconds `firstSecond..lastSecond` (inclusive) of one capture.
+struct BatchTask {
+    std::string file;
+    long long firstSecond = 0;
+    long long lastSecond = 0;
+
+    long long seconds() const { return lastSecond - firstSecond + 1; }
+};
+
+/// The tasks of `shard` out of `tasks` (one per file, in list order).
+/// Files mode keeps task `i` when `i % count == index`; Seconds mode splits
+/// every task into `count` near-equal contiguous parts and keeps part
+/// `index`. Empty parts are dropped.
+std::vector<BatchTask> planShard(const std::vector<BatchTask> &tasks, ShardSpec shard,
+                                 ShardMode mode);
+
+/// Rough resident size of loading `seconds` buckets of `filename`, whose
+/// whole capture spans `durationSec`: the event count estimated from the
+/// file size (10-byte BIN records, or a conservative CSV line length)
+/// times the bytes the reader holds per event.
+size_t estimateLoadBytes(const std::string &filename, double durationSec,
+                         long long seconds);
+
+/// Counting semaphore over bytes, bounding the data that concurrent loads
+/// keep resident. A request larger than the whole budget is clamped to it,
+/// so an oversized load still runs, alone.
+class MemoryBudget {
+public:
+    /// Bytes held until destroyed or moved from.
+    class Lease {
+    public:
+        Lease() = default;
+        Lease(Lease &&other) noexcept;
+        Lease &operator=(Lease &&other) noexcept;
+        ~Lease();
+        Lease(const Lease &) = delete;
+        Lease &operator=(const Lease &) = delete;
+
+        size_t bytes() const { return bytes_; }
+
+    private:
+        friend class MemoryBudget;
+        Lease(MemoryBudget *budget, size_t bytes) : budget_(budget), bytes_(bytes) {}
+
+        MemoryBudget *budget_ = nullptr;
+        size_t bytes_ = 0;
+    };
+
+    /// `capacityBytes == 0` means unlimited.
+    explicit MemoryBudget(size_t capacityBytes) : capacity_(capacityBytes) {}
+    MemoryBudget(const MemoryBudget &) = delete;
+    MemoryBudget &operator=(const MemoryBudget &) = delete;
+
+    /// Waits until `bytes` (clamped to the capacity) fit, then holds them.
+    Lease reserve(size_t bytes);
+
+    size_t capacity() const { return capacity_; }
+    size_t inUse() const;
+
+private:
+    void release(size_t bytes);
+
+    const size_t capacity_;
+    mutable std::mutex mutex_;
+    std::condition_variable freed_;
+    size_t inUse_ = 0;
+};
+
+/// Totals of one pair over the seconds of one task.
+struct BatchSummaryRow {
+    std::string pair;
+    long long delayPs = 0;
+    long long firstSecond = 0;
+    long long lastSecond = 0;
+    long long seconds = 0;
+    long long coincidences = 0;
+    std::string file;
+};
+
+/// `<directory>/shard_<k>_of_<n>.csv`.
+std::string shardSummaryPath(const std::string &directory, ShardSpec shard);
+
+/// Writes `rows` in the summary format through a temporary that is renamed
+/// into place, so an aggregator never sees a partial shard. Throws
+/// std::runtime_error on I/O failure.
+void writeBatchSummary(const std::string &filename,
+                       const std::vector<BatchSummaryRow> &rows);
+
+/// Parses a summary written by `writeBatchSummary`; throws
+/// std::runtime_error when the file is missing or malformed.
+std::vector<BatchSummaryRow> readBatchSummary(const std::string &filename);
+
+/// Merges rows of the same (file, pair): seconds and coincidences are
+/// summed and the second range widened. Rows keep the order in which their
+/// key first appears. Throws std::runtime_error when two rows of a key
+/// disagree on the delay.
+std::vector<BatchSummaryRow> mergeBatchSummaries(const std::vector<BatchSummaryRow> &rows);
+
+/// Reads the summaries of shards 0..shardCount-1 in `directory` and merges
+/// them. Throws std::runtime_error naming the missing shards if any has
+/// not finished.
+std::vector<BatchSummaryRow> aggregateShardSummaries(const std::string &directory,
+                                                     int shardCount);
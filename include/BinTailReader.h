@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "Singles.h"
+
+class RollingSingles;
+
+/// @file
+/// Tail-follow reader for a Qutools BIN file that is still being written.
+/// Each `poll` returns only the complete records appended since the previous
+/// call; a partially written trailing record is left for the next poll.
+
+class BinTailReader {
+public:
+    /// The file does not need to exist yet; polls return nothing until it
+    /// does and its 40-byte header has been written.
+    explicit BinTailReader(std::string filename);
+
+    /// Appends up to `maxRecords` new records to `out` and returns how many
+    /// were added. When the file shrinks (rotated or truncated) reading
+    /// restarts from its header. Throws std::runtime_error on read errors.
+    size_t poll(std::vector<RawRecord> &out,
+                size_t maxRecords = std::numeric_limits<size_t>::max());
+
+    /// Convenience: polls and feeds the records straight into `rolling`.
+    /// Returns the number of records read (not all need be accepted).
+    size_t pollInto(RollingSingles &rolling,
+                    size_t maxRecords = std::numeric_limits<size_t>::max());
+
+    /// Byte offset of the next unread record.
+    uint64_t offset() const { return offset_; }
+    const std::string &filename() const { return filename_; }
+
+private:
+    std::string filename_;
+    std::ifstream in_;
+    uint64_t offset_ = 0;
+    std::vector<unsigned char> buffer_;
+    std::vector<RawRecord> scratch_;
+};
@@ -0,0 +1,67 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+/// @file
+/// Minimal multi-producer / multi-consumer FIFO with a fixed capacity, used to
+/// hand work from the scan threads to background writers. Producers block
+/// only when the consumer falls `capacity` items behind.
+
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity_(capacity ? capacity : 1) {}
+
+    BoundedQueue(const BoundedQueue &) = delete;
+    BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+    /// Enqueues `value`, waiting for room. Returns false (dropping `value`)
+    /// once the queue has been closed.
+    bool push(T value) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notFull_.wait(lock,
+                      [this] { return closed_ || items_.size() < capacity_; });
+        if (closed_)
+            return false;
+        items_.push_back(std::move(value));
+        lock.unlock();
+        notEmpty_.notify_one();
+        return true;
+    }
+
+    /// Dequeues the oldest item, waiting for one. Returns std::nullopt when the
+    /// queue is closed and fully drained.
+    std::optional<T> pop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notEmpty_.wait(lock, [this] { return closed_ || !items_.empty(); });
+        if (items_.empty())
+            return std::nullopt;
+        T value = std::move(items_.front());
+        items_.pop_front();
+        lock.unlock();
+        notFull_.notify_one();
+        return value;
+    }
+
+    /// Rejects further pushes; consumers still drain what is queued.
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+        }
+        notFull_.notify_all();
+        notEmpty_.notify_all();
+    }
+
+private:
+    const size_t capacity_;
+    std::deque<T> items_;
+    bool closed_ = false;
+    std::mutex mutex_;
+    std::condition_variable notFull_;
+    std::condition_variable notEmpty_;
+};
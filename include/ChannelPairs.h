@@ -0,0 +1,112 @@
+#pragma once
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Coincidences.h"
+
+/// @file
+/// Parsing of the `--pairs` option and the pair tables shared by the CLIs.
+
+/// Parses a comma-separated list of detector channel pairs such as
+/// "1-5,2-6,1-6". Channels are positive integers; throws
+/// std::invalid_argument on malformed entries, so callers can report the
+/// message as is.
+inline std::vector<std::pair<int, int>> parseChannelPairs(const std::string &spec) {
+    std::vector<std::pair<int, int>> pairs;
+    size_t pos = 0;
+    while (pos <= spec.size()) {
+        const size_t comma = std::min(spec.find(',', pos), spec.size());
+        const std::string item = spec.substr(pos, comma - pos);
+        const size_t dash = item.find('-');
+        int first = 0;
+        int second = 0;
+        const auto parse = [](const std::string &text, int &value) {
+            const auto res =
+                std::from_chars(text.data(), text.data() + text.size(), value);
+            return res.ec == std::errc() && res.ptr == text.data() + text.size() &&
+                   value > 0;
+        };
+        if (dash == std::string::npos || !parse(item.substr(0, dash), first) ||
+            !parse(item.substr(dash + 1), second))
+            throw std::invalid_argument("Invalid channel pair '" + item +
+                                        "' (expected e.g. 1-5,2-6)");
+        pairs.emplace_back(first, second);
+        pos = comma + 1;
+    }
+    return pairs;
+}
+
+/// One counted pair of the pair-based CLIs: its channels, its label ("HH" is
+/// 1-5) and the label of the same pair whose delay it is counted at.
+struct PairInfo {
+    int ch1;
+    int ch2;
+    std::string label;
+    std::string delay_source; // which same-pair delay to reuse
+};
+
+/// Pairs that get their own delay search (`same`) and pairs counted at the
+/// delay of a same pair (`cross`).
+struct PairTable {
+    std::vector<PairInfo> same;
+    std::vector<PairInfo> cross;
+};
+
+/// The polarization table (HH, VV, DD, AA, with HV, VH, DA, AD at the delay
+/// of the same pair on their first channel). A non-empty `requested` list
+/// replaces it: each pair, labelled "ch1-ch2", searches its own delay and
+/// there are no cross pairs.
+inline PairTable pairTable(const std::vector<std::pair<int, int>> &requested) {
+    PairTable table;
+    if (requested.empty()) {
+        table.same = {{1, 5, "HH", "HH"}, {2, 6, "VV", "VV"},
+                      {3, 7, "DD", "DD"}, {4, 8, "AA", "AA"}};
+        table.cross = {{1, 6, "HV", "HH"}, {2, 5, "VH", "VV"},
+                       {3, 8, "DA", "DD"}, {4, 7, "AD", "AA"}};
+        return table;
+    }
+    for (const auto &[ch1, ch2] : requested) {
+        const std::string label = std::to_string(ch1) + "-" + std::to_string(ch2);
+        table.same.push_back({ch1, ch2, label, label});
+    }
+    return table;
+}
+
+/// One `computeCoincidenceMatrix` sweep over a pair list: the channels
+/// involved in first-use order, one matrix entry per pair with a delay, and
+/// the index into the pair list each entry came from.
+struct PairMatrix {
+    std::vector<int> channels;
+    std::vector<CoincidencePair> pairs;
+    std::vector<size_t> slots;
+};
+
+/// Maps `pairs` onto a matrix sweep. `delayOf(label)` returns the delay (ps)
+/// of a `delay_source`, or nullopt to leave its pairs out.
+template <typename DelayOf>
+PairMatrix pairMatrix(const std::vector<PairInfo> &pairs, DelayOf &&delayOf) {
+    PairMatrix matrix;
+    const auto indexOf = [&](int ch) {
+        const auto it = std::find(matrix.channels.begin(), matrix.channels.end(), ch);
+        if (it != matrix.channels.end())
+            return static_cast<size_t>(it - matrix.channels.begin());
+        matrix.channels.push_back(ch);
+        return matrix.channels.size() - 1;
+    };
+    for (size_t p = 0; p < pairs.size(); ++p) {
+        const std::optional<long long> delayPs = delayOf(pairs[p].delay_source);
+        if (!delayPs)
+            continue;
+        const size_t first = indexOf(pairs[p].ch1);
+        const size_t second = indexOf(pairs[p].ch2);
+        matrix.pairs.push_back({first, second, *delayPs});
+        matrix.slots.push_back(p);
+    }
+    return matrix;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "Coincidences.h"
+#include "Instrumentation.h"
+
+/// @file
+/// Scratch memory of the coincidence kernels. Every kernel call used to
+/// allocate its temporaries (difference arrays, merge cursors, histograms);
+/// they now live in a per-thread workspace whose buffers only ever grow, so
+/// once a worker has seen its largest pair-second the kernels stop touching
+/// the heap. Outputs the caller owns (result vectors, returned counts) are
+/// not part of it.
+
+/// Buffers reused across kernel calls on one thread. Each member belongs to
+/// exactly one kernel, so nested calls (e.g. `findBestDelayCoarseToFine`
+/// running full scans) never share a buffer.
+struct CoincWorkspace {
+    /// Difference array of the direct `computeCoincidencesForRange` scan.
+    std::vector<long long> scanDiff;
+    /// Histogram of `findBestDelayPicoseconds` when no scratch is passed.
+    std::vector<std::pair<float, int>> bestDelayResults;
+    /// Coarse histogram and its counts in `findBestDelayCoarseToFine`.
+    std::vector<std::pair<float, int>> coarseResults;
+    std::vector<int> coarseCounts;
+    /// Per-delay cursors of `countCoincidencesAtDelays`.
+    std::vector<size_t> delayCursors;
+    /// Merge cursors and tile ends of `computeCoincidenceMatrix`.
+    std::vector<size_t> matrixCursor1;
+    std::vector<size_t> matrixCursor2;
+    std::vector<size_t> matrixChannelEnd;
+    std::vector<size_t> matrixShiftedEnd;
+    std::vector<SegmentedSpan> matrixChannels;
+    /// Window occupancy and the two merge cursors of `countNFoldCoincidences`.
+    std::vector<int> nfoldFreq;
+    std::vector<size_t> nfoldLeft;
+    std::vector<size_t> nfoldRight;
+
+    /// Returns all memory to the allocator, e.g. after one unusually large
+    /// scan on a long-lived thread.
+    void release() { *this = CoincWorkspace{}; }
+};
+
+/// Sets `buffer` to `size` copies of `value`, counting the calls that had
+/// to grow it as `StatCounter::ScratchAllocations`.
+template <typename T, typename V>
+void assignScratch(std::vector<T> &buffer, size_t size, const V &value) {
+    if (buffer.capacity() < size)
+        COINCFINDER_COUNT(ScratchAllocations, 1);
+    buffer.assign(size, value);
+}
+
+/// Workspace of the calling thread, used by every kernel in Coincidences.h.
+/// OpenMP workers and Python threads each get their own.
+CoincWorkspace &threadWorkspace();
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+#include <span>
+
+/// @file
+/// Runtime-dispatched kernels behind `countCoincidencesWithDelay`. All of them
+/// run the same greedy two-pointer merge as the scalar reference, but replace
+/// the one-step-at-a-time advance over singles-only runs with a vectorised
+/// (AVX2 / AVX-512 / NEON) probe followed by galloping search. The kernel is
+/// chosen once from the CPU features; tests and benchmarks may override it.
+
+enum class CoincidenceKernel {
+    Scalar,    ///< Original branchy two-pointer merge.
+    Galloping, ///< Portable probe + galloping skip, no intrinsics.
+    Avx2,      ///< 4 x int64 probe (x86-64 with AVX2).
+    Avx512,    ///< 8 x int64 probe (x86-64 with AVX-512F).
+    Neon,      ///< 2 x int64 probe (AArch64).
+};
+
+/// Kernel used by `countCoincidencesWithDelay` for plain spans.
+CoincidenceKernel activeCoincidenceKernel();
+
+/// True when `kernel` was compiled in and the running CPU supports it.
+bool coincidenceKernelSupported(CoincidenceKernel kernel);
+
+/// Forces `kernel`; throws std::invalid_argument when it is not supported.
+void setCoincidenceKernel(CoincidenceKernel kernel);
+
+/// Short lowercase name ("scalar", "avx2", ...) for logs and reports.
+const char *coincidenceKernelName(CoincidenceKernel kernel);
+
+/// Reference implementation, kept for validation and as the portable fallback.
+int countCoincidencesWithDelayScalar(std::span<const long long> ch1,
+                                     std::span<const long long> ch2,
+                                     long long coincWindowPs,
+                                     long long delayPs);
+
+/// Low-level entry: continues the greedy merge from cursors (`i`, `j`) with
+/// the active kernel until either input is exhausted and returns the number
+/// of coincidences found on the way. Cursors are left where the merge
+/// stopped so a caller can resume over a following segment.
+int countCoincidencesKernel(const long long *ch1, size_t size1,
+                            const long long *ch2, size_t size2,
+                            long long coincWindowPs, long long delayPs,
+                            size_t &i, size_t &j);
@@ -10,12 +10,83 @@
 /// Python bindings. All timestamp/delay values are expressed in picoseconds and
 /// passed around as lightweight spans to avoid redundant copies.
 
+/// Read-only view of one sorted sequence stored in two pieces, typically a
+/// bucket (`head`) plus a short lookahead from the following bucket (`tail`).
+/// Every kernel below accepts it in place of a span, so coincidences that
+/// straddle a bucket boundary are kept without concatenating the buckets.
+struct SegmentedSpan {
+    std::span<const long long> head;
+    std::span<const long long> tail;
+
+    SegmentedSpan() = default;
+    SegmentedSpan(std::span<const long long> headSpan,
+                  std::span<const long long> tailSpan = {})
+        : head(headSpan), tail(tailSpan) {}
+
+    size_t size() const { return head.size() + tail.size(); }
+    bool empty() const { return head.empty() && tail.empty(); }
+    long long operator[](size_t idx) const {
+        return idx < head.size() ? head[idx] : tail[idx - head.size()];
+    }
+};
+
+/// Boundary-aware view of `currentSecond` followed by the first event of
+/// `nextSecond` (the same sequence `appendNextFirstEvent` builds, no copy).
+inline SegmentedSpan withNextFirstEvent(std::span<const long long> currentSecond,
+                                        std::span<const long long> nextSecond) {
+    return SegmentedSpan(currentSecond,
+                         nextSecond.empty() ? nextSecond : nextSecond.first(1));
+}
+
 /// Counts coincidences (picoseconds) for a given delay between two channels.
 int countCoincidencesWithDelay(std::span<const long long> ch1,
                                std::span<const long long> ch2,
                                long long coincWindowPs,
                                long long delayPs);
 
+/// Segmented overload; mixing a plain span with a `SegmentedSpan` lands here.
+int countCoincidencesWithDelay(SegmentedSpan ch1, SegmentedSpan ch2,
+                               long long coincWindowPs, long long delayPs);
+
+/// Counts coincidences for each entry of `delaysPs` in a single pass over
+/// `ch1`. Element k of the result equals
+/// `countCoincidencesWithDelay(ch1, ch2, coincWindowPs, delaysPs[k])`; the
+/// delays may be arbitrary, unsorted and non-uniform. Cheaper than K separate
+/// merges for small K and than a dense `computeCoincidencesForRange` sweep
+/// when the delays are sparse.
+std::vector<int> countCoincidencesAtDelays(std::span<const long long> ch1,
+                                           std::span<const long long> ch2,
+                                           long long coincWindowPs,
+                                           std::span<const long long> delaysPs);
+
+std::vector<int> countCoincidencesAtDelays(SegmentedSpan ch1, SegmentedSpan ch2,
+                                           long long coincWindowPs,
+                                           std::span<const long long> delaysPs);
+
+/// One requested entry of `computeCoincidenceMatrix`: indices into its channel
+/// list and the delay applied to `first` (same convention as
+/// `countCoincidencesWithDelay`, i.e. `first - delay ~ second`).
+struct CoincidencePair {
+    size_t first = 0;
+    size_t second = 0;
+    long long delayPs = 0;
+};
+
+/// Counts coincidences for every entry of `pairs` in one sweep over time:
+/// the channels are cut into cache-sized time tiles and every pair's merge
+/// is advanced through a tile before the next one is touched, so each
+/// channel is streamed from memory once rather than once per pair it appears
+/// in. Element k equals `countCoincidencesWithDelay(channels[pairs[k].first],
+/// channels[pairs[k].second], coincWindowPs, pairs[k].delayPs)`.
+std::vector<int> computeCoincidenceMatrix(std::span<const SegmentedSpan> channels,
+                                          std::span<const CoincidencePair> pairs,
+                                          long long coincWindowPs);
+
+std::vector<int>
+computeCoincidenceMatrix(std::span<const std::span<const long long>> channels,
+                         std::span<const CoincidencePair> pairs,
+                         long long coincWindowPs);
+
 /// Collects timestamp pairs that fall within the coincidence window for a
 /// given delay. Returns pairs of (t1_ps, t2_ps) in the original clock domain.
 std::vector<std::pair<long long, long long>>
@@ -24,6 +95,21 @@ collectCoincidencesWithDelay(std::span<const long long> ch1,
                              long long coincWindowPs,
                              long long delayPs);
 
+std::vector<std::pair<long long, long long>>
+collectCoincidencesWithDelay(SegmentedSpan ch1, SegmentedSpan ch2,
+                             long long coincWindowPs, long long delayPs);
+
+/// Fills `hits` (cleared first) instead of returning a new vector, so a
+/// caller looping over seconds keeps reusing one buffer.
+void collectCoincidencesWithDelay(std::span<const long long> ch1,
+                                  std::span<const long long> ch2,
+                                  long long coincWindowPs, long long delayPs,
+                                  std::vector<std::pair<long long, long long>> &hits);
+
+void collectCoincidencesWithDelay(SegmentedSpan ch1, SegmentedSpan ch2,
+                                  long long coincWindowPs, long long delayPs,
+                                  std::vector<std::pair<long long, long long>> &hits);
+
 /// Scans a delay range and fills `results` with (delay_ns, coincidence_count)
 /// using a histogram/difference-array approach (single pass over the data).
 void computeCoincidencesForRange(std::span<const long long> channel1,
@@ -33,6 +119,12 @@ void computeCoincidencesForRange(std::span<const long long> channel1,
                                  long long delayStepPs,
                                  std::vector<std::pair<float, int>> &results);
 
+void computeCoincidencesForRange(SegmentedSpan channel1, SegmentedSpan channel2,
+                                 long long coincWindowPs,
+                                 long long delayStartPs, long long delayEndPs,
+                                 long long delayStepPs,
+                                 std::vector<std::pair<float, int>> &results);
+
 inline void computeCoincidencesForRangeHistogram(
     std::span<const long long> channel1, std::span<const long long> channel2,
     long long coincWindowPs, long long delayStartPs, long long delayEndPs,
@@ -43,7 +135,10 @@ inline void computeCoincidencesForRangeHistogram(
 }
 
 /// Counts N-fold coincidences in a zero-delay window. When `channels.size()==2`
-/// this simply calls `countCoincidencesWithDelay` with zero delay.
+/// this simply calls `countCoincidencesWithDelay` with zero delay. Otherwise a
+/// sliding window runs over a k-way merge of the (already sorted) inputs:
+/// O(total events x channels) time and O(channels) extra memory, so whole
+/// runs can be passed as spans. Equal timestamps order by channel index.
 int countNFoldCoincidences(const std::vector<std::span<const long long>> &channels,
                            long long coincWindowPs,
                            std::span<const long long> offsetsPs = {});
@@ -61,14 +156,74 @@ long long findBestDelayPicoseconds(
     long long delayStepPs,
     std::vector<std::pair<float, int>> *scratchResults = nullptr);
 
+long long findBestDelayPicoseconds(
+    SegmentedSpan reference,
+    SegmentedSpan target,
+    long long coincWindowPs,
+    long long delayStartPs,
+    long long delayEndPs,
+    long long delayStepPs,
+    std::vector<std::pair<float, int>> *scratchResults = nullptr);
+
+/// Tuning for `findBestDelayCoarseToFine`; the defaults suit wide searches
+/// (hundreds of ns) over one-second buckets.
+struct CoarseToFineOptions {
+    /// Coarse bin width; 0 picks `(delayEnd - delayStart) / 256`. Each pair
+    /// is counted in the coarse bin whose centre lies within half a step.
+    long long coarseStepPs = 0;
+    /// Leading fraction of `reference` scanned by the coarse pass.
+    double sampleFraction = 0.125;
+    /// Coarse peak must exceed the median bin by this many Poisson sigmas.
+    double minSignificance = 5.0;
+    /// ...and no bin away from the peak may reach this fraction of its excess.
+    double maxRunnerUpRatio = 0.5;
+};
+
+/// What `findBestDelayCoarseToFine` ended up doing, for logging and tests.
+struct CoarseToFineReport {
+    bool usedFullScan = true;
+    long long coarseStepPs = 0;
+    /// Coarse peak excess over the median bin, in sqrt(median) units.
+    double significance = 0.0;
+};
+
+/// Same answer as `findBestDelayPicoseconds` for a well-defined peak, found
+/// hierarchically: a coarse histogram over a subsample of `reference` locates
+/// the peak, then the full data is scanned at `delayStepPs` only in a few
+/// coarse bins around it (on the same grid as the full scan). An ambiguous
+/// coarse peak (see `CoarseToFineOptions`), or a range too narrow to gain
+/// anything, falls back to the full scan. `scratchResults` receives the
+/// histogram of whichever fine scan ran.
+long long findBestDelayCoarseToFine(
+    std::span<const long long> reference,
+    std::span<const long long> target,
+    long long coincWindowPs,
+    long long delayStartPs,
+    long long delayEndPs,
+    long long delayStepPs,
+    const CoarseToFineOptions &options = {},
+    CoarseToFineReport *report = nullptr,
+    std::vector<std::pair<float, int>> *scratchResults = nullptr);
+
+long long findBestDelayCoarseToFine(
+    SegmentedSpan reference,
+    SegmentedSpan target,
+    long long coincWindowPs,
+    long long delayStartPs,
+    long long delayEndPs,
+    long long delayStepPs,
+    const CoarseToFineOptions &options = {},
+    CoarseToFineReport *report = nullptr,
+    std::vector<std::pair<float, int>> *scratchResults = nullptr);
+
 /// Writes coincidence scan results to `filename` as CSV.
 void writeResultsToFile(const std::vector<std::pair<float, int>> &results,
                         const std::string &filename);
 
 /// Returns a span over `currentSecond`, appending the first event from
-/// `nextSecond` into `scratch` only when necessary. This mirrors the CLI logic
-/// that preserves coincidences crossing a one-second boundary without copying
-/// the entire bucket.
+/// `nextSecond` into `scratch` only when necessary. This copies the whole
+/// bucket whenever `nextSecond` is non-empty; prefer `withNextFirstEvent`,
+/// which expresses the same sequence as a `SegmentedSpan` without copying.
 std::span<const long long>
 appendNextFirstEvent(const std::vector<long long> &currentSecond,
                      const std::vector<long long> &nextSecond,
@@ -0,0 +1,110 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "Singles.h"
+
+/// @file
+/// 32-bit encoding of `FlatSingles` for keeping long captures resident.
+/// Time is cut into blocks of 2^32 ps (about 4.3 ms) on a fixed grid; each
+/// non-empty block stores its 64-bit base once and every event in it is a
+/// `uint32_t` offset from that base. At tagger rates a block holds hundreds
+/// of events, so a channel costs just over 4 bytes per event instead of 8.
+/// Buckets index events exactly like `FlatSingles::bucketOffsets`, whatever
+/// the bucket width; with buckets of 4 ms or less a bucket never spans more
+/// than two blocks.
+
+/// log2 of the block length in picoseconds.
+constexpr int kCompactBlockBits = 32;
+
+/// One channel in the compact layout. Event `k` is
+/// `blockBases[b] + offsets[k]` for the block `b` with
+/// `blockEnds[b - 1] <= k < blockEnds[b]`.
+struct CompactSingles {
+    /// Detector channel identifier (1-based).
+    int channel = 0;
+    /// Absolute second index associated with bucket 0.
+    long long baseSecond = 0;
+    /// Every event as an offset from its block base, ascending.
+    std::vector<uint32_t> offsets;
+    /// Base timestamp (a multiple of 2^32 ps) of each non-empty block.
+    std::vector<Timestamp> blockBases;
+    /// Index one past each block's last event in `offsets`.
+    std::vector<size_t> blockEnds;
+    /// Bucket start offsets into `offsets`; size is bucket count + 1, or 0
+    /// when the channel is empty.
+    std::vector<size_t> bucketOffsets;
+    /// Duration of one bucket, as in `Singles`.
+    long long bucketWidthPs = kDefaultBucketWidthPs;
+
+    size_t bucketCount() const {
+        return bucketOffsets.empty() ? 0 : bucketOffsets.size() - 1;
+    }
+    size_t size() const { return offsets.size(); }
+    /// Heap bytes held by the four arrays (capacity, not size).
+    size_t memoryBytes() const;
+};
+
+/// Read-only view of the events `[begin, end)` of one `CompactSingles`.
+struct CompactSpan {
+    const CompactSingles *singles = nullptr;
+    size_t begin = 0;
+    size_t end = 0;
+
+    size_t size() const { return end - begin; }
+    bool empty() const { return begin == end; }
+};
+
+/// Packs a flat channel into the compact layout (one pass, one copy).
+CompactSingles compactSingles(const FlatSingles &flat);
+
+/// Appends the buckets of `chunk` after those of `compact`, padding any gap
+/// with empty buckets. Every bucket of `chunk` must come after the last one
+/// of `compact`; throws std::invalid_argument otherwise. Lets a capture be
+/// packed slice by slice without holding its 64-bit form.
+void appendCompactSingles(CompactSingles &compact, const FlatSingles &chunk);
+
+/// Expands the compact layout back into `FlatSingles` (one copy).
+FlatSingles expandCompactSingles(const CompactSingles &compact);
+
+/// Buckets `firstSecond..lastSecond` (inclusive, clamped). No copy.
+CompactSpan eventsForSeconds(const CompactSingles &singles, long long firstSecond,
+                             long long lastSecond);
+
+/// The bucket for `second`, or an empty view when out of range.
+CompactSpan eventsForSecond(const CompactSingles &singles, long long second);
+
+/// Compact counterpart of `eventsWithNextFirst`: the bucket for `second`
+/// extended by the first event of bucket `second + 1`.
+CompactSpan eventsWithNextFirst(const CompactSingles &singles, long long second);
+
+/// Timestamp of event `index` of `singles` (binary search over the blocks).
+Timestamp compactTimestampAt(const CompactSingles &singles, size_t index);
+
+/// Decodes `events` into `scratch` and returns a span over it, so any
+/// `Coincidences.h` kernel can run on one bucket at a time while the rest
+/// of the capture stays compact. Reuses the capacity of `scratch`.
+std::span<const Timestamp> decodeCompact(CompactSpan events,
+                                         std::vector<Timestamp> &scratch);
+
+/// `countCoincidencesWithDelay` on compact views. Both channels are decoded
+/// in L1-sized chunks that feed the same runtime-selected SIMD kernel as the
+/// span overload, so the result is identical while main memory is read at
+/// half the width.
+int countCoincidencesWithDelay(CompactSpan ch1, CompactSpan ch2,
+                               long long coincWindowPs, long long delayPs);
+
+/// Reads a whole capture into the compact layout `chunkSeconds` buckets at
+/// a time through the range-selective `readFileAutoFlat`, so the peak
+/// footprint is the compact result plus one 64-bit chunk. Same arguments
+/// and `duration_sec` as `readFileAuto`; throws std::invalid_argument for
+/// a non-positive `chunkSeconds` or `kAutoExposure` (the chunks must share
+/// one width).
+std::map<int, CompactSingles> readFileAutoCompact(const std::string &filename,
+                                                  double &duration_sec,
+                                                  double exposure_seconds = -1.0,
+                                                  long long chunkSeconds = 60);
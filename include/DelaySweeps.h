@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "Singles.h"
+
+/// @file
+/// Batched delay scans: every (pair, second) histogram of a second range in
+/// one call, computed on OpenMP threads into a caller-provided
+/// `pair x second x delay_bin` int32 block (the `SweepTensorFile` layout).
+/// Each second is scanned like the CoincFinder CLI does it: second `sec` of
+/// the first channel against second `sec` of the second channel plus the
+/// first event of `sec + 1`. Seconds are capture seconds whatever the
+/// channels' bucket width (`eventsForCaptureSecond`).
+
+/// The two channels of one batched pair. A null side (a channel without
+/// data) leaves the pair's counts at zero.
+struct SweepChannels {
+    const Singles *first = nullptr;
+    const Singles *second = nullptr;
+};
+
+/// Delay bins of a scan over `[delayStartPs, delayEndPs]`, matching the
+/// result size of `computeCoincidencesForRange`. Throws
+/// std::invalid_argument for a non-positive step or an inverted range.
+size_t delaySweepBins(long long delayStartPs, long long delayEndPs,
+                      long long delayStepPs);
+
+/// Fills `out`, laid out `[pair][second - startSec][bin]`, with the delay
+/// histograms of seconds `startSec..stopSec`. `out` must hold exactly
+/// `pairs.size() * (stopSec - startSec + 1) * delaySweepBins(...)` values;
+/// throws std::invalid_argument otherwise.
+void computeDelaySweeps(std::span<const SweepChannels> pairs, long long startSec,
+                        long long stopSec, long long coincWindowPs,
+                        long long delayStartPs, long long delayEndPs,
+                        long long delayStepPs, std::span<int32_t> out);
+
+/// Convenience overload resolving detector channel numbers in `singles`;
+/// channels missing from the map count as empty.
+std::vector<int32_t> computeDelaySweeps(const std::map<int, Singles> &singles,
+                                        std::span<const std::pair<int, int>> pairs,
+                                        long long startSec, long long stopSec,
+                                        long long coincWindowPs,
+                                        long long delayStartPs,
+                                        long long delayEndPs,
+                                        long long delayStepPs);
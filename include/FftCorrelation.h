@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "Coincidences.h"
+
+/// @file
+/// FFT cross-correlation engine behind `computeCoincidencesForRange`. Both
+/// channels are binned at the delay step and correlated block by block, so
+/// the cost follows the number of occupied time bins instead of the number of
+/// (t1, t2) pairs inside the delay range. The result approximates the direct
+/// scan: each pair is placed at its bin-index difference, i.e. its delay is
+/// known to within one step, so counts can move by one bin at the window
+/// edges. `Auto` only picks it when the cost model says it wins and the
+/// window is at least one step wide.
+
+enum class DelayScanEngine {
+    Auto,   ///< Direct difference-array scan unless the FFT is estimated cheaper.
+    Direct, ///< Always the exact difference-array scan.
+    Fft,    ///< Always the binned FFT correlation.
+};
+
+/// Engine used by `computeCoincidencesForRange` (and everything built on it).
+DelayScanEngine delayScanEngine();
+
+/// Process-wide override, e.g. for benchmarks or to pin exact counts.
+void setDelayScanEngine(DelayScanEngine engine);
+
+/// Short lowercase name ("auto", "direct", "fft") for logs and reports.
+const char *delayScanEngineName(DelayScanEngine engine);
+
+/// Cost model used by `Auto`: true when the FFT path is expected to be
+/// cheaper for `size1`/`size2` events spread over `spanPs` picoseconds.
+bool fftScanPreferred(size_t size1, size_t size2, long long spanPs,
+                      long long coincWindowPs, long long delayStartPs,
+                      long long delayEndPs, long long delayStepPs);
+
+/// Fills `results` in the same layout as `computeCoincidencesForRange`, with
+/// the FFT engine regardless of the global setting.
+void computeCoincidencesForRangeFft(SegmentedSpan channel1,
+                                    SegmentedSpan channel2,
+                                    long long coincWindowPs,
+                                    long long delayStartPs, long long delayEndPs,
+                                    long long delayStepPs,
+                                    std::vector<std::pair<float, int>> &results);
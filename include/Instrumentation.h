@@ -0,0 +1,114 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// @file
+/// Process-wide counters and per-stage timers for finding where a run
+/// spends its time. The CLIs print them with `--stats`; Python reads them
+/// through `get_stats()`.
+///
+/// Kernels and readers accumulate locally and publish once per call, so a
+/// counter costs one relaxed atomic add per pair-second or per file, and a
+/// timed scope costs two clock reads. Build with
+/// `-DCOINCFINDER_ENABLE_STATS=OFF` (which defines `COINCFINDER_STATS=0`)
+/// to compile the macros below away entirely.
+
+#ifndef COINCFINDER_STATS
+#define COINCFINDER_STATS 1
+#endif
+
+/// Counted quantities; `statCounterName` gives their report keys.
+enum class StatCounter {
+    EventsIngested,     ///< Records stored by the readers.
+    OutOfOrderInserts,  ///< Stored records older than their predecessor.
+    CandidatePairs,     ///< Pairs visited by the direct delay-scan kernel.
+    BytesWritten,       ///< Bytes handed to output files.
+    ScratchAllocations, ///< Kernel workspace buffers that had to grow.
+    Count
+};
+
+/// Accumulated time of one named stage.
+struct StageStats {
+    std::string name;
+    std::atomic<uint64_t> calls{0};
+    std::atomic<uint64_t> nanoseconds{0};
+};
+
+/// Snapshot of every counter and stage, in registration order.
+struct StatsSnapshot {
+    struct Stage {
+        std::string name;
+        uint64_t calls = 0;
+        double seconds = 0.0;
+    };
+    bool enabled = COINCFINDER_STATS != 0;
+    std::vector<std::pair<std::string, uint64_t>> counters;
+    std::vector<Stage> stages;
+};
+
+/// Report key of `counter` ("events_ingested", ...).
+const char *statCounterName(StatCounter counter);
+
+/// Adds `amount` to `counter` (relaxed; totals are read after the work).
+void addStat(StatCounter counter, uint64_t amount);
+
+/// Stage registered under `name`, created on first use. The reference
+/// stays valid for the life of the process.
+StageStats &statStage(const char *name);
+
+/// Current values of all counters and stages.
+StatsSnapshot statsSnapshot();
+
+/// The snapshot as a single JSON object.
+std::string statsJson();
+
+/// Writes `statsJson()` plus a newline to `path`, or to stderr when `path`
+/// is "-". Throws std::runtime_error when the file cannot be written.
+void writeStatsJson(const std::string &path);
+
+/// Zeroes all counters and stage totals (stages stay registered).
+void resetStats();
+
+/// Adds the lifetime of the scope to a stage.
+class StageTimer {
+public:
+    explicit StageTimer(StageStats &stage)
+        : stage_(stage), start_(std::chrono::steady_clock::now()) {}
+    ~StageTimer() {
+        const auto elapsed = std::chrono::steady_clock::now() - start_;
+        stage_.calls.fetch_add(1, std::memory_order_relaxed);
+        stage_.nanoseconds.fetch_add(
+            static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+                    .count()),
+            std::memory_order_relaxed);
+    }
+    StageTimer(const StageTimer &) = delete;
+    StageTimer &operator=(const StageTimer &) = delete;
+
+private:
+    StageStats &stage_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+#define COINCFINDER_STATS_CONCAT_(a, b) a##b
+#define COINCFINDER_STATS_CONCAT(a, b) COINCFINDER_STATS_CONCAT_(a, b)
+
+#if COINCFINDER_STATS
+/// Times the rest of the enclosing scope as stage `name` (a string literal).
+#define COINCFINDER_TIME_SCOPE(name)                                           \
+    static StageStats &COINCFINDER_STATS_CONCAT(cfStage_, __LINE__) =          \
+        statStage(name);                                                       \
+    const StageTimer COINCFINDER_STATS_CONCAT(cfTimer_, __LINE__)(             \
+        COINCFINDER_STATS_CONCAT(cfStage_, __LINE__))
+/// Adds `amount` to `StatCounter::counter`.
+#define COINCFINDER_COUNT(counter, amount)                                     \
+    addStat(StatCounter::counter, static_cast<uint64_t>(amount))
+#else
+#define COINCFINDER_TIME_SCOPE(name) static_cast<void>(0)
+#define COINCFINDER_COUNT(counter, amount) static_cast<void>(amount)
+#endif
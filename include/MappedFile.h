@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+/// @file
+/// Read-only memory mapping of a whole file (POSIX `mmap` / Windows
+/// `MapViewOfFile`). Readers use it to walk packed records straight from the
+/// page cache instead of pulling them through stream calls.
+
+class MappedFile {
+public:
+    MappedFile() = default;
+    /// Maps `filename`; check `isOpen()` afterwards. Pipes, character devices
+    /// and other non-regular files are never mapped.
+    explicit MappedFile(const std::string &filename);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+
+    /// True when the mapping succeeded (an empty regular file also counts).
+    bool isOpen() const { return open_; }
+    const unsigned char *data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    void release();
+
+    const unsigned char *data_ = nullptr;
+    size_t size_ = 0;
+    bool open_ = false;
+#ifdef _WIN32
+    void *fileHandle_ = nullptr;
+    void *mappingHandle_ = nullptr;
+#endif
+};
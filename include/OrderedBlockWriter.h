@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <exception>
+#include <fstream>
+#include <map>
+#include <string>
+#include <thread>
+
+#include "BoundedQueue.h"
+
+/// @file
+/// Background file writer that accepts pre-formatted byte blocks tagged with a
+/// sequence number and appends them strictly in sequence order. Parallel
+/// workers can finish blocks in any order; the writer thread parks early ones
+/// until the gap is filled, so the file reads as if written serially.
+
+class OrderedBlockWriter {
+public:
+    /// Opens (truncating) `filename`, writes `preamble` and starts the writer
+    /// thread. Throws std::runtime_error when the file cannot be opened.
+    explicit OrderedBlockWriter(const std::string &filename,
+                                const std::string &preamble = {},
+                                size_t queueCapacity = 256);
+    ~OrderedBlockWriter();
+
+    OrderedBlockWriter(const OrderedBlockWriter &) = delete;
+    OrderedBlockWriter &operator=(const OrderedBlockWriter &) = delete;
+
+    /// Queues block `sequence` (0, 1, 2, ... each exactly once; an empty block
+    /// still has to be submitted so later ones can be released).
+    void submit(size_t sequence, std::string bytes);
+
+    /// Drains the queue, joins the writer and closes the file. Throws
+    /// std::runtime_error when a write failed or a sequence number is missing.
+    void finish();
+
+private:
+    struct Block {
+        size_t sequence = 0;
+        std::string bytes;
+    };
+
+    void run();
+
+    std::string filename_;
+    std::ofstream out_;
+    BoundedQueue<Block> queue_;
+    std::map<size_t, std::string> pending_;
+    size_t next_ = 0;
+    bool failed_ = false;
+    std::thread worker_;
+    bool finished_ = false;
+};
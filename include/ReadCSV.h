@@ -7,6 +7,7 @@
 #include <algorithm>
 #include <stdexcept>
 #include <climits>
+#include <limits>
 
 #include "Singles.h"
 
@@ -15,16 +16,82 @@
 /// per-second buckets of timestamps. The accompanying implementation avoids
 /// heap churn so coincidence scans can consume the data directly.
 
-/// Configure bucket duration (seconds per time bucket). Defaults to 1s.
+/// Process default bucket duration (seconds per time bucket), used by
+/// readers called without an exposure. Defaults to 1s. Readers never change
+/// it: a positive `exposure_seconds` applies to that read only, so
+/// concurrent reads with different exposures do not interfere.
 void setBucketDurationSeconds(double seconds);
 double bucketDurationSeconds();
 
+/// `exposure_seconds` value asking the reader to choose the bucket width
+/// from the capture's event rate (`chooseBucketWidthPs` over the busiest
+/// channel). Range arguments are then capture seconds, and second `s`
+/// covers buckets `s * n .. s * n + n - 1` where `n` is
+/// `kDefaultBucketWidthPs / bucketWidthPs` of the result. Negative infinity
+/// so no existing caller selects it by accident: every other non-positive
+/// exposure, 0 included, still means the process default.
+inline constexpr double kAutoExposure = -std::numeric_limits<double>::infinity();
+
+/// Events per bucket the automatic width aims to stay under, so a bucket of
+/// the busiest channel fits in L2.
+inline constexpr size_t kAutoBucketEvents = 32768;
+/// Finest automatic subdivision of a second (buckets of ~244 us).
+inline constexpr long long kMaxAutoBucketsPerSecond = 4096;
+
+/// One second divided by the smallest power of two `n` (at most
+/// `kMaxAutoBucketsPerSecond`) for which `busiestEvents` spread over
+/// `spanPs` (at least one second) average at most `kAutoBucketEvents` per
+/// bucket. Low rates keep one-second buckets.
+long long chooseBucketWidthPs(size_t busiestEvents, long long spanPs);
+
+/// Bucket width in ps that a read with `exposure_seconds` uses: the exposure
+/// when positive, 0 (chosen per capture) for `kAutoExposure`, otherwise the
+/// process default.
+long long bucketWidthForExposure(double exposure_seconds);
+
 /// Dispatches to the appropriate reader based on filename suffix.
 /// @param filename Path to CSV or BIN file.
 /// @param duration_sec Populated with measurement duration in seconds.
+/// @param exposure_seconds Bucket width in seconds; negative uses the process
+/// default and `kAutoExposure` picks it from the event rate. Every returned
+/// channel records its width in `bucketWidthPs`.
 std::map<int, Singles> readFileAuto(const std::string &filename, double &duration_sec,
                                     double exposure_seconds = -1.0);
 
+/// Same dispatch as `readFileAuto`, returning the contiguous `FlatSingles`
+/// layout (one allocation per channel instead of one per bucket).
+std::map<int, FlatSingles> readFileAutoFlat(const std::string &filename,
+                                            double &duration_sec,
+                                            double exposure_seconds = -1.0);
+
+/// Range-selective `readFileAuto`: only buckets `startSec..stopSec`
+/// (inclusive; `stopSec < 0` reads to the end) are kept. Mapped BIN and CSV
+/// inputs are binary-searched for the start of the range and decoding stops
+/// one bucket past its end, so the cost follows the slice rather than the
+/// file. Assumes timestamps ascend up to jitter shorter than one bucket.
+/// Bucket numbers and `duration_sec` still refer to the whole capture.
+/// Callers that count across the `stopSec` boundary should ask for one more
+/// bucket.
+std::map<int, Singles> readFileAuto(const std::string &filename, double &duration_sec,
+                                    double exposure_seconds, long long startSec,
+                                    long long stopSec);
+
+std::map<int, FlatSingles> readFileAutoFlat(const std::string &filename,
+                                            double &duration_sec,
+                                            double exposure_seconds,
+                                            long long startSec, long long stopSec);
+
+/// The `duration_sec` that `readFileAuto` would report, without keeping any
+/// event: mapped inputs decode only their first and last records. Lets a
+/// caller size range reads before loading anything.
+double captureDurationSeconds(const std::string &filename);
+
+/// Restores ascending order of a mostly sorted sequence whose first
+/// out-of-order element is at `firstDescent`, in near-linear time for
+/// interleaved or jittered arrivals. Shared by the file readers and
+/// `RollingSingles::ingest`.
+void restoreOrder(std::vector<Timestamp> &v, size_t firstDescent);
+
 /// Returns true if `str` ends with the requested suffix.
 bool hasEnding(const std::string& str, const std::string& ending);
 
@@ -33,5 +100,17 @@ bool hasEnding(const std::string& str, const std::string& ending);
 /// @param duration Filled with measurement duration (seconds).
 std::map<int, Singles> readCSVtoSingles(const std::string &filename, double &duration);
 
-/// Parses a Qutools BIN file into per-channel singles.
+/// Parallel CSV reader: maps the file, splits it into newline-aligned byte
+/// ranges and parses each on its own OpenMP thread before merging the
+/// per-range buckets. Produces the same result as `readCSVtoSingles`.
+std::map<int, Singles> readCSVtoSinglesParallel(const std::string &filename,
+                                                double &duration);
+
+/// Parses a Qutools BIN file into per-channel singles. The file is memory
+/// mapped and the packed 10-byte records are decoded in place; inputs that
+/// cannot be mapped (pipes, devices) fall back to `readBINStreamToSingles`.
 std::map<int, Singles> readBINtoSingles(const std::string &filename, double &duration);
+
+/// Stream-based BIN reader (one `read` per field). Works on pipes.
+std::map<int, Singles> readBINStreamToSingles(const std::string &filename,
+                                              double &duration);
@@ -0,0 +1,80 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "RollingSingles.h"
+
+/// @file
+/// Companion to `RollingSingles` for live alignment: keeps one delay
+/// histogram per (pair, second) plus their running sum over the window, so
+/// the window-wide histogram and best delay cost O(bins) after each update
+/// instead of a fresh scan over the whole window.
+
+class RollingDelayHistogram {
+public:
+    /// Histograms use the same binning as `computeCoincidencesForRange`
+    /// (all values in picoseconds). Throws std::invalid_argument for a
+    /// non-positive step or window, or an empty delay range.
+    RollingDelayHistogram(std::vector<std::pair<int, int>> pairs,
+                          long long coincWindowPs, long long delayStartPs,
+                          long long delayEndPs, long long delayStepPs);
+
+    /// Brings the histograms in line with `rolling`: seconds whose buckets
+    /// changed since the last call are rescanned (a cheap size check per
+    /// window second), seconds that left the window are subtracted from the
+    /// totals. Call after `appendChunk` / `ingest`. Returns the number of
+    /// (pair, second) histograms recomputed. Throws std::invalid_argument
+    /// when `rolling` holds buckets other than one second wide.
+    size_t update(const RollingSingles &rolling);
+
+    /// Window-wide counts per delay bin for `pairIndex`.
+    const std::vector<long long> &windowHistogram(size_t pairIndex) const;
+
+    /// Delay (ps) of the highest window count for `pairIndex`; the first bin
+    /// on ties, `delayStartPs` when the window is empty.
+    long long bestDelayPs(size_t pairIndex) const;
+
+    /// Histogram of a single second, or nullptr when it is not tracked.
+    const std::vector<int32_t> *secondHistogram(size_t pairIndex,
+                                                long long second) const;
+
+    size_t binCount() const { return bins_; }
+    long long delayForBin(size_t bin) const {
+        return delayStartPs_ + static_cast<long long>(bin) * delayStepPs_;
+    }
+    const std::vector<std::pair<int, int>> &pairs() const { return pairs_; }
+
+private:
+    /// What a per-second histogram was computed from. Buckets only grow, so
+    /// matching sizes (plus the lookahead event) mean nothing changed.
+    struct Fingerprint {
+        size_t size1 = 0;
+        size_t size2 = 0;
+        bool hasNext = false;
+        Timestamp nextFirst = 0;
+        bool operator==(const Fingerprint &) const = default;
+    };
+
+    struct SecondHistogram {
+        Fingerprint source;
+        std::vector<int32_t> counts;
+    };
+
+    struct PairState {
+        std::map<long long, SecondHistogram> seconds;
+        std::vector<long long> total;
+    };
+
+    void subtract(PairState &state, const SecondHistogram &entry);
+
+    std::vector<std::pair<int, int>> pairs_;
+    std::vector<PairState> states_;
+    long long coincWindowPs_;
+    long long delayStartPs_;
+    long long delayEndPs_;
+    long long delayStepPs_;
+    size_t bins_;
+};
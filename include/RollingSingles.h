@@ -1,25 +1,69 @@
 #pragma once
 
+#include <limits>
 #include <map>
+#include <span>
 #include <vector>
 
 #include "Singles.h"
 
 /// Maintains per-channel Singles buckets for the last N seconds.
+///
+/// Buckets live in a per-channel ring of `windowSeconds` slots indexed by
+/// second, so advancing the window retires slots in O(1) and their capacity
+/// is reused by later seconds instead of being freed and reallocated. The
+/// `Singles`-shaped accessors (`channelSingles`, `allChannels`) build a copy
+/// on demand; hot paths should read buckets through `eventsForSecond`.
 class RollingSingles {
 public:
   explicit RollingSingles(long long windowSeconds = 200);
 
   /// Merge per-channel Singles produced by a chunk (e.g., readBINtoSingles).
+  /// The first non-empty chunk (or `ingest`) fixes the bucket width; a chunk
+  /// of another width throws std::invalid_argument.
   void appendChunk(const std::map<int, Singles> &chunk);
 
+  /// Same as above for chunks read with `readFileAutoFlat`.
+  void appendChunk(const std::map<int, FlatSingles> &chunk);
+
+  /// Feeds raw tagger records (e.g. from `BinTailReader`). The first accepted
+  /// record fixes the time origin for the lifetime of this object, so bucket
+  /// numbering stays stable across calls; records before the origin or older
+  /// than the window are dropped. Records are filtered like the file readers
+  /// (channels 1-8, non-zero timestamps). Returns the number accepted.
+  size_t ingest(std::span<const RawRecord> records);
+
+  /// Width of the buckets held, 0 until the first chunk or record arrives.
+  long long bucketWidthPs() const { return bucketWidthPs_; }
+
+  /// True once `ingest` (or `setOrigin`) has fixed the time origin.
+  bool hasOrigin() const { return hasOrigin_; }
+  /// Absolute timestamp (ps) that maps to second 0 for ingested records.
+  Timestamp origin() const { return origin_; }
+  /// Pins the origin before the first `ingest`, e.g. to line a live feed up
+  /// with a batch read of the same file. Throws std::logic_error once set.
+  void setOrigin(Timestamp origin);
+
+  /// Bucket for (`channel`, `second`) straight from the ring; empty when the
+  /// second is outside the window or has no events. Valid until the next
+  /// mutating call.
+  std::span<const Timestamp> eventsForSecond(int channel, long long second) const;
+
   /// Retrieve the Singles for `channel`. Returns empty instance when missing.
+  /// Materialised lazily from the ring and cached until the next mutation.
   const Singles &channelSingles(int channel) const;
 
-  /// Latest chunk snapshots per channel (for histograms/auto-align).
-  const std::vector<std::vector<Timestamp>> &latestChunk(int channel) const;
+  /// Contiguous copy of the window for `channel` (empty when missing).
+  FlatSingles flatChannel(int channel) const;
 
-  /// Trim buckets older than the rolling window.
+  /// Views of what the latest chunk added to `channel`, one span per second
+  /// starting at the chunk's first second (for histograms/auto-align). When a
+  /// chunk merged into an already populated bucket, that span also covers
+  /// the older events it interleaved with. Valid until the next mutation.
+  std::vector<std::span<const Timestamp>> latestChunk(int channel) const;
+
+  /// Trim buckets older than the rolling window. Appends already retire
+  /// stale slots lazily; this only releases their contents early.
   void prune();
 
   /// Set the rolling window length in seconds.
@@ -28,11 +72,46 @@ public:
   long long windowSeconds() const { return windowSeconds_; }
   long long latestSecond() const { return latestSecond_; }
 
-  const std::map<int, Singles> &allChannels() const { return channels_; }
+  /// All channels in `Singles` form (materialised lazily, see above).
+  const std::map<int, Singles> &allChannels() const;
 
 private:
-  std::map<int, Singles> channels_;
-  std::map<int, std::vector<std::vector<Timestamp>>> latestChunks_;
+  struct Bucket {
+    long long second = 0;
+    bool used = false;
+    std::vector<Timestamp> events;
+  };
+
+  struct ChannelRing {
+    int channel = 0;
+    std::vector<Bucket> slots;
+    /// Latest chunk: first second and, per second, where its events start.
+    long long chunkFirstSecond = 0;
+    std::vector<size_t> chunkOffsets;
+    /// Seconds with data seen so far (bounds for materialisation).
+    long long minSecond = std::numeric_limits<long long>::max();
+    long long maxSecond = std::numeric_limits<long long>::min();
+  };
+
+  ChannelRing &ring(int channel);
+  const Bucket *findBucket(const ChannelRing &ring, long long second) const;
+  std::vector<Timestamp> &bucketFor(ChannelRing &ring, long long second);
+  /// Shared tail of both `appendChunk` overloads; replaces the channel's
+  /// latest-chunk view with these buckets.
+  void appendBuckets(int channel, long long baseSecond,
+                     std::span<const std::span<const Timestamp>> buckets);
+  void advanceLatest(long long second);
+  void adoptBucketWidth(long long bucketWidthPs);
+  bool inWindow(long long second) const;
+  void materialise(const ChannelRing &ring, Singles &out) const;
+  void invalidateViews();
+
+  std::map<int, ChannelRing> rings_;
+  mutable std::map<int, Singles> materialised_;
+  mutable bool allMaterialised_ = false;
   long long windowSeconds_;
   long long latestSecond_;
+  Timestamp origin_ = 0;
+  bool hasOrigin_ = false;
+  long long bucketWidthPs_ = 0;
 };
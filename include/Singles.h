@@ -1,16 +1,30 @@
 #pragma once
+#include <algorithm>
 #include <cstdint>
 #include <cstddef>
+#include <span>
+#include <stdexcept>
 #include <vector>
 
 /// @file
 /// Compact representation of time-tagged detector singles grouped into
-/// contiguous one-second buckets. This structure is the backbone for both the
-/// CLI and Python-facing APIs.
+/// contiguous time buckets (one second unless a reader chose otherwise).
+/// This structure is the backbone for both the CLI and Python-facing APIs.
 
 /// Alias for raw detector timestamps expressed in picoseconds.
 using Timestamp = long long;
 
+/// Bucket width the readers use unless told otherwise: one second.
+inline constexpr long long kDefaultBucketWidthPs = 1'000'000'000'000LL;
+
+/// One time-tagger record as stored in a Qutools BIN file: absolute timestamp
+/// in picoseconds and the tagger's 0-based input (channel + 1 is the 1-based
+/// detector channel used everywhere else).
+struct RawRecord {
+    uint64_t timestamp = 0;
+    uint16_t channel = 0;
+};
+
 /// Represents singles collected on one detector channel, grouped by seconds.
 struct Singles {
     /// Detector channel identifier (1-based).
@@ -19,6 +33,10 @@ struct Singles {
     long long baseSecond = 0;
     /// Per-second buckets of timestamps; bucket i => baseSecond + i.
     std::vector<std::vector<Timestamp>> eventsPerSecond;
+    /// Duration of one bucket. Bucket indices count buckets of this width
+    /// from the capture's first record, so they are seconds only at the
+    /// default width.
+    long long bucketWidthPs = kDefaultBucketWidthPs;
 };
 
 /// Ensures the bucket for `second` exists and returns it for mutation.
@@ -48,14 +66,244 @@ inline std::vector<Timestamp> &ensureSecond(Singles &singles, long long second)
     return singles.eventsPerSecond[idx];
 }
 
-/// Returns the bucket for `second` or an empty view when out of range.
-inline const std::vector<Timestamp> &eventsForSecond(const Singles &singles,
-                                                     long long second) {
+/// Floor of `a / b` for positive `b` (bucket of a possibly negative time).
+inline long long floorDivide(long long a, long long b) {
+    return a / b - ((a % b != 0) && ((a < 0) != (b < 0)) ? 1 : 0);
+}
+
+/// Throws std::invalid_argument unless buckets of `bucketWidthPs` are
+/// seconds, for accessors that take a second as a bucket index.
+inline void requireSecondBuckets(long long bucketWidthPs) {
+    if (bucketWidthPs != kDefaultBucketWidthPs)
+        throw std::invalid_argument(
+            "buckets are not one second wide; index them with eventsForBucket "
+            "or read capture seconds with eventsForCaptureSeconds");
+}
+
+/// Returns bucket `bucket` (of any width) or an empty view when out of range.
+inline const std::vector<Timestamp> &eventsForBucket(const Singles &singles,
+                                                     long long bucket) {
     static const std::vector<Timestamp> kEmpty;
-    if (singles.eventsPerSecond.empty() || second < singles.baseSecond) {
+    if (singles.eventsPerSecond.empty() || bucket < singles.baseSecond) {
         return kEmpty;
     }
-    const size_t idx = static_cast<size_t>(second - singles.baseSecond);
+    const size_t idx = static_cast<size_t>(bucket - singles.baseSecond);
     return idx < singles.eventsPerSecond.size() ? singles.eventsPerSecond[idx]
                                                 : kEmpty;
 }
+
+/// Returns the bucket for `second` or an empty view when out of range.
+/// Throws std::invalid_argument unless the buckets are one second wide.
+inline const std::vector<Timestamp> &eventsForSecond(const Singles &singles,
+                                                     long long second) {
+    requireSecondBuckets(singles.bucketWidthPs);
+    return eventsForBucket(singles, second);
+}
+
+/// Events of capture second `second` whatever the bucket width. At the
+/// default width this is bucket `second` itself; otherwise the covering
+/// buckets, trimmed at the second boundaries, are gathered into `scratch`
+/// and the view points there.
+inline std::span<const Timestamp> eventsForCaptureSecond(const Singles &singles,
+                                                         long long second,
+                                                         std::vector<Timestamp> &scratch) {
+    const long long width =
+        singles.bucketWidthPs > 0 ? singles.bucketWidthPs : kDefaultBucketWidthPs;
+    if (width == kDefaultBucketWidthPs)
+        return eventsForBucket(singles, second);
+    scratch.clear();
+    if (singles.eventsPerSecond.empty())
+        return scratch;
+    const long long startPs = second * kDefaultBucketWidthPs;
+    const long long stopPs = startPs + kDefaultBucketWidthPs;
+    const long long lastBucket =
+        singles.baseSecond + static_cast<long long>(singles.eventsPerSecond.size()) - 1;
+    const long long lo = std::max(floorDivide(startPs, width), singles.baseSecond);
+    const long long hi = std::min(floorDivide(stopPs - 1, width), lastBucket);
+    for (long long b = lo; b <= hi; ++b) {
+        const auto &bucket = eventsForBucket(singles, b);
+        const auto begin = std::lower_bound(bucket.begin(), bucket.end(), startPs);
+        const auto end = std::lower_bound(begin, bucket.end(), stopPs);
+        scratch.insert(scratch.end(), begin, end);
+    }
+    return scratch;
+}
+
+/// The first event of capture second `second` as a one-element view (empty
+/// when the second has none): the lookahead `withNextFirstEvent` needs,
+/// without gathering the whole second.
+inline std::span<const Timestamp> firstEventOfCaptureSecond(const Singles &singles,
+                                                            long long second) {
+    const long long width =
+        singles.bucketWidthPs > 0 ? singles.bucketWidthPs : kDefaultBucketWidthPs;
+    if (width == kDefaultBucketWidthPs) {
+        const auto &bucket = eventsForBucket(singles, second);
+        return bucket.empty() ? std::span<const Timestamp>()
+                              : std::span<const Timestamp>(bucket.data(), 1);
+    }
+    if (singles.eventsPerSecond.empty())
+        return {};
+    const long long startPs = second * kDefaultBucketWidthPs;
+    const long long stopPs = startPs + kDefaultBucketWidthPs;
+    const long long lastBucket =
+        singles.baseSecond + static_cast<long long>(singles.eventsPerSecond.size()) - 1;
+    const long long lo = std::max(floorDivide(startPs, width), singles.baseSecond);
+    const long long hi = std::min(floorDivide(stopPs - 1, width), lastBucket);
+    for (long long b = lo; b <= hi; ++b) {
+        const auto &bucket = eventsForBucket(singles, b);
+        const auto it = std::lower_bound(bucket.begin(), bucket.end(), startPs);
+        if (it == bucket.end())
+            continue;
+        return *it < stopPs ? std::span<const Timestamp>(&*it, 1)
+                            : std::span<const Timestamp>();
+    }
+    return {};
+}
+
+/// Contiguous (CSR) variant of `Singles`: every timestamp of a channel lives in
+/// one sorted array and bucket i spans
+/// `timestamps[bucketOffsets[i], bucketOffsets[i + 1])`. One allocation per
+/// channel instead of one per bucket, and neighbouring seconds are adjacent.
+struct FlatSingles {
+    /// Detector channel identifier (1-based).
+    int channel = 0;
+    /// Absolute second index associated with bucket 0.
+    long long baseSecond = 0;
+    /// All timestamps of the channel, ascending.
+    std::vector<Timestamp> timestamps;
+    /// Bucket start offsets into `timestamps`; size is bucket count + 1, or 0
+    /// when the channel is empty.
+    std::vector<size_t> bucketOffsets;
+    /// Duration of one bucket, as in `Singles`.
+    long long bucketWidthPs = kDefaultBucketWidthPs;
+
+    size_t bucketCount() const {
+        return bucketOffsets.empty() ? 0 : bucketOffsets.size() - 1;
+    }
+};
+
+/// Returns a view over the buckets `firstSecond..lastSecond` (inclusive,
+/// clamped to the available range). No copy: the buckets are adjacent.
+inline std::span<const Timestamp> eventsForSeconds(const FlatSingles &singles,
+                                                   long long firstSecond,
+                                                   long long lastSecond) {
+    const long long buckets = static_cast<long long>(singles.bucketCount());
+    const long long lo = std::max(firstSecond - singles.baseSecond, 0LL);
+    const long long hi = std::min(lastSecond - singles.baseSecond, buckets - 1);
+    if (buckets == 0 || lo > hi)
+        return {};
+    const size_t begin = singles.bucketOffsets[static_cast<size_t>(lo)];
+    const size_t end = singles.bucketOffsets[static_cast<size_t>(hi) + 1];
+    return std::span<const Timestamp>(singles.timestamps.data() + begin,
+                                      end - begin);
+}
+
+/// Returns bucket `bucket` (of any width) or an empty view when out of range.
+inline std::span<const Timestamp> eventsForBucket(const FlatSingles &singles,
+                                                  long long bucket) {
+    return eventsForSeconds(singles, bucket, bucket);
+}
+
+/// Returns the bucket for `second` or an empty view when out of range.
+/// Throws std::invalid_argument unless the buckets are one second wide.
+inline std::span<const Timestamp> eventsForSecond(const FlatSingles &singles,
+                                                  long long second) {
+    requireSecondBuckets(singles.bucketWidthPs);
+    return eventsForBucket(singles, second);
+}
+
+/// Flat counterpart of `appendNextFirstEvent`: the bucket for `second`
+/// extended by the first event of bucket `second + 1`, so coincidences
+/// straddling the boundary survive. Always a view, never a copy.
+inline std::span<const Timestamp> eventsWithNextFirst(const FlatSingles &singles,
+                                                      long long second) {
+    std::span<const Timestamp> current = eventsForSecond(singles, second);
+    if (current.empty()) {
+        // Mirror the vector-of-vectors path: an empty bucket still borrows
+        // the next bucket's head.
+        const auto next = eventsForSecond(singles, second + 1);
+        return next.empty() ? next : next.first(1);
+    }
+    const auto next = eventsForSecond(singles, second + 1);
+    return next.empty() ? current
+                        : std::span<const Timestamp>(current.data(),
+                                                     current.size() + 1);
+}
+
+/// Events of capture seconds `firstSecond..lastSecond` (inclusive; times
+/// relative to the capture's first record) whatever the bucket width: the
+/// covering buckets, trimmed at the second boundaries when these fall
+/// inside a bucket. Widths dividing a second, which the automatic width
+/// always does, need no trimming. No copy.
+inline std::span<const Timestamp> eventsForCaptureSeconds(const FlatSingles &singles,
+                                                          long long firstSecond,
+                                                          long long lastSecond) {
+    if (lastSecond < firstSecond)
+        return {};
+    const long long width =
+        singles.bucketWidthPs > 0 ? singles.bucketWidthPs : kDefaultBucketWidthPs;
+    const long long startPs = firstSecond * kDefaultBucketWidthPs;
+    const long long stopPs = (lastSecond + 1) * kDefaultBucketWidthPs;
+    std::span<const Timestamp> events = eventsForSeconds(
+        singles, floorDivide(startPs, width), floorDivide(stopPs - 1, width));
+    if (startPs % width != 0) {
+        const auto begin = std::lower_bound(events.begin(), events.end(), startPs);
+        events = events.subspan(static_cast<size_t>(begin - events.begin()));
+    }
+    if (stopPs % width != 0) {
+        const auto end = std::lower_bound(events.begin(), events.end(), stopPs);
+        events = events.first(static_cast<size_t>(end - events.begin()));
+    }
+    return events;
+}
+
+/// `eventsWithNextFirst` in capture seconds: second `second` extended by the
+/// first event of second `second + 1`.
+inline std::span<const Timestamp>
+captureSecondWithNextFirst(const FlatSingles &singles, long long second) {
+    const auto current = eventsForCaptureSeconds(singles, second, second);
+    const auto next = eventsForCaptureSeconds(singles, second + 1, second + 1);
+    if (current.empty())
+        return next.empty() ? next : next.first(1);
+    return next.empty() ? current
+                        : std::span<const Timestamp>(current.data(),
+                                                     current.size() + 1);
+}
+
+/// Packs vector-of-vectors buckets into the flat layout (one copy).
+inline FlatSingles flattenSingles(const Singles &singles) {
+    FlatSingles flat;
+    flat.channel = singles.channel;
+    flat.baseSecond = singles.baseSecond;
+    flat.bucketWidthPs = singles.bucketWidthPs;
+    if (singles.eventsPerSecond.empty())
+        return flat;
+    size_t total = 0;
+    for (const auto &bucket : singles.eventsPerSecond)
+        total += bucket.size();
+    flat.timestamps.reserve(total);
+    flat.bucketOffsets.reserve(singles.eventsPerSecond.size() + 1);
+    flat.bucketOffsets.push_back(0);
+    for (const auto &bucket : singles.eventsPerSecond) {
+        flat.timestamps.insert(flat.timestamps.end(), bucket.begin(), bucket.end());
+        flat.bucketOffsets.push_back(flat.timestamps.size());
+    }
+    return flat;
+}
+
+/// Expands the flat layout back into per-second vectors (one copy).
+inline Singles expandSingles(const FlatSingles &flat) {
+    Singles singles;
+    singles.channel = flat.channel;
+    singles.baseSecond = flat.baseSecond;
+    singles.bucketWidthPs = flat.bucketWidthPs;
+    singles.eventsPerSecond.resize(flat.bucketCount());
+    for (size_t idx = 0; idx < flat.bucketCount(); ++idx) {
+        const auto begin = flat.timestamps.begin() +
+                           static_cast<std::ptrdiff_t>(flat.bucketOffsets[idx]);
+        const auto end = flat.timestamps.begin() +
+                         static_cast<std::ptrdiff_t>(flat.bucketOffsets[idx + 1]);
+        singles.eventsPerSecond[idx].assign(begin, end);
+    }
+    return singles;
+}
@@ -0,0 +1,128 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+#include "Singles.h"
+
+/// @file
+/// Pre-bucketed cache of a parsed capture. Re-analysis runs map the cache
+/// instead of re-parsing the CSV/BIN. Opening checks the bucket offsets (8
+/// bytes a bucket) and a range only touches the timestamps inside it, so a
+/// short slice of a long capture costs a few page faults rather than a
+/// full read.
+///
+/// Layout (all integers little-endian):
+///   0   char[8]  magic "CFCACHE1"
+///   8   uint32   version (1)
+///   12  uint32   channelCount
+///   16  int64    bucketWidthPs   (bucket duration the offsets were built for)
+///   24  uint64   durationBits    (measurement duration, IEEE-754 double)
+///   32  uint64   sourceSize      (bytes of the capture the cache came from)
+///   40  int64    sourceMtime     (its last-write time, filesystem clock ticks)
+///   48  uint64   reserved[2]
+///   64  channel table, 48 bytes per channel:
+///         int32 channel, uint32 reserved, int64 baseSecond,
+///         uint64 bucketCount, uint64 eventCount,
+///         uint64 offsetsPos, uint64 timestampsPos
+///   offsetsPos     uint64[bucketCount + 1]  bucket start indices
+///   timestampsPos  int64[eventCount]        sorted timestamps
+/// Both arrays start on a 64-byte boundary so they can be used in place.
+
+inline constexpr char kSinglesCacheMagic[8] = {'C', 'F', 'C', 'A',
+                                               'C', 'H', 'E', '1'};
+inline constexpr uint32_t kSinglesCacheVersion = 1;
+inline constexpr size_t kSinglesCacheHeaderBytes = 64;
+inline constexpr size_t kSinglesCacheChannelBytes = 48;
+
+/// Identifies the capture a cache was built from; a cache whose stamp no
+/// longer matches the file on disk is stale.
+struct SinglesCacheSource {
+    uint64_t size = 0;
+    int64_t mtime = 0;
+
+    /// Stamp of `filename`; throws std::runtime_error when it cannot be read.
+    static SinglesCacheSource of(const std::string &filename);
+
+    bool operator==(const SinglesCacheSource &) const = default;
+};
+
+/// Writes `channels` (as produced by `readFileAutoFlat`) to `filename`. The
+/// data goes to a temporary next to it, unique to this writer, that is
+/// renamed into place, so readers never see a partial cache even while
+/// several runs rebuild it at once. Throws std::runtime_error on I/O failure.
+void writeSinglesCache(const std::string &filename,
+                       const std::map<int, FlatSingles> &channels,
+                       double durationSec, long long bucketWidthPs,
+                       const SinglesCacheSource &source);
+
+/// Read-only view of a cache file. Timestamps are served straight from the
+/// mapping; nothing is copied until `read` is asked for owning buckets.
+class SinglesCache {
+public:
+    /// Maps and validates `filename`; throws std::runtime_error when it is
+    /// missing, truncated, not a version-1 cache or has bucket offsets that
+    /// decrease or overrun the events (or on big-endian hosts, where the
+    /// arrays cannot be used in place).
+    explicit SinglesCache(const std::string &filename);
+
+    long long bucketWidthPs() const { return bucketWidthPs_; }
+    double durationSeconds() const { return durationSec_; }
+    const SinglesCacheSource &source() const { return source_; }
+
+    /// Channels present in the cache, ascending.
+    std::vector<int> channels() const;
+
+    /// View over buckets `firstSecond..lastSecond` (inclusive, clamped) of
+    /// `channel`, same contract as `eventsForSeconds` on `FlatSingles`.
+    /// Empty for unknown channels.
+    std::span<const Timestamp> eventsForSeconds(int channel, long long firstSecond,
+                                                long long lastSecond) const;
+
+    std::span<const Timestamp> eventsForSecond(int channel, long long second) const {
+        return eventsForSeconds(channel, second, second);
+    }
+
+    /// Copies buckets `firstSecond..lastSecond` (inclusive) of every channel.
+    /// Channels without a bucket in the range are left out, as the readers
+    /// leave out channels without events.
+    std::map<int, FlatSingles> readFlat(long long firstSecond,
+                                        long long lastSecond) const;
+    std::map<int, Singles> read(long long firstSecond, long long lastSecond) const;
+
+private:
+    struct Channel {
+        long long baseSecond = 0;
+        size_t bucketCount = 0;
+        const uint64_t *offsets = nullptr;
+        const Timestamp *timestamps = nullptr;
+    };
+
+    const Channel *find(int channel) const;
+
+    MappedFile file_;
+    long long bucketWidthPs_ = 0;
+    double durationSec_ = 0.0;
+    SinglesCacheSource source_;
+    std::map<int, Channel> channels_;
+};
+
+/// Sidecar path used by `readFileCached`: `<filename>.cfcache`.
+std::string singlesCachePath(const std::string &filename);
+
+/// `readFileAuto` restricted to buckets `firstSecond..lastSecond`, backed by
+/// the sidecar cache: a current cache (same source stamp and bucket width) is
+/// mapped and sliced, otherwise the capture is parsed and the cache rewritten
+/// for the next run. Failing to write the cache (read-only media) only costs
+/// the speed-up. `lastSecond < 0` means the end of the capture; callers that
+/// need boundary coincidences of `lastSecond` should ask for one more bucket.
+/// Throws std::invalid_argument for `kAutoExposure`: the cache is built for
+/// one fixed width.
+std::map<int, Singles> readFileCached(const std::string &filename,
+                                      double &duration_sec,
+                                      long long firstSecond = 0,
+                                      long long lastSecond = -1,
+                                      double exposure_seconds = -1.0);
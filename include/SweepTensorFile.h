@@ -0,0 +1,101 @@
+#pragma once
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "BoundedQueue.h"
+
+/// @file
+/// Single-file container for CoincFinder delay sweeps: a dense
+/// `pair x second x delay_bin` int32 count tensor behind a small header, laid
+/// out so NumPy can `np.memmap` the data block directly.
+///
+/// Layout (all integers little-endian):
+///   0   char[8]  magic "CFSWEEP1"
+///   8   uint32   version (1)
+///   12  uint32   pairCount
+///   16  uint32   secondCount
+///   20  uint32   delayBins
+///   24  int64    startSec        (second of index 0)
+///   32  int64    delayStartPs    (delay of bin 0)
+///   40  int64    delayStepPs
+///   48  int64    coincWindowPs
+///   56  uint64   dataOffset      (64-byte aligned)
+///   64  int32[pairCount][2]       channel numbers (ch1, ch2) per pair
+///   ..  uint8[pairCount][secondCount]  1 where a sweep was written
+///   dataOffset  int32[pairCount][secondCount][delayBins]
+/// Seconds that were skipped (no events) keep zero counts and a 0 flag.
+
+inline constexpr char kSweepTensorMagic[8] = {'C', 'F', 'S', 'W',
+                                              'E', 'E', 'P', '1'};
+inline constexpr uint32_t kSweepTensorVersion = 1;
+inline constexpr size_t kSweepTensorHeaderBytes = 64;
+
+struct SweepTensorHeader {
+    std::vector<std::pair<int, int>> pairs;
+    uint32_t secondCount = 0;
+    uint32_t delayBins = 0;
+    long long startSec = 0;
+    long long delayStartPs = 0;
+    long long delayStepPs = 0;
+    long long coincWindowPs = 0;
+    uint64_t dataOffset = 0; ///< Filled in by the writer / reader.
+
+    uint64_t validOffset() const {
+        return kSweepTensorHeaderBytes + 8ull * pairs.size();
+    }
+};
+
+/// Parses the header of a sweep tensor file; throws std::runtime_error when
+/// the file is missing or not a version-1 tensor.
+SweepTensorHeader readSweepTensorHeader(const std::string &filename);
+
+/// Preallocates the tensor file and fills it from a dedicated writer thread.
+/// Scan threads call `submit` and return immediately unless the writer falls
+/// `queueCapacity` sweeps behind; every sweep lands at its fixed offset, so
+/// submission order does not matter.
+class SweepTensorWriter {
+public:
+    /// Creates (truncating) `filename` sized for the full tensor and starts
+    /// the writer thread. Throws std::runtime_error on I/O failure.
+    SweepTensorWriter(const std::string &filename, SweepTensorHeader header,
+                      size_t queueCapacity = 1024);
+    ~SweepTensorWriter();
+
+    SweepTensorWriter(const SweepTensorWriter &) = delete;
+    SweepTensorWriter &operator=(const SweepTensorWriter &) = delete;
+
+    /// Queues the sweep for (`pairIndex`, `secondIndex`), where `secondIndex`
+    /// counts from `startSec`. `counts` must hold exactly `delayBins` values.
+    /// Throws std::out_of_range / std::invalid_argument on bad input.
+    void submit(size_t pairIndex, size_t secondIndex, std::vector<int32_t> counts);
+
+    /// Drains the queue, joins the writer and flushes the file. Rethrows the
+    /// first error the writer hit. Safe to call more than once.
+    void finish();
+
+    const SweepTensorHeader &header() const { return header_; }
+
+private:
+    struct Sweep {
+        size_t pairIndex = 0;
+        size_t secondIndex = 0;
+        std::vector<int32_t> counts;
+    };
+
+    void run();
+
+    SweepTensorHeader header_;
+    std::fstream file_;
+    BoundedQueue<Sweep> queue_;
+    std::thread worker_;
+    std::mutex errorMutex_;
+    std::exception_ptr error_;
+    bool finished_ = false;
+};
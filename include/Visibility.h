@@ -0,0 +1,158 @@
+#pragma once
+#include <cstddef>
+#include <limits>
+#include <map>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "Coincidences.h"
+#include "Singles.h"
+
+/// @file
+/// Per-second polarization metrics: accidental coincidences, visibility and
+/// QBER of the HV and DA bases, computed while the pairs are counted.
+///
+/// A basis compares its correlated ("same") pairs with its anti-correlated
+/// ("opposite") pairs, each counted at a fixed delay:
+///   visibility = (same - opposite) / (same + opposite)
+///   qber       = opposite / (same + opposite)
+/// The corrected variants subtract each pair's accidental estimate first
+/// (clamped at zero). Accidentals come either from the same pair at two
+/// off-peak delays, `delay +- offset`, counted in the same coincidence-matrix
+/// sweep as the peak, or from the singles product
+/// `n1 * n2 * (2 * window + 1) / bucket`.
+
+/// How accidental coincidences are estimated.
+enum class AccidentalsMethod {
+    None,           ///< No estimate; corrected values equal the raw ones.
+    OffPeak,        ///< Mean count at `delay - offset` and `delay + offset`.
+    SinglesProduct, ///< Uncorrelated rate `n1 * n2 * (2w + 1) / bucket`.
+};
+
+/// Default off-peak offset in coincidence windows, far enough from the peak
+/// that its tails do not leak into the background samples.
+constexpr long long kDefaultOffPeakWindows = 100;
+
+struct AccidentalsOptions {
+    AccidentalsMethod method = AccidentalsMethod::OffPeak;
+    /// Off-peak distance from the peak delay; 0 selects
+    /// `kDefaultOffPeakWindows` coincidence windows. For pulsed sources use a
+    /// multiple of the repetition period.
+    long long offPeakOffsetPs = 0;
+    /// Bucket length for the singles product; 0 uses one second in
+    /// `analyze`, whose counts span capture seconds, or the process default
+    /// in `analyzeSecond`.
+    long long bucketPs = 0;
+};
+
+/// One counted pair: its label and channels (as in the CLIs, "HH" = 1-5)
+/// and the delay it is counted at.
+struct AnalysisPair {
+    std::string label;
+    int ch1 = 0;
+    int ch2 = 0;
+    long long delayPs = 0;
+};
+
+/// Pairs of one basis, as indices into the analysis pair list.
+struct BasisPairs {
+    std::string name;
+    std::vector<size_t> same;
+    std::vector<size_t> opposite;
+};
+
+/// Coincidences of one pair in one second and their accidental estimate.
+struct PairCounts {
+    long long coincidences = 0;
+    double accidentals = 0.0;
+};
+
+/// Visibility and QBER of one basis (or of all bases, see `SecondMetrics`).
+/// Ratios are NaN when their denominator is zero.
+struct BasisMetrics {
+    double same = 0.0;
+    double opposite = 0.0;
+    double accidentalsSame = 0.0;
+    double accidentalsOpposite = 0.0;
+    double visibility = std::numeric_limits<double>::quiet_NaN();
+    double qber = std::numeric_limits<double>::quiet_NaN();
+    double visibilityCorrected = std::numeric_limits<double>::quiet_NaN();
+    double qberCorrected = std::numeric_limits<double>::quiet_NaN();
+};
+
+/// Metrics of one second.
+struct SecondMetrics {
+    long long second = 0;
+    std::vector<PairCounts> pairs;   ///< Parallel to the analysis pairs.
+    std::vector<BasisMetrics> bases; ///< Parallel to the analysis bases.
+    /// Counts summed over the bases; the ratios are the mean of the bases
+    /// that have one, as the delay-folder summaries report them.
+    BasisMetrics total;
+};
+
+/// Visibility and QBER from summed same/opposite counts and accidentals.
+BasisMetrics basisMetrics(double same, double opposite, double accidentalsSame,
+                          double accidentalsOpposite);
+
+/// `basisMetrics` over the given pairs' counts.
+BasisMetrics basisMetrics(std::span<const PairCounts> counts, const BasisPairs &basis);
+
+/// The HV basis (HH, VV against HV, VH) and the DA basis (DD, AA against DA,
+/// AD), found by label in `pairs`. A basis missing any of its labels is
+/// left out.
+std::vector<BasisPairs> polarizationBases(std::span<const AnalysisPair> pairs);
+
+/// Expected accidentals between `n1` and `n2` uncorrelated events spread
+/// over `bucketPs`, for the inclusive +-`coincWindowPs` window.
+double singlesProductAccidentals(size_t n1, size_t n2, long long coincWindowPs,
+                                 long long bucketPs);
+
+/// Counts a fixed set of pairs per second and derives their metrics.
+/// Throws std::invalid_argument for a non-positive window, a basis index
+/// outside `pairs`, or a negative off-peak offset.
+class VisibilityAnalysis {
+public:
+    VisibilityAnalysis(std::vector<AnalysisPair> pairs, std::vector<BasisPairs> bases,
+                       long long coincWindowPs, AccidentalsOptions options = {});
+
+    const std::vector<AnalysisPair> &pairs() const { return pairs_; }
+    const std::vector<BasisPairs> &bases() const { return bases_; }
+    /// Distinct channels of the pairs, in first-use order: the order of the
+    /// spans `analyzeSecond` expects.
+    const std::vector<int> &channels() const { return channels_; }
+    /// Effective off-peak offset (0 unless the method is OffPeak).
+    long long offPeakOffsetPs() const { return offsetPs_; }
+
+    /// Counts every pair, plus its off-peak delays, in one
+    /// `computeCoincidenceMatrix` sweep over `spans` (one per `channels()`
+    /// entry, each a bucket plus its lookahead) and derives the metrics.
+    /// Throws std::invalid_argument when `spans` does not match `channels()`.
+    SecondMetrics analyzeSecond(long long second,
+                                std::span<const SegmentedSpan> spans) const;
+
+    /// `analyzeSecond` for capture seconds `firstSecond..lastSecond` of
+    /// `singles` (`eventsForCaptureSecond`, so any bucket width), second
+    /// `sec` of every channel plus the first event of `sec + 1`, on OpenMP
+    /// threads. Missing channels count as empty.
+    std::vector<SecondMetrics> analyze(const std::map<int, Singles> &singles,
+                                       long long firstSecond, long long lastSecond) const;
+
+    /// Same, with `sources` parallel to `channels()`; null entries are empty
+    /// channels. Throws std::invalid_argument on a size mismatch.
+    std::vector<SecondMetrics> analyze(std::span<const Singles *const> sources,
+                                       long long firstSecond, long long lastSecond) const;
+
+private:
+    SecondMetrics analyzeSecond(long long second, std::span<const SegmentedSpan> spans,
+                                long long bucketPs) const;
+
+    std::vector<AnalysisPair> pairs_;
+    std::vector<BasisPairs> bases_;
+    std::vector<int> channels_;
+    std::vector<CoincidencePair> matrixPairs_; ///< Peak, then off-peak pairs.
+    long long coincWindowPs_;
+    AccidentalsOptions options_;
+    long long offsetPs_ = 0;
+    long long bucketPs_ = 0;
+};
@@ -8,6 +8,7 @@ from pathlib import Path
 Setup_4 = False  # Change to True for 4-detector setup
 
 data_dir = Path("Delay_Scan_Data")
+tensor_path = data_dir / "delay_scans.cfsweep"  # written by CoincFinder --tensor
 names = ["delay_ns", "coinc"]
 end_time = sys.argv[1]
 seconds = range(0, int(end_time))
@@ -40,13 +41,29 @@ else:
 # ===================================
 # 3. Helper Functions
 # ===================================
-def get_peak_delay_and_count(i, j, k):
-    """Return (delay_at_max, max_count) for a given pair and second."""
+tensor = None
+if tensor_path.exists():
+    from sweep_tensor import load_sweep_tensor
+    tensor = load_sweep_tensor(tensor_path)
+
+
+def load_scan(i, j, k):
+    """DataFrame(delay_ns, coinc) for one pair/second, or None if missing."""
+    if tensor is not None:
+        counts = tensor.sweep(i, j, k)
+        if counts is None:
+            return None
+        return pd.DataFrame({"delay_ns": tensor.delays_ns, "coinc": np.asarray(counts)})
     f = data_dir / f"delay_scan_{i}_vs_{j}_second_{k}.csv"
     if not f.exists():
-        return None, 0
-    df = pd.read_csv(f, names=names)
-    if df.empty:
+        return None
+    return pd.read_csv(f, names=names)
+
+
+def get_peak_delay_and_count(i, j, k):
+    """Return (delay_at_max, max_count) for a given pair and second."""
+    df = load_scan(i, j, k)
+    if df is None or df.empty:
         return None, 0
     idx_max = df["coinc"].idxmax()
     delay_at_max = df.loc[idx_max, "delay_ns"]
@@ -56,11 +73,8 @@ def get_peak_delay_and_count(i, j, k):
 
 def get_count_at_delay(i, j, k, delay_target):
     """Return coincidence count at a given delay (nearest value)."""
-    f = data_dir / f"delay_scan_{i}_vs_{j}_second_{k}.csv"
-    if not f.exists():
-        return 0
-    df = pd.read_csv(f, names=names)
-    if df.empty:
+    df = load_scan(i, j, k)
+    if df is None or df.empty:
         return 0
     # Find the coincidence closest to the target delay
     idx = (df["delay_ns"] - delay_target).abs().idxmin()
@@ -107,23 +121,19 @@ def compute_metrics(same_pairs, opp_pairs):
 global_max = 0
 for (i, j) in pairs.values():
     for k in seconds:
-        f = data_dir / f"delay_scan_{i}_vs_{j}_second_{k}.csv"
-        if not f.exists():
-            continue
-        df = pd.read_csv(f, names=["delay_ns", "coincidences"])
-        if not df.empty:
-            global_max = max(global_max, df["coincidences"].max())
+        df = load_scan(i, j, k)
+        if df is not None and not df.empty:
+            global_max = max(global_max, df["coinc"].max())
 
 fig, axes = plt.subplots(len(pairs), 1, figsize=(8, 6), sharex=True)
 if len(pairs) == 1:
     axes = [axes]
 for ax, (label, (i, j)) in zip(axes, pairs.items()):
     for k in seconds:
-        f = data_dir / f"delay_scan_{i}_vs_{j}_second_{k}.csv"
-        if not f.exists():
+        df = load_scan(i, j, k)
+        if df is None:
             continue
-        df = pd.read_csv(f, names=["delay_ns", "coincidences"])
-        ax.plot(df["delay_ns"], df["coincidences"], label=f"s {k+1}")
+        ax.plot(df["delay_ns"], df["coinc"], label=f"s {k+1}")
     ax.set_ylim(0, global_max * 1.1)
     ax.set_title(label)
     ax.set_ylabel("Coincidences")
@@ -49,7 +49,7 @@ def main():
     # Determine available seconds
     available_seconds = set()
     for s in singles_map.values():
-        available_seconds.update(range(s.base_second, s.base_second + len(s.events_per_second)))
+        available_seconds.update(range(s.base_second, s.base_second + s.bucket_count()))
     available_seconds = sorted(available_seconds)
     if not available_seconds:
         raise SystemExit("No data seconds found.")
@@ -65,12 +65,10 @@ def main():
             continue
         s1 = singles_map[c1]
         s2 = singles_map[c2]
-        idx1 = calib_sec - s1.base_second
-        idx2 = calib_sec - s2.base_second
-        if not (0 <= idx1 < len(s1.events_per_second) and 0 <= idx2 < len(s2.events_per_second)):
+        ch1 = s1.second_array(calib_sec)
+        ch2 = s2.second_array(calib_sec)
+        if len(ch1) == 0 or len(ch2) == 0:
             continue
-        ch1 = np.array(s1.events_per_second[idx1], dtype=np.int64)
-        ch2 = np.array(s2.events_per_second[idx2], dtype=np.int64)
         best = cf.find_best_delay_np(ch1, ch2, args.coinc_window_ps,
                                      delay_start_ps, delay_end_ps, delay_step_ps)
         delays_ns[lbl] = best / 1000.0
@@ -97,11 +95,7 @@ def main():
         # Gather buckets once per second for needed channels
         buckets = {}
         for ch, s in singles_map.items():
-            idx = sec - s.base_second
-            if 0 <= idx < len(s.events_per_second):
-                buckets[ch] = s.events_per_second[idx]
-            else:
-                buckets[ch] = []
+            buckets[ch] = s.second_array(sec)  # read-only view, no copy
             singles_per_sec[ch].append(len(buckets[ch]))
 
         # Same + cross pairs in one pass using a list
@@ -116,13 +110,11 @@ def main():
                 row[f"{lbl}_coinc"] = np.nan
                 continue
             delay_ps = int(delays_ns[base] * 1000)
-            ch1_list = buckets[c1]
-            ch2_list = buckets[c2]
-            if len(ch1_list) == 0 or len(ch2_list) == 0:
+            ch1 = buckets[c1]
+            ch2 = buckets[c2]
+            if len(ch1) == 0 or len(ch2) == 0:
                 row[f"{lbl}_coinc"] = np.nan
                 continue
-            ch1 = np.array(ch1_list, dtype=np.int64)
-            ch2 = np.array(ch2_list, dtype=np.int64)
             row[f"{lbl}_coinc"] = cf.count_coincidences_with_delay_np(
                 ch1, ch2, args.coinc_window_ps, delay_ps)
 
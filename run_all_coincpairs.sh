@@ -8,6 +8,7 @@ delay_end=12       # ns
 delay_step=0.01    # ns
 start=0            # start time (s); 0 means beginning
 stop=600           # stop time (s); 0 means end
+dump_format=csv    # csv or bin (compact int64 records, see docs/coinpairs.md)
 
 for f in 8hMeasurement/*.bin; do
   [ -e "$f" ] || { echo "No .bin files found in 8hMeasurement" >&2; exit 1; }
@@ -16,6 +17,6 @@ for f in 8hMeasurement/*.bin; do
   mkdir -p "$outdir"
 
   echo "Running CoincPairs on $f"
-  ./CoincPairs "$f" "$coinc" "$delay_start" "$delay_end" "$delay_step" "$start" "$stop" "$outdir/rate.csv" --dump-events
+  ./CoincPairs "$f" "$coinc" "$delay_start" "$delay_end" "$delay_step" "$start" "$stop" "$outdir/rate.csv" --dump-events --dump-format "$dump_format"
   echo "Done: $f"
 done
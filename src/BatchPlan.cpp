@@ -0,0 +1,342 @@
+#include "BatchPlan.h"
+
+// Batch planning: file lists, shard selection, the load budget and shard
+// summaries. Nothing here reads capture data; the driver is CoincBatch.cpp.
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+#include "Instrumentation.h"
+#include "ReadCSV.h"
+
+namespace {
+// Capture format sizes used for the load estimate.
+constexpr size_t kBinHeaderBytes = 40;
+constexpr size_t kBinRecordBytes = 10;
+// Short CSV lines ("<ps>,<ch>") run 16-20 bytes; assuming the short end
+// overestimates the event count, which is the safe side for a budget.
+constexpr size_t kCsvBytesPerEvent = 16;
+// A timestamp is 8 bytes; the reader's growing arrays can hold up to twice
+// their size while filling.
+constexpr size_t kResidentBytesPerEvent = 16;
+
+constexpr std::string_view kSummaryHeader =
+    "pair,delay_ps,first_second,last_second,seconds,coincidences,file";
+
+bool hasWildcard(const std::string &text) {
+    return text.find_first_of("*?") != std::string::npos;
+}
+
+// Glob match of `name` against `pattern` (`*` any run, `?` one character).
+bool wildcardMatch(std::string_view pattern, std::string_view name) {
+    size_t p = 0;
+    size_t n = 0;
+    size_t starP = std::string_view::npos;
+    size_t starN = 0;
+    while (n < name.size()) {
+        if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n])) {
+            ++p;
+            ++n;
+        } else if (p < pattern.size() && pattern[p] == '*') {
+            starP = p++;
+            starN = n;
+        } else if (starP != std::string_view::npos) {
+            p = starP + 1;
+            n = ++starN;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*')
+        ++p;
+    return p == pattern.size();
+}
+
+void expandInput(const std::string &input, std::vector<std::string> &files) {
+    if (!input.empty() && input.front() == '@') {
+        const std::string listName = input.substr(1);
+        std::ifstream list(listName);
+        if (!list)
+            throw std::runtime_error("Cannot open input list: " + listName);
+        std::string line;
+        while (std::getline(list, line)) {
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            if (line.empty() || line.front() == '#')
+                continue;
+            expandInput(line, files);
+        }
+        return;
+    }
+
+    const std::filesystem::path path(input);
+    if (!hasWildcard(input)) {
+        if (!std::filesystem::is_regular_file(path))
+            throw std::runtime_error("No such input file: " + input);
+        files.push_back(input);
+        return;
+    }
+    const std::string pattern = path.filename().string();
+    if (hasWildcard(path.parent_path().string()))
+        throw std::runtime_error("Wildcards are only supported in the file name: " +
+                                 input);
+    const std::filesystem::path dir =
+        path.has_parent_path() ? path.parent_path() : std::filesystem::path(".");
+    std::vector<std::string> matches;
+    std::error_code ec;
+    for (const auto &entry : std::filesystem::directory_iterator(dir, ec)) {
+        const std::string name = entry.path().filename().string();
+        if (entry.is_regular_file() && wildcardMatch(pattern, name))
+            matches.push_back(
+                (path.has_parent_path() ? path.parent_path() / name
+                                        : std::filesystem::path(name))
+                    .string());
+    }
+    if (matches.empty())
+        throw std::runtime_error("No input files match " + input);
+    std::sort(matches.begin(), matches.end());
+    files.insert(files.end(), matches.begin(), matches.end());
+}
+
+bool parseInteger(std::string_view text, long long &value) {
+    const auto res = std::from_chars(text.data(), text.data() + text.size(), value);
+    return res.ec == std::errc() && res.ptr == text.data() + text.size();
+}
+} // namespace
+
+ShardSpec parseShardSpec(const std::string &spec) {
+    const size_t slash = spec.find('/');
+    long long index = 0;
+    long long count = 0;
+    if (slash == std::string::npos ||
+        !parseInteger(std::string_view(spec).substr(0, slash), index) ||
+        !parseInteger(std::string_view(spec).substr(slash + 1), count) ||
+        count <= 0 || count > 1'000'000 || index < 0 || index >= count)
+        throw std::invalid_argument("Invalid shard '" + spec +
+                                    "' (expected k/n with 0 <= k < n)");
+    return {static_cast<int>(index), static_cast<int>(count)};
+}
+
+std::vector<std::string> expandInputPatterns(const std::vector<std::string> &inputs) {
+    std::vector<std::string> expanded;
+    for (const std::string &input : inputs)
+        expandInput(input, expanded);
+    // Keep the first occurrence of each file so the order stays meaningful.
+    std::vector<std::string> files;
+    std::set<std::string> seen;
+    for (std::string &file : expanded)
+        if (seen.insert(file).second)
+            files.push_back(std::move(file));
+    return files;
+}
+
+std::vector<BatchTask> planShard(const std::vector<BatchTask> &tasks, ShardSpec shard,
+                                 ShardMode mode) {
+    std::vector<BatchTask> planned;
+    for (size_t t = 0; t < tasks.size(); ++t) {
+        const BatchTask &task = tasks[t];
+        if (task.seconds() <= 0)
+            continue;
+        if (mode == ShardMode::Files) {
+            if (t % static_cast<size_t>(shard.count) == static_cast<size_t>(shard.index))
+                planned.push_back(task);
+            continue;
+        }
+        const long long length = task.seconds();
+        const long long begin = task.firstSecond + length * shard.index / shard.count;
+        const long long end =
+            task.firstSecond + length * (shard.index + 1) / shard.count;
+        if (end > begin)
+            planned.push_back({task.file, begin, end - 1});
+    }
+    return planned;
+}
+
+size_t estimateLoadBytes(const std::string &filename, double durationSec,
+                         long long seconds) {
+    std::error_code ec;
+    const auto fileBytes = std::filesystem::file_size(filename, ec);
+    if (ec || seconds <= 0)
+        return 0;
+    const size_t events =
+        hasEnding(filename, ".bin")
+            ? (fileBytes > kBinHeaderBytes ? (fileBytes - kBinHeaderBytes) / kBinRecordBytes
+                                           : 0)
+            : static_cast<size_t>(fileBytes / kCsvBytesPerEvent);
+    // Loads ask for one lookahead bucket past their range.
+    const double span = durationSec / bucketDurationSeconds();
+    const double share =
+        span > 0.0 ? std::min(1.0, static_cast<double>(seconds + 1) / span) : 1.0;
+    return static_cast<size_t>(std::ceil(static_cast<double>(events) * share)) *
+           kResidentBytesPerEvent;
+}
+
+MemoryBudget::Lease::Lease(Lease &&other) noexcept
+    : budget_(std::exchange(other.budget_, nullptr)),
+      bytes_(std::exchange(other.bytes_, 0)) {}
+
+MemoryBudget::Lease &MemoryBudget::Lease::operator=(Lease &&other) noexcept {
+    if (this != &other) {
+        if (budget_)
+            budget_->release(bytes_);
+        budget_ = std::exchange(other.budget_, nullptr);
+        bytes_ = std::exchange(other.bytes_, 0);
+    }
+    return *this;
+}
+
+MemoryBudget::Lease::~Lease() {
+    if (budget_)
+        budget_->release(bytes_);
+}
+
+MemoryBudget::Lease MemoryBudget::reserve(size_t bytes) {
+    if (capacity_ == 0)
+        return Lease(this, 0);
+    bytes = std::min(bytes, capacity_);
+    std::unique_lock<std::mutex> lock(mutex_);
+    freed_.wait(lock, [&] { return inUse_ + bytes <= capacity_; });
+    inUse_ += bytes;
+    return Lease(this, bytes);
+}
+
+size_t MemoryBudget::inUse() const {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    return inUse_;
+}
+
+void MemoryBudget::release(size_t bytes) {
+    if (bytes == 0)
+        return;
+    {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        inUse_ -= bytes;
+    }
+    freed_.notify_all();
+}
+
+std::string shardSummaryPath(const std::string &directory, ShardSpec shard) {
+    return (std::filesystem::path(directory) /
+            ("shard_" + std::to_string(shard.index) + "_of_" +
+             std::to_string(shard.count) + ".csv"))
+        .string();
+}
+
+void writeBatchSummary(const std::string &filename,
+                       const std::vector<BatchSummaryRow> &rows) {
+    const std::string tmpName = filename + ".tmp";
+    {
+        std::ofstream out(tmpName, std::ios::trunc);
+        if (!out)
+            throw std::runtime_error("Cannot create batch summary: " + tmpName);
+        out << kSummaryHeader << "\n";
+        for (const BatchSummaryRow &row : rows)
+            out << row.pair << "," << row.delayPs << "," << row.firstSecond << ","
+                << row.lastSecond << "," << row.seconds << "," << row.coincidences
+                << "," << row.file << "\n";
+        out.flush();
+        if (!out) {
+            out.close();
+            std::error_code ec;
+            std::filesystem::remove(tmpName, ec);
+            throw std::runtime_error("Failed writing batch summary: " + tmpName);
+        }
+        COINCFINDER_COUNT(BytesWritten, static_cast<long long>(out.tellp()));
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmpName, filename, ec);
+    if (ec) {
+        std::filesystem::remove(tmpName, ec);
+        throw std::runtime_error("Cannot move batch summary into place: " + filename);
+    }
+}
+
+std::vector<BatchSummaryRow> readBatchSummary(const std::string &filename) {
+    std::ifstream in(filename);
+    if (!in)
+        throw std::runtime_error("Cannot open batch summary: " + filename);
+    std::string line;
+    if (!std::getline(in, line) || line != kSummaryHeader)
+        throw std::runtime_error("Not a batch summary: " + filename);
+
+    std::vector<BatchSummaryRow> rows;
+    size_t lineNumber = 1;
+    while (std::getline(in, line)) {
+        ++lineNumber;
+        if (line.empty())
+            continue;
+        // Six numeric-or-label fields, then the path (which may hold commas).
+        std::string_view fields[6];
+        size_t pos = 0;
+        bool ok = true;
+        for (std::string_view &field : fields) {
+            const size_t comma = line.find(',', pos);
+            if (comma == std::string::npos) {
+                ok = false;
+                break;
+            }
+            field = std::string_view(line).substr(pos, comma - pos);
+            pos = comma + 1;
+        }
+        BatchSummaryRow row;
+        ok = ok && !fields[0].empty() && parseInteger(fields[1], row.delayPs) &&
+             parseInteger(fields[2], row.firstSecond) &&
+             parseInteger(fields[3], row.lastSecond) &&
+             parseInteger(fields[4], row.seconds) &&
+             parseInteger(fields[5], row.coincidences) && pos < line.size();
+        if (!ok)
+            throw std::runtime_error("Malformed batch summary line " +
+                                     std::to_string(lineNumber) + " in " + filename);
+        row.pair = std::string(fields[0]);
+        row.file = line.substr(pos);
+        rows.push_back(std::move(row));
+    }
+    return rows;
+}
+
+std::vector<BatchSummaryRow> mergeBatchSummaries(const std::vector<BatchSummaryRow> &rows) {
+    std::vector<BatchSummaryRow> merged;
+    std::map<std::pair<std::string, std::string>, size_t> index;
+    for (const BatchSummaryRow &row : rows) {
+        const auto [it, inserted] =
+            index.try_emplace({row.file, row.pair}, merged.size());
+        if (inserted) {
+            merged.push_back(row);
+            continue;
+        }
+        BatchSummaryRow &total = merged[it->second];
+        if (total.delayPs != row.delayPs)
+            throw std::runtime_error("Shards disagree on the delay of pair " +
+                                     row.pair + " in " + row.file);
+        total.firstSecond = std::min(total.firstSecond, row.firstSecond);
+        total.lastSecond = std::max(total.lastSecond, row.lastSecond);
+        total.seconds += row.seconds;
+        total.coincidences += row.coincidences;
+    }
+    return merged;
+}
+
+std::vector<BatchSummaryRow> aggregateShardSummaries(const std::string &directory,
+                                                     int shardCount) {
+    std::string missing;
+    for (int k = 0; k < shardCount; ++k)
+        if (!std::filesystem::is_regular_file(shardSummaryPath(directory, {k, shardCount})))
+            missing += (missing.empty() ? "" : ", ") + std::to_string(k);
+    if (!missing.empty())
+        throw std::runtime_error("Shards not finished in " + directory + ": " + missing);
+
+    std::vector<BatchSummaryRow> rows;
+    for (int k = 0; k < shardCount; ++k) {
+        const auto shardRows = readBatchSummary(shardSummaryPath(directory, {k, shardCount}));
+        rows.insert(rows.end(), shardRows.begin(), shardRows.end());
+    }
+    return mergeBatchSummaries(rows);
+}
@@ -0,0 +1,89 @@
+#include "BinTailReader.h"
+
+// Growing-file reader for live acquisition. The stream stays open between
+// polls; each poll checks the current size, reads whole records only and
+// clears EOF so the next poll can continue from the same offset.
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+#include "RollingSingles.h"
+
+namespace {
+// Qutools BIN layout: fixed header followed by packed (uint64 ts, uint16 ch).
+constexpr uint64_t kBinHeaderBytes = 40;
+constexpr uint64_t kBinRecordBytes = 10;
+// Bytes decoded per read so a large backlog does not need one huge buffer.
+constexpr uint64_t kMaxReadBytes = kBinRecordBytes * 65536;
+} // namespace
+
+BinTailReader::BinTailReader(std::string filename)
+    : filename_(std::move(filename)) {}
+
+size_t BinTailReader::poll(std::vector<RawRecord> &out, size_t maxRecords) {
+    std::error_code ec;
+    const auto size = std::filesystem::file_size(filename_, ec);
+    if (ec)
+        return 0; // not created yet (or briefly gone during rotation)
+
+    if (size < offset_) {
+        // Truncated or replaced: start over, including a fresh header.
+        in_.close();
+        offset_ = 0;
+    }
+    if (offset_ == 0) {
+        if (size < kBinHeaderBytes)
+            return 0;
+        offset_ = kBinHeaderBytes;
+    }
+
+    uint64_t available = (size - offset_) / kBinRecordBytes;
+    if (available > maxRecords)
+        available = maxRecords;
+    if (available == 0)
+        return 0;
+
+    if (!in_.is_open()) {
+        in_.open(filename_, std::ios::binary);
+        if (!in_)
+            return 0;
+    }
+    in_.clear(); // a previous poll may have hit EOF
+
+    size_t added = 0;
+    while (available > 0) {
+        const uint64_t records =
+            std::min<uint64_t>(available, kMaxReadBytes / kBinRecordBytes);
+        const uint64_t bytes = records * kBinRecordBytes;
+        buffer_.resize(bytes);
+        in_.seekg(static_cast<std::streamoff>(offset_));
+        if (!in_.read(reinterpret_cast<char *>(buffer_.data()),
+                      static_cast<std::streamsize>(bytes)))
+            throw std::runtime_error("Failed reading " + filename_);
+
+        const unsigned char *rec = buffer_.data();
+        for (uint64_t i = 0; i < records; ++i, rec += kBinRecordBytes) {
+            RawRecord raw;
+            std::memcpy(&raw.timestamp, rec, sizeof(raw.timestamp));
+            std::memcpy(&raw.channel, rec + sizeof(raw.timestamp),
+                        sizeof(raw.channel));
+            out.push_back(raw);
+        }
+        offset_ += bytes;
+        available -= records;
+        added += static_cast<size_t>(records);
+    }
+    return added;
+}
+
+size_t BinTailReader::pollInto(RollingSingles &rolling, size_t maxRecords) {
+    scratch_.clear();
+    const size_t read = poll(scratch_, maxRecords);
+    if (read > 0)
+        rolling.ingest(scratch_);
+    return read;
+}
@@ -0,0 +1,437 @@
+// CoincBatch CLI driver.
+// Runs the CoincPairs fixed-delay count over many captures. Delays are found
+// once on the first file and seed every other file; files (or parts of their
+// second ranges) are processed concurrently under a memory budget, and nodes
+// can each take one shard of the work and merge their summaries afterwards.
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "BatchPlan.h"
+#include "ChannelPairs.h"
+#include "Coincidences.h"
+#include "Instrumentation.h"
+#include "ReadCSV.h"
+#include "Singles.h"
+
+namespace {
+
+struct ScanSettings {
+    long long coincWindowPs = 0;
+    long long delayStartPs = 0;
+    long long delayEndPs = 0;
+    long long delayStepPs = 0;
+    long long startSec = 0;
+    long long sliceSeconds = 60;
+    long long refinePs = 0;
+};
+
+constexpr const char *kReportName = "batch_report.csv";
+
+long long nsToPs(double ns) {
+    return static_cast<long long>(std::llround(ns * 1000.0));
+}
+
+// Peak delay of every same pair at `second` of `file`, searched over
+// `[lo, hi]` per pair (`ranges` maps a label to its bounds). Pairs without
+// data in that second get no entry.
+std::map<std::string, long long>
+findDelays(const std::string &file, long long second,
+           const std::vector<PairInfo> &samePairs,
+           const std::map<std::string, std::pair<long long, long long>> &ranges,
+           const ScanSettings &settings) {
+    double duration = 0.0;
+    const auto singles = readFileAutoFlat(file, duration, -1.0, second, second + 1);
+    std::map<std::string, long long> delays;
+    for (const PairInfo &p : samePairs) {
+        const auto it1 = singles.find(p.ch1);
+        const auto it2 = singles.find(p.ch2);
+        const auto range = ranges.find(p.label);
+        if (it1 == singles.end() || it2 == singles.end() || range == ranges.end())
+            continue;
+        const auto span1 = eventsWithNextFirst(it1->second, second);
+        const auto span2 = eventsWithNextFirst(it2->second, second);
+        if (span1.empty() || span2.empty())
+            continue;
+        delays[p.label] = findBestDelayPicoseconds(
+            span1, span2, settings.coincWindowPs, range->second.first,
+            range->second.second, settings.delayStepPs);
+    }
+    return delays;
+}
+
+// Counts `task` slice by slice, appending per-second rows to `rate` and
+// returning one summary row per pair with a delay.
+std::vector<BatchSummaryRow>
+runTask(const BatchTask &task, double durationSec, const std::vector<PairInfo> &allPairs,
+        const std::map<std::string, long long> &delays, const ScanSettings &settings,
+        MemoryBudget &budget, std::ostream &rate) {
+    const PairMatrix matrix =
+        pairMatrix(allPairs, [&](const std::string &source) -> std::optional<long long> {
+            const auto it = delays.find(source);
+            if (it == delays.end())
+                return std::nullopt;
+            return it->second;
+        });
+    const std::vector<int> &channels = matrix.channels;
+    const std::vector<CoincidencePair> &matrixPairs = matrix.pairs;
+    std::vector<BatchSummaryRow> rows;
+    for (size_t k = 0; k < matrix.slots.size(); ++k) {
+        BatchSummaryRow row;
+        row.pair = allPairs[matrix.slots[k]].label;
+        row.delayPs = matrixPairs[k].delayPs;
+        row.firstSecond = task.firstSecond;
+        row.lastSecond = task.lastSecond;
+        row.seconds = task.seconds();
+        row.file = task.file;
+        rows.push_back(std::move(row));
+    }
+
+    std::vector<std::span<const long long>> spans(channels.size());
+    for (long long first = task.firstSecond; first <= task.lastSecond;
+         first += settings.sliceSeconds) {
+        const long long last =
+            std::min(task.lastSecond, first + settings.sliceSeconds - 1);
+        const MemoryBudget::Lease lease =
+            budget.reserve(estimateLoadBytes(task.file, durationSec, last - first + 1));
+        double duration = 0.0;
+        // One bucket past the slice for the boundary lookahead.
+        const auto singles = readFileAutoFlat(task.file, duration, -1.0, first, last + 1);
+        const FlatSingles empty;
+        for (long long sec = first; sec <= last; ++sec) {
+            for (size_t c = 0; c < channels.size(); ++c) {
+                const auto it = singles.find(channels[c]);
+                spans[c] = eventsWithNextFirst(it == singles.end() ? empty : it->second,
+                                               sec);
+            }
+            const std::vector<int> counts =
+                computeCoincidenceMatrix(spans, matrixPairs, settings.coincWindowPs);
+            for (size_t k = 0; k < rows.size(); ++k) {
+                rows[k].coincidences += counts[k];
+                rate << sec << "," << rows[k].pair << ","
+                     << static_cast<double>(rows[k].delayPs) / 1000.0 << ","
+                     << counts[k] << "\n";
+            }
+        }
+    }
+    return rows;
+}
+
+void writeReport(const std::string &outDir, int shardCount) {
+    const auto rows = aggregateShardSummaries(outDir, shardCount);
+    const std::string reportPath =
+        (std::filesystem::path(outDir) / kReportName).string();
+    writeBatchSummary(reportPath, rows);
+    std::cout << "Wrote aggregated report " << reportPath << " (" << rows.size()
+              << " file/pair rows from " << shardCount << " shard"
+              << (shardCount == 1 ? "" : "s") << ")\n";
+}
+
+} // namespace
+
+void print_help(const char *exe) {
+    std::cout
+        << "CoincBatch - fixed-delay coincidence counts over many captures\n"
+        << "Usage: " << exe
+        << " <coinc_window_ps> <delay_start_ns> <delay_end_ns> <delay_step_ns> <startSec> <stopSec> <input>... [--out-dir dir] [--jobs n] [--memory-mb m] [--slice-seconds s] [--shard k/n] [--shard-by file|second] [--refine-ps r] [--pairs 1-5,2-6,...] [--stats [file]]\n"
+        << "       " << exe << " --aggregate <n> [--out-dir dir]\n"
+        << "Examples:\n"
+        << "  " << exe << " 250 8 12 0.01 0 -1 '8hMeasurement/*.bin'\n"
+        << "  " << exe << " 250 8 12 0.01 0 -1 @week.txt --shard 3/8 --out-dir /shared/run\n\n"
+        << "Behavior:\n"
+        << "  - Inputs are paths, patterns such as dir/*.bin (quote them), or @list.txt\n"
+        << "    with one entry per line. The expanded list keeps argument order.\n"
+        << "  - Peak delays for the same pairs (HH, VV, DD, AA) are found once, at\n"
+        << "    startSec of the first input, and reused for every file (cross pairs\n"
+        << "    reuse the same-pair delays). --refine-ps r re-searches each file\n"
+        << "    within +-r ps of those seeds instead.\n"
+        << "  - stopSec < 0 processes each capture to its end.\n"
+        << "  - --jobs files run concurrently (default: hardware threads); each loads\n"
+        << "    --slice-seconds at a time (default 60), and loads wait while their\n"
+        << "    estimated footprint would exceed --memory-mb (default 4096, 0 = no limit).\n"
+        << "  - --shard k/n (0 <= k < n) processes one of n shards: whole files dealt\n"
+        << "    round-robin (--shard-by file, default) or part k of every file's\n"
+        << "    seconds (--shard-by second). All shards must get the same inputs.\n"
+        << "Outputs (in --out-dir, default CoincBatch):\n"
+        << "  <stem>/rate.csv            second,pair,delay_ns,coincidences\n"
+        << "                             (<stem>/rate.part<k>.csv with --shard-by second)\n"
+        << "  shard_<k>_of_<n>.csv       per file and pair totals of one shard\n"
+        << "  batch_report.csv           all shards merged; written directly for a\n"
+        << "                             single shard, else by --aggregate n once every\n"
+        << "                             shard has finished\n"
+        << "Notes:\n"
+        << "  - delay_* in nanoseconds; window in picoseconds.\n";
+}
+
+int main(int argc, char *argv[]) {
+    std::string outDir = "CoincBatch";
+    if (argc >= 3 && std::string(argv[1]) == "--aggregate") {
+        const int shardCount = std::atoi(argv[2]);
+        for (int a = 3; a < argc; ++a) {
+            const std::string arg = argv[a];
+            if (arg == "--out-dir" && a + 1 < argc) {
+                outDir = argv[++a];
+            } else {
+                std::cerr << "Unknown option: " << arg << "\n";
+                return 1;
+            }
+        }
+        if (shardCount <= 0) {
+            std::cerr << "Invalid shard count.\n";
+            return 1;
+        }
+        try {
+            writeReport(outDir, shardCount);
+        } catch (const std::exception &ex) {
+            std::cerr << ex.what() << "\n";
+            return 1;
+        }
+        return 0;
+    }
+
+    if (argc < 8) {
+        print_help(argv[0]);
+        return 1;
+    }
+
+    ScanSettings settings;
+    settings.coincWindowPs = std::atoll(argv[1]);
+    const double delayStartNs = std::atof(argv[2]);
+    const double delayEndNs = std::atof(argv[3]);
+    const double delayStepNs = std::atof(argv[4]);
+    settings.startSec = std::atoll(argv[5]);
+    const long long stopSec = std::atoll(argv[6]);
+    std::vector<std::string> inputs;
+    unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+    long long memoryMb = 4096;
+    ShardSpec shard;
+    ShardMode shardMode = ShardMode::Files;
+    std::string statsPath;
+    std::vector<std::pair<int, int>> requestedPairs;
+    for (int a = 7; a < argc; ++a) {
+        const std::string arg = argv[a];
+        if (arg == "--out-dir" && a + 1 < argc) {
+            outDir = argv[++a];
+        } else if (arg == "--jobs" && a + 1 < argc) {
+            jobs = static_cast<unsigned>(std::max(1, std::atoi(argv[++a])));
+        } else if (arg == "--memory-mb" && a + 1 < argc) {
+            memoryMb = std::max(0LL, std::atoll(argv[++a]));
+        } else if (arg == "--slice-seconds" && a + 1 < argc) {
+            settings.sliceSeconds = std::atoll(argv[++a]);
+        } else if (arg == "--refine-ps" && a + 1 < argc) {
+            settings.refinePs = std::atoll(argv[++a]);
+        } else if (arg == "--shard" && a + 1 < argc) {
+            try {
+                shard = parseShardSpec(argv[++a]);
+            } catch (const std::exception &ex) {
+                std::cerr << ex.what() << "\n";
+                return 1;
+            }
+        } else if (arg == "--shard-by" && a + 1 < argc) {
+            const std::string value = argv[++a];
+            if (value == "file") {
+                shardMode = ShardMode::Files;
+            } else if (value == "second") {
+                shardMode = ShardMode::Seconds;
+            } else {
+                std::cerr << "Unknown shard mode: " << value << "\n";
+                return 1;
+            }
+        } else if (arg == "--pairs" && a + 1 < argc) {
+            try {
+                requestedPairs = parseChannelPairs(argv[++a]);
+            } catch (const std::exception &ex) {
+                std::cerr << ex.what() << "\n";
+                return 1;
+            }
+        } else if (arg == "--stats") {
+            const bool hasValue =
+                a + 1 < argc && !std::string_view(argv[a + 1]).starts_with("--");
+            statsPath = hasValue ? argv[++a] : "-";
+        } else if (arg.rfind("--", 0) != 0) {
+            inputs.push_back(arg);
+        } else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            print_help(argv[0]);
+            return 1;
+        }
+    }
+
+    settings.delayStartPs = nsToPs(delayStartNs);
+    settings.delayEndPs = nsToPs(delayEndNs);
+    settings.delayStepPs = nsToPs(delayStepNs);
+    if (settings.coincWindowPs <= 0 || settings.delayStepPs <= 0 ||
+        settings.delayEndPs < settings.delayStartPs || settings.startSec < 0 ||
+        (stopSec >= 0 && stopSec < settings.startSec) || settings.sliceSeconds <= 0 ||
+        settings.refinePs < 0 || inputs.empty()) {
+        std::cerr << "Invalid arguments.\n";
+        return 1;
+    }
+
+    std::vector<std::string> files;
+    try {
+        files = expandInputPatterns(inputs);
+    } catch (const std::exception &ex) {
+        std::cerr << ex.what() << "\n";
+        return 1;
+    }
+    // Per-file outputs are named by stem, so stems must be unique.
+    std::set<std::string> stems;
+    for (const auto &file : files)
+        if (!stems.insert(std::filesystem::path(file).stem().string()).second) {
+            std::cerr << "Two inputs share the file name stem of " << file
+                      << "; their outputs would collide.\n";
+            return 1;
+        }
+
+    const PairTable table = pairTable(requestedPairs);
+    const std::vector<PairInfo> &samePairs = table.same;
+    std::vector<PairInfo> allPairs = samePairs;
+    allPairs.insert(allPairs.end(), table.cross.begin(), table.cross.end());
+
+    // Seeds from the first input. Every shard derives the same ones, so no
+    // node has to publish them.
+    std::map<std::string, std::pair<long long, long long>> fullRanges;
+    for (const PairInfo &p : samePairs)
+        fullRanges[p.label] = {settings.delayStartPs, settings.delayEndPs};
+    std::map<std::string, long long> seeds;
+    try {
+        seeds = findDelays(files.front(), settings.startSec, samePairs, fullRanges,
+                           settings);
+    } catch (const std::exception &ex) {
+        std::cerr << ex.what() << "\n";
+        return 1;
+    }
+    if (seeds.empty()) {
+        std::cerr << "Failed to determine any delays in " << files.front() << ".\n";
+        return 1;
+    }
+    for (const PairInfo &p : samePairs)
+        if (seeds.count(p.label))
+            std::cout << "Seed delay " << p.label << ": "
+                      << static_cast<double>(seeds.at(p.label)) / 1000.0 << " ns\n";
+
+    // One task per file over its whole requested range, then this shard's
+    // part of them.
+    std::vector<BatchTask> wholeTasks;
+    std::map<std::string, double> durations;
+    try {
+        for (const auto &file : files) {
+            const double duration = captureDurationSeconds(file);
+            durations[file] = duration;
+            const auto lastBucket =
+                static_cast<long long>(duration / bucketDurationSeconds());
+            wholeTasks.push_back(
+                {file, settings.startSec,
+                 stopSec < 0 ? lastBucket : std::min(stopSec, lastBucket)});
+        }
+    } catch (const std::exception &ex) {
+        std::cerr << ex.what() << "\n";
+        return 1;
+    }
+    const std::vector<BatchTask> tasks = planShard(wholeTasks, shard, shardMode);
+
+    std::filesystem::create_directories(outDir);
+    MemoryBudget budget(static_cast<size_t>(memoryMb) * 1024 * 1024);
+    std::vector<std::vector<BatchSummaryRow>> taskRows(tasks.size());
+    std::atomic<size_t> nextTask{0};
+    std::atomic<size_t> doneTasks{0};
+    std::atomic<bool> failed{false};
+    std::mutex consoleMutex;
+    const auto worker = [&] {
+        for (size_t t = nextTask.fetch_add(1); t < tasks.size();
+             t = nextTask.fetch_add(1)) {
+            const BatchTask &task = tasks[t];
+            try {
+                std::map<std::string, long long> delays = seeds;
+                if (settings.refinePs > 0) {
+                    // Refined at the file's own first second, so every shard
+                    // of a file lands on the same delays.
+                    std::map<std::string, std::pair<long long, long long>> ranges;
+                    for (const auto &[label, seed] : seeds)
+                        ranges[label] = {seed - settings.refinePs, seed + settings.refinePs};
+                    for (const auto &[label, delayPs] :
+                         findDelays(task.file, settings.startSec, samePairs, ranges,
+                                    settings))
+                        delays[label] = delayPs;
+                }
+
+                const std::filesystem::path dir =
+                    std::filesystem::path(outDir) /
+                    std::filesystem::path(task.file).stem();
+                std::filesystem::create_directories(dir);
+                const std::string rateName =
+                    shardMode == ShardMode::Seconds && shard.count > 1
+                        ? "rate.part" + std::to_string(shard.index) + ".csv"
+                        : "rate.csv";
+                std::ofstream rate(dir / rateName);
+                if (!rate)
+                    throw std::runtime_error("Cannot open output file: " +
+                                             (dir / rateName).string());
+                rate << "second,pair,delay_ns,coincidences\n";
+                taskRows[t] = runTask(task, durations.at(task.file), allPairs, delays,
+                                      settings, budget, rate);
+                rate.flush();
+                if (!rate)
+                    throw std::runtime_error("Failed writing " +
+                                             (dir / rateName).string());
+                COINCFINDER_COUNT(BytesWritten, static_cast<long long>(rate.tellp()));
+
+                const std::lock_guard<std::mutex> lock(consoleMutex);
+                std::cout << "[" << ++doneTasks << "/" << tasks.size() << "] "
+                          << task.file << " seconds " << task.firstSecond << "-"
+                          << task.lastSecond << "\n";
+            } catch (const std::exception &ex) {
+                failed = true;
+                const std::lock_guard<std::mutex> lock(consoleMutex);
+                std::cerr << task.file << ": " << ex.what() << "\n";
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    const size_t workerCount = std::min<size_t>(jobs, tasks.size());
+    for (size_t w = 0; w < workerCount; ++w)
+        workers.emplace_back(worker);
+    for (auto &thread : workers)
+        thread.join();
+    if (failed) {
+        // No summary: an aggregator must not mistake this shard for finished.
+        std::cerr << "Some files failed; shard summary not written.\n";
+        return 1;
+    }
+
+    std::vector<BatchSummaryRow> rows;
+    for (auto &part : taskRows)
+        rows.insert(rows.end(), part.begin(), part.end());
+    try {
+        const std::string summaryPath = shardSummaryPath(outDir, shard);
+        writeBatchSummary(summaryPath, rows);
+        std::cout << "Wrote shard summary " << summaryPath << "\n";
+        if (shard.count == 1)
+            writeReport(outDir, 1);
+        else
+            std::cout << "Merge with: " << argv[0] << " --aggregate " << shard.count
+                      << " --out-dir " << outDir << "\n";
+        if (!statsPath.empty())
+            writeStatsJson(statsPath);
+    } catch (const std::exception &ex) {
+        std::cerr << ex.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
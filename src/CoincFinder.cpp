@@ -1,19 +1,47 @@
 // CoincFinder CLI driver. Reads singles from CSV/BIN, scans a delay range for
 // each detector pair, and writes per-second coincidence sweeps to disk.
 
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <cmath>
+#include <exception>
 #include <filesystem>
 #include <iostream>
 #include <limits>
+#include <map>
+#include <memory>
+#include <sstream>
 #include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "BoundedQueue.h"
+#include "ChannelPairs.h"
 #include "Coincidences.h"
+#include "FftCorrelation.h"
+#include "Instrumentation.h"
 #include "ReadCSV.h"
 #include "Singles.h"
+#include "SinglesCache.h"
+#include "SweepTensorFile.h"
 
 namespace {
 
+constexpr const char *kDefaultTensorPath = "Delay_Scan_Data/delay_scans.cfsweep";
+
+// Pipelined mode: seconds per group when --pipeline gives no count, groups
+// queued between the reader and the scan, and sweeps queued for the writer.
+constexpr int kDefaultPipelineSeconds = 4;
+constexpr size_t kPipelineQueueGroups = 2;
+constexpr size_t kPipelineWriterQueue = 1024;
+
 long long nsToPs(float ns) {
     return static_cast<long long>(
         std::llround(static_cast<double>(ns) * 1000.0));
@@ -40,18 +68,321 @@ bool clampRange(const std::map<int, Singles> &singlesMap, int &startSec,
     return startSec <= stopSec;
 }
 
+// One unit of scheduled work: a contiguous run of seconds for one pair.
+struct Tile {
+    size_t pair = 0;
+    int firstSec = 0;
+    int lastSec = 0;
+};
+
+// Aims for ~8 tiles per thread overall so dynamic scheduling can balance
+// uneven pairs, without making tiles so small that scheduling dominates.
+std::vector<Tile> buildTiles(size_t pairCount, int startSec, int stopSec,
+                             int threads) {
+    constexpr long long kTilesPerThread = 8;
+    const long long totalSeconds =
+        static_cast<long long>(stopSec) - startSec + 1;
+    const long long wantedTiles = std::max<long long>(1, threads) * kTilesPerThread;
+    const long long tilesPerPair = std::clamp<long long>(
+        (wantedTiles + static_cast<long long>(pairCount) - 1) /
+            std::max<long long>(1, static_cast<long long>(pairCount)),
+        1, totalSeconds);
+    const int secondsPerTile =
+        static_cast<int>((totalSeconds + tilesPerPair - 1) / tilesPerPair);
+
+    std::vector<Tile> tiles;
+    tiles.reserve(pairCount * static_cast<size_t>(tilesPerPair));
+    // Second-major order keeps the output roughly chronological and spreads
+    // the pairs of one second over different threads.
+    for (int first = startSec; first <= stopSec; first += secondsPerTile) {
+        const int last = static_cast<int>(
+            std::min<long long>(stopSec, static_cast<long long>(first) +
+                                             secondsPerTile - 1));
+        for (size_t p = 0; p < pairCount; ++p)
+            tiles.push_back({p, first, last});
+        if (last == stopSec)
+            break;
+    }
+    return tiles;
+}
+
+// Lock-free progress reporting: workers bump a relaxed counter, and whoever
+// crosses the next reporting threshold claims it with a CAS and prints. The
+// print guard is try-only, so no worker ever blocks on the console.
+class ProgressCounter {
+public:
+    explicit ProgressCounter(int total)
+        : total_(total), interval_(std::max(1, total / 100)),
+          nextReport_(std::max(1, total / 100)) {}
+
+    void advance() {
+        const int done = done_.fetch_add(1, std::memory_order_relaxed) + 1;
+        int next = nextReport_.load(std::memory_order_relaxed);
+        if (done < next)
+            return;
+        if (!nextReport_.compare_exchange_strong(next, done + interval_,
+                                                 std::memory_order_relaxed))
+            return;
+        if (printing_.test_and_set(std::memory_order_acquire))
+            return;
+        std::cout << "\rProcessing " << done << " / " << total_ << std::flush;
+        printing_.clear(std::memory_order_release);
+    }
+
+private:
+    const int total_;
+    const int interval_;
+    std::atomic<int> done_{0};
+    std::atomic<int> nextReport_;
+    std::atomic_flag printing_ = ATOMIC_FLAG_INIT;
+};
+
+std::string sweepFileName(int ch1, int ch2, int sec) {
+    return "Delay_Scan_Data/delay_scan_" + std::to_string(ch1) + "_vs_" +
+           std::to_string(ch2) + "_second_" + std::to_string(sec) + ".csv";
+}
+
+// Writer stage of the pipelined mode: per-second CSV sweeps are written from
+// a background thread, so scan workers only wait on the filesystem once it
+// falls `capacity` sweeps behind.
+class SweepFileWriter {
+public:
+    explicit SweepFileWriter(size_t capacity)
+        : queue_(capacity), worker_([this] {
+              while (auto sweep = queue_.pop())
+                  writeResultsToFile(sweep->second, sweep->first);
+          }) {}
+    ~SweepFileWriter() { finish(); }
+
+    SweepFileWriter(const SweepFileWriter &) = delete;
+    SweepFileWriter &operator=(const SweepFileWriter &) = delete;
+
+    void submit(std::string path, std::vector<std::pair<float, int>> results) {
+        queue_.push({std::move(path), std::move(results)});
+    }
+
+    // Drains the queue and joins the writer. Call from the owning thread.
+    void finish() {
+        queue_.close();
+        if (worker_.joinable())
+            worker_.join();
+    }
+
+private:
+    BoundedQueue<std::pair<std::string, std::vector<std::pair<float, int>>>> queue_;
+    std::thread worker_;
+};
+
+// Sweep parameters and result sinks shared by every tile scan.
+struct ScanContext {
+    long long coincWindow = 0;
+    long long delayStartPs = 0;
+    long long delayEndPs = 0;
+    long long delayStepPs = 0;
+    int startSec = 0; // second index 0 of the tensor
+    SweepTensorWriter *tensorWriter = nullptr;
+    SweepFileWriter *fileWriter = nullptr; // else CSVs are written in place
+};
+
+// Scans every second of `tile` for one pair; returns the sweeps produced.
+size_t scanTile(const Tile &tile, const std::pair<int, int> &pair,
+                const Singles &singles1, const Singles &singles2,
+                const ScanContext &ctx, ProgressCounter &progress,
+                std::vector<std::pair<float, int>> &results) {
+    size_t sweeps = 0;
+    for (int sec = tile.firstSec; sec <= tile.lastSec; ++sec) {
+        progress.advance();
+
+        const auto &events1 = eventsForSecond(singles1, sec);
+        if (events1.empty())
+            continue;
+
+        const auto &currentSecond = eventsForSecond(singles2, sec);
+        const auto &nextSecond = eventsForSecond(singles2, sec + 1);
+        if (currentSecond.empty() && nextSecond.empty())
+            continue;
+
+        // Include the first event from the next second so cross-second
+        // coincidences survive (a segmented view, no copy of the bucket).
+        const SegmentedSpan channel2Span =
+            withNextFirstEvent(currentSecond, nextSecond);
+        if (channel2Span.empty())
+            continue;
+
+        const std::span<const long long> channel1Span(events1.data(),
+                                                      events1.size());
+
+        results.clear();
+        computeCoincidencesForRange(channel1Span, channel2Span, ctx.coincWindow,
+                                    ctx.delayStartPs, ctx.delayEndPs,
+                                    ctx.delayStepPs, results);
+        if (ctx.tensorWriter) {
+            std::vector<int32_t> counts(results.size());
+            for (size_t k = 0; k < results.size(); ++k)
+                counts[k] = results[k].second;
+            ctx.tensorWriter->submit(tile.pair,
+                                     static_cast<size_t>(sec - ctx.startSec),
+                                     std::move(counts));
+        } else if (ctx.fileWriter) {
+            ctx.fileWriter->submit(sweepFileName(pair.first, pair.second, sec),
+                                   std::move(results));
+        } else {
+            writeResultsToFile(results,
+                               sweepFileName(pair.first, pair.second, sec));
+        }
+        ++sweeps;
+    }
+    return sweeps;
+}
+
+// Runs `tiles` on the OpenMP team. Pairs with a channel missing from
+// `singlesMap` only advance the progress counter. An exception may not leave
+// the parallel region, so the first one is kept, the remaining tiles are
+// skipped and it is rethrown once the team has finished.
+void scanTiles(const std::vector<Tile> &tiles,
+               const std::vector<std::pair<int, int>> &pairs,
+               const std::map<int, Singles> &singlesMap, const ScanContext &ctx,
+               ProgressCounter &progress, std::vector<size_t> &filesWritten) {
+    std::exception_ptr error;
+    std::atomic<bool> failed{false};
+#pragma omp parallel
+    {
+        // Per-thread scratch reused across every tile this thread picks up.
+        std::vector<std::pair<float, int>> results;
+
+#pragma omp for schedule(dynamic, 1)
+        for (int t = 0; t < static_cast<int>(tiles.size()); ++t) {
+            if (failed.load(std::memory_order_relaxed))
+                continue;
+            const Tile &tile = tiles[static_cast<size_t>(t)];
+            const auto &pair = pairs[tile.pair];
+            const auto it1 = singlesMap.find(pair.first);
+            const auto it2 = singlesMap.find(pair.second);
+            if (it1 == singlesMap.end() || it2 == singlesMap.end()) {
+                for (int sec = tile.firstSec; sec <= tile.lastSec; ++sec)
+                    progress.advance();
+                continue;
+            }
+            try {
+                const size_t tileFiles = scanTile(tile, pair, it1->second, it2->second,
+                                                  ctx, progress, results);
+
+#pragma omp atomic
+                filesWritten[tile.pair] += tileFiles;
+            } catch (...) {
+#pragma omp critical(coincfinder_scan_error)
+                if (!error)
+                    error = std::current_exception();
+                failed.store(true, std::memory_order_relaxed);
+            }
+        }
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
+
+// A run of consecutive seconds handed from the reader stage to the scan
+// stage. Each channel also carries the first event of second `lastSec + 1`
+// as a one-event bucket, so the last second of the group keeps its boundary
+// coincidences without waiting for the next group.
+struct SecondGroup {
+    int firstSec = 0;
+    int lastSec = 0;
+    bool lastGroup = false; // its lookahead bucket is complete (see attachLookahead)
+    std::map<int, Singles> singles;
+};
+
+// Appends bucket `group.lastSec + 1` of `following` to `group`: only its
+// first event, or the whole bucket with `wholeBucket` (the run's final
+// lookahead, which the singles summary also counts).
+void attachLookahead(SecondGroup &group, const std::map<int, Singles> &following,
+                     bool wholeBucket) {
+    const long long next = static_cast<long long>(group.lastSec) + 1;
+    for (const auto &[ch, singles] : following) {
+        const auto &bucket = eventsForSecond(singles, next);
+        if (bucket.empty())
+            continue;
+        Singles &dst = group.singles[ch];
+        dst.channel = ch;
+        std::vector<Timestamp> &slot = ensureSecond(dst, next);
+        if (wholeBucket)
+            slot = bucket;
+        else
+            slot.assign(1, bucket.front());
+    }
+}
+
+// Events per second on channels 1..8 for the closing summary, over the
+// loaded seconds only; row `r` is second `firstSec + r`.
+struct SinglesTable {
+    long long firstSec = 0;
+    std::vector<std::array<size_t, 8>> rows;
+};
+
+// Records the buckets `firstSec..lastSec` of `singlesMap` in `table`.
+void tallySingles(SinglesTable &table, const std::map<int, Singles> &singlesMap,
+                  long long firstSec, long long lastSec) {
+    firstSec = std::max(firstSec, table.firstSec);
+    for (const auto &[ch, s] : singlesMap) {
+        const long long last = std::min(
+            lastSec, s.baseSecond + static_cast<long long>(s.eventsPerSecond.size()) - 1);
+        for (long long sec = std::max(firstSec, s.baseSecond); sec <= last; ++sec) {
+            const size_t count = eventsForSecond(s, sec).size();
+            if (count == 0)
+                continue;
+            const auto row = static_cast<size_t>(sec - table.firstSec);
+            if (table.rows.size() <= row)
+                table.rows.resize(row + 1, {});
+            if (ch >= 1 && ch <= 8)
+                table.rows[row][static_cast<size_t>(ch - 1)] = count;
+        }
+    }
+}
+
+// Per-second singles table. Built in one buffer and written once: a capture
+// of many hours would otherwise cost one console write per second.
+void printSinglesPerSecond(const SinglesTable &table) {
+    COINCFINDER_TIME_SCOPE("report");
+    std::ostringstream text;
+    text << "\nSingles per second:\nSecond";
+    for (int ch = 1; ch <= 8; ++ch)
+        text << "\tch" << ch;
+    text << "\n";
+    const size_t rows = std::max<size_t>(table.rows.size(), 1);
+    for (size_t row = 0; row < rows; ++row) {
+        text << table.firstSec + static_cast<long long>(row);
+        for (size_t ch = 0; ch < 8; ++ch)
+            text << "\t" << (row < table.rows.size() ? table.rows[row][ch] : 0);
+        text << "\n";
+    }
+    std::cout << text.str();
+}
+
 } // namespace
 
 void print_help(const char *exe) {
     std::cout
         << "CoincFinder - delay scan and histogram exporter\n"
         << "Usage: " << exe
-        << " <csv|bin> <coinc_window_ps> <delay_start_ns> <delay_end_ns> <delay_step_ns> <startSec> <stopSec>\n"
+        << " <csv|bin> <coinc_window_ps> <delay_start_ns> <delay_end_ns> <delay_step_ns> <startSec> <stopSec> [--tensor [file]] [--engine auto|direct|fft] [--pairs 1-5,2-6,...] [--cache] [--pipeline [seconds]] [--stats [file]]\n"
         << "Example: " << exe << " data.bin 250 8 12 0.01 0 600\n\n"
         << "Outputs:\n"
         << "  Delay_Scan_Data/delay_scan_<ch1>_vs_<ch2>_second_<sec>.csv\n"
+        << "  or, with --tensor, a single pair x second x delay int32 tensor\n"
+        << "  (default " << kDefaultTensorPath << ", see SweepTensorFile.h)\n"
+        << "  --engine picks the delay-scan engine (default auto: binned FFT\n"
+        << "  correlation only when estimated cheaper, see FftCorrelation.h)\n"
+        << "  --pairs replaces the default pairs (1-5,2-6,3-7,4-8,1-6,2-5,3-8,4-7)\n"
+        << "  --cache reads through <input>.cfcache, written on the first run\n"
+        << "  (only the requested seconds are loaded, see SinglesCache.h)\n"
+        << "  --pipeline overlaps reading, scanning and writing: groups of seconds\n"
+        << "  (default " << kDefaultPipelineSeconds << ") flow through bounded queues, so memory stays at a\n"
+        << "  few groups whatever the capture length (all pairs are kept)\n"
+        << "  --stats prints stage timings and counters as JSON to stderr, or to\n"
+        << "  the given file (see Instrumentation.h)\n"
         << "Notes:\n"
         << "  - <startSec>/<stopSec> are clamped to available data seconds.\n"
+        << "  - The closing singles table lists seconds startSec..stopSec+1 only.\n"
         << "  - delay_* in nanoseconds; window in picoseconds.\n";
 }
 
@@ -69,6 +400,57 @@ int main(int argc, char *argv[]) {
   int startSec = std::atoi(argv[6]);
   int stopSec = std::atoi(argv[7]);
 
+  std::string tensorPath;
+  std::vector<std::pair<int, int>> requestedPairs;
+  bool useCache = false;
+  std::string statsPath;
+  int pipelineSeconds = 0;
+  for (int a = 8; a < argc; ++a) {
+    const std::string arg = argv[a];
+    if (arg == "--cache") {
+      useCache = true;
+    } else if (arg == "--pipeline") {
+      const bool hasValue =
+          a + 1 < argc && !std::string_view(argv[a + 1]).starts_with("--");
+      pipelineSeconds = hasValue ? std::atoi(argv[++a]) : kDefaultPipelineSeconds;
+      if (pipelineSeconds <= 0) {
+        std::cerr << "--pipeline needs a positive number of seconds.\n";
+        return 1;
+      }
+    } else if (arg == "--stats") {
+      const bool hasValue =
+          a + 1 < argc && !std::string_view(argv[a + 1]).starts_with("--");
+      statsPath = hasValue ? argv[++a] : "-";
+    } else if (arg == "--tensor") {
+      const bool hasValue =
+          a + 1 < argc && !std::string_view(argv[a + 1]).starts_with("--");
+      tensorPath = hasValue ? argv[++a] : kDefaultTensorPath;
+    } else if (arg == "--pairs" && a + 1 < argc) {
+      try {
+        requestedPairs = parseChannelPairs(argv[++a]);
+      } catch (const std::exception &ex) {
+        std::cerr << ex.what() << "\n";
+        return 1;
+      }
+    } else if (arg == "--engine" && a + 1 < argc) {
+      const std::string value = argv[++a];
+      if (value == "auto") {
+        setDelayScanEngine(DelayScanEngine::Auto);
+      } else if (value == "direct") {
+        setDelayScanEngine(DelayScanEngine::Direct);
+      } else if (value == "fft") {
+        setDelayScanEngine(DelayScanEngine::Fft);
+      } else {
+        std::cerr << "Unknown engine: " << value << "\n";
+        return 1;
+      }
+    } else {
+      std::cerr << "Unknown option: " << arg << "\n";
+      print_help(argv[0]);
+      return 1;
+    }
+  }
+
   if (coincWindow <= 0) {
     std::cerr << "Coincidence window must be positive.\n";
     return 1;
@@ -98,12 +480,49 @@ int main(int argc, char *argv[]) {
     return 1;
   }
 
+  const auto loadSeconds = [&](long long first, long long last,
+                               double &duration) {
+    return useCache ? readFileCached(csvFilename, duration, first, last)
+                    : readFileAuto(csvFilename, duration, -1.0, first, last);
+  };
+
   std::cout << "Reading " << csvFilename << "...\n";
   double duration_sec = 0.0;
-  auto singlesMap = readFileAuto(csvFilename, duration_sec);
+  std::map<int, Singles> singlesMap;
+  SecondGroup firstGroup;
+  if (pipelineSeconds > 0) {
+    // Only the first group is read up front; it also reports the capture's
+    // duration, whose last bucket bounds the run as clampRange would.
+    firstGroup.firstSec = startSec;
+    firstGroup.lastSec = static_cast<int>(std::min<long long>(
+        stopSec, static_cast<long long>(startSec) + pipelineSeconds - 1));
+    firstGroup.singles =
+        loadSeconds(firstGroup.firstSec, firstGroup.lastSec, duration_sec);
+    const long long widthPs = firstGroup.singles.empty()
+                                  ? bucketWidthForExposure(-1.0)
+                                  : firstGroup.singles.begin()->second.bucketWidthPs;
+    const auto captureLast =
+        static_cast<long long>(duration_sec * static_cast<double>(kDefaultBucketWidthPs) /
+                               static_cast<double>(widthPs));
+    stopSec = static_cast<int>(std::min<long long>(stopSec, captureLast));
+    long long earliestSec = std::numeric_limits<long long>::max();
+    for (const auto &[ch, singles] : firstGroup.singles)
+      if (!singles.eventsPerSecond.empty())
+        earliestSec = std::min(earliestSec, singles.baseSecond);
+    if (earliestSec <= firstGroup.lastSec)
+      startSec = static_cast<int>(std::max<long long>(startSec, earliestSec));
+    firstGroup.firstSec = startSec;
+    firstGroup.lastSec = std::min(firstGroup.lastSec, stopSec);
+  } else {
+    // Only the requested seconds are loaded, plus one bucket past stopSec for
+    // the boundary lookahead.
+    const long long lastBucket = static_cast<long long>(stopSec) + 1;
+    singlesMap = loadSeconds(startSec, lastBucket, duration_sec);
+  }
   std::cout << "Measurement duration: " << duration_sec << " seconds\n";
 
-  if (!clampRange(singlesMap, startSec, stopSec)) {
+  if (pipelineSeconds > 0 ? startSec > stopSec
+                          : !clampRange(singlesMap, startSec, stopSec)) {
     std::cerr << "No singles data found or requested range empty.\n";
     return 1;
   }
@@ -130,12 +549,17 @@ int main(int argc, char *argv[]) {
       {3, 8}, // D-A
       {4, 7}  // A-D
   };
+  if (!requestedPairs.empty())
+    coincidencePairs = requestedPairs;
 
   // Build the subset of pairs that actually have data (avoids futile work).
+  // The pipelined mode cannot know that before reading everything, so it
+  // keeps every pair; one without data simply produces no sweeps.
   std::vector<std::pair<int, int>> activePairs;
   activePairs.reserve(coincidencePairs.size());
   for (const auto &pair : coincidencePairs) {
-    if (singlesMap.count(pair.first) && singlesMap.count(pair.second)) {
+    if (pipelineSeconds > 0 ||
+        (singlesMap.count(pair.first) && singlesMap.count(pair.second))) {
       activePairs.push_back(pair);
     } else {
       std::cout << "Skipping ch" << pair.first << "-ch" << pair.second
@@ -150,91 +574,157 @@ int main(int argc, char *argv[]) {
   // Progress bar cuzz why not
   const int totalSeconds = stopSec - startSec + 1;
   const int totalJobs = static_cast<int>(activePairs.size()) * totalSeconds;
-  std::atomic<int> jobsDone{0};
-
-#pragma omp parallel for
-  for (int p = 0; p < static_cast<int>(activePairs.size()); ++p) {
-    const int ch1 = activePairs[static_cast<size_t>(p)].first;
-    const int ch2 = activePairs[static_cast<size_t>(p)].second;
-    const Singles &singles1 = singlesMap.at(ch1);
-    const Singles &singles2 = singlesMap.at(ch2);
-
-    std::vector<long long> mergedEvents;
-    std::vector<std::pair<float, int>> results;
-    size_t filesWritten = 0;
-    for (int sec = startSec; sec <= stopSec; ++sec) {
-
-      const auto &events1 = eventsForSecond(singles1, sec);
-      if (events1.empty())
-        continue;
-
-      const auto &currentSecond = eventsForSecond(singles2, sec);
-      const auto &nextSecond = eventsForSecond(singles2, sec + 1);
-      if (currentSecond.empty() && nextSecond.empty())
-        continue;
-
-      // Include the first event from the next second so cross-second
-      // coincidences survive
-      const std::span<const long long> channel2Span =
-          appendNextFirstEvent(currentSecond, nextSecond, mergedEvents);
-      if (channel2Span.empty())
-        continue;
-
-      const std::span<const long long> channel1Span(events1.data(),
-                                                    events1.size());
-
-      std::string outFile = "Delay_Scan_Data/delay_scan_" +
-                            std::to_string(ch1) + "_vs_" + std::to_string(ch2) +
-                            "_second_" + std::to_string(sec) + ".csv";
-
-      results.clear();
-      computeCoincidencesForRange(channel1Span, channel2Span, coincWindow,
-                                  delayStartPs, delayEndPs, delayStepPs,
-                                  results);
-      writeResultsToFile(results, outFile);
-      ++filesWritten;
-
-      int done = ++jobsDone;
-      if (done == totalJobs || done % 50 == 0) {
-#pragma omp critical
-        std::cout << "\rProcessing " << done << " / " << totalJobs
-                  << std::flush;
+  ProgressCounter progress(totalJobs);
+
+  // Work is split into (pair, second-range) tiles so every core has
+  // something to do even with few pairs, and dynamic scheduling lets idle
+  // threads pick up whatever a slow pair leaves behind.
+  int threads = 1;
+#ifdef _OPENMP
+  threads = std::max(1, omp_get_max_threads());
+#endif
+  std::vector<size_t> filesWritten(activePairs.size(), 0);
+
+  // Tensor mode: scan threads hand finished sweeps to one writer thread that
+  // places them at fixed offsets in a preallocated file.
+  std::unique_ptr<SweepTensorWriter> tensorWriter;
+  if (!tensorPath.empty()) {
+    SweepTensorHeader header;
+    header.pairs = activePairs;
+    header.secondCount = static_cast<uint32_t>(totalSeconds);
+    header.delayBins =
+        static_cast<uint32_t>((delayEndPs - delayStartPs) / delayStepPs + 1);
+    header.startSec = startSec;
+    header.delayStartPs = delayStartPs;
+    header.delayStepPs = delayStepPs;
+    header.coincWindowPs = coincWindow;
+    try {
+      tensorWriter =
+          std::make_unique<SweepTensorWriter>(tensorPath, std::move(header));
+    } catch (const std::exception &ex) {
+      std::cerr << ex.what() << "\n";
+      return 1;
+    }
+  }
+
+  ScanContext ctx;
+  ctx.coincWindow = coincWindow;
+  ctx.delayStartPs = delayStartPs;
+  ctx.delayEndPs = delayEndPs;
+  ctx.delayStepPs = delayStepPs;
+  ctx.startSec = startSec;
+  ctx.tensorWriter = tensorWriter.get();
+  // Only the scanned seconds and their lookahead bucket are loaded, so the
+  // table covers startSec..stopSec + 1 rather than the whole capture.
+  SinglesTable singlesTable;
+  singlesTable.firstSec = startSec;
+
+  std::exception_ptr runError;
+  if (pipelineSeconds == 0) {
+    try {
+      scanTiles(buildTiles(activePairs.size(), startSec, stopSec, threads),
+                activePairs, singlesMap, ctx, progress, filesWritten);
+      tallySingles(singlesTable, singlesMap, startSec, stopSec + 1LL);
+    } catch (...) {
+      runError = std::current_exception();
+    }
+  } else {
+    // Reader -> scan -> writer. The reader holds each group until the next
+    // one is loaded (for its lookahead), so at most kPipelineQueueGroups + 3
+    // groups are resident: queued, held, loading and being scanned.
+    std::unique_ptr<SweepFileWriter> fileWriter;
+    if (!tensorWriter) {
+      fileWriter = std::make_unique<SweepFileWriter>(kPipelineWriterQueue);
+      ctx.fileWriter = fileWriter.get();
+    }
+    BoundedQueue<SecondGroup> groups(kPipelineQueueGroups);
+    std::exception_ptr readError;
+    std::thread reader([&] {
+      try {
+        SecondGroup pending = std::move(firstGroup);
+        while (pending.lastSec < stopSec) {
+          SecondGroup next;
+          next.firstSec = pending.lastSec + 1;
+          next.lastSec = static_cast<int>(std::min<long long>(
+              stopSec, static_cast<long long>(next.firstSec) + pipelineSeconds - 1));
+          double duration = 0.0;
+          next.singles = loadSeconds(next.firstSec, next.lastSec, duration);
+          attachLookahead(pending, next.singles, false);
+          if (!groups.push(std::move(pending)))
+            return; // the scan stage stopped early
+          pending = std::move(next);
+        }
+        double duration = 0.0;
+        attachLookahead(pending,
+                        loadSeconds(static_cast<long long>(stopSec) + 1,
+                                    static_cast<long long>(stopSec) + 1, duration),
+                        true);
+        pending.lastGroup = true;
+        groups.push(std::move(pending));
+      } catch (...) {
+        readError = std::current_exception();
+      }
+      groups.close();
+    });
+
+    // Every exit from the scan loop closes the queue, which releases a
+    // reader blocked in push, and joins it: unwinding past a joinable thread
+    // would terminate.
+    try {
+      while (auto group = groups.pop()) {
+        scanTiles(buildTiles(activePairs.size(), group->firstSec, group->lastSec,
+                             threads),
+                  activePairs, group->singles, ctx, progress, filesWritten);
+        tallySingles(singlesTable, group->singles, group->firstSec,
+                     group->lastGroup ? group->lastSec + 1LL : group->lastSec);
       }
+    } catch (...) {
+      runError = std::current_exception();
+    }
+    groups.close();
+    reader.join();
+    if (fileWriter)
+      fileWriter->finish();
+    if (!runError)
+      runError = readError;
+  }
+  if (runError) {
+    try {
+      std::rethrow_exception(runError);
+    } catch (const std::exception &ex) {
+      std::cerr << "\n" << ex.what() << "\n";
+      return 1;
     }
+  }
 
-#pragma omp critical
-    std::cout << "Finished ch" << ch1 << " vs ch" << ch2 << " (" << filesWritten
-              << " seconds)\n";
+  if (tensorWriter) {
+    try {
+      tensorWriter->finish();
+    } catch (const std::exception &ex) {
+      std::cerr << "\n" << ex.what() << "\n";
+      return 1;
+    }
   }
 
   if (totalJobs > 0) {
     std::cout << "\rProcessing " << totalJobs << " / " << totalJobs
               << " (done)\n";
   }
+  if (tensorWriter)
+    std::cout << "Wrote sweep tensor " << tensorPath << "\n";
+  for (size_t p = 0; p < activePairs.size(); ++p)
+    std::cout << "Finished ch" << activePairs[p].first << " vs ch"
+              << activePairs[p].second << " (" << filesWritten[p]
+              << " seconds)\n";
 
-  std::cout << "\nSingles per second:\n";
-  std::cout << "Second";
-  for (int ch = 1; ch <= 8; ++ch)
-    std::cout << "\tch" << ch;
-  std::cout << "\n";
-
-  long long maxSec = 0;
-  for (auto &[ch, s] : singlesMap)
-    if (!s.eventsPerSecond.empty()) {
-      long long lastSecond =
-          s.baseSecond + static_cast<long long>(s.eventsPerSecond.size()) - 1;
-      maxSec = std::max(maxSec, lastSecond);
-    }
-
-  for (long long sec = 0; sec <= maxSec; ++sec) {
-    std::cout << sec;
-    for (int ch = 1; ch <= 8; ++ch) {
-      long long count = 0;
-      if (singlesMap.count(ch))
-        count = eventsForSecond(singlesMap.at(ch), sec).size();
-      std::cout << "\t" << count;
+  printSinglesPerSecond(singlesTable);
+  if (!statsPath.empty()) {
+    try {
+      writeStatsJson(statsPath);
+    } catch (const std::exception &ex) {
+      std::cerr << ex.what() << "\n";
+      return 1;
     }
-    std::cout << "\n";
   }
   std::cout << "All done.\n";
   return 0;
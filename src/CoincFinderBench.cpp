@@ -0,0 +1,374 @@
+// Throughput benchmark for the core kernels and readers. Channels are
+// synthetic: independent Poisson singles plus a fraction of channel-1 events
+// echoed on every other channel at a fixed delay with Gaussian jitter, which
+// is what a pair source on a tagger looks like. Every benchmark reports the
+// median of several runs as JSON on stdout, so results can be diffed across
+// compilers and releases; progress goes to stderr.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "CoincidenceKernels.h"
+#include "Coincidences.h"
+#include "CompactSingles.h"
+#include "FftCorrelation.h"
+#include "ReadCSV.h"
+
+namespace {
+constexpr double kPicosecondsPerSecond = 1e12;
+
+struct BenchConfig {
+    double rateHz = 200'000;      // singles rate per channel
+    double pairFraction = 0.2;    // channel-1 events echoed on the others
+    double seconds = 2.0;         // simulated capture length
+    int channels = 4;             // detector channels 1..channels
+    long long windowPs = 250;
+    long long delayPs = 9'000;    // ch1 - delay ~ chN for echoed events
+    long long jitterPs = 50;      // sigma of the echo timing
+    long long delayStartPs = 7'000;
+    long long delayEndPs = 11'000;
+    long long delayStepPs = 10;
+    int repeat = 5;
+    uint64_t seed = 1;
+    std::string filter;           // run only benchmarks containing this
+};
+
+struct BenchResult {
+    std::string name;
+    size_t events = 0;      // events consumed per run
+    double seconds = 0.0;   // median wall time per run
+    long long checksum = 0; // keeps the work observable
+};
+
+// Sorted channels 1..config.channels (index 0 is channel 1).
+std::vector<std::vector<Timestamp>> generateChannels(const BenchConfig &config) {
+    std::mt19937_64 rng(config.seed);
+    const double spanPs = config.seconds * kPicosecondsPerSecond;
+    const auto poisson = [&](double rateHz) {
+        std::vector<Timestamp> events;
+        if (rateHz <= 0)
+            return events;
+        events.reserve(static_cast<size_t>(rateHz * config.seconds * 1.1));
+        std::exponential_distribution<double> gap(rateHz / kPicosecondsPerSecond);
+        // Offset from zero so echoes at -delay stay positive.
+        for (double t = 1e6 + gap(rng); t < spanPs; t += gap(rng))
+            events.push_back(static_cast<Timestamp>(t));
+        return events;
+    };
+
+    std::vector<std::vector<Timestamp>> channels;
+    channels.push_back(poisson(config.rateHz));
+    std::bernoulli_distribution echoed(config.pairFraction);
+    std::normal_distribution<double> jitter(0.0, static_cast<double>(config.jitterPs));
+    for (int c = 1; c < config.channels; ++c) {
+        std::vector<Timestamp> events =
+            poisson(config.rateHz * (1.0 - config.pairFraction));
+        for (const Timestamp t : channels.front())
+            if (echoed(rng))
+                events.push_back(t - config.delayPs +
+                                 static_cast<Timestamp>(std::llround(jitter(rng))));
+        std::sort(events.begin(), events.end());
+        channels.push_back(std::move(events));
+    }
+    return channels;
+}
+
+// All channels merged in time order as (timestamp, 0-based channel).
+std::vector<std::pair<Timestamp, uint16_t>>
+mergedRecords(const std::vector<std::vector<Timestamp>> &channels) {
+    std::vector<std::pair<Timestamp, uint16_t>> records;
+    for (size_t c = 0; c < channels.size(); ++c)
+        for (const Timestamp t : channels[c])
+            records.emplace_back(t, static_cast<uint16_t>(c));
+    std::sort(records.begin(), records.end());
+    return records;
+}
+
+void writeBin(const std::filesystem::path &path,
+              const std::vector<std::pair<Timestamp, uint16_t>> &records) {
+    std::ofstream out(path, std::ios::binary);
+    const char header[40] = {};
+    out.write(header, sizeof(header));
+    for (const auto &[ts, ch] : records) {
+        const auto raw = static_cast<uint64_t>(ts);
+        out.write(reinterpret_cast<const char *>(&raw), sizeof(raw));
+        out.write(reinterpret_cast<const char *>(&ch), sizeof(ch));
+    }
+    if (!out)
+        throw std::runtime_error("failed to write " + path.string());
+}
+
+void writeCsv(const std::filesystem::path &path,
+              const std::vector<std::pair<Timestamp, uint16_t>> &records) {
+    std::ofstream out(path);
+    out << "timestamp,channel\n";
+    for (const auto &[ts, ch] : records)
+        out << ts << ',' << ch + 1 << '\n';
+    if (!out)
+        throw std::runtime_error("failed to write " + path.string());
+}
+
+// Runs `body` config.repeat times and keeps the median wall time.
+BenchResult measure(const BenchConfig &config, const std::string &name,
+                    size_t events, const std::function<long long()> &body) {
+    std::vector<double> times;
+    BenchResult result{name, events, 0.0, 0};
+    for (int r = 0; r < config.repeat; ++r) {
+        const auto start = std::chrono::steady_clock::now();
+        result.checksum = body();
+        const auto stop = std::chrono::steady_clock::now();
+        times.push_back(std::chrono::duration<double>(stop - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    result.seconds = times[times.size() / 2];
+    std::cerr << name << ": " << result.seconds * 1e3 << " ms\n";
+    return result;
+}
+
+std::string compilerName() {
+#if defined(__clang__)
+    return "clang " __clang_version__;
+#elif defined(__GNUC__)
+    return "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+    return "msvc " + std::to_string(_MSC_VER);
+#else
+    return "unknown";
+#endif
+}
+
+// Names and versions are plain ASCII; only quotes and backslashes need care.
+std::string jsonString(const std::string &text) {
+    std::string out = "\"";
+    for (const char ch : text) {
+        if (ch == '"' || ch == '\\')
+            out.push_back('\\');
+        out.push_back(ch);
+    }
+    return out + "\"";
+}
+
+void writeJson(std::ostream &out, const BenchConfig &config,
+               const std::vector<BenchResult> &results) {
+    out << "{\n  \"compiler\": " << jsonString(compilerName())
+        << ",\n  \"kernel\": "
+        << jsonString(coincidenceKernelName(activeCoincidenceKernel()))
+        << ",\n  \"config\": {\"rate_hz\": " << config.rateHz
+        << ", \"pair_fraction\": " << config.pairFraction
+        << ", \"seconds\": " << config.seconds
+        << ", \"channels\": " << config.channels
+        << ", \"window_ps\": " << config.windowPs
+        << ", \"delay_ps\": " << config.delayPs
+        << ", \"jitter_ps\": " << config.jitterPs
+        << ", \"delay_start_ps\": " << config.delayStartPs
+        << ", \"delay_end_ps\": " << config.delayEndPs
+        << ", \"delay_step_ps\": " << config.delayStepPs
+        << ", \"repeat\": " << config.repeat << ", \"seed\": " << config.seed
+        << "},\n  \"results\": [";
+    for (size_t k = 0; k < results.size(); ++k) {
+        const BenchResult &r = results[k];
+        const double eventsPerSecond =
+            r.seconds > 0 ? static_cast<double>(r.events) / r.seconds : 0.0;
+        const double nsPerEvent =
+            r.events > 0 ? r.seconds * 1e9 / static_cast<double>(r.events) : 0.0;
+        out << (k == 0 ? "\n" : ",\n") << "    {\"name\": " << jsonString(r.name)
+            << ", \"events\": " << r.events << ", \"seconds\": " << r.seconds
+            << ", \"events_per_s\": " << eventsPerSecond
+            << ", \"ns_per_event\": " << nsPerEvent
+            << ", \"checksum\": " << r.checksum << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+std::vector<BenchResult> runBenchmarks(const BenchConfig &config) {
+    const auto channels = generateChannels(config);
+    const std::span<const long long> ch1(channels[0]);
+    const std::span<const long long> ch2(channels[1]);
+    const size_t pairEvents = ch1.size() + ch2.size();
+    size_t allEvents = 0;
+    for (const auto &c : channels)
+        allEvents += c.size();
+
+    std::vector<BenchResult> results;
+    const auto wanted = [&](const std::string &name) {
+        return config.filter.empty() || name.find(config.filter) != std::string::npos;
+    };
+    const auto run = [&](const std::string &name, size_t events,
+                         const std::function<long long()> &body) {
+        if (wanted(name))
+            results.push_back(measure(config, name, events, body));
+    };
+
+    run("count_coincidences_with_delay", pairEvents, [&] {
+        return countCoincidencesWithDelay(ch1, ch2, config.windowPs, config.delayPs);
+    });
+
+    FlatSingles flat1;
+    FlatSingles flat2;
+    flat1.timestamps = channels[0];
+    flat1.bucketOffsets = {0, flat1.timestamps.size()};
+    flat2.timestamps = channels[1];
+    flat2.bucketOffsets = {0, flat2.timestamps.size()};
+    const CompactSingles compact1 = compactSingles(flat1);
+    const CompactSingles compact2 = compactSingles(flat2);
+    run("count_coincidences_compact", pairEvents, [&] {
+        return countCoincidencesWithDelay(CompactSpan{&compact1, 0, compact1.size()},
+                                          CompactSpan{&compact2, 0, compact2.size()},
+                                          config.windowPs, config.delayPs);
+    });
+
+    // Direct engine only: what the FFT engine costs depends on the bin
+    // occupancy rather than on the event count.
+    std::vector<std::pair<float, int>> histogram;
+    run("compute_coincidences_for_range", pairEvents, [&] {
+        setDelayScanEngine(DelayScanEngine::Direct);
+        computeCoincidencesForRange(ch1, ch2, config.windowPs, config.delayStartPs,
+                                    config.delayEndPs, config.delayStepPs,
+                                    histogram);
+        setDelayScanEngine(DelayScanEngine::Auto);
+        long long total = 0;
+        for (const auto &bin : histogram)
+            total += bin.second;
+        return total;
+    });
+
+    std::vector<std::span<const long long>> spans(channels.begin(), channels.end());
+    std::vector<long long> offsets(channels.size(), config.delayPs);
+    offsets[0] = 0;
+    run("count_nfold_coincidences", allEvents, [&] {
+        return countNFoldCoincidences(spans, config.windowPs, offsets);
+    });
+
+    if (wanted("read_")) {
+        const auto records = mergedRecords(channels);
+        const auto dir = std::filesystem::temp_directory_path();
+        const auto binPath = dir / "coincfinder_bench.bin";
+        const auto csvPath = dir / "coincfinder_bench.csv";
+        writeBin(binPath, records);
+        writeCsv(csvPath, records);
+        const auto read = [&](const std::filesystem::path &path, auto reader) {
+            return [&, path, reader] {
+                double duration = 0.0;
+                long long total = 0;
+                for (const auto &[ch, s] : reader(path.string(), duration))
+                    for (const auto &bucket : s.eventsPerSecond)
+                        total += static_cast<long long>(bucket.size());
+                return total;
+            };
+        };
+        run("read_bin", records.size(), read(binPath, readBINtoSingles));
+        run("read_bin_stream", records.size(),
+            read(binPath, readBINStreamToSingles));
+        run("read_csv", records.size(), read(csvPath, readCSVtoSingles));
+        run("read_csv_parallel", records.size(),
+            read(csvPath, readCSVtoSinglesParallel));
+        std::filesystem::remove(binPath);
+        std::filesystem::remove(csvPath);
+    }
+    return results;
+}
+} // namespace
+
+void print_help(const char *exe) {
+    std::cout
+        << "coincfinder_bench - kernel and reader throughput on synthetic data\n"
+        << "Usage: " << exe << " [options]\n"
+        << "  --rate HZ          singles rate per channel (default 200000)\n"
+        << "  --pair-fraction F  channel-1 events echoed on the others (0.2)\n"
+        << "  --seconds S        simulated capture length (2)\n"
+        << "  --channels N       detector channels, 2..8 (4)\n"
+        << "  --window PS        coincidence window (250)\n"
+        << "  --delay PS         delay of the echoed events (9000)\n"
+        << "  --jitter PS        sigma of the echo timing (50)\n"
+        << "  --range START END STEP  delay scan in ps (7000 11000 10)\n"
+        << "  --repeat N         runs per benchmark, median reported (5)\n"
+        << "  --seed N           generator seed (1)\n"
+        << "  --filter TEXT      only benchmarks whose name contains TEXT\n"
+        << "  --output FILE      write the JSON report to FILE instead of stdout\n";
+}
+
+int main(int argc, char *argv[]) {
+  BenchConfig config;
+  std::string outputPath;
+  try {
+    for (int a = 1; a < argc; ++a) {
+      const std::string arg = argv[a];
+      const auto value = [&]() -> std::string {
+        if (a + 1 >= argc)
+          throw std::invalid_argument("missing value for " + arg);
+        return argv[++a];
+      };
+      if (arg == "--rate") {
+        config.rateHz = std::stod(value());
+      } else if (arg == "--pair-fraction") {
+        config.pairFraction = std::stod(value());
+      } else if (arg == "--seconds") {
+        config.seconds = std::stod(value());
+      } else if (arg == "--channels") {
+        config.channels = std::stoi(value());
+      } else if (arg == "--window") {
+        config.windowPs = std::stoll(value());
+      } else if (arg == "--delay") {
+        config.delayPs = std::stoll(value());
+      } else if (arg == "--jitter") {
+        config.jitterPs = std::stoll(value());
+      } else if (arg == "--range") {
+        config.delayStartPs = std::stoll(value());
+        config.delayEndPs = std::stoll(value());
+        config.delayStepPs = std::stoll(value());
+      } else if (arg == "--repeat") {
+        config.repeat = std::stoi(value());
+      } else if (arg == "--seed") {
+        config.seed = std::stoull(value());
+      } else if (arg == "--filter") {
+        config.filter = value();
+      } else if (arg == "--output") {
+        outputPath = value();
+      } else if (arg == "--help" || arg == "-h") {
+        print_help(argv[0]);
+        return 0;
+      } else {
+        throw std::invalid_argument("unknown option: " + arg);
+      }
+    }
+    if (config.channels < 2 || config.channels > 8)
+      throw std::invalid_argument("--channels must be between 2 and 8");
+    if (config.rateHz <= 0 || config.seconds <= 0 || config.repeat <= 0)
+      throw std::invalid_argument("--rate, --seconds and --repeat must be positive");
+    if (config.pairFraction < 0 || config.pairFraction > 1)
+      throw std::invalid_argument("--pair-fraction must be within [0, 1]");
+  } catch (const std::exception &ex) {
+    std::cerr << ex.what() << "\n";
+    print_help(argv[0]);
+    return 1;
+  }
+
+  try {
+    const auto results = runBenchmarks(config);
+    if (outputPath.empty()) {
+      writeJson(std::cout, config, results);
+    } else {
+      std::ofstream out(outputPath);
+      writeJson(out, config, results);
+      if (!out)
+        throw std::runtime_error("failed to write " + outputPath);
+    }
+  } catch (const std::exception &ex) {
+    std::cerr << "Error: " << ex.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
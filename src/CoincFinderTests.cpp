@@ -1,14 +1,112 @@
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <climits>
 #include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <map>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
 #include <vector>
 
+#include "BatchPlan.h"
+#include "BinTailReader.h"
+#include "ChannelPairs.h"
+#include "CoincidenceKernels.h"
 #include "Coincidences.h"
+#include "CompactSingles.h"
+#include "DelaySweeps.h"
+#include "FftCorrelation.h"
+#include "Instrumentation.h"
+#include "OrderedBlockWriter.h"
+#include "ReadCSV.h"
+#include "RollingDelayHistogram.h"
+#include "RollingSingles.h"
+#include "SinglesCache.h"
+#include "SweepTensorFile.h"
+#include "Visibility.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 using Timestamp = long long;
 
 namespace {
+// Counts heap allocations while enabled (see testKernelsReuseWorkspace).
+std::atomic<bool> gCountAllocations{false};
+std::atomic<long long> gAllocations{0};
+} // namespace
+
+// Every unaligned form is replaced so all of them share one malloc/free pair;
+// a sanitizer runtime would otherwise allocate through the forms left out
+// (the nothrow new behind std::get_temporary_buffer) and see them freed here.
+//
+// GCC 12 inlines these into call sites at -O2 and then flags free() on memory
+// from operator new as -Wmismatched-new-delete; here every new form is backed
+// by malloc, so the pairing is correct.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+    if (gCountAllocations.load(std::memory_order_relaxed))
+        gAllocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size != 0 ? size : 1);
+}
+
+void *operator new(std::size_t size) {
+    if (void *p = operator new(size, std::nothrow))
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) { return operator new(size); }
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+    return operator new(size, std::nothrow);
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+void operator delete(void *p, const std::nothrow_t &) noexcept { std::free(p); }
+
+void operator delete[](void *p) noexcept { std::free(p); }
+
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept { std::free(p); }
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+namespace {
+// Writes a Qutools BIN capture: the 40-byte header, then one packed
+// (uint64 timestamp, uint16 input) record per entry.
+void writeBinCapture(const std::filesystem::path &path,
+                     const std::vector<RawRecord> &records) {
+    std::ofstream out(path, std::ios::binary);
+    const char header[40] = {};
+    out.write(header, sizeof(header));
+    for (const RawRecord &rec : records) {
+        out.write(reinterpret_cast<const char *>(&rec.timestamp), sizeof(rec.timestamp));
+        out.write(reinterpret_cast<const char *>(&rec.channel), sizeof(rec.channel));
+    }
+}
+
 int naiveCoincidences(const std::vector<Timestamp> &ch1,
                       const std::vector<Timestamp> &ch2,
                       Timestamp windowPs,
@@ -65,9 +163,12 @@ void testFindBestDelay() {
     for (size_t i = 0; i < ref.size(); ++i)
         target[i] = ref[i] + offset;
 
+    // Delays shift the first span (ch1 - delay ~ ch2), so a target lagging
+    // the reference by `offset` peaks at -offset. The window stays below half
+    // a step so the peak is a single bin rather than a plateau.
     const Timestamp best = findBestDelayPicoseconds(ref, target,
-                                                    200, -3'000, 3'000, 25);
-    assert(best == offset);
+                                                    10, -3'000, 3'000, 25);
+    assert(best == -offset);
 }
 
 void testNFoldCounts() {
@@ -95,10 +196,1744 @@ void testNFoldCounts() {
     assert(pair == static_cast<int>(base.size()));
 }
 
+// The sort-based sliding window countNFoldCoincidences used to run.
+int nFoldByMergedSort(const std::vector<std::vector<Timestamp>> &channels,
+                      long long window, const std::vector<long long> &offsets) {
+    std::vector<std::pair<Timestamp, size_t>> merged;
+    for (size_t c = 0; c < channels.size(); ++c)
+        for (const Timestamp t : channels[c])
+            merged.emplace_back(t + offsets[c], c);
+    std::sort(merged.begin(), merged.end());
+    std::vector<int> freq(channels.size(), 0);
+    size_t have = 0;
+    size_t left = 0;
+    int count = 0;
+    for (size_t right = 0; right < merged.size(); ++right) {
+        if (++freq[merged[right].second] == 1)
+            ++have;
+        while (merged[right].first - merged[left].first > window && left < right) {
+            if (--freq[merged[left].second] == 0)
+                --have;
+            ++left;
+        }
+        if (have == channels.size()) {
+            ++count;
+            if (--freq[merged[left].second] == 0)
+                --have;
+            ++left;
+        }
+    }
+    return count;
+}
+
+void testNFoldMergeMatchesSort() {
+    std::mt19937_64 rng(808);
+    for (size_t fold = 3; fold <= 6; ++fold) {
+        std::vector<std::vector<Timestamp>> channels(fold);
+        std::vector<long long> offsets(fold);
+        for (size_t c = 0; c < fold; ++c)
+            offsets[c] = static_cast<long long>(c) * 37 - 60;
+        // Shared "emission" times plus independent noise on every channel.
+        for (int k = 0; k < 3'000; ++k) {
+            const Timestamp t = static_cast<Timestamp>(rng() % 50'000'000);
+            for (size_t c = 0; c < fold; ++c) {
+                if (rng() % 3 != 0)
+                    channels[c].push_back(t - offsets[c] +
+                                          static_cast<Timestamp>(rng() % 40));
+                channels[c].push_back(static_cast<Timestamp>(rng() % 50'000'000));
+            }
+        }
+        std::vector<std::span<const Timestamp>> spans;
+        for (auto &ch : channels) {
+            std::sort(ch.begin(), ch.end());
+            ch.erase(std::unique(ch.begin(), ch.end()), ch.end());
+            spans.emplace_back(ch);
+        }
+        const int expected = nFoldByMergedSort(channels, 100, offsets);
+        assert(expected > 0);
+        assert(countNFoldCoincidences(spans, 100, offsets) == expected);
+        const std::vector<long long> zero(fold, 0);
+        assert(countNFoldCoincidences(spans, 100) ==
+               nFoldByMergedSort(channels, 100, zero));
+    }
+}
+
+void testCoincidenceMatrixMatchesPairs() {
+    std::mt19937_64 rng(1717);
+    constexpr Timestamp kSpanPs = 2'000'000'000;
+    // Five channels, enough events for several time tiles each.
+    std::vector<std::vector<Timestamp>> events(5);
+    for (int k = 0; k < 12'000; ++k) {
+        const Timestamp t = static_cast<Timestamp>(rng() % kSpanPs);
+        for (size_t c = 0; c < events.size(); ++c)
+            if (rng() % 2 == 0)
+                events[c].push_back(t + static_cast<Timestamp>(c) * 3'000 +
+                                    static_cast<Timestamp>(rng() % 200));
+    }
+    for (auto &ch : events)
+        std::sort(ch.begin(), ch.end());
+    // Lookahead tails, as the CLIs pass them.
+    std::vector<Timestamp> tail = {kSpanPs + 50, kSpanPs + 9'000};
+
+    std::vector<SegmentedSpan> channels;
+    for (size_t c = 0; c < events.size(); ++c)
+        channels.emplace_back(events[c], c % 2 == 0 ? std::span<const Timestamp>(tail)
+                                                    : std::span<const Timestamp>());
+    const std::vector<CoincidencePair> pairs = {
+        {0, 1, -3'000}, {1, 0, 3'000}, {0, 4, -12'000}, {2, 3, -3'000},
+        {3, 4, 0},      {1, 3, -6'000}, {4, 4, 0},      {0, 2, 500'000'000}};
+    const std::vector<int> matrix = computeCoincidenceMatrix(channels, pairs, 250);
+    assert(matrix.size() == pairs.size());
+    for (size_t k = 0; k < pairs.size(); ++k)
+        assert(matrix[k] ==
+               countCoincidencesWithDelay(channels[pairs[k].first],
+                                          channels[pairs[k].second], 250,
+                                          pairs[k].delayPs));
+    assert(matrix[0] > 1'000); // the correlated pairs really do coincide
+
+    const std::vector<CoincidencePair> missing = {{0, 7, 0}};
+    bool threw = false;
+    try {
+        computeCoincidenceMatrix(channels, missing, 250);
+    } catch (const std::invalid_argument &) {
+        threw = true;
+    }
+    assert(threw);
+
+    const auto parsed = parseChannelPairs("1-5,2-6,12-3");
+    assert((parsed == std::vector<std::pair<int, int>>{{1, 5}, {2, 6}, {12, 3}}));
+    for (const char *bad : {"", "1-5,", "1:5", "0-5", "1-x"}) {
+        threw = false;
+        try {
+            parseChannelPairs(bad);
+        } catch (const std::invalid_argument &) {
+            threw = true;
+        }
+        assert(threw);
+    }
+}
+
+void testBinReadersAgree() {
+    const auto path =
+        std::filesystem::temp_directory_path() / "coincfinder_test_readers.bin";
+    writeBinCapture(path, {{1'000, 0},
+                           {1'200, 4},
+                           {1'100, 0},
+                           {2'000'000'000'500ULL, 1},
+                           {0, 2},
+                           {1'500'000'000'000ULL, 9}});
+    // A trailing partial record is ignored.
+    std::ofstream(path, std::ios::binary | std::ios::app).write("\x01\x02\x03", 3);
+
+    double mappedDuration = 0.0;
+    double streamDuration = 0.0;
+    const auto mapped = readBINtoSingles(path.string(), mappedDuration);
+    const auto streamed = readBINStreamToSingles(path.string(), streamDuration);
+    std::filesystem::remove(path);
+
+    assert(mappedDuration == streamDuration);
+    assert(mapped.size() == streamed.size());
+    for (const auto &[ch, s] : mapped) {
+        const Singles &other = streamed.at(ch);
+        assert(s.baseSecond == other.baseSecond);
+        assert(s.eventsPerSecond == other.eventsPerSecond);
+    }
+    // ch1 gets both early events, sorted and rebased onto the first record.
+    const auto &ch1 = eventsForSecond(mapped.at(1), 0);
+    assert((ch1 == std::vector<Timestamp>{0, 100}));
+    assert(eventsForSecond(mapped.at(2), 1).size() == 1);
+    assert(mapped.count(3) == 0); // ts == 0 is dropped
+}
+
+void testParallelCsvMatchesSerial() {
+    const auto path =
+        std::filesystem::temp_directory_path() / "coincfinder_test_parallel.csv";
+    {
+        // Large enough to be split into several ranges; includes jitter,
+        // CRLF endings and lines the parser must skip.
+        std::ofstream out(path, std::ios::binary);
+        out << "timestamp,channel\n";
+        Timestamp ts = 5'000'000;
+        for (int i = 0; i < 80'000; ++i) {
+            ts += 37'000'000 + (i % 7) * 1'000;
+            const Timestamp jittered = (i % 5 == 0) ? ts - 40'000'000 : ts;
+            out << jittered << "," << (i % 8) + 1 << ",x";
+            out << ((i % 3 == 0) ? "\r\n" : "\n");
+            if (i % 1'000 == 0)
+                out << "\n" << "garbage\n" << ts << ",9\n";
+        }
+        out << ts + 1 << ",3"; // no trailing newline
+    }
+
+    double serialDuration = 0.0;
+    double parallelDuration = 0.0;
+    const auto serial = readCSVtoSingles(path.string(), serialDuration);
+    const auto parallel =
+        readCSVtoSinglesParallel(path.string(), parallelDuration);
+    double flatDuration = 0.0;
+    const auto flat = readFileAutoFlat(path.string(), flatDuration);
+    std::filesystem::remove(path);
+
+    assert(flat.size() == serial.size());
+    for (const auto &[ch, f] : flat) {
+        const FlatSingles expected = flattenSingles(serial.at(ch));
+        assert(f.baseSecond == expected.baseSecond);
+        assert(f.timestamps == expected.timestamps);
+        assert(f.bucketOffsets == expected.bucketOffsets);
+    }
+
+    assert(serialDuration == parallelDuration);
+    assert(serial.size() == parallel.size());
+    for (const auto &[ch, s] : serial) {
+        const Singles &other = parallel.at(ch);
+        assert(s.baseSecond == other.baseSecond);
+        assert(s.eventsPerSecond == other.eventsPerSecond);
+        for (const auto &bucket : s.eventsPerSecond)
+            assert(std::is_sorted(bucket.begin(), bucket.end()));
+    }
+}
+
+// Events of every bucket lie inside that bucket's second.
+bool bucketsMatchTimestamps(const FlatSingles &flat) {
+    for (size_t b = 0; b < flat.bucketCount(); ++b)
+        for (size_t i = flat.bucketOffsets[b]; i < flat.bucketOffsets[b + 1]; ++i)
+            if (flat.timestamps[i] / flat.bucketWidthPs !=
+                flat.baseSecond + static_cast<long long>(b))
+                return false;
+    return true;
+}
+
+void testCsvRestoresChannelOrder() {
+    const auto path =
+        std::filesystem::temp_directory_path() / "coincfinder_test_disorder.csv";
+    // Real per-channel disorder: every block of 60 ticks arrives as its odd
+    // ticks, then its even ticks (two interleaved runs), for 100+ runs per
+    // channel, and block 3 is held back to the end of the capture so it is
+    // displaced by almost every other event.
+    constexpr Timestamp kOrigin = 1'000;
+    constexpr Timestamp kTickPs = 2'000'000'000;
+    constexpr int kTicks = 3'000;
+    constexpr int kBlock = 60;
+    const std::vector<int> channels{1, 2, 5};
+    std::map<int, std::vector<Timestamp>> arrival;
+    std::map<int, std::vector<Timestamp>> reference;
+    for (int ch : channels) {
+        std::vector<Timestamp> &order = arrival[ch];
+        std::vector<Timestamp> heldBack;
+        for (int block = 0; block < kTicks / kBlock; ++block)
+            for (int parity : {1, 0})
+                for (int k = block * kBlock + parity; k < (block + 1) * kBlock; k += 2)
+                    (block == 3 ? heldBack : order)
+                        .push_back(kOrigin + ch * 1'000 + k * kTickPs);
+        order.insert(order.end(), heldBack.begin(), heldBack.end());
+        std::vector<Timestamp> &sorted = reference[ch];
+        for (Timestamp ts : order)
+            sorted.push_back(ts - kOrigin);
+        std::sort(sorted.begin(), sorted.end());
+    }
+    reference[8] = {0};
+    {
+        std::ofstream out(path, std::ios::binary);
+        out << kOrigin << ",8\n"; // earliest record: the origin
+        for (size_t i = 0; i < arrival.at(1).size(); ++i)
+            for (int ch : channels)
+                out << arrival.at(ch)[i] << "," << ch << "\n";
+    }
+
+    double serialDuration = 0.0;
+    double parallelDuration = 0.0;
+    double flatDuration = 0.0;
+    const auto serial = readCSVtoSingles(path.string(), serialDuration);
+    const auto parallel = readCSVtoSinglesParallel(path.string(), parallelDuration);
+    const auto flat = readFileAutoFlat(path.string(), flatDuration);
+    std::filesystem::remove(path);
+
+    assert(serial.size() == reference.size());
+    assert(parallel.size() == reference.size());
+    assert(flat.size() == reference.size());
+    for (const auto &[ch, expected] : reference) {
+        for (const FlatSingles &got :
+             {flattenSingles(serial.at(ch)), flattenSingles(parallel.at(ch)), flat.at(ch)}) {
+            assert(got.timestamps == expected);
+            assert(bucketsMatchTimestamps(got));
+        }
+    }
+}
+
+void testRestoreOrderFallbackAndSeams() {
+    const auto dir = std::filesystem::temp_directory_path();
+    constexpr Timestamp kOrigin = 1'000;
+
+    // Fragmented input: 5000 ascending blocks of four in descending block
+    // order. Every block merges in at the front, so the merge budget runs
+    // out and the reader falls back to one std::sort.
+    const auto binPath = dir / "coincfinder_test_fragmented.bin";
+    std::vector<Timestamp> fragmented{0};
+    std::vector<RawRecord> fragmentedRecords{{kOrigin, 0}};
+    for (int block = 4'999; block >= 0; --block)
+        for (int k = 0; k < 4; ++k) {
+            const Timestamp rel = (block * 4 + k + 1) * 300'000'000LL;
+            fragmentedRecords.push_back({static_cast<uint64_t>(kOrigin + rel), 0});
+            fragmented.push_back(rel);
+        }
+    writeBinCapture(binPath, fragmentedRecords);
+    std::sort(fragmented.begin(), fragmented.end());
+    double duration = 0.0;
+    const auto flat = readFileAutoFlat(binPath.string(), duration);
+    std::filesystem::remove(binPath);
+    assert(flat.size() == 1);
+    assert(flat.at(1).timestamps == fragmented);
+    assert(bucketsMatchTimestamps(flat.at(1)));
+
+    // Parallel CSV ranges that are each sorted but interleave: the first half
+    // of the file holds the even ticks, the second half the odd ones. Lines
+    // have a fixed width, so with two ranges the split lands exactly on the
+    // first odd line and only the seam between them is out of order.
+    const auto csvPath = dir / "coincfinder_test_seams.csv";
+    constexpr int kHalf = 40'000; // 16-byte lines: above the parallel threshold
+    constexpr Timestamp kTickPs = 10'000'000;
+    std::vector<Timestamp> interleaved;
+    {
+        std::ofstream out(csvPath, std::ios::binary);
+        char line[32];
+        const auto write = [&](Timestamp ts, int ch) {
+            std::snprintf(line, sizeof(line), "%013lld,%d\n", ts, ch);
+            out << line;
+        };
+        write(kOrigin, 2);
+        for (int parity : {0, 1})
+            for (int k = 0; k < kHalf; ++k) {
+                const Timestamp rel = (2 * k + parity + 1) * kTickPs;
+                write(kOrigin + rel, 1);
+                interleaved.push_back(rel);
+            }
+    }
+    std::sort(interleaved.begin(), interleaved.end());
+#ifdef _OPENMP
+    const int threads = omp_get_max_threads();
+    omp_set_num_threads(2);
+#endif
+    double parallelDuration = 0.0;
+    double serialDuration = 0.0;
+    const auto parallel = readCSVtoSinglesParallel(csvPath.string(), parallelDuration);
+    const auto serial = readCSVtoSingles(csvPath.string(), serialDuration);
+#ifdef _OPENMP
+    omp_set_num_threads(threads);
+#endif
+    std::filesystem::remove(csvPath);
+    assert(parallelDuration == serialDuration);
+    for (const auto *read : {&parallel, &serial}) {
+        assert(read->size() == 2);
+        const FlatSingles merged = flattenSingles(read->at(1));
+        assert(merged.timestamps == interleaved);
+        assert(bucketsMatchTimestamps(merged));
+        assert(flattenSingles(read->at(2)).timestamps == std::vector<Timestamp>{0});
+    }
+}
+
+void testSinglesCacheRoundTrip() {
+    const auto path =
+        std::filesystem::temp_directory_path() / "coincfinder_test_cache.bin";
+    const std::string cachePath = singlesCachePath(path.string());
+    std::filesystem::remove(cachePath);
+    const auto writeCapture = [&](int events) {
+        std::vector<RawRecord> records;
+        for (int i = 0; i < events; ++i) {
+            // Two channels over ~6 s, with second 3 left empty on channel 2.
+            const uint64_t ts = 1'000 + static_cast<uint64_t>(i) * 3'000'000'000ULL;
+            const uint16_t ch = static_cast<uint16_t>(i % 2);
+            if (ch == 1 && ts / 1'000'000'000'000ULL == 3)
+                continue;
+            records.push_back({ts, ch});
+        }
+        writeBinCapture(path, records);
+    };
+    writeCapture(2'000);
+
+    double durationAuto = 0.0;
+    const auto full = readFileAuto(path.string(), durationAuto);
+    // First call parses and writes the cache, the second one maps it.
+    for (int pass = 0; pass < 2; ++pass) {
+        double duration = 0.0;
+        const auto cached = readFileCached(path.string(), duration);
+        assert(std::filesystem::exists(cachePath));
+        assert(duration == durationAuto);
+        assert(cached.size() == full.size());
+        for (const auto &[ch, s] : full) {
+            assert(cached.at(ch).baseSecond == s.baseSecond);
+            assert(cached.at(ch).eventsPerSecond == s.eventsPerSecond);
+        }
+    }
+
+    {
+        const SinglesCache cache(cachePath);
+        assert((cache.channels() == std::vector<int>{1, 2}));
+        assert(cache.source() == SinglesCacheSource::of(path.string()));
+        for (long long sec = -1; sec <= 7; ++sec) {
+            const auto view = cache.eventsForSecond(2, sec);
+            const auto &bucket = eventsForSecond(full.at(2), sec);
+            assert(std::equal(view.begin(), view.end(), bucket.begin(), bucket.end()));
+        }
+        assert(cache.eventsForSecond(5, 0).empty());
+        const auto flat = cache.readFlat(2, 4);
+        assert(flat.at(1).baseSecond == 2 && flat.at(1).bucketCount() == 3);
+    }
+
+    // Concurrent rebuilds each write their own temporary; whichever rename
+    // lands last leaves a complete cache and no temporary behind.
+    {
+        double flatDuration = 0.0;
+        const auto flat = readFileAutoFlat(path.string(), flatDuration);
+        const SinglesCacheSource source = SinglesCacheSource::of(path.string());
+        std::vector<std::thread> writers;
+        for (int w = 0; w < 4; ++w)
+            writers.emplace_back([&] {
+                writeSinglesCache(cachePath, flat, flatDuration, kDefaultBucketWidthPs,
+                                  source);
+            });
+        for (std::thread &writer : writers)
+            writer.join();
+        const SinglesCache cache(cachePath);
+        assert(cache.readFlat(0, LLONG_MAX).at(2).timestamps == flat.at(2).timestamps);
+        for (const auto &entry :
+             std::filesystem::directory_iterator(path.parent_path()))
+            assert(entry.path().string().rfind(cachePath + ".tmp", 0) != 0);
+    }
+
+    // Offsets that run backwards are rejected rather than sliced.
+    const auto corruptPath = path.string() + ".corrupt";
+    std::filesystem::copy_file(cachePath, corruptPath,
+                               std::filesystem::copy_options::overwrite_existing);
+    {
+        std::fstream corrupt(corruptPath, std::ios::binary | std::ios::in | std::ios::out);
+        char entry[48];
+        corrupt.seekg(64);
+        corrupt.read(entry, sizeof(entry));
+        uint64_t offsetsPos = 0;
+        std::memcpy(&offsetsPos, entry + 32, sizeof(offsetsPos));
+        const uint64_t backwards = 1'000'000;
+        corrupt.seekp(static_cast<std::streamoff>(offsetsPos + 8));
+        corrupt.write(reinterpret_cast<const char *>(&backwards), sizeof(backwards));
+    }
+    bool rejected = false;
+    try {
+        const SinglesCache corrupt(corruptPath);
+    } catch (const std::runtime_error &) {
+        rejected = true;
+    }
+    assert(rejected);
+    std::filesystem::remove(corruptPath);
+
+    double duration = 0.0;
+    const auto slice = readFileCached(path.string(), duration, 2, 4);
+    assert(duration == durationAuto);
+    for (const auto &[ch, s] : slice) {
+        assert(s.baseSecond == 2);
+        assert(s.eventsPerSecond.size() == 3);
+        for (long long sec = 2; sec <= 4; ++sec)
+            assert(eventsForSecond(s, sec) == eventsForSecond(full.at(ch), sec));
+    }
+
+    // A different capture under the same name invalidates the cache.
+    writeCapture(1'000);
+    double shortDuration = 0.0;
+    const auto rewritten = readFileAuto(path.string(), shortDuration);
+    const auto refreshed = readFileCached(path.string(), duration);
+    assert(duration == shortDuration && duration < durationAuto);
+    assert(refreshed.at(1).eventsPerSecond == rewritten.at(1).eventsPerSecond);
+    std::filesystem::remove(path);
+    std::filesystem::remove(cachePath);
+}
+
+void testRangeReadMatchesFull() {
+    const auto dir = std::filesystem::temp_directory_path();
+    const auto binPath = dir / "coincfinder_test_range.bin";
+    const auto csvPath = dir / "coincfinder_test_range.csv";
+    {
+        std::vector<RawRecord> records;
+        std::ofstream csv(csvPath);
+        csv << "timestamp,channel\n";
+        std::mt19937_64 rng(19);
+        uint64_t ts = 7'000;
+        for (int i = 0; i < 20'000; ++i) {
+            ts += 400'000'000 + rng() % 200'000'000;
+            // Small jitter and records the readers reject along the way.
+            const uint64_t jittered = (i % 9 == 0) ? ts - 50'000 : ts;
+            const uint16_t ch = (i % 97 == 0) ? uint16_t{11}
+                                              : static_cast<uint16_t>(rng() % 4);
+            records.push_back({jittered, ch});
+            csv << jittered << "," << ch + 1 << "\n";
+            if (i % 1'000 == 0)
+                csv << "garbage\n";
+        }
+        writeBinCapture(binPath, records);
+    }
+
+    for (const auto &path : {binPath, csvPath}) {
+        double fullDuration = 0.0;
+        const auto full = readFileAuto(path.string(), fullDuration);
+        for (const auto &[first, last] :
+             std::vector<std::pair<long long, long long>>{{3, 5}, {0, 0}, {9, -1}}) {
+            double duration = 0.0;
+            const auto slice =
+                readFileAuto(path.string(), duration, -1.0, first, last);
+            assert(duration == fullDuration);
+            assert(slice.size() == full.size());
+            for (const auto &[ch, s] : full) {
+                const Singles &part = slice.at(ch);
+                const long long lastSecond =
+                    last < 0 ? s.baseSecond +
+                                   static_cast<long long>(s.eventsPerSecond.size()) - 1
+                             : last;
+                assert(part.baseSecond == std::max(first, s.baseSecond));
+                assert(part.baseSecond +
+                           static_cast<long long>(part.eventsPerSecond.size()) - 1 ==
+                       lastSecond);
+                for (long long sec = first; sec <= lastSecond; ++sec)
+                    assert(eventsForSecond(part, sec) == eventsForSecond(s, sec));
+            }
+        }
+        double duration = 0.0;
+        assert(readFileAutoFlat(path.string(), duration, -1.0, 1'000, 1'001).empty());
+        assert(duration == fullDuration);
+    }
+    std::filesystem::remove(binPath);
+    std::filesystem::remove(csvPath);
+}
+
+void testCompactSinglesMatchFlat() {
+    // Dense enough that merge chunks straddle 2^32 ps blocks and buckets.
+    std::mt19937_64 rng(2404);
+    Singles s1;
+    Singles s2;
+    s1.channel = 1;
+    s2.channel = 5;
+    Timestamp ts = -3'000'000'000LL; // negative times pack too
+    for (int i = 0; i < 60'000; ++i) {
+        ts += 1 + static_cast<Timestamp>(rng() % 400'000'000);
+        const long long second = ts < 0 ? -1 : ts / 1'000'000'000'000LL;
+        ensureSecond(s1, second).push_back(ts);
+        if (rng() % 3 == 0) {
+            const Timestamp partner = ts - 9'000 + static_cast<Timestamp>(rng() % 400);
+            ensureSecond(s2, partner < 0 ? -1 : partner / 1'000'000'000'000LL)
+                .push_back(partner);
+        }
+    }
+    ensureSecond(s1, 20); // trailing empty bucket
+    const FlatSingles flat1 = flattenSingles(s1);
+    const FlatSingles flat2 = flattenSingles(s2);
+    const CompactSingles c1 = compactSingles(flat1);
+    const CompactSingles c2 = compactSingles(flat2);
+
+    const FlatSingles back = expandCompactSingles(c1);
+    assert(back.channel == 1 && back.baseSecond == flat1.baseSecond);
+    assert(back.timestamps == flat1.timestamps);
+    assert(back.bucketOffsets == flat1.bucketOffsets);
+    assert(c1.blockBases.size() > 10);
+    assert(compactTimestampAt(c1, 12'345) == flat1.timestamps[12'345]);
+    assert(eventsForSeconds(c1, LLONG_MIN, LLONG_MAX).size() == c1.size());
+    assert(c1.memoryBytes() < flat1.timestamps.capacity() * sizeof(Timestamp) * 2 / 3);
+
+    std::vector<Timestamp> scratch;
+    for (long long sec = flat1.baseSecond - 1; sec <= 21; ++sec) {
+        const auto expected = eventsWithNextFirst(flat1, sec);
+        const auto decoded = decodeCompact(eventsWithNextFirst(c1, sec), scratch);
+        assert(std::equal(decoded.begin(), decoded.end(), expected.begin(),
+                          expected.end()));
+        for (const long long delay : {0LL, 9'000LL, 9'200LL})
+            assert(countCoincidencesWithDelay(eventsWithNextFirst(c1, sec),
+                                              eventsWithNextFirst(c2, sec), 250,
+                                              delay) ==
+                   countCoincidencesWithDelay(eventsWithNextFirst(flat1, sec),
+                                              eventsWithNextFirst(flat2, sec),
+                                              250, delay));
+    }
+    const CompactSpan all1{&c1, 0, c1.size()};
+    const CompactSpan all2{&c2, 0, c2.size()};
+    const int whole = countCoincidencesWithDelay(all1, all2, 250, 9'000);
+    assert(whole > 5'000);
+    assert(whole == countCoincidencesWithDelay(std::span<const long long>(flat1.timestamps),
+                                               flat2.timestamps, 250, 9'000));
+
+    // Packing slice by slice (with a gap) gives the same layout.
+    CompactSingles pieces;
+    bool threw = false;
+    for (const auto &[first, last] :
+         std::vector<std::pair<long long, long long>>{{-1, 3}, {6, 12}}) {
+        FlatSingles slice;
+        slice.channel = 1;
+        slice.baseSecond = first;
+        slice.bucketOffsets.push_back(0);
+        for (long long sec = first; sec <= last; ++sec) {
+            const auto events = eventsForSecond(flat1, sec);
+            slice.timestamps.insert(slice.timestamps.end(), events.begin(),
+                                    events.end());
+            slice.bucketOffsets.push_back(slice.timestamps.size());
+        }
+        appendCompactSingles(pieces, slice);
+        try {
+            appendCompactSingles(pieces, slice);
+        } catch (const std::invalid_argument &) {
+            threw = true;
+        }
+    }
+    assert(threw);
+    for (long long sec = -1; sec <= 12; ++sec) {
+        const auto events = decodeCompact(eventsForSecond(pieces, sec), scratch);
+        const auto expected = (sec == 4 || sec == 5)
+                                  ? std::span<const Timestamp>()
+                                  : eventsForSecond(flat1, sec);
+        assert(std::equal(events.begin(), events.end(), expected.begin(),
+                          expected.end()));
+    }
+    assert(pieces.bucketCount() == 14);
+}
+
+void testReadFileAutoCompact() {
+    const auto binPath =
+        std::filesystem::temp_directory_path() / "coincfinder_test_compact.bin";
+    {
+        std::vector<RawRecord> records;
+        std::mt19937_64 rng(2405);
+        uint64_t ts = 5'000;
+        for (int i = 0; i < 30'000; ++i) {
+            ts += 100'000'000 + rng() % 400'000'000;
+            records.push_back({ts, static_cast<uint16_t>(rng() % 4)});
+        }
+        writeBinCapture(binPath, records);
+    }
+    double flatDuration = 0.0;
+    const auto flat = readFileAutoFlat(binPath.string(), flatDuration);
+    double duration = 0.0;
+    const auto compact = readFileAutoCompact(binPath.string(), duration, -1.0, 2);
+    assert(duration == flatDuration);
+    assert(compact.size() == flat.size());
+    for (const auto &[ch, f] : flat) {
+        const FlatSingles back = expandCompactSingles(compact.at(ch));
+        assert(back.channel == ch && back.baseSecond == f.baseSecond);
+        assert(back.timestamps == f.timestamps);
+        assert(back.bucketOffsets == f.bucketOffsets);
+    }
+    std::filesystem::remove(binPath);
+}
+
+void testFlatSinglesViews() {
+    Singles s;
+    s.channel = 3;
+    s.baseSecond = 4;
+    s.eventsPerSecond = {{1, 2, 3}, {}, {10, 11}, {20}};
+    const FlatSingles flat = flattenSingles(s);
+    assert(flat.bucketCount() == 4);
+    assert((flat.bucketOffsets == std::vector<size_t>{0, 3, 3, 5, 6}));
+
+    std::vector<Timestamp> scratch;
+    for (long long sec = 2; sec <= 9; ++sec) {
+        const auto expected = appendNextFirstEvent(
+            eventsForSecond(s, sec), eventsForSecond(s, sec + 1), scratch);
+        const auto view = eventsWithNextFirst(flat, sec);
+        assert(std::equal(view.begin(), view.end(), expected.begin(),
+                          expected.end()));
+    }
+    const auto span = eventsForSeconds(flat, 0, 6);
+    assert(span.size() == 5 && span.data() == flat.timestamps.data());
+
+    const Singles back = expandSingles(flat);
+    assert(back.baseSecond == s.baseSecond);
+    assert(back.eventsPerSecond == s.eventsPerSecond);
+}
+
+void testSegmentedSpansMatchCopies() {
+    std::vector<Timestamp> ch1, current, next;
+    for (int i = 0; i < 200; ++i) {
+        ch1.push_back(i * 5'000 + (i % 3) * 70);
+        current.push_back(i * 5'000 + 1'200 + (i % 4) * 40);
+    }
+    next = {1'000'050, 1'004'000};
+    ch1.push_back(1'000'000 + 1'200 - 50); // pairs with the lookahead only
+
+    std::vector<Timestamp> scratch;
+    const auto copied = appendNextFirstEvent(current, next, scratch);
+    const SegmentedSpan segmented = withNextFirstEvent(current, next);
+    assert(segmented.size() == copied.size());
+    assert(segmented.tail.data() == next.data());
+
+    const std::span<const Timestamp> s1(ch1);
+    for (Timestamp delay : {-1'300LL, -1'200LL, 0LL, 1'150LL}) {
+        assert(countCoincidencesWithDelay(s1, segmented, 100, delay) ==
+               countCoincidencesWithDelay(s1, copied, 100, delay));
+        assert(collectCoincidencesWithDelay(s1, segmented, 100, delay) ==
+               collectCoincidencesWithDelay(s1, copied, 100, delay));
+    }
+    std::vector<std::pair<float, int>> a, b;
+    computeCoincidencesForRange(s1, segmented, 100, -2'000, 2'000, 10, a);
+    computeCoincidencesForRange(s1, copied, 100, -2'000, 2'000, 10, b);
+    assert(a == b);
+    assert(findBestDelayPicoseconds(s1, segmented, 100, -2'000, 2'000, 10) ==
+           findBestDelayPicoseconds(s1, copied, 100, -2'000, 2'000, 10));
+}
+
+void testKernelsMatchNaive() {
+    // Mixed densities: long singles-only runs on ch1, bursts on ch2, plus
+    // true coincidences at a fixed delay, so every seek path gets exercised.
+    std::mt19937_64 rng(1234);
+    std::vector<Timestamp> ch1, ch2;
+    Timestamp t = 0;
+    for (int i = 0; i < 20'000; ++i) {
+        t += 1 + static_cast<Timestamp>(rng() % 3'000);
+        ch1.push_back(t);
+        if (rng() % 8 == 0)
+            ch2.push_back(t - 9'000 + static_cast<Timestamp>(rng() % 200));
+        if (i % 4'000 < 50)
+            for (int k = 0; k < 30; ++k)
+                ch2.push_back(t + k * 3);
+    }
+    std::sort(ch2.begin(), ch2.end());
+
+    const CoincidenceKernel original = activeCoincidenceKernel();
+    const CoincidenceKernel kernels[] = {
+        CoincidenceKernel::Scalar, CoincidenceKernel::Galloping,
+        CoincidenceKernel::Avx2, CoincidenceKernel::Avx512,
+        CoincidenceKernel::Neon};
+    for (const Timestamp delay : {-9'000LL, 0LL, 250LL, 9'100LL}) {
+        const int expected = naiveCoincidences(ch1, ch2, 120, delay);
+        assert(countCoincidencesWithDelayScalar(ch1, ch2, 120, delay) ==
+               expected);
+        for (const CoincidenceKernel kernel : kernels) {
+            if (!coincidenceKernelSupported(kernel))
+                continue;
+            setCoincidenceKernel(kernel);
+            assert(countCoincidencesWithDelay(ch1, ch2, 120, delay) == expected);
+            assert(static_cast<size_t>(expected) ==
+                   collectCoincidencesWithDelay(ch1, ch2, 120, delay).size());
+            // Swapped roles and a segmented view go through other paths.
+            assert(countCoincidencesWithDelay(ch2, ch1, 120, -delay) ==
+                   naiveCoincidences(ch2, ch1, 120, -delay));
+            const std::span<const Timestamp> all(ch2);
+            const SegmentedSpan split(all.first(all.size() - 3),
+                                      all.last(3));
+            assert(countCoincidencesWithDelay(std::span<const Timestamp>(ch1), split,
+                                              120, delay) ==
+                   expected);
+        }
+    }
+    setCoincidenceKernel(original);
+}
+
+void testCountAtDelaysMatchesSingleDelay() {
+    std::mt19937_64 rng(77);
+    std::vector<Timestamp> ch1, ch2;
+    Timestamp t = 0;
+    for (int i = 0; i < 5'000; ++i) {
+        t += 1 + static_cast<Timestamp>(rng() % 2'000);
+        ch1.push_back(t);
+        if (rng() % 3 == 0)
+            ch2.push_back(t - 4'000 + static_cast<Timestamp>(rng() % 100));
+        if (rng() % 5 == 0)
+            ch2.push_back(t + static_cast<Timestamp>(rng() % 1'500));
+    }
+    std::sort(ch2.begin(), ch2.end());
+
+    // Unsorted, non-uniform, with a duplicate.
+    const std::vector<Timestamp> delays = {4'050, -300, 0, 4'050, 123'456,
+                                           3'990, -4'000};
+    const std::vector<int> counts =
+        countCoincidencesAtDelays(ch1, ch2, 80, delays);
+    assert(counts.size() == delays.size());
+    for (size_t k = 0; k < delays.size(); ++k)
+        assert(counts[k] == naiveCoincidences(ch1, ch2, 80, delays[k]));
+
+    const std::span<const Timestamp> all(ch2);
+    const SegmentedSpan split(all.first(all.size() / 2),
+                              all.subspan(all.size() / 2));
+    assert(countCoincidencesAtDelays(SegmentedSpan(ch1), split, 80, delays) ==
+           counts);
+    assert(countCoincidencesAtDelays(ch1, std::span<const Timestamp>{}, 80,
+                                     delays) ==
+           std::vector<int>(delays.size(), 0));
+}
+
+void testSweepTensorRoundTrip() {
+    const auto path = std::filesystem::temp_directory_path() /
+                      "coincfinder_sweeps.cfsweep";
+    SweepTensorHeader header;
+    header.pairs = {{1, 5}, {2, 6}};
+    header.secondCount = 3;
+    header.delayBins = 4;
+    header.startSec = 10;
+    header.delayStartPs = -2'000;
+    header.delayStepPs = 500;
+    header.coincWindowPs = 250;
+    {
+        SweepTensorWriter writer(path.string(), header, 2);
+        // Out of order and more sweeps than the queue holds.
+        writer.submit(1, 2, {9, 8, 7, -1});
+        writer.submit(0, 0, {1, 2, 3, 4});
+        writer.submit(1, 0, {5, 6, 7, 8});
+        writer.finish();
+    }
+
+    const SweepTensorHeader read = readSweepTensorHeader(path.string());
+    assert(read.pairs == header.pairs);
+    assert(read.secondCount == 3 && read.delayBins == 4);
+    assert(read.startSec == 10 && read.delayStartPs == -2'000);
+    assert(read.delayStepPs == 500 && read.coincWindowPs == 250);
+    assert(read.dataOffset % 64 == 0);
+
+    std::ifstream in(path, std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(in)),
+                            std::istreambuf_iterator<char>());
+    assert(bytes.size() == read.dataOffset + 2 * 3 * 4 * sizeof(int32_t));
+    const std::vector<char> expectedValid = {1, 0, 0, 1, 0, 1};
+    assert(std::equal(expectedValid.begin(), expectedValid.end(),
+                      bytes.begin() + static_cast<long>(read.validOffset())));
+    auto cell = [&](size_t pair, size_t sec, size_t bin) {
+        int32_t value = 0;
+        std::memcpy(&value,
+                    bytes.data() + read.dataOffset +
+                        ((pair * 3 + sec) * 4 + bin) * sizeof(int32_t),
+                    sizeof(value));
+        return value;
+    };
+    assert(cell(0, 0, 3) == 4 && cell(1, 0, 1) == 6 && cell(1, 2, 3) == -1);
+    assert(cell(0, 1, 0) == 0 && cell(1, 1, 2) == 0);
+    std::filesystem::remove(path);
+}
+
+void testDelaySweepsMatchPerSecond() {
+    constexpr long long kSecond = 1'000'000'000'000LL;
+    std::mt19937_64 rng(21);
+    std::map<int, Singles> singles;
+    for (int ch : {1, 5}) {
+        Singles &s = singles[ch];
+        s.channel = ch;
+        s.baseSecond = 2;
+        s.eventsPerSecond.resize(4);
+        for (size_t sec = 0; sec < s.eventsPerSecond.size(); ++sec) {
+            auto &bucket = s.eventsPerSecond[sec];
+            const long long base = (2 + static_cast<long long>(sec)) * kSecond;
+            for (int i = 0; i < 300; ++i)
+                bucket.push_back(base + static_cast<long long>(rng() % kSecond));
+            std::sort(bucket.begin(), bucket.end());
+        }
+    }
+    // A pair across the 3/4 bucket edge, only visible via the lookahead.
+    singles[5].eventsPerSecond[1].push_back(4 * kSecond - 1);
+    singles[1].eventsPerSecond[2].insert(singles[1].eventsPerSecond[2].begin(),
+                                         4 * kSecond + 5'000);
+
+    const std::vector<std::pair<int, int>> pairs = {{1, 5}, {5, 1}, {1, 7}};
+    const long long window = 20'000'000;
+    const long long start = -500'000'000;
+    const long long end = 500'000'000;
+    const long long step = 50'000'000;
+    const size_t bins = delaySweepBins(start, end, step);
+    const auto sweeps =
+        computeDelaySweeps(singles, pairs, 1, 5, window, start, end, step);
+    assert(sweeps.size() == pairs.size() * 5 * bins);
+
+    std::vector<std::pair<float, int>> expected;
+    for (size_t p = 0; p < pairs.size(); ++p) {
+        for (long long sec = 1; sec <= 5; ++sec) {
+            const int32_t *row =
+                sweeps.data() + (p * 5 + static_cast<size_t>(sec - 1)) * bins;
+            if (!singles.count(pairs[p].second)) {
+                assert(std::all_of(row, row + bins, [](int32_t v) { return v == 0; }));
+                continue;
+            }
+            const Singles &s1 = singles.at(pairs[p].first);
+            const Singles &s2 = singles.at(pairs[p].second);
+            expected.clear();
+            computeCoincidencesForRange(
+                std::span<const long long>(eventsForSecond(s1, sec)),
+                withNextFirstEvent(eventsForSecond(s2, sec),
+                                   eventsForSecond(s2, sec + 1)),
+                window, start, end, step, expected);
+            for (size_t b = 0; b < bins; ++b)
+                assert(row[b] == expected[b].second);
+        }
+    }
+
+    bool threw = false;
+    try {
+        std::vector<int32_t> tooSmall(3);
+        const SweepChannels channels{&singles.at(1), &singles.at(5)};
+        computeDelaySweeps(std::span<const SweepChannels>(&channels, 1), 1, 5,
+                           window, start, end, step, tooSmall);
+    } catch (const std::invalid_argument &) {
+        threw = true;
+    }
+    assert(threw);
+}
+
+void testOrderedBlockWriterReorders() {
+    const auto path = std::filesystem::temp_directory_path() /
+                      "coincfinder_ordered_blocks.txt";
+    {
+        OrderedBlockWriter writer(path.string(), "head\n", 2);
+        const int order[] = {3, 0, 4, 2, 1};
+        for (int seq : order)
+            writer.submit(static_cast<size_t>(seq),
+                          seq == 2 ? std::string() : std::to_string(seq) + "\n");
+        writer.finish();
+    }
+    std::ifstream in(path);
+    const std::string text((std::istreambuf_iterator<char>(in)),
+                           std::istreambuf_iterator<char>());
+    assert(text == "head\n0\n1\n3\n4\n");
+    in.close();
+
+    bool threw = false;
+    try {
+        OrderedBlockWriter gap(path.string());
+        gap.submit(1, "late");
+        gap.finish();
+    } catch (const std::runtime_error &) {
+        threw = true;
+    }
+    assert(threw);
+    std::filesystem::remove(path);
+}
+
+void testTailReaderFeedsRolling() {
+    const auto path =
+        std::filesystem::temp_directory_path() / "coincfinder_test_tail.bin";
+    std::filesystem::remove(path);
+    auto appendBytes = [&](const std::string &bytes) {
+        std::ofstream out(path, std::ios::binary | std::ios::app);
+        out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    };
+    auto record = [](uint64_t ts, uint16_t ch) {
+        std::string bytes(10, '\0');
+        std::memcpy(bytes.data(), &ts, sizeof(ts));
+        std::memcpy(bytes.data() + 8, &ch, sizeof(ch));
+        return bytes;
+    };
+
+    BinTailReader tail(path.string());
+    RollingSingles rolling(100);
+    assert(tail.pollInto(rolling) == 0); // file does not exist yet
+
+    appendBytes(std::string(20, '\0')); // header still incomplete
+    assert(tail.pollInto(rolling) == 0);
+    appendBytes(std::string(20, '\0'));
+    const std::string second = record(1'000'000'000'300ULL, 4);
+    appendBytes(record(5'000, 0) + record(5'100, 4) + second.substr(0, 6));
+    assert(tail.pollInto(rolling) == 2);
+    assert(rolling.hasOrigin() && rolling.origin() == 5'000);
+
+    // Completing the split record plus later ones keeps the same origin
+    // (a batch reader would have re-based each chunk on its own first record).
+    appendBytes(second.substr(6) + record(5'050, 0) + record(0, 1) +
+                record(2'000'000'000'000ULL, 9) + record(3'000'000'004'000ULL, 0));
+    std::vector<RawRecord> records;
+    assert(tail.poll(records) == 5);
+    assert(rolling.ingest(records) == 3);
+
+    double duration = 0.0;
+    const auto batch = readBINtoSingles(path.string(), duration);
+    for (const auto &[ch, s] : batch) {
+        const Singles &live = rolling.channelSingles(ch);
+        for (long long sec = s.baseSecond;
+             sec < s.baseSecond + static_cast<long long>(s.eventsPerSecond.size());
+             ++sec)
+            assert(eventsForSecond(live, sec) == eventsForSecond(s, sec));
+    }
+    assert((eventsForSecond(rolling.channelSingles(1), 0) ==
+            std::vector<Timestamp>{0, 50}));
+    assert(eventsForSecond(rolling.channelSingles(1), 2).size() == 1);
+    assert(rolling.channelSingles(10).eventsPerSecond.empty());
+
+    // A truncated/rotated file restarts from its header.
+    std::filesystem::remove(path);
+    appendBytes(std::string(40, '\0') + record(42, 1));
+    records.clear();
+    assert(tail.poll(records) == 1 && records[0].timestamp == 42);
+    std::filesystem::remove(path);
+}
+
+void testRollingIngestRestoresOrder() {
+    // A live feed with per-channel jitter: blocks of 64 ticks arrive in
+    // reverse, interleaved across two channels and two seconds.
+    std::vector<RawRecord> records{{1'000, 0}};
+    std::map<int, std::vector<Timestamp>> expected{{1, {0}}};
+    const Timestamp tick = 31'000'000;
+    for (int block = 0; block < 1'000; ++block)
+        for (int k = 63; k >= 0; --k) {
+            const Timestamp rel = (block * 64 + k + 1) * tick;
+            for (const uint16_t input : {uint16_t{0}, uint16_t{3}}) {
+                records.push_back({static_cast<uint64_t>(1'000 + rel + input), input});
+                expected[input + 1].push_back(rel + input);
+            }
+        }
+
+    RollingSingles rolling(10);
+    assert(rolling.ingest(records) == records.size());
+    for (auto &[ch, events] : expected) {
+        std::sort(events.begin(), events.end());
+        const Singles &live = rolling.channelSingles(ch);
+        std::vector<Timestamp> got;
+        for (const auto &bucket : live.eventsPerSecond) {
+            assert(std::is_sorted(bucket.begin(), bucket.end()));
+            got.insert(got.end(), bucket.begin(), bucket.end());
+        }
+        assert(got == events);
+    }
+}
+
+void testRollingRingWindow() {
+    RollingSingles rolling(3);
+    auto chunkAt = [](long long base, std::vector<std::vector<Timestamp>> buckets) {
+        Singles s;
+        s.channel = 1;
+        s.baseSecond = base;
+        s.eventsPerSecond = std::move(buckets);
+        return std::map<int, Singles>{{1, s}};
+    };
+
+    rolling.appendChunk(chunkAt(0, {{1, 2}, {10}, {20, 21, 22}}));
+    assert(rolling.latestSecond() == 2);
+    assert(rolling.eventsForSecond(1, 0).size() == 2);
+    const Timestamp *slotZero = rolling.eventsForSecond(1, 0).data();
+
+    // Second 3 retires second 0 and lands in its slot, reusing the storage.
+    rolling.appendChunk(chunkAt(3, {{30}}));
+    assert(rolling.eventsForSecond(1, 0).empty());
+    assert(rolling.eventsForSecond(1, 3).data() == slotZero);
+    const Singles &s = rolling.channelSingles(1);
+    assert(s.baseSecond == 1 && s.eventsPerSecond.size() == 3);
+    assert((eventsForSecond(s, 2) == std::vector<Timestamp>{20, 21, 22}));
+
+    // Overlapping chunk: merged in order, the view covers what it touched.
+    rolling.appendChunk(chunkAt(2, {{15, 25}, {31}}));
+    assert((std::vector<Timestamp>(rolling.eventsForSecond(1, 2).begin(),
+                                   rolling.eventsForSecond(1, 2).end()) ==
+            std::vector<Timestamp>{15, 20, 21, 22, 25}));
+    const auto views = rolling.latestChunk(1);
+    assert(views.size() == 2 && views[0].size() == 5 && views[1].size() == 1);
+    assert(views[1][0] == 31);
+
+    // A chunk entirely behind the window is ignored.
+    rolling.appendChunk(chunkAt(-5, {{1}}));
+    assert(rolling.eventsForSecond(1, -5).empty());
+    assert(rolling.latestChunk(1)[0].empty());
+
+    rolling.setWindow(1);
+    assert(rolling.eventsForSecond(1, 2).empty());
+    assert(rolling.eventsForSecond(1, 3).size() == 2);
+    assert(rolling.allChannels().at(1).eventsPerSecond.size() == 1);
+}
+
+void testRollingDelayHistogramTracksWindow() {
+    constexpr long long kSecond = 1'000'000'000'000LL;
+    std::mt19937_64 rng(99);
+    RollingSingles rolling(3);
+    RollingDelayHistogram hist({{1, 2}}, 20, -2'000, 2'000, 50);
+
+    auto expectedTotal = [&]() {
+        std::vector<long long> total(hist.binCount(), 0);
+        std::vector<std::pair<float, int>> results;
+        const long long latest = rolling.latestSecond();
+        for (long long sec = latest - 2; sec <= latest; ++sec) {
+            const auto e1 = rolling.eventsForSecond(1, sec);
+            const SegmentedSpan e2 = withNextFirstEvent(
+                rolling.eventsForSecond(2, sec), rolling.eventsForSecond(2, sec + 1));
+            if (e1.empty() || e2.empty())
+                continue;
+            computeCoincidencesForRange(SegmentedSpan(e1), e2, 20, -2'000, 2'000,
+                                        50, results);
+            for (size_t b = 0; b < total.size(); ++b)
+                total[b] += results[b].second;
+        }
+        return total;
+    };
+
+    // Half-second chunks: every other update extends a second that is
+    // already tracked, which must be rescanned rather than double counted.
+    for (int chunk = 0; chunk < 12; ++chunk) {
+        Singles s1, s2;
+        s1.channel = 1;
+        s2.channel = 2;
+        for (int k = 0; k < 400; ++k) {
+            const Timestamp t = chunk * (kSecond / 2) +
+                                static_cast<Timestamp>(rng() % (kSecond / 2));
+            ensureSecond(s1, t / kSecond).push_back(t);
+            ensureSecond(s2, (t + 700) / kSecond).push_back(t + 700);
+        }
+        for (auto *s : {&s1, &s2})
+            for (auto &bucket : s->eventsPerSecond)
+                std::sort(bucket.begin(), bucket.end());
+        rolling.appendChunk(std::map<int, Singles>{{1, s1}, {2, s2}});
+        const size_t recomputed = hist.update(rolling);
+        assert(recomputed <= 3);
+        assert(hist.windowHistogram(0) == expectedTotal());
+    }
+    assert(hist.update(rolling) == 0); // nothing changed
+    // t2 = t1 + 700, so the peak sits at delay t1 - t2 = -700 ps.
+    assert(hist.bestDelayPs(0) == -700);
+    assert(hist.secondHistogram(0, rolling.latestSecond() - 3) == nullptr);
+    assert(hist.secondHistogram(0, rolling.latestSecond()) != nullptr);
+}
+
+void testCoarseToFineMatchesFullScan() {
+    std::mt19937_64 rng(4242);
+    constexpr Timestamp kSpanPs = 10'000'000'000LL; // 10 ms of data
+    constexpr Timestamp kOffset = 37'430;
+    std::vector<Timestamp> ref(20'000);
+    for (auto &t : ref)
+        t = static_cast<Timestamp>(rng() % kSpanPs);
+    std::sort(ref.begin(), ref.end());
+    std::vector<Timestamp> correlated;
+    std::vector<Timestamp> noise;
+    for (const Timestamp t : ref) {
+        if (rng() % 10 < 7)
+            correlated.push_back(t + kOffset);
+        noise.push_back(static_cast<Timestamp>(rng() % kSpanPs));
+    }
+    correlated.insert(correlated.end(), noise.begin(), noise.end());
+    std::sort(correlated.begin(), correlated.end());
+    std::sort(noise.begin(), noise.end());
+
+    // +-500 ns at 10 ps: the fine pass only covers a few coarse bins.
+    CoarseToFineReport report;
+    std::vector<std::pair<float, int>> fine;
+    const Timestamp best = findBestDelayCoarseToFine(
+        ref, correlated, 4, -500'000, 500'000, 10, {}, &report, &fine);
+    assert(!report.usedFullScan);
+    assert(best == -kOffset);
+    assert(best == findBestDelayPicoseconds(ref, correlated, 4, -500'000,
+                                            500'000, 10));
+    assert(fine.size() < 10'000);
+
+    // No correlation: the coarse peak is noise, so it falls back.
+    const Timestamp flat = findBestDelayCoarseToFine(
+        ref, noise, 4, -500'000, 500'000, 10, {}, &report);
+    assert(report.usedFullScan);
+    assert(flat == findBestDelayPicoseconds(ref, noise, 4, -500'000, 500'000, 10));
+
+    // Narrow ranges skip the coarse pass entirely.
+    findBestDelayCoarseToFine(ref, correlated, 4, -40'000, -35'000, 100, {},
+                              &report);
+    assert(report.usedFullScan && report.coarseStepPs == 0);
+}
+
+void testFftScanTracksDirect() {
+    // Dense enough for the FFT engine: ~1 event per delay bin per channel.
+    std::mt19937_64 rng(515);
+    constexpr Timestamp kSpanPs = 200'000'000;
+    constexpr Timestamp kOffset = 48'600;
+    std::vector<Timestamp> ch1(100'000);
+    for (auto &t : ch1)
+        t = static_cast<Timestamp>(rng() % kSpanPs);
+    std::sort(ch1.begin(), ch1.end());
+    std::vector<Timestamp> ch2;
+    for (const Timestamp t : ch1) {
+        if (rng() % 4 == 0)
+            ch2.push_back(t + kOffset);
+        ch2.push_back(static_cast<Timestamp>(rng() % kSpanPs));
+    }
+    std::sort(ch2.begin(), ch2.end());
+
+    const long long window = 2'000;
+    const long long step = 1'000;
+    assert(fftScanPreferred(ch1.size(), ch2.size(), kSpanPs, window, -500'000,
+                            500'000, step));
+    assert(!fftScanPreferred(ch1.size(), ch2.size(), kSpanPs, 500, -500'000,
+                             500'000, step)); // window below one step
+
+    std::vector<std::pair<float, int>> direct;
+    std::vector<std::pair<float, int>> fft;
+    setDelayScanEngine(DelayScanEngine::Direct);
+    computeCoincidencesForRange(ch1, ch2, window, -500'000, 500'000, step,
+                                direct);
+    setDelayScanEngine(DelayScanEngine::Auto);
+    computeCoincidencesForRange(ch1, ch2, window, -500'000, 500'000, step, fft);
+    assert(fft.size() == direct.size());
+
+    // Bin-level residuals blur the edges of the peak by up to one step, so
+    // compare totals, away-from-peak bins and the peak location.
+    long long sumDirect = 0;
+    long long sumFft = 0;
+    size_t peakDirect = 0;
+    size_t peakFft = 0;
+    for (size_t b = 0; b < fft.size(); ++b) {
+        assert(fft[b].first == direct[b].first);
+        sumDirect += direct[b].second;
+        sumFft += fft[b].second;
+        if (direct[b].second > direct[peakDirect].second)
+            peakDirect = b;
+        if (fft[b].second > fft[peakFft].second)
+            peakFft = b;
+        const double delayPs = fft[b].first * 1000.0;
+        if (std::abs(delayPs + kOffset) > 5'000) {
+            const double sigma = std::sqrt(std::max(direct[b].second, 1));
+            assert(std::abs(fft[b].second - direct[b].second) < 6.0 * sigma);
+        }
+    }
+    assert(std::llabs(sumFft - sumDirect) < sumDirect / 500);
+    const long long peakGap = static_cast<long long>(peakFft) -
+                              static_cast<long long>(peakDirect);
+    assert(std::llabs(peakGap) <= 2);
+    assert(std::abs(fft[peakFft].first * 1000.0 + kOffset) <= 2'000.0);
+}
+
+void testSpecializedStepsMatchBruteForce() {
+    // Every divider of the range scan (fixed steps, reciprocal, and the
+    // plain division used past the reciprocal's limit) against a count of
+    // all pairs per delay bin.
+    std::mt19937_64 rng(2303);
+    std::vector<Timestamp> ch1(100);
+    for (auto &t : ch1)
+        t = static_cast<Timestamp>(rng() % 400'000'000);
+    std::sort(ch1.begin(), ch1.end());
+    std::vector<Timestamp> ch2;
+    for (const Timestamp t : ch1) {
+        ch2.push_back(t - 7'000 + static_cast<Timestamp>(rng() % 600));
+        ch2.push_back(static_cast<Timestamp>(rng() % 400'000'000));
+    }
+    std::sort(ch2.begin(), ch2.end());
+
+    struct Scan {
+        long long window, start, end, step;
+    };
+    const Scan scans[] = {
+        {250, 6'000, 8'000, 1},       {250, 5'000, 9'000, 10},
+        {250, 5'000, 9'005, 50},      {40, 6'000, 8'000, 100},
+        {250, -3'000, 9'001, 7},      {30, 5'000, 9'000, 333},
+        {5'000'000, -(1LL << 31), 1LL << 31, 1LL << 24},
+    };
+    setDelayScanEngine(DelayScanEngine::Direct);
+    for (const Scan &scan : scans) {
+        std::vector<std::pair<float, int>> results;
+        computeCoincidencesForRange(ch1, ch2, scan.window, scan.start, scan.end,
+                                    scan.step, results);
+        assert(results.size() ==
+               static_cast<size_t>((scan.end - scan.start) / scan.step + 1));
+        for (size_t b = 0; b < results.size(); ++b) {
+            const long long delay =
+                scan.start + static_cast<long long>(b) * scan.step;
+            int expected = 0;
+            for (const Timestamp t1 : ch1)
+                for (const Timestamp t2 : ch2)
+                    expected += std::llabs(t1 - t2 - delay) <= scan.window;
+            assert(results[b].second == expected);
+        }
+    }
+    setDelayScanEngine(DelayScanEngine::Auto);
+}
+
+void testKernelsReuseWorkspace() {
+    std::mt19937_64 rng(2202);
+    std::vector<Timestamp> ch1(20'000);
+    for (auto &t : ch1)
+        t = static_cast<Timestamp>(rng() % 1'000'000'000);
+    std::sort(ch1.begin(), ch1.end());
+    std::vector<Timestamp> ch2;
+    std::vector<Timestamp> ch3;
+    for (const Timestamp t : ch1) {
+        ch2.push_back(t + 9'000 + static_cast<Timestamp>(rng() % 200));
+        ch3.push_back(t + static_cast<Timestamp>(rng() % 300));
+    }
+    std::sort(ch2.begin(), ch2.end());
+    std::sort(ch3.begin(), ch3.end());
+    const std::vector<std::span<const long long>> channels{ch1, ch2, ch3};
+    const std::vector<long long> offsets{0, 9'000, 0};
+
+    setDelayScanEngine(DelayScanEngine::Direct);
+    std::vector<std::pair<float, int>> results;
+    std::vector<std::pair<long long, long long>> hits;
+    long long best = 0;
+    int nfold = 0;
+    const auto run = [&] {
+        computeCoincidencesForRange(ch1, ch2, 250, 5'000, 13'000, 10, results);
+        best = findBestDelayPicoseconds(ch1, ch2, 250, 5'000, 13'000, 10);
+        nfold = countNFoldCoincidences(channels, 250, offsets);
+        collectCoincidencesWithDelay(ch1, ch2, 250, best, hits);
+    };
+    run(); // grows the workspace and the caller-owned outputs
+    const auto warmResults = results;
+    const long long warmBest = best;
+    const int warmNFold = nfold;
+    const size_t warmHits = hits.size();
+
+    gAllocations = 0;
+    gCountAllocations = true;
+    for (int rep = 0; rep < 5; ++rep)
+        run();
+    gCountAllocations = false;
+    setDelayScanEngine(DelayScanEngine::Auto);
+
+    assert(gAllocations == 0);
+    assert(results == warmResults);
+    assert(best == warmBest && nfold == warmNFold && hits.size() == warmHits);
+    assert(warmHits > 0 && nfold > 0);
+}
+
+void testStatsCountHotPaths() {
+    const auto dir = std::filesystem::temp_directory_path();
+    const auto binPath = dir / "coincfinder_test_stats.bin";
+    const auto csvPath = dir / "coincfinder_test_stats.csv";
+    // Every fourth record lands before the previous one on its channel.
+    constexpr int kRecords = 4'000;
+    {
+        std::vector<RawRecord> records;
+        for (int i = 0; i < kRecords; ++i) {
+            const uint64_t ts = 1'000 + static_cast<uint64_t>(i) * 10'000 -
+                                (i % 4 == 3 ? 25'050 : 0);
+            records.push_back({ts, static_cast<uint16_t>(i % 2)});
+        }
+        writeBinCapture(binPath, records);
+    }
+
+    resetStats();
+    double duration = 0.0;
+    const auto flat = readFileAutoFlat(binPath.string(), duration);
+    const std::vector<Timestamp> &ch1 = flat.at(1).timestamps;
+    const std::vector<Timestamp> &ch2 = flat.at(2).timestamps;
+    setDelayScanEngine(DelayScanEngine::Direct);
+    std::vector<std::pair<float, int>> results;
+    computeCoincidencesForRange(ch1, ch2, 250, -20'000, 20'000, 10, results);
+    setDelayScanEngine(DelayScanEngine::Auto);
+    writeResultsToFile(results, csvPath.string());
+
+    const StatsSnapshot snapshot = statsSnapshot();
+    const auto counter = [&](const std::string &name) {
+        for (const auto &[key, value] : snapshot.counters)
+            if (key == name)
+                return value;
+        assert(false && "missing counter");
+        return uint64_t{0};
+    };
+    const auto stageCalls = [&](const std::string &name) {
+        for (const auto &stage : snapshot.stages)
+            if (stage.name == name)
+                return stage.calls;
+        return uint64_t{0};
+    };
+    assert(snapshot.counters.size() == static_cast<size_t>(StatCounter::Count));
+#if COINCFINDER_STATS
+    assert(snapshot.enabled);
+    assert(counter("events_ingested") == kRecords);
+    assert(counter("out_of_order_inserts") == kRecords / 4);
+    assert(counter("candidate_pairs") > 0);
+    assert(counter("bytes_written") == std::filesystem::file_size(csvPath));
+    assert(stageCalls("read") == 1);
+    assert(stageCalls("delay_scan") == 1);
+    assert(stageCalls("write") == 1);
+    assert(statsJson().find("\"events_ingested\": 4000") != std::string::npos);
+
+    resetStats();
+    assert(statsSnapshot().counters.front().second == 0);
+#else
+    assert(!snapshot.enabled && counter("events_ingested") == 0);
+    assert(stageCalls("read") == 0);
+#endif
+    std::filesystem::remove(binPath);
+    std::filesystem::remove(csvPath);
+}
+
+void testBatchPlanShardsAndMerges() {
+    const ShardSpec spec = parseShardSpec("2/5");
+    assert(spec.index == 2 && spec.count == 5);
+    for (const char *bad : {"5/5", "-1/3", "1", "a/2", "1/0"}) {
+        bool threw = false;
+        try {
+            parseShardSpec(bad);
+        } catch (const std::invalid_argument &) {
+            threw = true;
+        }
+        assert(threw);
+    }
+
+    // Both modes cover every (file, second) exactly once over all shards.
+    const std::vector<BatchTask> whole{{"a.bin", 0, 9}, {"b.bin", 5, 7}, {"c.bin", 0, 0}};
+    for (const ShardMode mode : {ShardMode::Files, ShardMode::Seconds}) {
+        std::map<std::string, std::vector<int>> covered;
+        for (int k = 0; k < 4; ++k)
+            for (const BatchTask &task : planShard(whole, {k, 4}, mode))
+                for (long long sec = task.firstSecond; sec <= task.lastSecond; ++sec)
+                    covered[task.file].push_back(static_cast<int>(sec));
+        for (const BatchTask &task : whole) {
+            auto &seconds = covered[task.file];
+            std::sort(seconds.begin(), seconds.end());
+            assert(static_cast<long long>(seconds.size()) == task.seconds());
+            assert(seconds.front() == task.firstSecond &&
+                   seconds.back() == task.lastSecond);
+            assert(std::adjacent_find(seconds.begin(), seconds.end()) == seconds.end());
+        }
+    }
+    assert(planShard(whole, {1, 4}, ShardMode::Files).front().file == "b.bin");
+
+    const auto dir = std::filesystem::temp_directory_path() / "coincfinder_test_batch";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    for (const char *name : {"run2.bin", "run1.bin", "notes.txt"})
+        std::ofstream(dir / name) << "x";
+    {
+        std::ofstream list(dir / "list.txt");
+        list << "# nightly\n\n" << (dir / "notes.txt").string() << "\n";
+    }
+    // Appending to "@" rather than prepending it to a temporary keeps GCC 12
+    // from a false -Wrestrict on the inlined insert.
+    const auto files = expandInputPatterns(
+        {(dir / "run*.bin").string(),
+         std::string("@").append((dir / "list.txt").string()),
+         (dir / "run1.bin").string()});
+    assert(files.size() == 3);
+    assert(files[0] == (dir / "run1.bin").string());
+    assert(files[1] == (dir / "run2.bin").string());
+    assert(files[2] == (dir / "notes.txt").string());
+    bool threw = false;
+    try {
+        expandInputPatterns({(dir / "*.csv").string()});
+    } catch (const std::runtime_error &) {
+        threw = true;
+    }
+    assert(threw);
+
+    MemoryBudget budget(100);
+    {
+        MemoryBudget::Lease big = budget.reserve(1'000); // clamped, runs alone
+        assert(big.bytes() == 100 && budget.inUse() == 100);
+    }
+    MemoryBudget::Lease first = budget.reserve(60);
+    MemoryBudget::Lease moved = std::move(first);
+    assert(budget.inUse() == 60 && first.bytes() == 0);
+    moved = MemoryBudget::Lease();
+    assert(budget.inUse() == 0);
+
+    // Shard 0 and 1 each saw part of a.bin's seconds; the path holds a comma.
+    const std::string odd = "dir,with comma/a.bin";
+    writeBatchSummary(shardSummaryPath(dir.string(), {0, 2}),
+                      {{"HH", 9'750, 0, 4, 5, 40, odd}, {"VV", 11'620, 0, 4, 5, 7, odd}});
+    bool missing = false;
+    try {
+        aggregateShardSummaries(dir.string(), 2);
+    } catch (const std::runtime_error &) {
+        missing = true;
+    }
+    assert(missing);
+    writeBatchSummary(shardSummaryPath(dir.string(), {1, 2}),
+                      {{"HH", 9'750, 5, 9, 5, 2, odd}, {"HH", 9'750, 0, 0, 1, 1, "b.bin"}});
+    const auto merged = aggregateShardSummaries(dir.string(), 2);
+    assert(merged.size() == 3);
+    assert(merged[0].pair == "HH" && merged[0].file == odd);
+    assert(merged[0].firstSecond == 0 && merged[0].lastSecond == 9);
+    assert(merged[0].seconds == 10 && merged[0].coincidences == 42);
+    assert(merged[1].pair == "VV" && merged[1].coincidences == 7);
+    assert(merged[2].file == "b.bin");
+
+    bool conflict = false;
+    try {
+        mergeBatchSummaries({{"HH", 1, 0, 0, 1, 1, "x"}, {"HH", 2, 1, 1, 1, 1, "x"}});
+    } catch (const std::runtime_error &) {
+        conflict = true;
+    }
+    assert(conflict);
+    std::filesystem::remove_all(dir);
+}
+
+void testCaptureDurationMatchesRead() {
+    const auto binPath =
+        std::filesystem::temp_directory_path() / "coincfinder_test_duration.bin";
+    {
+        std::vector<RawRecord> records;
+        for (int i = 0; i < 1'000; ++i)
+            records.push_back({7'000 + static_cast<uint64_t>(i) * 3'000'000'000ULL,
+                               static_cast<uint16_t>(i % 3)});
+        writeBinCapture(binPath, records);
+    }
+    double duration = 0.0;
+    readFileAuto(binPath.string(), duration);
+    assert(duration > 2.9);
+    assert(captureDurationSeconds(binPath.string()) == duration);
+    std::filesystem::remove(binPath);
+}
+
+void testVisibilityMetrics() {
+    const BasisMetrics m = basisMetrics(90.0, 10.0, 5.0, 5.0);
+    assert(std::abs(m.visibility - 0.8) < 1e-12 && std::abs(m.qber - 0.1) < 1e-12);
+    assert(std::abs(m.visibilityCorrected - 80.0 / 90.0) < 1e-12);
+    assert(std::abs(m.qberCorrected - 5.0 / 90.0) < 1e-12);
+    assert(std::isnan(basisMetrics(0.0, 0.0, 0.0, 0.0).visibility));
+    assert(std::abs(singlesProductAccidentals(1000, 2000, 250, 1'000'000'000'000LL) -
+                    1000.0 * 2000.0 * 501.0 / 1e12) < 1e-15);
+
+    // H and V emitters: 1-5 and 2-6 mostly correlated, a tenth of H leaking
+    // into 6, over two seconds plus a lookahead second.
+    const long long delayPs = 4'000;
+    const long long second = 1'000'000'000'000LL;
+    std::mt19937_64 rng(29);
+    std::uniform_int_distribution<long long> offset(0, second - 1);
+    std::map<int, Singles> singles;
+    for (int ch : {1, 2, 5, 6})
+        singles[ch].channel = ch;
+    for (long long sec = 0; sec < 3; ++sec) {
+        for (int n = 0; n < 2000; ++n) {
+            const long long t1 = sec * second + offset(rng);
+            const long long t2 = sec * second + offset(rng);
+            ensureSecond(singles[1], sec).push_back(t1);
+            ensureSecond(singles[2], sec).push_back(t2);
+            if (n % 10 != 0)
+                ensureSecond(singles[5], sec).push_back(t1 - delayPs + n % 7);
+            ensureSecond(singles[6], sec).push_back(n % 10 == 0 ? t1 - delayPs
+                                                                : t2 - delayPs);
+        }
+        for (auto &[ch, s] : singles)
+            std::sort(s.eventsPerSecond.back().begin(), s.eventsPerSecond.back().end());
+    }
+
+    const std::vector<AnalysisPair> pairs{{"HH", 1, 5, delayPs},
+                                          {"VV", 2, 6, delayPs},
+                                          {"HV", 1, 6, delayPs},
+                                          {"VH", 2, 5, delayPs}};
+    const std::vector<BasisPairs> bases = polarizationBases(pairs);
+    assert(bases.size() == 1 && bases[0].name == "HV");
+    assert((bases[0].same == std::vector<size_t>{0, 1}));
+    assert((bases[0].opposite == std::vector<size_t>{2, 3}));
+
+    const long long window = 50;
+    const VisibilityAnalysis offPeak(pairs, bases, window);
+    assert(offPeak.offPeakOffsetPs() == kDefaultOffPeakWindows * window);
+    const std::vector<SecondMetrics> metrics = offPeak.analyze(singles, 0, 1);
+    assert(metrics.size() == 2);
+    for (const SecondMetrics &sm : metrics) {
+        const long long sec = sm.second;
+        for (size_t k = 0; k < pairs.size(); ++k) {
+            const Singles &a = singles.at(pairs[k].ch1);
+            const Singles &b = singles.at(pairs[k].ch2);
+            const SegmentedSpan spanA =
+                withNextFirstEvent(eventsForSecond(a, sec), eventsForSecond(a, sec + 1));
+            const SegmentedSpan spanB =
+                withNextFirstEvent(eventsForSecond(b, sec), eventsForSecond(b, sec + 1));
+            assert(sm.pairs[k].coincidences ==
+                   countCoincidencesWithDelay(spanA, spanB, window, delayPs));
+            const double background =
+                0.5 * (countCoincidencesWithDelay(spanA, spanB, window,
+                                                  delayPs - offPeak.offPeakOffsetPs()) +
+                       countCoincidencesWithDelay(spanA, spanB, window,
+                                                  delayPs + offPeak.offPeakOffsetPs()));
+            assert(sm.pairs[k].accidentals == background);
+        }
+        const BasisMetrics expected = basisMetrics(sm.pairs, bases[0]);
+        assert(sm.bases.size() == 1 && sm.bases[0].visibility == expected.visibility);
+        assert(sm.total.visibility == expected.visibility);
+        assert(sm.total.same == expected.same);
+        // 1800 HH + 1800 VV against 200 HV, plus the odd random overlap.
+        assert(sm.bases[0].same >= 3600.0 && sm.bases[0].same < 3610.0);
+        assert(sm.bases[0].opposite >= 200.0 && sm.bases[0].opposite < 210.0);
+        assert(sm.bases[0].visibilityCorrected >= sm.bases[0].visibility - 1e-3);
+    }
+
+    AccidentalsOptions product;
+    product.method = AccidentalsMethod::SinglesProduct;
+    const VisibilityAnalysis singlesBased(pairs, bases, window, product);
+    const SecondMetrics first = singlesBased.analyze(singles, 0, 0).front();
+    assert(first.pairs[0].coincidences == metrics[0].pairs[0].coincidences);
+    assert(std::abs(first.pairs[0].accidentals -
+                    singlesProductAccidentals(2000, 1800, window, second)) < 1e-12);
+
+    bool threw = false;
+    try {
+        VisibilityAnalysis(pairs, {{"bad", {0}, {7}}}, window);
+    } catch (const std::invalid_argument &) {
+        threw = true;
+    }
+    assert(threw);
+}
+
+void testAutoBucketWidth() {
+    const long long second = kDefaultBucketWidthPs;
+    assert(chooseBucketWidthPs(1'000, second) == second);
+    assert(chooseBucketWidthPs(5 * kAutoBucketEvents, second) == second / 8);
+    assert(chooseBucketWidthPs(100'000, second / 1000) == second / 4);
+    assert(chooseBucketWidthPs(size_t{1} << 40, second) ==
+           second / kMaxAutoBucketsPerSecond);
+    assert(bucketWidthForExposure(kAutoExposure) == 0);
+    // As before automatic widths existed, 0 and negative exposures select
+    // the process default.
+    assert(bucketWidthForExposure(0.0) == second);
+    assert(bucketWidthForExposure(-1.0) == second);
+    assert(bucketWidthForExposure(0.25) == second / 4);
+
+    // 100k events/s on channel 1 over two seconds: four buckets per second.
+    const auto binPath =
+        std::filesystem::temp_directory_path() / "coincfinder_test_auto_bucket.bin";
+    {
+        std::vector<RawRecord> records;
+        for (int i = 0; i < 200'000; ++i)
+            records.push_back({7'000 + static_cast<uint64_t>(i) * 10'000'000ULL,
+                               static_cast<uint16_t>(i % 100 == 0 ? 1 : 0)});
+        writeBinCapture(binPath, records);
+    }
+    const std::string path = binPath.string();
+
+    // Reads with different exposures on concurrent threads neither see nor
+    // change each other's width.
+    double duration = 0.0;
+    double durationAuto = 0.0;
+    double durationHalf = 0.0;
+    std::map<int, FlatSingles> plain;
+    std::map<int, FlatSingles> automatic;
+    std::map<int, FlatSingles> odd;
+    std::thread autoReader(
+        [&] { automatic = readFileAutoFlat(path, durationAuto, kAutoExposure); });
+    std::thread oddReader([&] { odd = readFileAutoFlat(path, durationHalf, 0.3); });
+    plain = readFileAutoFlat(path, duration);
+    autoReader.join();
+    oddReader.join();
+    assert(bucketDurationSeconds() == 1.0);
+    assert(plain.at(1).bucketWidthPs == second);
+    assert(odd.at(1).bucketWidthPs == 300'000'000'000LL);
+    for (const auto &[ch, flat] : automatic)
+        assert(flat.bucketWidthPs == second / 4);
+    assert(automatic.at(1).bucketCount() == 8);
+    assert(durationAuto == duration && durationHalf == duration);
+
+    // Capture seconds map onto the finer (or misaligned) buckets.
+    for (int ch : {1, 2}) {
+        for (long long sec = -1; sec <= 2; ++sec) {
+            const auto expected = eventsForSecond(plain.at(ch), sec);
+            for (const auto *layout : {&automatic, &odd}) {
+                const auto got = eventsForCaptureSeconds(layout->at(ch), sec, sec);
+                assert(std::equal(got.begin(), got.end(), expected.begin(),
+                                  expected.end()));
+            }
+            const auto withNext = captureSecondWithNextFirst(automatic.at(ch), sec);
+            const auto plainNext = eventsWithNextFirst(plain.at(ch), sec);
+            assert(std::equal(withNext.begin(), withNext.end(), plainNext.begin(),
+                              plainNext.end()));
+        }
+    }
+
+    // Second-keyed accessors refuse finer buckets; the per-second scans map
+    // capture seconds onto them and match the one-second read.
+    std::map<int, Singles> plainSingles, autoSingles, oddSingles;
+    for (int ch : {1, 2}) {
+        plainSingles[ch] = expandSingles(plain.at(ch));
+        autoSingles[ch] = expandSingles(automatic.at(ch));
+        oddSingles[ch] = expandSingles(odd.at(ch));
+    }
+    bool rejected = false;
+    try {
+        (void)eventsForSecond(automatic.at(1), 0);
+    } catch (const std::invalid_argument &) {
+        rejected = true;
+    }
+    assert(rejected);
+    rejected = false;
+    try {
+        (void)eventsForSecond(oddSingles.at(1), 0);
+    } catch (const std::invalid_argument &) {
+        rejected = true;
+    }
+    assert(rejected);
+    assert(eventsForBucket(autoSingles.at(1), 1).size() ==
+           eventsForBucket(automatic.at(1), 1).size());
+    std::vector<Timestamp> scratch;
+    for (long long sec = -1; sec <= 2; ++sec) {
+        const auto &expected = eventsForSecond(plainSingles.at(2), sec);
+        for (const auto *layout : {&autoSingles, &oddSingles}) {
+            const auto got = eventsForCaptureSecond(layout->at(2), sec, scratch);
+            assert(std::equal(got.begin(), got.end(), expected.begin(),
+                              expected.end()));
+            const auto head = firstEventOfCaptureSecond(layout->at(2), sec);
+            assert(head.size() == (expected.empty() ? 0u : 1u));
+            assert(head.empty() || head.front() == expected.front());
+        }
+    }
+    const std::vector<std::pair<int, int>> sweepPairs{{1, 2}, {2, 1}};
+    // Channel 2 ticks every 10 us, so the +-10 us bins hold coincidences.
+    const long long tick = 10'000'000;
+    const auto plainSweeps = computeDelaySweeps(plainSingles, sweepPairs, 0, 1, 100,
+                                                -2 * tick, 2 * tick, tick / 2);
+    assert(std::count(plainSweeps.begin(), plainSweeps.end(), 0) <
+           static_cast<std::ptrdiff_t>(plainSweeps.size()));
+    assert(computeDelaySweeps(autoSingles, sweepPairs, 0, 1, 100, -2 * tick,
+                              2 * tick, tick / 2) == plainSweeps);
+    assert(computeDelaySweeps(oddSingles, sweepPairs, 0, 1, 100, -2 * tick,
+                              2 * tick, tick / 2) == plainSweeps);
+    AccidentalsOptions product;
+    product.method = AccidentalsMethod::SinglesProduct;
+    const VisibilityAnalysis perSecond({{"HH", 1, 2, tick}}, {}, 100, product);
+    const auto plainMetrics = perSecond.analyze(plainSingles, 0, 1);
+    assert(plainMetrics[0].pairs[0].coincidences > 0);
+    for (const auto *layout : {&autoSingles, &oddSingles}) {
+        const auto metrics = perSecond.analyze(*layout, 0, 1);
+        assert(metrics.size() == plainMetrics.size());
+        for (size_t i = 0; i < metrics.size(); ++i) {
+            assert(metrics[i].pairs[0].coincidences ==
+                   plainMetrics[i].pairs[0].coincidences);
+            assert(metrics[i].pairs[0].accidentals ==
+                   plainMetrics[i].pairs[0].accidentals);
+        }
+    }
+    RollingSingles fineRolling(8);
+    fineRolling.appendChunk(automatic);
+    RollingDelayHistogram fineHistogram({{1, 2}}, 100, -1'000, 1'000, 500);
+    rejected = false;
+    try {
+        fineHistogram.update(fineRolling);
+    } catch (const std::invalid_argument &) {
+        rejected = true;
+    }
+    assert(rejected);
+
+    // Range arguments of an automatic read are capture seconds.
+    double rangeDuration = 0.0;
+    const auto slice = readFileAuto(path, rangeDuration, kAutoExposure, 1, 1);
+    assert(rangeDuration == duration);
+    const Singles &slice1 = slice.at(1);
+    assert(slice1.bucketWidthPs == second / 4 && slice1.baseSecond == 4);
+    size_t sliceEvents = 0;
+    for (const auto &bucket : slice1.eventsPerSecond)
+        sliceEvents += bucket.size();
+    assert(sliceEvents == eventsForSecond(plain.at(1), 1).size());
+    assert(flattenSingles(slice1).bucketWidthPs == slice1.bucketWidthPs);
+
+    bool threw = false;
+    try {
+        readFileAutoCompact(path, duration, kAutoExposure);
+    } catch (const std::invalid_argument &) {
+        threw = true;
+    }
+    assert(threw);
+    std::filesystem::remove(binPath);
+}
+
 int main() {
     testHistogramMatchesNaive();
     testFindBestDelay();
     testNFoldCounts();
+    testNFoldMergeMatchesSort();
+    testBinReadersAgree();
+    testParallelCsvMatchesSerial();
+    testCsvRestoresChannelOrder();
+    testRestoreOrderFallbackAndSeams();
+    testSinglesCacheRoundTrip();
+    testRangeReadMatchesFull();
+    testFlatSinglesViews();
+    testCompactSinglesMatchFlat();
+    testReadFileAutoCompact();
+    testSegmentedSpansMatchCopies();
+    testKernelsMatchNaive();
+    testCountAtDelaysMatchesSingleDelay();
+    testCoincidenceMatrixMatchesPairs();
+    testSweepTensorRoundTrip();
+    testDelaySweepsMatchPerSecond();
+    testOrderedBlockWriterReorders();
+    testTailReaderFeedsRolling();
+    testRollingIngestRestoresOrder();
+    testRollingRingWindow();
+    testRollingDelayHistogramTracksWindow();
+    testCoarseToFineMatchesFullScan();
+    testFftScanTracksDirect();
+    testSpecializedStepsMatchBruteForce();
+    testKernelsReuseWorkspace();
+    testStatsCountHotPaths();
+    testBatchPlanShardsAndMerges();
+    testCaptureDurationMatchesRead();
+    testVisibilityMetrics();
+    testAutoBucketWidth();
     std::cout << "All CoincFinder tests passed" << std::endl;
     return 0;
 }
@@ -3,59 +3,66 @@
 // at those fixed delays for both same and cross pairs across the requested
 // time window. Optionally dumps individual coincidence events (timetags).
 
+#include <algorithm>
+#include <charconv>
 #include <cmath>
+#include <cstdint>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <limits>
 #include <map>
+#include <memory>
+#include <optional>
 #include <span>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
+#include "ChannelPairs.h"
 #include "Coincidences.h"
+#include "Instrumentation.h"
+#include "OrderedBlockWriter.h"
 #include "ReadCSV.h"
 #include "Singles.h"
+#include "SinglesCache.h"
+#include "Visibility.h"
 
 namespace {
 
-struct PairInfo {
-    int ch1;
-    int ch2;
-    std::string label;
-    std::string delay_source; // which same-pair delay to reuse
-};
-
 struct DelayInfo {
     long long delayPs = 0;
     double delayNs = 0.0;
     bool valid = false;
 };
 
-std::span<const long long> spanWithNext(const Singles &s, int second,
-                                        std::vector<long long> &scratch) {
+// Bucket for `second` plus the head of the next one, as a segmented view.
+SegmentedSpan spanWithNext(const Singles &s, int second) {
     const auto &current = eventsForSecond(s, second);
     const auto &next = eventsForSecond(s, second + 1);
-    return appendNextFirstEvent(current, next, scratch);
+    return withNextFirstEvent(current, next);
 }
 
 DelayInfo bestDelayForPair(const Singles &s1, const Singles &s2,
                            int second, long long coincWindowPs,
                            long long delayStartPs, long long delayEndPs,
-                           long long delayStepPs,
-                           std::vector<std::pair<float, int>> &scratchResults,
-                           std::vector<long long> &scratch1,
-                           std::vector<long long> &scratch2) {
-    const auto span1 = spanWithNext(s1, second, scratch1);
-    const auto span2 = spanWithNext(s2, second, scratch2);
+                           long long delayStepPs, bool coarseToFine,
+                           std::vector<std::pair<float, int>> &scratchResults) {
+    COINCFINDER_TIME_SCOPE("delay_search");
+    const auto span1 = spanWithNext(s1, second);
+    const auto span2 = spanWithNext(s2, second);
     if (span1.empty() || span2.empty())
         return {};
 
     const long long delayPs =
-        findBestDelayPicoseconds(span1, span2, coincWindowPs,
-                                 delayStartPs, delayEndPs, delayStepPs,
-                                 &scratchResults);
+        coarseToFine
+            ? findBestDelayCoarseToFine(span1, span2, coincWindowPs,
+                                        delayStartPs, delayEndPs, delayStepPs,
+                                        {}, nullptr, &scratchResults)
+            : findBestDelayPicoseconds(span1, span2, coincWindowPs,
+                                       delayStartPs, delayEndPs, delayStepPs,
+                                       &scratchResults);
     DelayInfo info;
     info.delayPs = delayPs;
     info.delayNs = static_cast<double>(delayPs) / 1000.0;
@@ -63,27 +70,64 @@ DelayInfo bestDelayForPair(const Singles &s1, const Singles &s2,
     return info;
 }
 
-int countAtDelay(const Singles &s1, const Singles &s2, int second,
-                 long long coincWindowPs, long long delayPs,
-                 std::vector<long long> &scratch1,
-                 std::vector<long long> &scratch2) {
-    const auto span1 = spanWithNext(s1, second, scratch1);
-    const auto span2 = spanWithNext(s2, second, scratch2);
-    if (span1.empty() || span2.empty())
-        return 0;
-    return countCoincidencesWithDelay(span1, span2, coincWindowPs, delayPs);
+enum class DumpFormat { Csv, Binary };
+
+// Binary dumps start with this tag, followed by little-endian int64 records
+// (second, t1_ps, t2_ps).
+constexpr char kBinaryDumpMagic[8] = {'C', 'F', 'H', 'I', 'T', 'S', '0', '1'};
+
+void appendInteger(std::string &out, long long value) {
+    char buf[24];
+    const auto res = std::to_chars(buf, buf + sizeof(buf), value);
+    out.append(buf, res.ptr);
 }
 
-std::vector<std::pair<long long, long long>>
-collectCoincidences(const Singles &s1, const Singles &s2, int second,
-                    long long coincWindowPs, long long delayPs,
-                    std::vector<long long> &scratch1,
-                    std::vector<long long> &scratch2) {
-    const auto span1 = spanWithNext(s1, second, scratch1);
-    const auto span2 = spanWithNext(s2, second, scratch2);
+void appendLittleEndian(std::string &out, long long value) {
+    auto bits = static_cast<uint64_t>(value);
+    char bytes[8];
+    for (char &b : bytes) {
+        b = static_cast<char>(bits & 0xFFu);
+        bits >>= 8;
+    }
+    out.append(bytes, sizeof(bytes));
+}
+
+// Formats one second's hits for a pair in the requested dump format.
+void formatHits(std::string &out, int second,
+                const std::vector<std::pair<long long, long long>> &hits,
+                DumpFormat format) {
+    out.clear();
+    if (format == DumpFormat::Binary) {
+        out.reserve(hits.size() * 24);
+        for (const auto &h : hits) {
+            appendLittleEndian(out, second);
+            appendLittleEndian(out, h.first);
+            appendLittleEndian(out, h.second);
+        }
+        return;
+    }
+    out.reserve(hits.size() * 40);
+    for (const auto &h : hits) {
+        appendInteger(out, second);
+        out.push_back(',');
+        appendInteger(out, h.first);
+        out.push_back(',');
+        appendInteger(out, h.second);
+        out.push_back('\n');
+    }
+}
+
+// Fills `hits` (reused across seconds by each worker) with one second's
+// coincidences.
+void collectCoincidences(const Singles &s1, const Singles &s2, int second,
+                         long long coincWindowPs, long long delayPs,
+                         std::vector<std::pair<long long, long long>> &hits) {
+    hits.clear();
+    const auto span1 = spanWithNext(s1, second);
+    const auto span2 = spanWithNext(s2, second);
     if (span1.empty() || span2.empty())
-        return {};
-    return collectCoincidencesWithDelay(span1, span2, coincWindowPs, delayPs);
+        return;
+    collectCoincidencesWithDelay(span1, span2, coincWindowPs, delayPs, hits);
 }
 
 } // namespace
@@ -92,7 +136,7 @@ void print_help(const char *exe) {
     std::cout
         << "CoincPairs - fixed-delay coincidence counter (optional timetags)\n"
         << "Usage: " << exe
-        << " <csv|bin> <coinc_window_ps> <delay_start_ns> <delay_end_ns> <delay_step_ns> <startSec> <stopSec> [output_csv] [--dump-events]\n"
+        << " <csv|bin> <coinc_window_ps> <delay_start_ns> <delay_end_ns> <delay_step_ns> <startSec> <stopSec> [output_csv] [--dump-events] [--dump-format csv|bin] [--coarse-to-fine] [--pairs 1-5,2-6,...] [--cache] [--stats [file]] [--visibility [file]] [--accidentals offpeak|singles|none] [--offpeak-ns n]\n"
         << "Examples:\n"
         << "  " << exe << " data.bin 250 8 12 0.01 0 600\n"
         << "  " << exe << " data.bin 250 8 12 0.01 0 600 report.csv --dump-events\n\n"
@@ -100,7 +144,23 @@ void print_help(const char *exe) {
         << "  - Finds peak delays for same pairs (HH, VV, DD, AA) at the first in-range second,\n"
         << "    reuses them for cross pairs (HV,VH,DA,AD).\n"
         << "  - Writes per-second counts to output_csv (default coincidences_report.csv).\n"
-        << "  - With --dump-events, writes CoincEvents/<pair>.csv containing raw timetag pairs.\n"
+        << "  - With --dump-events, writes CoincEvents/<pair>.csv containing raw timetag pairs\n"
+        << "    (or CoincEvents/<pair>.bin with --dump-format bin: \"CFHITS01\" then int64\n"
+        << "    little-endian records second,t1_ps,t2_ps).\n"
+        << "  - With --pairs, only the listed channel pairs are processed; each finds\n"
+        << "    its own delay (labels become <ch1>-<ch2>).\n"
+        << "  - With --coarse-to-fine, the delay search locates the peak on a coarse\n"
+        << "    histogram first and refines only around it (falls back to the full scan\n"
+        << "    when the coarse peak is ambiguous); useful for wide delay ranges.\n"
+        << "  - With --cache, the input is read through <input>.cfcache (written on the\n"
+        << "    first run); later runs map it and load only the requested seconds.\n"
+        << "  - With --stats, stage timings and counters are printed as JSON to\n"
+        << "    stderr, or written to the given file (see Instrumentation.h).\n"
+        << "  - With --visibility, per-second visibility and QBER of the HV and DA\n"
+        << "    bases (raw and accidental-corrected) go to the given file (default\n"
+        << "    visibility_report.csv). --accidentals picks the background estimate:\n"
+        << "    counts at delay +- --offpeak-ns (default 100 windows) from the same\n"
+        << "    sweep, the singles product, or none.\n"
         << "Notes:\n"
         << "  - startSec/stopSec are clamped to available data seconds.\n"
         << "  - delay_* in nanoseconds; window in picoseconds.\n";
@@ -119,12 +179,73 @@ int main(int argc, char *argv[]) {
     const double delayStepNs = std::atof(argv[5]);
     int startSec = std::atoi(argv[6]);
     int stopSec = std::atoi(argv[7]);
-    const bool dumpEvents =
-        (argc >= 9 && std::string(argv[argc - 1]) == "--dump-events");
-
-    const std::string outCsv =
-        dumpEvents ? (argc >= 10 ? argv[8] : "coincidences_report.csv")
-                   : (argc >= 9 ? argv[8] : "coincidences_report.csv");
+    bool dumpEvents = false;
+    DumpFormat dumpFormat = DumpFormat::Csv;
+    std::string outCsv = "coincidences_report.csv";
+    bool outCsvGiven = false;
+    bool coarseToFine = false;
+    bool useCache = false;
+    std::string statsPath;
+    std::string visibilityPath;
+    AccidentalsOptions accidentals;
+    std::vector<std::pair<int, int>> requestedPairs;
+    for (int a = 8; a < argc; ++a) {
+        const std::string arg = argv[a];
+        if (arg == "--dump-events") {
+            dumpEvents = true;
+        } else if (arg == "--stats") {
+            const bool hasValue =
+                a + 1 < argc && !std::string_view(argv[a + 1]).starts_with("--");
+            statsPath = hasValue ? argv[++a] : "-";
+        } else if (arg == "--visibility") {
+            const bool hasValue =
+                a + 1 < argc && !std::string_view(argv[a + 1]).starts_with("--");
+            visibilityPath = hasValue ? argv[++a] : "visibility_report.csv";
+        } else if (arg == "--accidentals" && a + 1 < argc) {
+            const std::string value = argv[++a];
+            if (value == "offpeak") {
+                accidentals.method = AccidentalsMethod::OffPeak;
+            } else if (value == "singles") {
+                accidentals.method = AccidentalsMethod::SinglesProduct;
+            } else if (value == "none") {
+                accidentals.method = AccidentalsMethod::None;
+            } else {
+                std::cerr << "Unknown accidentals method: " << value << "\n";
+                return 1;
+            }
+        } else if (arg == "--offpeak-ns" && a + 1 < argc) {
+            accidentals.offPeakOffsetPs =
+                static_cast<long long>(std::llround(std::atof(argv[++a]) * 1000.0));
+        } else if (arg == "--pairs" && a + 1 < argc) {
+            try {
+                requestedPairs = parseChannelPairs(argv[++a]);
+            } catch (const std::exception &ex) {
+                std::cerr << ex.what() << "\n";
+                return 1;
+            }
+        } else if (arg == "--coarse-to-fine") {
+            coarseToFine = true;
+        } else if (arg == "--cache") {
+            useCache = true;
+        } else if (arg == "--dump-format" && a + 1 < argc) {
+            const std::string value = argv[++a];
+            if (value == "csv") {
+                dumpFormat = DumpFormat::Csv;
+            } else if (value == "bin") {
+                dumpFormat = DumpFormat::Binary;
+            } else {
+                std::cerr << "Unknown dump format: " << value << "\n";
+                return 1;
+            }
+        } else if (!outCsvGiven && arg.rfind("--", 0) != 0) {
+            outCsv = arg;
+            outCsvGiven = true;
+        } else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            print_help(argv[0]);
+            return 1;
+        }
+    }
 
     if (coincWindowPs <= 0 || delayStepNs <= 0.0 || delayEndNs < delayStartNs ||
         startSec < 0 || stopSec < 0 || startSec > stopSec) {
@@ -141,7 +262,12 @@ int main(int argc, char *argv[]) {
 
     std::cout << "Reading " << filename << "...\n";
     double duration_sec = 0.0;
-    auto singlesMap = readFileAuto(filename, duration_sec);
+    // Only the requested seconds are loaded, plus one bucket past stopSec for
+    // the boundary lookahead.
+    const long long lastBucket = static_cast<long long>(stopSec) + 1;
+    auto singlesMap =
+        useCache ? readFileCached(filename, duration_sec, startSec, lastBucket)
+                 : readFileAuto(filename, duration_sec, -1.0, startSec, lastBucket);
 
     long long earliestSec = std::numeric_limits<long long>::max();
     long long latestSec = std::numeric_limits<long long>::min();
@@ -166,13 +292,11 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    // Define same and cross pairs
-    std::vector<PairInfo> samePairs = {
-        {1, 5, "HH", "HH"}, {2, 6, "VV", "VV"},
-        {3, 7, "DD", "DD"}, {4, 8, "AA", "AA"}};
-    std::vector<PairInfo> crossPairs = {
-        {1, 6, "HV", "HH"}, {2, 5, "VH", "VV"},
-        {3, 8, "DA", "DD"}, {4, 7, "AD", "AA"}};
+    // Define same and cross pairs; user-supplied pairs each scan for their
+    // own delay.
+    PairTable table = pairTable(requestedPairs);
+    std::vector<PairInfo> &samePairs = table.same;
+    std::vector<PairInfo> &crossPairs = table.cross;
 
     // Filter to existing channels
     auto hasChannel = [&](int ch) { return singlesMap.count(ch) > 0; };
@@ -195,13 +319,12 @@ int main(int argc, char *argv[]) {
     // Compute best delays using the first available second in-range (startSec)
     std::map<std::string, DelayInfo> delays;
     std::vector<std::pair<float, int>> scratchResults;
-    std::vector<long long> scratch1, scratch2;
     for (const auto &p : samePairs) {
         const Singles &s1 = singlesMap.at(p.ch1);
         const Singles &s2 = singlesMap.at(p.ch2);
         DelayInfo d = bestDelayForPair(s1, s2, startSec, coincWindowPs,
                                        delayStartPs, delayEndPs, delayStepPs,
-                                       scratchResults, scratch1, scratch2);
+                                       coarseToFine, scratchResults);
         if (d.valid) {
             delays[p.label] = d;
             std::cout << "Delay " << p.label << ": " << d.delayNs << " ns\n";
@@ -220,65 +343,211 @@ int main(int argc, char *argv[]) {
     }
     out << "second,pair,delay_ns,coincidences\n";
 
-    std::map<std::string, std::ofstream> eventStreams;
+    // Convenience list to process both same and cross with the same loop
+    std::vector<PairInfo> allPairs;
+    allPairs.reserve(samePairs.size() + crossPairs.size());
+    allPairs.insert(allPairs.end(), samePairs.begin(), samePairs.end());
+    allPairs.insert(allPairs.end(), crossPairs.begin(), crossPairs.end());
+
+    // One ordered writer per pair: workers finish seconds in any order and
+    // the writer threads append them chronologically.
+    std::vector<std::unique_ptr<OrderedBlockWriter>> eventWriters;
+    std::filesystem::path perFileDir;
     if (dumpEvents) {
         std::filesystem::path eventsRoot("CoincEvents");
         std::filesystem::path inputPath(filename);
         // Use the stem (no extension) to avoid nesting directories based on full path.
-        std::filesystem::path perFileDir = eventsRoot / inputPath.stem();
+        perFileDir = eventsRoot / inputPath.stem();
         if (inputPath.stem().empty())
             perFileDir = eventsRoot;
 
         std::filesystem::create_directories(perFileDir);
-        auto openStream = [&](const std::string &label) {
-            auto &stream = eventStreams[label];
-            const auto outPath = perFileDir / (label + ".csv");
-            stream.open(outPath);
-            stream << "second,t1_ps,t2_ps\n";
-        };
-        for (const auto &p : samePairs)
-            openStream(p.label);
-        for (const auto &p : crossPairs)
-            openStream(p.label);
+        const bool binary = dumpFormat == DumpFormat::Binary;
+        const std::string preamble =
+            binary ? std::string(kBinaryDumpMagic, sizeof(kBinaryDumpMagic))
+                   : std::string("second,t1_ps,t2_ps\n");
+        try {
+            for (const auto &p : allPairs)
+                eventWriters.push_back(std::make_unique<OrderedBlockWriter>(
+                    (perFileDir / (p.label + (binary ? ".bin" : ".csv")))
+                        .string(),
+                    preamble));
+        } catch (const std::exception &ex) {
+            std::cerr << ex.what() << "\n";
+            return 1;
+        }
     }
 
-    // Convenience list to process both same and cross with the same loop
-    std::vector<PairInfo> allPairs;
-    allPairs.reserve(samePairs.size() + crossPairs.size());
-    allPairs.insert(allPairs.end(), samePairs.begin(), samePairs.end());
-    allPairs.insert(allPairs.end(), crossPairs.begin(), crossPairs.end());
+    // Per-second counts, stored densely so the report can be written in
+    // order after the parallel loop; -1 marks pairs without a usable delay.
+    const int totalSeconds = stopSec - startSec + 1;
+    const size_t pairCount = allPairs.size();
+    std::vector<int> counts(static_cast<size_t>(totalSeconds) * pairCount, -1);
+
+    // Without dumps, every pair of a second is counted in one matrix sweep
+    // over the channels involved instead of streaming each bucket per pair.
+    const PairMatrix matrix =
+        pairMatrix(allPairs, [&](const std::string &source) -> std::optional<long long> {
+            const auto it = delays.find(source);
+            if (it == delays.end() || !it->second.valid)
+                return std::nullopt;
+            return it->second.delayPs;
+        });
+    const std::vector<int> &matrixChannels = matrix.channels;
+    const std::vector<CoincidencePair> &matrixPairs = matrix.pairs;
+    const std::vector<size_t> &matrixSlots = matrix.slots;
+
+    // With --visibility the analysis sweeps the same channels, adding each
+    // pair's off-peak delays, and its peak counts replace the plain matrix.
+    std::unique_ptr<VisibilityAnalysis> visibility;
+    std::vector<SecondMetrics> secondMetrics;
+    if (!visibilityPath.empty()) {
+        std::vector<AnalysisPair> analysisPairs;
+        for (const size_t slot : matrixSlots) {
+            const PairInfo &pair = allPairs[slot];
+            analysisPairs.push_back({pair.label, pair.ch1, pair.ch2,
+                                     delays.at(pair.delay_source).delayPs});
+        }
+        std::vector<BasisPairs> bases = polarizationBases(analysisPairs);
+        if (accidentals.bucketPs == 0)
+            accidentals.bucketPs = singlesMap.begin()->second.bucketWidthPs;
+        if (bases.empty())
+            std::cerr << "Warning: --visibility needs HH/VV/HV/VH or DD/AA/DA/AD;"
+                         " the report will be empty.\n";
+        try {
+            visibility = std::make_unique<VisibilityAnalysis>(
+                std::move(analysisPairs), std::move(bases), coincWindowPs,
+                accidentals);
+        } catch (const std::exception &ex) {
+            std::cerr << ex.what() << "\n";
+            return 1;
+        }
+        secondMetrics.resize(static_cast<size_t>(totalSeconds));
+    }
 
-    // Process per-second counts
-    for (int sec = startSec; sec <= stopSec; ++sec) {
-        for (const auto &p : allPairs) {
-            const auto itDelay = delays.find(p.delay_source);
-            if (itDelay == delays.end() || !itDelay->second.valid)
+#pragma omp parallel
+    {
+        std::string block;
+        std::vector<std::pair<long long, long long>> hits;
+
+        std::vector<SegmentedSpan> channelSpans(matrixChannels.size());
+
+#pragma omp for schedule(dynamic, 1)
+        for (int idx = 0; idx < totalSeconds; ++idx) {
+            // Summed over workers, so the total is CPU time, not wall time.
+            COINCFINDER_TIME_SCOPE("count");
+            const int sec = startSec + idx;
+            if (!dumpEvents || visibility) {
+                for (size_t c = 0; c < matrixChannels.size(); ++c)
+                    channelSpans[c] =
+                        spanWithNext(singlesMap.at(matrixChannels[c]), sec);
+            }
+            if (visibility) {
+                // With dumps the hit lists below still supply the counts.
+                SecondMetrics &metrics = secondMetrics[static_cast<size_t>(idx)];
+                metrics = visibility->analyzeSecond(sec, channelSpans);
+                if (!dumpEvents) {
+                    for (size_t k = 0; k < matrixSlots.size(); ++k)
+                        counts[static_cast<size_t>(idx) * pairCount + matrixSlots[k]] =
+                            static_cast<int>(metrics.pairs[k].coincidences);
+                    continue;
+                }
+            }
+            if (!dumpEvents) {
+                const std::vector<int> secondCounts = computeCoincidenceMatrix(
+                    channelSpans, matrixPairs, coincWindowPs);
+                for (size_t k = 0; k < matrixPairs.size(); ++k)
+                    counts[static_cast<size_t>(idx) * pairCount + matrixSlots[k]] =
+                        secondCounts[k];
                 continue;
-
-            const long long delayPs = itDelay->second.delayPs;
-            const Singles &s1 = singlesMap.at(p.ch1);
-            const Singles &s2 = singlesMap.at(p.ch2);
-
-            const int count =
-                countAtDelay(s1, s2, sec, coincWindowPs, delayPs, scratch1,
-                             scratch2);
-            out << sec << "," << p.label << "," << itDelay->second.delayNs
-                << "," << count << "\n";
-
-            if (dumpEvents) {
-                auto hits = collectCoincidences(s1, s2, sec, coincWindowPs,
-                                                delayPs, scratch1, scratch2);
-                auto &stream = eventStreams[p.label];
-                for (auto &h : hits) {
-                    stream << sec << "," << h.first << "," << h.second << "\n";
+            }
+            for (size_t p = 0; p < pairCount; ++p) {
+                const PairInfo &pair = allPairs[p];
+                const auto itDelay = delays.find(pair.delay_source);
+                const bool haveDelay =
+                    itDelay != delays.end() && itDelay->second.valid;
+                if (!haveDelay) {
+                    // Still submit an (empty) block so the writer can advance.
+                    eventWriters[p]->submit(static_cast<size_t>(idx), {});
+                    continue;
                 }
+
+                const long long delayPs = itDelay->second.delayPs;
+                const Singles &s1 = singlesMap.at(pair.ch1);
+                const Singles &s2 = singlesMap.at(pair.ch2);
+                int &count = counts[static_cast<size_t>(idx) * pairCount + p];
+
+                // Single pass: the hit list doubles as the count.
+                collectCoincidences(s1, s2, sec, coincWindowPs, delayPs, hits);
+                count = static_cast<int>(hits.size());
+                formatHits(block, sec, hits, dumpFormat);
+                eventWriters[p]->submit(static_cast<size_t>(idx),
+                                        std::move(block));
+                block = std::string();
             }
         }
     }
 
+    for (int idx = 0; idx < totalSeconds; ++idx) {
+        const int sec = startSec + idx;
+        for (size_t p = 0; p < pairCount; ++p) {
+            const int count = counts[static_cast<size_t>(idx) * pairCount + p];
+            if (count < 0)
+                continue;
+            out << sec << "," << allPairs[p].label << ","
+                << delays.at(allPairs[p].delay_source).delayNs << "," << count
+                << "\n";
+        }
+    }
+
+    if (visibility) {
+        std::ofstream vis(visibilityPath);
+        if (!vis.is_open()) {
+            std::cerr << "Cannot open visibility report: " << visibilityPath << "\n";
+            return 1;
+        }
+        vis << "second,basis,same,opposite,accidentals_same,accidentals_opposite,"
+               "visibility,qber,visibility_corrected,qber_corrected\n";
+        const auto writeRow = [&](long long sec, const std::string &basis,
+                                  const BasisMetrics &m) {
+            vis << sec << "," << basis << "," << m.same << "," << m.opposite << ","
+                << m.accidentalsSame << "," << m.accidentalsOpposite << ","
+                << m.visibility << "," << m.qber << "," << m.visibilityCorrected
+                << "," << m.qberCorrected << "\n";
+        };
+        const auto &bases = visibility->bases();
+        for (const SecondMetrics &metrics : secondMetrics) {
+            if (bases.empty())
+                break;
+            for (size_t b = 0; b < bases.size(); ++b)
+                writeRow(metrics.second, bases[b].name, metrics.bases[b]);
+            writeRow(metrics.second, "total", metrics.total);
+        }
+        COINCFINDER_COUNT(BytesWritten, static_cast<long long>(vis.tellp()));
+        std::cout << "Wrote visibility report to " << visibilityPath << "\n";
+    }
+
+    for (auto &writer : eventWriters) {
+        try {
+            writer->finish();
+        } catch (const std::exception &ex) {
+            std::cerr << ex.what() << "\n";
+            return 1;
+        }
+    }
+
+    COINCFINDER_COUNT(BytesWritten, static_cast<long long>(out.tellp()));
     std::cout << "Wrote coincidence report to " << outCsv << "\n";
     if (dumpEvents) {
-        std::cout << "Event CSVs written to CoincEvents/*.csv\n";
+        std::cout << "Event dumps written to " << perFileDir.string() << "/\n";
+    }
+    if (!statsPath.empty()) {
+        try {
+            writeStatsJson(statsPath);
+        } catch (const std::exception &ex) {
+            std::cerr << ex.what() << "\n";
+            return 1;
+        }
     }
     return 0;
 }
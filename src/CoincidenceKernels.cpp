@@ -0,0 +1,257 @@
+#include "CoincidenceKernels.h"
+
+// Kernel selection for fixed-delay coincidence counting. The ISA-specific
+// probes live in their own translation units (see CMakeLists.txt); this file
+// holds the portable variants and picks one from the CPU features at first
+// use.
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define COINCFINDER_NEON_KERNELS 1
+#endif
+
+#if defined(COINCFINDER_X86_KERNELS) && defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+#include "SeekMergeKernel.h"
+
+#if defined(COINCFINDER_X86_KERNELS)
+int countCoincidencesAvx2(const long long *ch1, size_t size1,
+                          const long long *ch2, size_t size2,
+                          long long coincWindowPs, long long delayPs,
+                          size_t &i, size_t &j);
+int countCoincidencesAvx512(const long long *ch1, size_t size1,
+                            const long long *ch2, size_t size2,
+                            long long coincWindowPs, long long delayPs,
+                            size_t &i, size_t &j);
+#endif
+
+namespace {
+
+using KernelFn = int (*)(const long long *, size_t, const long long *, size_t,
+                         long long, long long, size_t &, size_t &);
+
+int countScalar(const long long *ch1, size_t size1, const long long *ch2,
+                size_t size2, long long coincWindowPs, long long delayPs,
+                size_t &iRef, size_t &jRef) {
+    const long long lowerBound = -coincWindowPs;
+    const long long upperBound = coincWindowPs;
+    size_t i = iRef;
+    size_t j = jRef;
+    int count = 0;
+    while (i < size1 && j < size2) {
+        const long long shifted = ch1[i] - delayPs;
+        const long long diff = shifted - ch2[j];
+        if (diff < lowerBound) {
+            ++i;
+        } else if (diff > upperBound) {
+            ++j;
+        } else {
+            ++count;
+            ++i;
+            ++j;
+        }
+    }
+    iRef = i;
+    jRef = j;
+    return count;
+}
+
+// Plain compares over a 4-wide block; the compiler may vectorise it with
+// whatever the baseline target allows.
+struct PortableProbe {
+    static constexpr size_t kLanes = 4;
+    static unsigned lessMask(const long long *p, long long threshold) {
+        return static_cast<unsigned>(p[0] < threshold) |
+               static_cast<unsigned>(p[1] < threshold) << 1 |
+               static_cast<unsigned>(p[2] < threshold) << 2 |
+               static_cast<unsigned>(p[3] < threshold) << 3;
+    }
+};
+
+int countGalloping(const long long *ch1, size_t size1, const long long *ch2,
+                   size_t size2, long long coincWindowPs, long long delayPs,
+                   size_t &i, size_t &j) {
+    return seekMergeCount<PortableProbe>(ch1, size1, ch2, size2, coincWindowPs,
+                                         delayPs, i, j);
+}
+
+#if defined(COINCFINDER_NEON_KERNELS)
+struct NeonProbe {
+    static constexpr size_t kLanes = 2;
+    static unsigned lessMask(const long long *p, long long threshold) {
+        const uint64x2_t below =
+            vcltq_s64(vld1q_s64(reinterpret_cast<const int64_t *>(p)),
+                      vdupq_n_s64(threshold));
+        return static_cast<unsigned>(vgetq_lane_u64(below, 0) & 1u) |
+               static_cast<unsigned>(vgetq_lane_u64(below, 1) & 1u) << 1;
+    }
+};
+
+int countNeon(const long long *ch1, size_t size1, const long long *ch2,
+              size_t size2, long long coincWindowPs, long long delayPs,
+              size_t &i, size_t &j) {
+    return seekMergeCount<NeonProbe>(ch1, size1, ch2, size2, coincWindowPs,
+                                     delayPs, i, j);
+}
+#endif
+
+#if defined(COINCFINDER_X86_KERNELS)
+struct X86Features {
+    bool avx2 = false;
+    bool avx512f = false;
+};
+
+X86Features detectX86Features() {
+    X86Features features;
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4] = {};
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return features;
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx)
+        return features;
+    const unsigned long long xcr0 = _xgetbv(0);
+    __cpuidx(info, 7, 0);
+    // YMM state (bits 1-2) for AVX2; opmask/ZMM state (bits 5-7) for AVX-512.
+    features.avx2 = (xcr0 & 0x6) == 0x6 && (info[1] & (1 << 5)) != 0;
+    features.avx512f = (xcr0 & 0xE6) == 0xE6 && (info[1] & (1 << 16)) != 0;
+#else
+    __builtin_cpu_init();
+    features.avx2 = __builtin_cpu_supports("avx2");
+    features.avx512f = __builtin_cpu_supports("avx512f");
+#endif
+    return features;
+}
+
+const X86Features &x86Features() {
+    static const X86Features features = detectX86Features();
+    return features;
+}
+#endif
+
+CoincidenceKernel bestSupportedKernel() {
+#if defined(COINCFINDER_X86_KERNELS)
+    if (x86Features().avx512f)
+        return CoincidenceKernel::Avx512;
+    if (x86Features().avx2)
+        return CoincidenceKernel::Avx2;
+#endif
+#if defined(COINCFINDER_NEON_KERNELS)
+    return CoincidenceKernel::Neon;
+#else
+    return CoincidenceKernel::Galloping;
+#endif
+}
+
+KernelFn kernelFunction(CoincidenceKernel kernel) {
+    switch (kernel) {
+    case CoincidenceKernel::Scalar:
+        return &countScalar;
+    case CoincidenceKernel::Galloping:
+        return &countGalloping;
+#if defined(COINCFINDER_X86_KERNELS)
+    case CoincidenceKernel::Avx2:
+        return &countCoincidencesAvx2;
+    case CoincidenceKernel::Avx512:
+        return &countCoincidencesAvx512;
+#endif
+#if defined(COINCFINDER_NEON_KERNELS)
+    case CoincidenceKernel::Neon:
+        return &countNeon;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+struct KernelSelection {
+    std::atomic<CoincidenceKernel> kernel;
+    std::atomic<KernelFn> fn;
+
+    KernelSelection()
+        : kernel(bestSupportedKernel()), fn(kernelFunction(kernel.load())) {}
+};
+
+KernelSelection &selection() {
+    static KernelSelection instance;
+    return instance;
+}
+
+} // namespace
+
+CoincidenceKernel activeCoincidenceKernel() {
+    return selection().kernel.load(std::memory_order_relaxed);
+}
+
+bool coincidenceKernelSupported(CoincidenceKernel kernel) {
+    switch (kernel) {
+    case CoincidenceKernel::Scalar:
+    case CoincidenceKernel::Galloping:
+        return true;
+#if defined(COINCFINDER_X86_KERNELS)
+    case CoincidenceKernel::Avx2:
+        return x86Features().avx2;
+    case CoincidenceKernel::Avx512:
+        return x86Features().avx512f;
+#endif
+#if defined(COINCFINDER_NEON_KERNELS)
+    case CoincidenceKernel::Neon:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+void setCoincidenceKernel(CoincidenceKernel kernel) {
+    if (!coincidenceKernelSupported(kernel))
+        throw std::invalid_argument(
+            std::string("Coincidence kernel not supported on this CPU: ") +
+            coincidenceKernelName(kernel));
+    KernelSelection &sel = selection();
+    sel.fn.store(kernelFunction(kernel), std::memory_order_relaxed);
+    sel.kernel.store(kernel, std::memory_order_relaxed);
+}
+
+const char *coincidenceKernelName(CoincidenceKernel kernel) {
+    switch (kernel) {
+    case CoincidenceKernel::Scalar:
+        return "scalar";
+    case CoincidenceKernel::Galloping:
+        return "galloping";
+    case CoincidenceKernel::Avx2:
+        return "avx2";
+    case CoincidenceKernel::Avx512:
+        return "avx512";
+    case CoincidenceKernel::Neon:
+        return "neon";
+    }
+    return "unknown";
+}
+
+int countCoincidencesWithDelayScalar(std::span<const long long> ch1,
+                                     std::span<const long long> ch2,
+                                     long long coincWindowPs,
+                                     long long delayPs) {
+    size_t i = 0;
+    size_t j = 0;
+    return countScalar(ch1.data(), ch1.size(), ch2.data(), ch2.size(),
+                       coincWindowPs, delayPs, i, j);
+}
+
+int countCoincidencesKernel(const long long *ch1, size_t size1,
+                            const long long *ch2, size_t size2,
+                            long long coincWindowPs, long long delayPs,
+                            size_t &i, size_t &j) {
+    const KernelFn fn = selection().fn.load(std::memory_order_relaxed);
+    return fn(ch1, size1, ch2, size2, coincWindowPs, delayPs, i, j);
+}
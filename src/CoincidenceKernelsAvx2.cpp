@@ -0,0 +1,29 @@
+// AVX2 probe for the seek-merge coincidence kernel. This file alone is built
+// with AVX2 enabled; it is only entered after the runtime CPU check in
+// CoincidenceKernels.cpp.
+
+#include <immintrin.h>
+
+#include "SeekMergeKernel.h"
+
+namespace {
+struct Avx2Probe {
+    static constexpr size_t kLanes = 4;
+    static unsigned lessMask(const long long *p, long long threshold) {
+        const __m256i values =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        const __m256i below =
+            _mm256_cmpgt_epi64(_mm256_set1_epi64x(threshold), values);
+        return static_cast<unsigned>(
+            _mm256_movemask_pd(_mm256_castsi256_pd(below)));
+    }
+};
+} // namespace
+
+int countCoincidencesAvx2(const long long *ch1, size_t size1,
+                          const long long *ch2, size_t size2,
+                          long long coincWindowPs, long long delayPs,
+                          size_t &i, size_t &j) {
+    return seekMergeCount<Avx2Probe>(ch1, size1, ch2, size2, coincWindowPs,
+                                     delayPs, i, j);
+}
@@ -0,0 +1,26 @@
+// AVX-512F probe for the seek-merge coincidence kernel. This file alone is
+// built with AVX-512 enabled; it is only entered after the runtime CPU check
+// in CoincidenceKernels.cpp.
+
+#include <immintrin.h>
+
+#include "SeekMergeKernel.h"
+
+namespace {
+struct Avx512Probe {
+    static constexpr size_t kLanes = 8;
+    static unsigned lessMask(const long long *p, long long threshold) {
+        const __m512i values = _mm512_loadu_si512(p);
+        return static_cast<unsigned>(
+            _mm512_cmplt_epi64_mask(values, _mm512_set1_epi64(threshold)));
+    }
+};
+} // namespace
+
+int countCoincidencesAvx512(const long long *ch1, size_t size1,
+                            const long long *ch2, size_t size2,
+                            long long coincWindowPs, long long delayPs,
+                            size_t &i, size_t &j) {
+    return seekMergeCount<Avx512Probe>(ch1, size1, ch2, size2, coincWindowPs,
+                                       delayPs, i, j);
+}
@@ -1,4 +1,8 @@
 #include "Coincidences.h"
+#include "CoincWorkspace.h"
+#include "CoincidenceKernels.h"
+#include "FftCorrelation.h"
+#include "Instrumentation.h"
 
 // Implementation of the low-level coincidence counting logic. Keeping detailed
 // comments here helps both the CLI driver and the Python wrapper stay in sync
@@ -6,7 +10,9 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <iostream>
+#include <limits>
 #include <stdexcept>
 
 namespace {
@@ -34,6 +40,11 @@ DelayScanConfig buildConfig(long long delayStartPs, long long delayEndPs,
 }
 } // namespace
 
+CoincWorkspace &threadWorkspace() {
+    thread_local CoincWorkspace workspace;
+    return workspace;
+}
+
 std::span<const long long>
 appendNextFirstEvent(const std::vector<long long> &currentSecond,
                      const std::vector<long long> &nextSecond,
@@ -57,17 +68,18 @@ appendNextFirstEvent(const std::vector<long long> &currentSecond,
 }
 
 namespace {
-template <bool Collect>
-int countCoincidencesWithDelay(std::span<const long long> ch1,
-                               std::span<const long long> ch2,
+// Kernels are templated over the sequence type so plain spans and
+// `SegmentedSpan` (bucket + lookahead) share one implementation; for spans
+// the indexing compiles down to the same loads as before.
+template <bool Collect, typename Seq1, typename Seq2>
+int countCoincidencesWithDelay(const Seq1 &ch1, const Seq2 &ch2,
                                long long coincWindowPs, long long delayPs,
-                               std::vector<std::pair<long long, long long>> *outHits) {
+                               std::vector<std::pair<long long, long long>> *outHits,
+                               size_t i = 0, size_t j = 0) {
     const long long lowerBound = -coincWindowPs;
     const long long upperBound = coincWindowPs;
 
     int count = 0;
-    size_t i = 0;
-    size_t j = 0;
     const size_t size1 = ch1.size();
     const size_t size2 = ch2.size();
 
@@ -92,22 +104,250 @@ int countCoincidencesWithDelay(std::span<const long long> ch1,
 }
 } // namespace
 
+void collectCoincidencesWithDelay(std::span<const long long> ch1,
+                                  std::span<const long long> ch2,
+                                  long long coincWindowPs, long long delayPs,
+                                  std::vector<std::pair<long long, long long>> &hits) {
+    hits.clear();
+    countCoincidencesWithDelay<true>(ch1, ch2, coincWindowPs, delayPs, &hits);
+}
+
 std::vector<std::pair<long long, long long>>
 collectCoincidencesWithDelay(std::span<const long long> ch1,
                              std::span<const long long> ch2,
                              long long coincWindowPs, long long delayPs) {
     std::vector<std::pair<long long, long long>> hits;
-    countCoincidencesWithDelay<true>(ch1, ch2, coincWindowPs, delayPs, &hits);
+    collectCoincidencesWithDelay(ch1, ch2, coincWindowPs, delayPs, hits);
     return hits;
 }
 
 int countCoincidencesWithDelay(std::span<const long long> ch1,
                                std::span<const long long> ch2,
                                long long coincWindowPs, long long delayPs) {
-    return countCoincidencesWithDelay<false>(ch1, ch2, coincWindowPs, delayPs,
-                                             nullptr);
+    // Counting goes through the runtime-selected SIMD/galloping kernel; the
+    // collecting variant above stays on the scalar template.
+    size_t i = 0;
+    size_t j = 0;
+    return countCoincidencesKernel(ch1.data(), ch1.size(), ch2.data(),
+                                   ch2.size(), coincWindowPs, delayPs, i, j);
+}
+
+void collectCoincidencesWithDelay(SegmentedSpan ch1, SegmentedSpan ch2,
+                                  long long coincWindowPs, long long delayPs,
+                                  std::vector<std::pair<long long, long long>> &hits) {
+    hits.clear();
+    countCoincidencesWithDelay<true>(ch1, ch2, coincWindowPs, delayPs, &hits);
+}
+
+std::vector<std::pair<long long, long long>>
+collectCoincidencesWithDelay(SegmentedSpan ch1, SegmentedSpan ch2,
+                             long long coincWindowPs, long long delayPs) {
+    std::vector<std::pair<long long, long long>> hits;
+    collectCoincidencesWithDelay(ch1, ch2, coincWindowPs, delayPs, hits);
+    return hits;
+}
+
+int countCoincidencesWithDelay(SegmentedSpan ch1, SegmentedSpan ch2,
+                               long long coincWindowPs, long long delayPs) {
+    // Run the fast kernel over the heads, then let the generic merge finish
+    // across the (short) lookahead tails from wherever it stopped.
+    size_t i = 0;
+    size_t j = 0;
+    const int headCount = countCoincidencesKernel(
+        ch1.head.data(), ch1.head.size(), ch2.head.data(), ch2.head.size(),
+        coincWindowPs, delayPs, i, j);
+    return headCount + countCoincidencesWithDelay<false>(
+                           ch1, ch2, coincWindowPs, delayPs, nullptr, i, j);
 }
 
+namespace {
+// Average events per channel in one time tile of `computeCoincidenceMatrix`;
+// a tile of every channel (8 x 32 KiB) stays within L2.
+constexpr size_t kMatrixTileEvents = 4096;
+} // namespace
+
+std::vector<int> computeCoincidenceMatrix(std::span<const SegmentedSpan> channels,
+                                          std::span<const CoincidencePair> pairs,
+                                          long long coincWindowPs) {
+    std::vector<int> counts(pairs.size(), 0);
+    for (const CoincidencePair &p : pairs)
+        if (p.first >= channels.size() || p.second >= channels.size())
+            throw std::invalid_argument("coincidence pair refers to a missing channel");
+    if (pairs.empty())
+        return counts;
+
+    long long firstTs = std::numeric_limits<long long>::max();
+    long long lastTs = std::numeric_limits<long long>::min();
+    size_t longest = 0;
+    for (const SegmentedSpan &ch : channels) {
+        if (ch.head.empty())
+            continue;
+        firstTs = std::min(firstTs, ch.head.front());
+        lastTs = std::max(lastTs, ch.head.back());
+        longest = std::max(longest, ch.head.size());
+    }
+
+    // Cursors of each pair's greedy merge. The merge only ever looks at
+    // (ch1[i], ch2[j]), so it can stop at any truncation of both inputs and
+    // resume later with exactly the decisions an uninterrupted run makes.
+    CoincWorkspace &ws = threadWorkspace();
+    std::vector<size_t> &cursor1 = ws.matrixCursor1;
+    std::vector<size_t> &cursor2 = ws.matrixCursor2;
+    assignScratch(cursor1, pairs.size(), 0);
+    assignScratch(cursor2, pairs.size(), 0);
+    if (longest != 0) {
+        const size_t tiles = (longest + kMatrixTileEvents - 1) / kMatrixTileEvents;
+        const long long tilePs =
+            (lastTs - firstTs) / static_cast<long long>(tiles) + 1;
+        // Per channel, and per pair for the delayed side: end of the events
+        // that fall before the current tile boundary.
+        std::vector<size_t> &channelEnd = ws.matrixChannelEnd;
+        std::vector<size_t> &shiftedEnd = ws.matrixShiftedEnd;
+        assignScratch(channelEnd, channels.size(), 0);
+        assignScratch(shiftedEnd, pairs.size(), 0);
+        for (size_t t = 1; t <= tiles; ++t) {
+            const bool last = t == tiles;
+            const long long boundary = firstTs + static_cast<long long>(t) * tilePs;
+            for (size_t c = 0; c < channels.size(); ++c) {
+                const auto head = channels[c].head;
+                size_t &end = channelEnd[c];
+                while (end < head.size() && (last || head[end] < boundary))
+                    ++end;
+            }
+            for (size_t k = 0; k < pairs.size(); ++k) {
+                const CoincidencePair &p = pairs[k];
+                const auto head1 = channels[p.first].head;
+                const auto head2 = channels[p.second].head;
+                size_t &end1 = shiftedEnd[k];
+                while (end1 < head1.size() &&
+                       (last || head1[end1] - p.delayPs < boundary))
+                    ++end1;
+                counts[k] += countCoincidencesKernel(
+                    head1.data(), end1, head2.data(), channelEnd[p.second],
+                    coincWindowPs, p.delayPs, cursor1[k], cursor2[k]);
+            }
+        }
+    }
+
+    // Finish across the lookahead tails, as the segmented counter does.
+    for (size_t k = 0; k < pairs.size(); ++k) {
+        const CoincidencePair &p = pairs[k];
+        counts[k] += countCoincidencesWithDelay<false>(
+            channels[p.first], channels[p.second], coincWindowPs, p.delayPs,
+            nullptr, cursor1[k], cursor2[k]);
+    }
+    return counts;
+}
+
+std::vector<int>
+computeCoincidenceMatrix(std::span<const std::span<const long long>> channels,
+                         std::span<const CoincidencePair> pairs,
+                         long long coincWindowPs) {
+    std::vector<SegmentedSpan> &segmented = threadWorkspace().matrixChannels;
+    assignScratch(segmented, channels.size(), SegmentedSpan());
+    std::copy(channels.begin(), channels.end(), segmented.begin());
+    return computeCoincidenceMatrix(std::span<const SegmentedSpan>(segmented),
+                                    pairs, coincWindowPs);
+}
+
+namespace {
+// One cursor into ch2 per delay. For a fixed delay the greedy merge visits
+// ch1 in order, skips ch2 events that are too early for ch1[i] and pairs the
+// next one if it falls inside the window; running that step for every delay
+// at each i reproduces all K merges while streaming ch1 exactly once.
+template <typename Seq1, typename Seq2>
+std::vector<int> countCoincidencesAtDelaysImpl(const Seq1 &ch1, const Seq2 &ch2,
+                                               long long coincWindowPs,
+                                               std::span<const long long> delaysPs) {
+    const size_t delayCount = delaysPs.size();
+    std::vector<int> counts(delayCount, 0);
+    if (delayCount == 0 || ch1.size() == 0 || ch2.size() == 0)
+        return counts;
+
+    const size_t size1 = ch1.size();
+    const size_t size2 = ch2.size();
+    std::vector<size_t> &cursors = threadWorkspace().delayCursors;
+    assignScratch(cursors, delayCount, 0);
+    size_t exhausted = 0;
+
+    for (size_t i = 0; i < size1 && exhausted < delayCount; ++i) {
+        const long long t1 = ch1[i];
+        for (size_t k = 0; k < delayCount; ++k) {
+            size_t j = cursors[k];
+            if (j >= size2)
+                continue;
+            const long long shifted = t1 - delaysPs[k];
+            const long long earliest = shifted - coincWindowPs;
+            while (j < size2 && ch2[j] < earliest)
+                ++j;
+            if (j < size2 && ch2[j] <= shifted + coincWindowPs) {
+                ++counts[k];
+                ++j;
+            }
+            if (j >= size2)
+                ++exhausted;
+            cursors[k] = j;
+        }
+    }
+    return counts;
+}
+} // namespace
+
+std::vector<int> countCoincidencesAtDelays(std::span<const long long> ch1,
+                                           std::span<const long long> ch2,
+                                           long long coincWindowPs,
+                                           std::span<const long long> delaysPs) {
+    return countCoincidencesAtDelaysImpl(ch1, ch2, coincWindowPs, delaysPs);
+}
+
+std::vector<int> countCoincidencesAtDelays(SegmentedSpan ch1, SegmentedSpan ch2,
+                                           long long coincWindowPs,
+                                           std::span<const long long> delaysPs) {
+    return countCoincidencesAtDelaysImpl(ch1, ch2, coincWindowPs, delaysPs);
+}
+
+namespace {
+// Streams the union of sorted channels (each shifted by its offset) in time
+// order by taking the smallest head among the per-channel cursors; ties go
+// to the lower channel index. A linear scan beats a heap for the handful of
+// detectors we merge.
+class ChannelMerge {
+public:
+    /// `pos` is the cursor storage (one entry per channel), reset here.
+    ChannelMerge(const std::vector<std::span<const long long>> &channels,
+                 std::span<const long long> offsetsPs, std::vector<size_t> &pos)
+        : channels_(channels), offsetsPs_(offsetsPs), pos_(pos) {
+        assignScratch(pos_, channels.size(), 0);
+    }
+
+    bool next(size_t &channelIdx, long long &timestamp) {
+        size_t best = channels_.size();
+        long long bestTs = 0;
+        for (size_t c = 0; c < channels_.size(); ++c) {
+            if (pos_[c] == channels_[c].size())
+                continue;
+            const long long ts =
+                channels_[c][pos_[c]] + (offsetsPs_.empty() ? 0 : offsetsPs_[c]);
+            if (best == channels_.size() || ts < bestTs) {
+                best = c;
+                bestTs = ts;
+            }
+        }
+        if (best == channels_.size())
+            return false;
+        ++pos_[best];
+        channelIdx = best;
+        timestamp = bestTs;
+        return true;
+    }
+
+private:
+    const std::vector<std::span<const long long>> &channels_;
+    std::span<const long long> offsetsPs_;
+    std::vector<size_t> &pos_;
+};
+} // namespace
+
 int countNFoldCoincidences(const std::vector<std::span<const long long>> &channels,
                            long long coincWindowPs,
                            std::span<const long long> offsetsPs) {
@@ -118,90 +358,113 @@ int countNFoldCoincidences(const std::vector<std::span<const long long>> &channe
     if (channels.size() == 2 && offsetsPs.empty())
         return countCoincidencesWithDelay(channels[0], channels[1], coincWindowPs, 0);
 
-    struct Tagged {
-        long long timestamp;
-        size_t channelIdx;
+    // Sliding window over the merged event stream without materialising it:
+    // `right` admits events, `left` replays the same merge to retire them.
+    CoincWorkspace &ws = threadWorkspace();
+    ChannelMerge right(channels, offsetsPs, ws.nfoldRight);
+    ChannelMerge left(channels, offsetsPs, ws.nfoldLeft);
+    std::vector<int> &freq = ws.nfoldFreq;
+    assignScratch(freq, channels.size(), 0);
+    size_t have = 0;
+    size_t admitted = 0;
+    size_t retired = 0;
+    size_t leftIdx = 0;
+    long long leftTs = 0;
+    const auto retire = [&] {
+        if (--freq[leftIdx] == 0)
+            --have;
+        ++retired;
+        left.next(leftIdx, leftTs);
     };
+    left.next(leftIdx, leftTs);
 
-    size_t totalEvents = 0;
-    for (auto span : channels)
-        totalEvents += span.size();
-    if (totalEvents == 0)
-        return 0;
-
-    std::vector<Tagged> merged;
-    merged.reserve(totalEvents);
-    for (size_t idx = 0; idx < channels.size(); ++idx) {
-        const long long offset = offsetsPs.empty() ? 0 : offsetsPs[idx];
-        for (long long ts : channels[idx])
-            merged.push_back({ts + offset, idx});
-    }
-    std::sort(merged.begin(), merged.end(),
-              [](const Tagged &a, const Tagged &b) { return a.timestamp < b.timestamp; });
-
-    std::vector<int> freq(channels.size(), 0);
-    size_t have = 0;
-    size_t left = 0;
     int coincidences = 0;
-
-    for (size_t right = 0; right < merged.size(); ++right) {
-        const size_t idx = merged[right].channelIdx;
+    size_t idx = 0;
+    long long ts = 0;
+    while (right.next(idx, ts)) {
+        ++admitted;
         if (++freq[idx] == 1)
             ++have;
 
-        while (merged[right].timestamp - merged[left].timestamp > coincWindowPs &&
-               left < right) {
-            const size_t lidx = merged[left].channelIdx;
-            if (--freq[lidx] == 0)
-                --have;
-            ++left;
-        }
+        while (ts - leftTs > coincWindowPs && retired + 1 < admitted)
+            retire();
 
         if (have == channels.size()) {
             ++coincidences;
-            const size_t lidx = merged[left].channelIdx;
-            if (--freq[lidx] == 0)
-                --have;
-            ++left;
+            retire();
         }
     }
 
     return coincidences;
 }
 
-void computeCoincidencesForRange(std::span<const long long> channel1,
-                                 std::span<const long long> channel2,
-                                 long long coincWindowPs,
-                                 long long delayStartPs, long long delayEndPs,
-                                 long long delayStepPs,
-                                 std::vector<std::pair<float, int>> &results) {
-    results.clear();
-    const DelayScanConfig config =
-        buildConfig(delayStartPs, delayEndPs, delayStepPs);
-    if (config.steps == 0)
-        return;
+namespace {
+// Bin offsets handed to the dividers below stay within [0, range + step).
+// Below this bound the reciprocal fits in 64-bit arithmetic (2.1 ms of
+// delay range, far wider than any scan we run).
+constexpr long long kReciprocalLimit = 1LL << 31;
+
+// Step known at compile time: the compiler lowers the division to a
+// multiply-shift on its own.
+template <long long Step>
+struct FixedStep {
+    static_assert(Step > 0);
+    size_t operator()(long long offset) const {
+        return static_cast<size_t>(static_cast<unsigned long long>(offset) / Step);
+    }
+};
 
-    results.resize(config.steps);
-    if (channel1.empty() || channel2.empty()) {
-        // Exit when either channel has no events.
-        for (size_t idx = 0; idx < config.steps; ++idx) {
-            const long long delayPs =
-                config.startPs + static_cast<long long>(idx) * config.stepPs;
-            results[idx] = {static_cast<float>(delayPs) /
-                                kPicosecondsPerNanosecond,
-                            0};
-        }
-        return;
+// Runtime step, offsets below kReciprocalLimit: floor(n / d) equals
+// (n * m) >> (31 + l) with l = ceil(log2 d) and m = ceil(2^(31 + l) / d)
+// (Granlund & Montgomery, Thm 4.2). m stays below 2^32 + 1, so the product
+// never overflows 64 bits.
+class ReciprocalStep {
+public:
+    explicit ReciprocalStep(long long stepPs) {
+        unsigned l = 0;
+        while ((1LL << l) < stepPs)
+            ++l;
+        shift_ = 31 + l;
+        const auto d = static_cast<std::uint64_t>(stepPs);
+        multiplier_ = ((std::uint64_t{1} << shift_) + d - 1) / d;
     }
 
-    // Difference array (size = steps + 1 so "end + 1" stays in-bounds).
-    std::vector<long long> diff(config.steps + 1, 0);
+    size_t operator()(long long offset) const {
+        return static_cast<size_t>(
+            (static_cast<std::uint64_t>(offset) * multiplier_) >> shift_);
+    }
+
+private:
+    std::uint64_t multiplier_ = 0;
+    unsigned shift_ = 0;
+};
+
+// Plain division for ranges too wide for the reciprocal.
+struct RuntimeStep {
+    long long stepPs;
+    size_t operator()(long long offset) const {
+        return static_cast<size_t>(offset / stepPs);
+    }
+};
+
+// Accumulates every candidate pair into the difference array `diff`. Each
+// pair's window is clamped to the scanned range with min/max, and a pair
+// whose window misses the range adds zero instead of branching. A window
+// that falls between two bin centres gives idxStart == idxEnd + 1, so its
+// +1 and -1 land on the same slot and cancel.
+template <typename Divide, typename Seq1, typename Seq2>
+void scanDelayRangeWith(const Seq1 &channel1, const Seq2 &channel2,
+                        long long coincWindowPs, const DelayScanConfig &config,
+                        Divide divide, std::vector<long long> &diff) {
     size_t jLo = 0;
     size_t jHi = 0;
     const long long minNeeded = config.startPs - coincWindowPs;
     const long long maxNeeded = config.endPs + coincWindowPs;
+    const long long roundUp = config.stepPs - 1;
+    size_t visited = 0;
 
-    for (const long long t1 : channel1) {
+    for (size_t i = 0; i < channel1.size(); ++i) {
+        const long long t1 = channel1[i];
         // Keep channel2[jLo:jHi) aligned with timestamps that can still
         // contribute coincidences for this t1 once the delay range is applied.
         const long long lowCut = t1 - maxNeeded;
@@ -214,30 +477,107 @@ void computeCoincidencesForRange(std::span<const long long> channel1,
         while (jHi < channel2.size() && channel2[jHi] <= highCut)
             ++jHi;
 
+        visited += jHi - jLo;
         for (size_t j = jLo; j < jHi; ++j) {
             const long long diffCenter = t1 - channel2[j];
-            long long intervalStart = diffCenter - coincWindowPs;
-            long long intervalEnd = diffCenter + coincWindowPs;
-            if (intervalEnd < config.startPs || intervalStart > config.endPs)
-                continue;
-            intervalStart = std::max(intervalStart, config.startPs);
-            intervalEnd = std::min(intervalEnd, config.endPs);
+            const long long intervalStart =
+                std::max(diffCenter - coincWindowPs, config.startPs);
+            const long long intervalEnd =
+                std::min(diffCenter + coincWindowPs, config.endPs);
+            const long long hit = intervalStart <= intervalEnd ? 1 : 0;
 
             // Round into discrete delay bins: start indexes the first bin whose
-            // centre lies inside the window; end indexes the last bin.
-            const long long offsetStart = intervalStart - config.startPs;
-            const long long offsetEnd = intervalEnd - config.startPs;
-            const size_t idxStart = static_cast<size_t>(
-                (offsetStart + config.stepPs - 1) / config.stepPs);
-            const size_t idxEnd = static_cast<size_t>(offsetEnd / config.stepPs);
-            if (idxStart > idxEnd || idxEnd >= config.steps)
-                continue;
+            // centre lies inside the window; end indexes the last bin. Both
+            // offsets are clamped into [0, range] so a miss still indexes
+            // inside `diff`.
+            const long long offsetStart =
+                std::min(intervalStart, config.endPs) - config.startPs;
+            const long long offsetEnd =
+                std::max(intervalEnd, config.startPs) - config.startPs;
+            const size_t idxStart = divide(offsetStart + roundUp);
+            const size_t idxEnd = divide(offsetEnd);
+
+            diff[idxStart] += hit;
+            diff[idxEnd + 1] -= hit;
+        }
+    }
+    COINCFINDER_COUNT(CandidatePairs, visited);
+}
+
+// Picks the divider for the configured step. The fixed steps are the ones
+// our production sweeps use (ps-resolution and the 10 ps CLI default).
+template <typename Seq1, typename Seq2>
+void scanDelayRange(const Seq1 &channel1, const Seq2 &channel2,
+                    long long coincWindowPs, const DelayScanConfig &config,
+                    std::vector<long long> &diff) {
+    const auto scan = [&](auto divide) {
+        scanDelayRangeWith(channel1, channel2, coincWindowPs, config, divide,
+                           diff);
+    };
+    if (config.endPs - config.startPs + config.stepPs >= kReciprocalLimit)
+        return scan(RuntimeStep{config.stepPs});
+    switch (config.stepPs) {
+    case 1:
+        return scan(FixedStep<1>{});
+    case 10:
+        return scan(FixedStep<10>{});
+    case 50:
+        return scan(FixedStep<50>{});
+    case 100:
+        return scan(FixedStep<100>{});
+    default:
+        return scan(ReciprocalStep(config.stepPs));
+    }
+}
+
+template <typename Seq1, typename Seq2>
+void computeCoincidencesForRangeImpl(const Seq1 &channel1, const Seq2 &channel2,
+                                     long long coincWindowPs,
+                                     long long delayStartPs, long long delayEndPs,
+                                     long long delayStepPs,
+                                     std::vector<std::pair<float, int>> &results) {
+    COINCFINDER_TIME_SCOPE("delay_scan");
+    results.clear();
+    const DelayScanConfig config =
+        buildConfig(delayStartPs, delayEndPs, delayStepPs);
+    if (config.steps == 0)
+        return;
+
+    results.resize(config.steps);
+    if (channel1.empty() || channel2.empty()) {
+        // Exit when either channel has no events.
+        for (size_t idx = 0; idx < config.steps; ++idx) {
+            const long long delayPs =
+                config.startPs + static_cast<long long>(idx) * config.stepPs;
+            results[idx] = {static_cast<float>(delayPs) /
+                                kPicosecondsPerNanosecond,
+                            0};
+        }
+        return;
+    }
 
-            diff[idxStart] += 1;
-            diff[idxEnd + 1] -= 1;
+    // Wide ranges over dense data go to the binned FFT engine instead.
+    const DelayScanEngine engine = delayScanEngine();
+    if (engine != DelayScanEngine::Direct) {
+        const long long spanPs =
+            std::max(channel1[channel1.size() - 1], channel2[channel2.size() - 1]) -
+            std::min(channel1[0], channel2[0]);
+        if (engine == DelayScanEngine::Fft ||
+            fftScanPreferred(channel1.size(), channel2.size(), spanPs,
+                             coincWindowPs, delayStartPs, delayEndPs,
+                             delayStepPs)) {
+            computeCoincidencesForRangeFft(channel1, channel2, coincWindowPs,
+                                           delayStartPs, delayEndPs,
+                                           delayStepPs, results);
+            return;
         }
     }
 
+    // Difference array (size = steps + 1 so "end + 1" stays in-bounds).
+    std::vector<long long> &diff = threadWorkspace().scanDiff;
+    assignScratch(diff, config.steps + 1, 0);
+    scanDelayRange(channel1, channel2, coincWindowPs, config, diff);
+
     // Prefix-sum the diff array to convert it into actual coincidence counts.
     long long running = 0;
     for (size_t idx = 0; idx < config.steps; ++idx) {
@@ -250,20 +590,16 @@ void computeCoincidencesForRange(std::span<const long long> channel1,
     }
 }
 
-long long findBestDelayPicoseconds(
-    std::span<const long long> reference,
-    std::span<const long long> target,
-    long long coincWindowPs,
-    long long delayStartPs,
-    long long delayEndPs,
-    long long delayStepPs,
+template <typename Seq1, typename Seq2>
+long long findBestDelayPicosecondsImpl(
+    const Seq1 &reference, const Seq2 &target, long long coincWindowPs,
+    long long delayStartPs, long long delayEndPs, long long delayStepPs,
     std::vector<std::pair<float, int>> *scratchResults) {
-    std::vector<std::pair<float, int>> local;
     std::vector<std::pair<float, int>> &results =
-        scratchResults ? *scratchResults : local;
-    computeCoincidencesForRange(reference, target, coincWindowPs,
-                                delayStartPs, delayEndPs, delayStepPs,
-                                results);
+        scratchResults ? *scratchResults : threadWorkspace().bestDelayResults;
+    computeCoincidencesForRangeImpl(reference, target, coincWindowPs,
+                                    delayStartPs, delayEndPs, delayStepPs,
+                                    results);
     long long bestDelayPs = delayStartPs;
     int bestCount = std::numeric_limits<int>::min();
     for (const auto &entry : results) {
@@ -278,6 +614,190 @@ long long findBestDelayPicoseconds(
     return bestDelayPs;
 }
 
+// Coarse bins in an automatic coarse pass, and the minimum coarse/fine step
+// ratio for which the two passes beat a single full-resolution scan.
+constexpr long long kAutoCoarseBins = 256;
+constexpr long long kMinCoarseRatio = 4;
+// Below this many events the coarse pass keeps the whole reference.
+constexpr size_t kMinCoarseSample = 4096;
+
+std::span<const long long> leadingEvents(std::span<const long long> seq,
+                                         size_t count) {
+    return seq.first(std::min(count, seq.size()));
+}
+
+SegmentedSpan leadingEvents(const SegmentedSpan &seq, size_t count) {
+    const size_t head = std::min(count, seq.head.size());
+    const size_t tail = std::min(count - head, seq.tail.size());
+    return SegmentedSpan(seq.head.first(head), seq.tail.first(tail));
+}
+
+template <typename Seq1, typename Seq2>
+long long findBestDelayCoarseToFineImpl(
+    const Seq1 &reference, const Seq2 &target, long long coincWindowPs,
+    long long delayStartPs, long long delayEndPs, long long delayStepPs,
+    const CoarseToFineOptions &options, CoarseToFineReport *report,
+    std::vector<std::pair<float, int>> *scratchResults) {
+    CoarseToFineReport local;
+    CoarseToFineReport &rep = report ? *report : local;
+    rep = CoarseToFineReport{};
+    const auto fullScan = [&] {
+        return findBestDelayPicosecondsImpl(reference, target, coincWindowPs,
+                                            delayStartPs, delayEndPs,
+                                            delayStepPs, scratchResults);
+    };
+
+    const DelayScanConfig config =
+        buildConfig(delayStartPs, delayEndPs, delayStepPs);
+    if (config.steps == 0 || reference.empty() || target.empty())
+        return fullScan();
+
+    const long long span = delayEndPs - delayStartPs;
+    long long coarseStep = options.coarseStepPs > 0
+                               ? options.coarseStepPs
+                               : (span + kAutoCoarseBins - 1) / kAutoCoarseBins;
+    coarseStep = std::max(coarseStep, delayStepPs);
+    if (coarseStep < kMinCoarseRatio * delayStepPs)
+        return fullScan();
+    rep.coarseStepPs = coarseStep;
+
+    // Half-step windows tile the range, so every pair lands in a coarse bin
+    // however far apart the bin centres are.
+    const long long coarseWindow = std::max(coincWindowPs, coarseStep / 2);
+    const double fraction = std::clamp(options.sampleFraction, 0.0, 1.0);
+    const size_t sample = std::max(
+        std::min(reference.size(), kMinCoarseSample),
+        static_cast<size_t>(std::llround(fraction *
+                                         static_cast<double>(reference.size()))));
+
+    CoincWorkspace &ws = threadWorkspace();
+    std::vector<std::pair<float, int>> &coarse = ws.coarseResults;
+    computeCoincidencesForRangeImpl(leadingEvents(reference, sample), target,
+                                    coarseWindow, delayStartPs, delayEndPs,
+                                    coarseStep, coarse);
+
+    size_t best = 0;
+    for (size_t idx = 1; idx < coarse.size(); ++idx)
+        if (coarse[idx].second > coarse[best].second)
+            best = idx;
+
+    std::vector<int> &counts = ws.coarseCounts;
+    assignScratch(counts, coarse.size(), 0);
+    for (size_t idx = 0; idx < coarse.size(); ++idx)
+        counts[idx] = coarse[idx].second;
+    const auto mid = counts.begin() + static_cast<std::ptrdiff_t>(counts.size() / 2);
+    std::nth_element(counts.begin(), mid, counts.end());
+    const double background = *mid;
+
+    // A peak (plus the fine window around it) may straddle a few coarse bins;
+    // only bins beyond that guard count as competitors.
+    const size_t guard =
+        static_cast<size_t>((coarseWindow + coincWindowPs) / coarseStep) + 1;
+    int runnerUp = 0;
+    for (size_t idx = 0; idx < coarse.size(); ++idx) {
+        const size_t dist = idx > best ? idx - best : best - idx;
+        if (dist > guard)
+            runnerUp = std::max(runnerUp, coarse[idx].second);
+    }
+
+    const double excess = coarse[best].second - background;
+    rep.significance = excess / std::sqrt(std::max(background, 1.0));
+    if (excess <= 0.0 || rep.significance < options.minSignificance ||
+        runnerUp - background > options.maxRunnerUpRatio * excess)
+        return fullScan();
+
+    // Fine scan on the full-scan grid, over the peak bin and its neighbours.
+    const long long centre =
+        delayStartPs + static_cast<long long>(best) * coarseStep;
+    const long long halfSpan = coarseStep + coarseWindow + coincWindowPs;
+    const long long lo = std::max(delayStartPs, centre - halfSpan);
+    const long long fineStart =
+        delayStartPs + ((lo - delayStartPs) / delayStepPs) * delayStepPs;
+    const long long fineEnd = std::min(delayEndPs, centre + halfSpan);
+    rep.usedFullScan = false;
+    return findBestDelayPicosecondsImpl(reference, target, coincWindowPs,
+                                        fineStart, fineEnd, delayStepPs,
+                                        scratchResults);
+}
+} // namespace
+
+void computeCoincidencesForRange(std::span<const long long> channel1,
+                                 std::span<const long long> channel2,
+                                 long long coincWindowPs,
+                                 long long delayStartPs, long long delayEndPs,
+                                 long long delayStepPs,
+                                 std::vector<std::pair<float, int>> &results) {
+    computeCoincidencesForRangeImpl(channel1, channel2, coincWindowPs,
+                                    delayStartPs, delayEndPs, delayStepPs,
+                                    results);
+}
+
+void computeCoincidencesForRange(SegmentedSpan channel1, SegmentedSpan channel2,
+                                 long long coincWindowPs,
+                                 long long delayStartPs, long long delayEndPs,
+                                 long long delayStepPs,
+                                 std::vector<std::pair<float, int>> &results) {
+    computeCoincidencesForRangeImpl(channel1, channel2, coincWindowPs,
+                                    delayStartPs, delayEndPs, delayStepPs,
+                                    results);
+}
+
+long long findBestDelayPicoseconds(
+    std::span<const long long> reference,
+    std::span<const long long> target,
+    long long coincWindowPs,
+    long long delayStartPs,
+    long long delayEndPs,
+    long long delayStepPs,
+    std::vector<std::pair<float, int>> *scratchResults) {
+    return findBestDelayPicosecondsImpl(reference, target, coincWindowPs,
+                                        delayStartPs, delayEndPs, delayStepPs,
+                                        scratchResults);
+}
+
+long long findBestDelayPicoseconds(
+    SegmentedSpan reference,
+    SegmentedSpan target,
+    long long coincWindowPs,
+    long long delayStartPs,
+    long long delayEndPs,
+    long long delayStepPs,
+    std::vector<std::pair<float, int>> *scratchResults) {
+    return findBestDelayPicosecondsImpl(reference, target, coincWindowPs,
+                                        delayStartPs, delayEndPs, delayStepPs,
+                                        scratchResults);
+}
+
+long long findBestDelayCoarseToFine(
+    std::span<const long long> reference,
+    std::span<const long long> target,
+    long long coincWindowPs,
+    long long delayStartPs,
+    long long delayEndPs,
+    long long delayStepPs,
+    const CoarseToFineOptions &options,
+    CoarseToFineReport *report,
+    std::vector<std::pair<float, int>> *scratchResults) {
+    return findBestDelayCoarseToFineImpl(reference, target, coincWindowPs,
+                                         delayStartPs, delayEndPs, delayStepPs,
+                                         options, report, scratchResults);
+}
+
+long long findBestDelayCoarseToFine(
+    SegmentedSpan reference,
+    SegmentedSpan target,
+    long long coincWindowPs,
+    long long delayStartPs,
+    long long delayEndPs,
+    long long delayStepPs,
+    const CoarseToFineOptions &options,
+    CoarseToFineReport *report,
+    std::vector<std::pair<float, int>> *scratchResults) {
+    return findBestDelayCoarseToFineImpl(reference, target, coincWindowPs,
+                                         delayStartPs, delayEndPs, delayStepPs,
+                                         options, report, scratchResults);
+}
+
 void writeResultsToFile(const std::vector<std::pair<float, int>> &results,
                         const std::string &filename) {
     std::ofstream out(filename);
@@ -285,7 +805,9 @@ void writeResultsToFile(const std::vector<std::pair<float, int>> &results,
         std::cerr << "Error opening file: " << filename << std::endl;
         return;
     }
+    COINCFINDER_TIME_SCOPE("write");
     for (auto &p : results)
         out << p.first << "," << p.second << "\n";
+    COINCFINDER_COUNT(BytesWritten, static_cast<long long>(out.tellp()));
     out.close();
 }
@@ -0,0 +1,251 @@
+#include "CompactSingles.h"
+
+// Compact singles: 32-bit offsets from per-block 64-bit bases. Blocks sit on
+// a fixed 2^32 ps grid (`ts >> 32`), so appending a slice only has to check
+// whether its first event continues the last block.
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "CoincidenceKernels.h"
+#include "ReadCSV.h"
+
+namespace {
+constexpr Timestamp kBlockMask = (Timestamp{1} << kCompactBlockBits) - 1;
+
+// Events decoded per channel before handing them to the merge kernel:
+// 2 x 8 KiB of stack stays in L1.
+constexpr size_t kDecodeChunk = 1024;
+
+template <typename T>
+size_t capacityBytes(const std::vector<T> &v) {
+    return v.capacity() * sizeof(T);
+}
+
+void shrinkToFit(CompactSingles &singles) {
+    singles.offsets.shrink_to_fit();
+    singles.blockBases.shrink_to_fit();
+    singles.blockEnds.shrink_to_fit();
+    singles.bucketOffsets.shrink_to_fit();
+}
+
+// Index of the block holding event `index`.
+size_t blockOf(const CompactSingles &singles, size_t index) {
+    return static_cast<size_t>(
+        std::upper_bound(singles.blockEnds.begin(), singles.blockEnds.end(),
+                         index) -
+        singles.blockEnds.begin());
+}
+
+// Sequential decoder over one view, tracking the current block.
+class CompactDecoder {
+public:
+    explicit CompactDecoder(CompactSpan events)
+        : singles_(events.singles), next_(events.begin), end_(events.end) {
+        if (next_ < end_)
+            block_ = blockOf(*singles_, next_);
+    }
+
+    // Writes up to `capacity` timestamps to `out`; returns how many.
+    size_t decode(Timestamp *out, size_t capacity) {
+        size_t count = 0;
+        while (count < capacity && next_ < end_) {
+            const size_t blockEnd = singles_->blockEnds[block_];
+            const size_t take =
+                std::min({capacity - count, blockEnd - next_, end_ - next_});
+            const Timestamp base = singles_->blockBases[block_];
+            const uint32_t *src = singles_->offsets.data() + next_;
+            for (size_t k = 0; k < take; ++k)
+                out[count + k] = base + src[k];
+            count += take;
+            next_ += take;
+            if (next_ == blockEnd)
+                ++block_;
+        }
+        return count;
+    }
+
+private:
+    const CompactSingles *singles_;
+    size_t next_;
+    size_t end_;
+    size_t block_ = 0;
+};
+} // namespace
+
+size_t CompactSingles::memoryBytes() const {
+    return capacityBytes(offsets) + capacityBytes(blockBases) +
+           capacityBytes(blockEnds) + capacityBytes(bucketOffsets);
+}
+
+void appendCompactSingles(CompactSingles &compact, const FlatSingles &chunk) {
+    if (chunk.bucketCount() == 0)
+        return;
+    if (compact.bucketCount() == 0) {
+        compact.channel = chunk.channel;
+        compact.baseSecond = chunk.baseSecond;
+        compact.bucketWidthPs = chunk.bucketWidthPs;
+        compact.bucketOffsets.assign(1, compact.offsets.size());
+    } else if (chunk.bucketWidthPs != compact.bucketWidthPs) {
+        throw std::invalid_argument(
+            "appendCompactSingles: chunk has a different bucket width");
+    } else if (chunk.baseSecond <
+               compact.baseSecond + static_cast<long long>(compact.bucketCount())) {
+        throw std::invalid_argument(
+            "appendCompactSingles: chunk overlaps the buckets already packed");
+    }
+
+    // Empty buckets between the packed range and the chunk.
+    const long long gap = chunk.baseSecond - compact.baseSecond -
+                          static_cast<long long>(compact.bucketCount());
+    compact.bucketOffsets.insert(compact.bucketOffsets.end(),
+                                 static_cast<size_t>(gap),
+                                 compact.offsets.size());
+
+    compact.offsets.reserve(compact.offsets.size() + chunk.timestamps.size());
+    Timestamp blockBase = compact.blockBases.empty() ? 0 : compact.blockBases.back();
+    for (size_t b = 0; b < chunk.bucketCount(); ++b) {
+        for (size_t k = chunk.bucketOffsets[b]; k < chunk.bucketOffsets[b + 1]; ++k) {
+            const Timestamp ts = chunk.timestamps[k];
+            const Timestamp base = ts & ~kBlockMask;
+            if (compact.blockBases.empty() || base != blockBase) {
+                if (!compact.blockBases.empty() && base < blockBase)
+                    throw std::invalid_argument(
+                        "appendCompactSingles: timestamps must ascend");
+                compact.blockBases.push_back(base);
+                compact.blockEnds.push_back(compact.offsets.size());
+                blockBase = base;
+            }
+            compact.offsets.push_back(static_cast<uint32_t>(ts & kBlockMask));
+            ++compact.blockEnds.back();
+        }
+        compact.bucketOffsets.push_back(compact.offsets.size());
+    }
+}
+
+CompactSingles compactSingles(const FlatSingles &flat) {
+    CompactSingles compact;
+    compact.channel = flat.channel;
+    compact.baseSecond = flat.baseSecond;
+    compact.bucketWidthPs = flat.bucketWidthPs;
+    appendCompactSingles(compact, flat);
+    shrinkToFit(compact);
+    return compact;
+}
+
+FlatSingles expandCompactSingles(const CompactSingles &compact) {
+    FlatSingles flat;
+    flat.channel = compact.channel;
+    flat.baseSecond = compact.baseSecond;
+    flat.bucketWidthPs = compact.bucketWidthPs;
+    flat.bucketOffsets = compact.bucketOffsets;
+    decodeCompact({&compact, 0, compact.size()}, flat.timestamps);
+    return flat;
+}
+
+CompactSpan eventsForSeconds(const CompactSingles &singles, long long firstSecond,
+                             long long lastSecond) {
+    const long long buckets = static_cast<long long>(singles.bucketCount());
+    const long long lastBucket = singles.baseSecond + buckets - 1;
+    if (buckets == 0 || firstSecond > lastBucket || lastSecond < singles.baseSecond ||
+        firstSecond > lastSecond)
+        return {&singles, 0, 0};
+    // Clamp before subtracting so open-ended ranges (LLONG_MIN/MAX) work.
+    const long long lo = std::max(firstSecond, singles.baseSecond) - singles.baseSecond;
+    const long long hi = std::min(lastSecond, lastBucket) - singles.baseSecond;
+    return {&singles, singles.bucketOffsets[static_cast<size_t>(lo)],
+            singles.bucketOffsets[static_cast<size_t>(hi) + 1]};
+}
+
+CompactSpan eventsForSecond(const CompactSingles &singles, long long second) {
+    return eventsForSeconds(singles, second, second);
+}
+
+CompactSpan eventsWithNextFirst(const CompactSingles &singles, long long second) {
+    CompactSpan current = eventsForSecond(singles, second);
+    const CompactSpan next = eventsForSecond(singles, second + 1);
+    if (next.empty())
+        return current;
+    // An empty bucket still borrows the next bucket's head, as for
+    // FlatSingles.
+    if (current.empty())
+        return {&singles, next.begin, next.begin + 1};
+    current.end += 1;
+    return current;
+}
+
+Timestamp compactTimestampAt(const CompactSingles &singles, size_t index) {
+    if (index >= singles.size())
+        throw std::out_of_range("compactTimestampAt: index past the last event");
+    return singles.blockBases[blockOf(singles, index)] + singles.offsets[index];
+}
+
+std::span<const Timestamp> decodeCompact(CompactSpan events,
+                                         std::vector<Timestamp> &scratch) {
+    scratch.resize(events.size());
+    if (!events.empty())
+        CompactDecoder(events).decode(scratch.data(), scratch.size());
+    return scratch;
+}
+
+int countCoincidencesWithDelay(CompactSpan ch1, CompactSpan ch2,
+                               long long coincWindowPs, long long delayPs) {
+    CompactDecoder decoder1(ch1);
+    CompactDecoder decoder2(ch2);
+    Timestamp chunk1[kDecodeChunk];
+    Timestamp chunk2[kDecodeChunk];
+    size_t size1 = ch1.empty() ? 0 : decoder1.decode(chunk1, kDecodeChunk);
+    size_t size2 = ch2.empty() ? 0 : decoder2.decode(chunk2, kDecodeChunk);
+
+    // The greedy merge carries no state beyond its two cursors, so refilling
+    // whichever chunk ran out and resuming gives the same pairs as one merge
+    // over the full sequences.
+    int count = 0;
+    size_t i = 0;
+    size_t j = 0;
+    while (size1 > 0 && size2 > 0) {
+        count += countCoincidencesKernel(chunk1, size1, chunk2, size2,
+                                         coincWindowPs, delayPs, i, j);
+        if (i == size1) {
+            size1 = decoder1.decode(chunk1, kDecodeChunk);
+            i = 0;
+        }
+        if (j == size2) {
+            size2 = decoder2.decode(chunk2, kDecodeChunk);
+            j = 0;
+        }
+    }
+    return count;
+}
+
+std::map<int, CompactSingles> readFileAutoCompact(const std::string &filename,
+                                                  double &duration_sec,
+                                                  double exposure_seconds,
+                                                  long long chunkSeconds) {
+    if (chunkSeconds <= 0)
+        throw std::invalid_argument("chunkSeconds must be positive");
+    const long long bucketWidthPs = bucketWidthForExposure(exposure_seconds);
+    if (bucketWidthPs == 0)
+        throw std::invalid_argument(
+            "readFileAutoCompact needs a fixed bucket width, not kAutoExposure");
+
+    std::map<int, CompactSingles> compact;
+    long long lastBucket = 0;
+    for (long long first = 0; first <= lastBucket; first += chunkSeconds) {
+        const auto chunk = readFileAutoFlat(filename, duration_sec, exposure_seconds,
+                                            first, first + chunkSeconds - 1);
+        // The duration covers the whole capture; one spare bucket absorbs
+        // rounding of the last event's bucket.
+        lastBucket = static_cast<long long>(duration_sec * 1e12 /
+                                            static_cast<double>(bucketWidthPs)) +
+                     1;
+        for (const auto &[channel, flat] : chunk) {
+            CompactSingles &dst = compact[channel];
+            dst.channel = channel;
+            appendCompactSingles(dst, flat);
+        }
+    }
+    for (auto &[channel, singles] : compact)
+        shrinkToFit(singles);
+    return compact;
+}
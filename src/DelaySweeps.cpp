@@ -0,0 +1,91 @@
+#include "DelaySweeps.h"
+
+// Batched per-second delay scans. The (pair, second) jobs are independent,
+// so they are flattened into one index space and handed out dynamically:
+// seconds differ a lot in event count and busy pairs should not leave
+// threads idle.
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "Coincidences.h"
+
+size_t delaySweepBins(long long delayStartPs, long long delayEndPs,
+                      long long delayStepPs) {
+    if (delayStepPs <= 0)
+        throw std::invalid_argument("delayStep must be positive in ps");
+    if (delayEndPs < delayStartPs)
+        throw std::invalid_argument("delayEnd must be >= delayStart");
+    return static_cast<size_t>((delayEndPs - delayStartPs) / delayStepPs + 1);
+}
+
+void computeDelaySweeps(std::span<const SweepChannels> pairs, long long startSec,
+                        long long stopSec, long long coincWindowPs,
+                        long long delayStartPs, long long delayEndPs,
+                        long long delayStepPs, std::span<int32_t> out) {
+    if (stopSec < startSec)
+        throw std::invalid_argument("stopSec must be >= startSec");
+    const size_t bins = delaySweepBins(delayStartPs, delayEndPs, delayStepPs);
+    const size_t seconds = static_cast<size_t>(stopSec - startSec + 1);
+    if (out.size() != pairs.size() * seconds * bins)
+        throw std::invalid_argument(
+            "output size does not match pairs x seconds x bins");
+
+    const long long jobs = static_cast<long long>(pairs.size() * seconds);
+#pragma omp parallel
+    {
+        // Per-thread scratch reused across every job this thread picks up.
+        std::vector<std::pair<float, int>> results;
+        std::vector<Timestamp> scratch1, scratch2;
+
+#pragma omp for schedule(dynamic, 16)
+        for (long long job = 0; job < jobs; ++job) {
+            const size_t pair = static_cast<size_t>(job) / seconds;
+            const size_t secIdx = static_cast<size_t>(job) % seconds;
+            const long long sec = startSec + static_cast<long long>(secIdx);
+            int32_t *row = out.data() + (pair * seconds + secIdx) * bins;
+            std::fill(row, row + bins, 0);
+
+            const SweepChannels &channels = pairs[pair];
+            if (!channels.first || !channels.second)
+                continue;
+            const auto events1 = eventsForCaptureSecond(*channels.first, sec, scratch1);
+            const SegmentedSpan events2 = withNextFirstEvent(
+                eventsForCaptureSecond(*channels.second, sec, scratch2),
+                firstEventOfCaptureSecond(*channels.second, sec + 1));
+            if (events1.empty() || events2.empty())
+                continue;
+
+            results.clear();
+            computeCoincidencesForRange(events1, events2, coincWindowPs, delayStartPs,
+                                        delayEndPs, delayStepPs, results);
+            for (size_t k = 0; k < bins; ++k)
+                row[k] = results[k].second;
+        }
+    }
+}
+
+std::vector<int32_t> computeDelaySweeps(const std::map<int, Singles> &singles,
+                                        std::span<const std::pair<int, int>> pairs,
+                                        long long startSec, long long stopSec,
+                                        long long coincWindowPs,
+                                        long long delayStartPs,
+                                        long long delayEndPs,
+                                        long long delayStepPs) {
+    const auto find = [&](int channel) -> const Singles * {
+        const auto it = singles.find(channel);
+        return it == singles.end() ? nullptr : &it->second;
+    };
+    std::vector<SweepChannels> channels;
+    channels.reserve(pairs.size());
+    for (const auto &[ch1, ch2] : pairs)
+        channels.push_back({find(ch1), find(ch2)});
+
+    const size_t bins = delaySweepBins(delayStartPs, delayEndPs, delayStepPs);
+    const size_t seconds =
+        stopSec < startSec ? 0 : static_cast<size_t>(stopSec - startSec + 1);
+    std::vector<int32_t> out(pairs.size() * seconds * bins);
+    computeDelaySweeps(channels, startSec, stopSec, coincWindowPs, delayStartPs,
+                       delayEndPs, delayStepPs, out);
+    return out;
+}
@@ -0,0 +1,319 @@
+#include "FftCorrelation.h"
+
+// Binned FFT cross-correlation for wide delay scans. Channel 1 is shifted by
+// the start of the delay range and both channels are binned at the delay
+// step, so a pair whose bin indices differ by k lands near delay bin k. The
+// time axis is cut into blocks that are correlated independently
+// (overlap-save on the channel 2 side); blocks without channel 1 events are
+// skipped, which keeps sparse files cheap.
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <complex>
+#include <numbers>
+#include <optional>
+#include <stdexcept>
+
+#include "CoincWorkspace.h"
+
+namespace {
+constexpr long long kPicosecondsPerNanosecond = 1000LL;
+
+using Complex = std::complex<double>;
+
+std::atomic<DelayScanEngine> gEngine{DelayScanEngine::Auto};
+
+// Iterative radix-2 transform with the bit-reversal and twiddle tables of one
+// size, reused for every block of a scan.
+class FftPlan {
+public:
+    explicit FftPlan(size_t n) : n_(n), bitrev_(n), twiddles_(n / 2) {
+        unsigned bits = 0;
+        while ((size_t{1} << bits) < n)
+            ++bits;
+        for (size_t i = 0; i < n; ++i) {
+            size_t r = 0;
+            for (unsigned b = 0; b < bits; ++b)
+                if ((i >> b) & 1u)
+                    r |= size_t{1} << (bits - 1 - b);
+            bitrev_[i] = r;
+        }
+        for (size_t k = 0; k < twiddles_.size(); ++k)
+            twiddles_[k] = std::polar(
+                1.0, -2.0 * std::numbers::pi * static_cast<double>(k) /
+                         static_cast<double>(n));
+    }
+
+    size_t size() const { return n_; }
+
+    void forward(std::vector<Complex> &a) const { transform(a, false); }
+
+    void inverse(std::vector<Complex> &a) const {
+        transform(a, true);
+        const double scale = 1.0 / static_cast<double>(n_);
+        for (auto &v : a)
+            v *= scale;
+    }
+
+private:
+    void transform(std::vector<Complex> &a, bool inverse) const {
+        for (size_t i = 0; i < n_; ++i)
+            if (i < bitrev_[i])
+                std::swap(a[i], a[bitrev_[i]]);
+        for (size_t len = 2; len <= n_; len <<= 1) {
+            const size_t half = len / 2;
+            const size_t stride = n_ / len;
+            // Twiddle-major order: each factor is loaded once per stage.
+            for (size_t k = 0; k < half; ++k) {
+                const Complex w = twiddles_[k * stride];
+                const double wr = w.real();
+                const double wi = inverse ? -w.imag() : w.imag();
+                for (size_t base = 0; base < n_; base += len) {
+                    const Complex x = a[base + k + half];
+                    // Spelled out: operator* on std::complex guards against
+                    // NaN/inf and does not inline without -ffast-math.
+                    const Complex t(wr * x.real() - wi * x.imag(),
+                                    wr * x.imag() + wi * x.real());
+                    a[base + k + half] = a[base + k] - t;
+                    a[base + k] += t;
+                }
+            }
+        }
+    }
+
+    size_t n_;
+    std::vector<size_t> bitrev_;
+    std::vector<Complex> twiddles_;
+};
+
+// Plan and buffers of the last scan on this thread. Consecutive seconds of a
+// sweep share the geometry, so the plan is rebuilt only when the size
+// changes and the buffers only grow.
+struct FftScratch {
+    std::optional<FftPlan> plan;
+    std::vector<Complex> packed;
+    std::vector<Complex> product;
+    std::vector<double> lagHist;
+    std::vector<double> taps;
+
+    const FftPlan &planFor(size_t n) {
+        if (!plan || plan->size() != n)
+            plan.emplace(n);
+        return *plan;
+    }
+};
+
+FftScratch &threadFftScratch() {
+    thread_local FftScratch scratch;
+    return scratch;
+}
+
+struct FftGeometry {
+    long long reach = 0;  // extra lags on each side that can touch a bin
+    size_t steps = 0;     // delay bins
+    size_t lags = 0;      // steps + 2 * reach
+    size_t fftSize = 0;
+    size_t blockBins = 0; // channel 1 bins per block
+};
+
+FftGeometry buildGeometry(long long coincWindowPs, long long delayStartPs,
+                          long long delayEndPs, long long delayStepPs) {
+    FftGeometry g;
+    g.steps = static_cast<size_t>((delayEndPs - delayStartPs) / delayStepPs + 1);
+    // One lag beyond the window: residuals inside the bins blur every pair
+    // by up to one step.
+    g.reach = coincWindowPs / delayStepPs + 1;
+    g.lags = g.steps + 2 * static_cast<size_t>(g.reach);
+    g.fftSize = 2;
+    while (g.fftSize < 2 * g.lags)
+        g.fftSize <<= 1;
+    g.blockBins = g.fftSize - g.lags + 1;
+    return g;
+}
+
+// CDF of r1 - r2 for residuals uniform in [0, step): triangular on
+// (-step, step).
+double residualCdf(double x, double step) {
+    if (x <= -step)
+        return 0.0;
+    if (x >= step)
+        return 1.0;
+    if (x < 0.0)
+        return (step + x) * (step + x) / (2.0 * step * step);
+    return 1.0 - (step - x) * (step - x) / (2.0 * step * step);
+}
+
+// Probability that a pair `m` bins away from a delay bin falls inside the
+// coincidence window once the in-bin residuals are accounted for.
+double lagWeight(long long m, long long coincWindowPs, long long delayStepPs) {
+    const double step = static_cast<double>(delayStepPs);
+    const double centre = static_cast<double>(m) * step;
+    const double w = static_cast<double>(coincWindowPs);
+    return residualCdf(w - centre, step) - residualCdf(-w - centre, step);
+}
+
+// Cost model in units of one direct pair visit, measured on x86-64: a
+// radix-2 butterfly pass (per element and level, forward plus inverse) costs
+// about six, the per-block packing/unpacking about ten per element.
+constexpr double kButterflyCost = 6.0;
+constexpr double kBlockElementCost = 10.0;
+
+void fillEmpty(size_t steps, long long delayStartPs, long long delayStepPs,
+               std::vector<std::pair<float, int>> &results) {
+    results.resize(steps);
+    for (size_t idx = 0; idx < steps; ++idx) {
+        const long long delayPs =
+            delayStartPs + static_cast<long long>(idx) * delayStepPs;
+        results[idx] = {static_cast<float>(delayPs) / kPicosecondsPerNanosecond,
+                        0};
+    }
+}
+} // namespace
+
+DelayScanEngine delayScanEngine() {
+    return gEngine.load(std::memory_order_relaxed);
+}
+
+void setDelayScanEngine(DelayScanEngine engine) {
+    gEngine.store(engine, std::memory_order_relaxed);
+}
+
+const char *delayScanEngineName(DelayScanEngine engine) {
+    switch (engine) {
+    case DelayScanEngine::Auto:
+        return "auto";
+    case DelayScanEngine::Direct:
+        return "direct";
+    case DelayScanEngine::Fft:
+        return "fft";
+    }
+    return "unknown";
+}
+
+bool fftScanPreferred(size_t size1, size_t size2, long long spanPs,
+                      long long coincWindowPs, long long delayStartPs,
+                      long long delayEndPs, long long delayStepPs) {
+    // Binning at the step only makes sense when the window covers a step.
+    if (delayStepPs <= 0 || delayEndPs < delayStartPs || spanPs <= 0 ||
+        coincWindowPs < delayStepPs || size1 == 0 || size2 == 0)
+        return false;
+    const FftGeometry g =
+        buildGeometry(coincWindowPs, delayStartPs, delayEndPs, delayStepPs);
+
+    const double n1 = static_cast<double>(size1);
+    const double n2 = static_cast<double>(size2);
+    const double reachPs = static_cast<double>(delayEndPs - delayStartPs) +
+                           2.0 * static_cast<double>(coincWindowPs);
+    const double pairs = n1 * n2 * reachPs / static_cast<double>(spanPs);
+    const double direct = n1 + n2 + static_cast<double>(g.steps) + pairs;
+
+    const double blockPs =
+        static_cast<double>(g.blockBins) * static_cast<double>(delayStepPs);
+    const double blocks =
+        std::min(n1, std::ceil(static_cast<double>(spanPs) / blockPs) + 1.0);
+    const double n = static_cast<double>(g.fftSize);
+    const double fft =
+        n1 + n2 +
+        blocks * n * (kButterflyCost * std::log2(n) + kBlockElementCost);
+    return fft < direct;
+}
+
+void computeCoincidencesForRangeFft(SegmentedSpan channel1,
+                                    SegmentedSpan channel2,
+                                    long long coincWindowPs,
+                                    long long delayStartPs, long long delayEndPs,
+                                    long long delayStepPs,
+                                    std::vector<std::pair<float, int>> &results) {
+    results.clear();
+    if (delayStepPs <= 0)
+        throw std::invalid_argument("delayStep must be positive in ps");
+    if (delayEndPs < delayStartPs)
+        return;
+
+    const FftGeometry g =
+        buildGeometry(coincWindowPs, delayStartPs, delayEndPs, delayStepPs);
+    fillEmpty(g.steps, delayStartPs, delayStepPs, results);
+    if (channel1.empty() || channel2.empty())
+        return;
+
+    // Bin indices relative to a common origin: channel 1 is shifted by the
+    // delay start so lag k (bin1 - bin2) sits at delay bin k.
+    const long long origin =
+        std::min(channel1[0] - delayStartPs, channel2[0]);
+    const auto bin1 = [&](size_t i) {
+        return (channel1[i] - delayStartPs - origin) / delayStepPs;
+    };
+    const auto bin2 = [&](size_t j) {
+        return (channel2[j] - origin) / delayStepPs;
+    };
+
+    // lagHist[l + reach] counts pairs whose bins differ by l, for l in
+    // [-reach, steps - 1 + reach].
+    const long long lagLo = -g.reach;
+    const long long lagHi = static_cast<long long>(g.steps) - 1 + g.reach;
+    FftScratch &scratch = threadFftScratch();
+    std::vector<double> &lagHist = scratch.lagHist;
+    assignScratch(lagHist, g.lags, 0.0);
+
+    const FftPlan &plan = scratch.planFor(g.fftSize);
+    const size_t n = g.fftSize;
+    const auto blockBins = static_cast<long long>(g.blockBins);
+    std::vector<Complex> &packed = scratch.packed;
+    std::vector<Complex> &product = scratch.product;
+    assignScratch(packed, n, Complex());
+    assignScratch(product, n, Complex());
+    size_t i = 0;
+    size_t jLo = 0;
+    while (i < channel1.size()) {
+        const long long base = (bin1(i) / blockBins) * blockBins;
+        std::fill(packed.begin(), packed.end(), Complex());
+        // Channel 1 goes into the real part, channel 2 into the imaginary
+        // part: one forward transform yields both spectra.
+        for (; i < channel1.size() && bin1(i) < base + blockBins; ++i)
+            packed[static_cast<size_t>(bin1(i) - base)] += Complex(1.0, 0.0);
+
+        const long long segFirst = base - lagHi;
+        const long long segLast = base + blockBins - 1 - lagLo;
+        while (jLo < channel2.size() && bin2(jLo) < segFirst)
+            ++jLo;
+        bool any = false;
+        for (size_t j = jLo; j < channel2.size() && bin2(j) <= segLast; ++j) {
+            packed[static_cast<size_t>(bin2(j) - segFirst)] += Complex(0.0, 1.0);
+            any = true;
+        }
+        if (!any)
+            continue;
+
+        plan.forward(packed);
+        for (size_t k = 0; k < n; ++k) {
+            // X1 = (Z[k] + conj(Z[n-k])) / 2, X2 = (Z[k] - conj(Z[n-k])) / 2i,
+            // product = conj(X1) * X2.
+            const Complex zk = packed[k];
+            const Complex zr = packed[(n - k) & (n - 1)];
+            const double ar = 0.5 * (zk.real() + zr.real());
+            const double ai = 0.5 * (zk.imag() - zr.imag());
+            const double br = 0.5 * (zk.imag() + zr.imag());
+            const double bi = -0.5 * (zk.real() - zr.real());
+            product[k] = Complex(ar * br + ai * bi, ar * bi - ai * br);
+        }
+        plan.inverse(product);
+        // product[u] = sum_x x1[x] * seg[x + u], where u = lagHi - lag.
+        for (size_t u = 0; u < g.lags; ++u)
+            lagHist[g.lags - 1 - u] += product[u].real();
+    }
+
+    // Spread each lag over the delay bins it can reach, weighted by how
+    // likely the in-bin residuals keep the pair inside the window.
+    std::vector<double> &taps = scratch.taps;
+    assignScratch(taps, static_cast<size_t>(2 * g.reach + 1), 0.0);
+    for (long long m = -g.reach; m <= g.reach; ++m)
+        taps[static_cast<size_t>(m + g.reach)] =
+            lagWeight(m, coincWindowPs, delayStepPs);
+    for (size_t k = 0; k < g.steps; ++k) {
+        double sum = 0.0;
+        for (size_t t = 0; t < taps.size(); ++t)
+            sum += taps[t] * lagHist[k + t];
+        results[k].second = static_cast<int>(std::llround(sum));
+    }
+}
@@ -0,0 +1,132 @@
+#include "Instrumentation.h"
+
+// Counter storage and the stage registry. Counters sit on their own cache
+// lines so OpenMP workers publishing different counters do not contend;
+// stages live in a deque so references handed out stay valid as it grows.
+
+#include <array>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+struct alignas(64) PaddedCounter {
+    std::atomic<uint64_t> value{0};
+};
+
+constexpr size_t kCounterCount = static_cast<size_t>(StatCounter::Count);
+
+std::array<PaddedCounter, kCounterCount> gCounters;
+
+std::mutex gStagesMutex;
+std::deque<StageStats> gStages;
+
+// Names and stage labels are plain identifiers; only quotes and
+// backslashes need escaping.
+void writeJsonString(std::ostream &out, const std::string &text) {
+    out << '"';
+    for (const char ch : text) {
+        if (ch == '"' || ch == '\\')
+            out << '\\';
+        out << ch;
+    }
+    out << '"';
+}
+} // namespace
+
+const char *statCounterName(StatCounter counter) {
+    switch (counter) {
+    case StatCounter::EventsIngested:
+        return "events_ingested";
+    case StatCounter::OutOfOrderInserts:
+        return "out_of_order_inserts";
+    case StatCounter::CandidatePairs:
+        return "candidate_pairs";
+    case StatCounter::BytesWritten:
+        return "bytes_written";
+    case StatCounter::ScratchAllocations:
+        return "scratch_allocations";
+    case StatCounter::Count:
+        break;
+    }
+    return "unknown";
+}
+
+void addStat(StatCounter counter, uint64_t amount) {
+    gCounters[static_cast<size_t>(counter)].value.fetch_add(
+        amount, std::memory_order_relaxed);
+}
+
+StageStats &statStage(const char *name) {
+    const std::lock_guard<std::mutex> lock(gStagesMutex);
+    for (StageStats &stage : gStages)
+        if (stage.name == name)
+            return stage;
+    StageStats &stage = gStages.emplace_back();
+    stage.name = name;
+    return stage;
+}
+
+StatsSnapshot statsSnapshot() {
+    StatsSnapshot snapshot;
+    for (size_t c = 0; c < kCounterCount; ++c)
+        snapshot.counters.emplace_back(
+            statCounterName(static_cast<StatCounter>(c)),
+            gCounters[c].value.load(std::memory_order_relaxed));
+    const std::lock_guard<std::mutex> lock(gStagesMutex);
+    for (const StageStats &stage : gStages)
+        snapshot.stages.push_back(
+            {stage.name, stage.calls.load(std::memory_order_relaxed),
+             static_cast<double>(
+                 stage.nanoseconds.load(std::memory_order_relaxed)) *
+                 1e-9});
+    return snapshot;
+}
+
+std::string statsJson() {
+    const StatsSnapshot snapshot = statsSnapshot();
+    std::ostringstream out;
+    out << std::setprecision(9);
+    out << "{\"enabled\": " << (snapshot.enabled ? "true" : "false")
+        << ", \"counters\": {";
+    for (size_t k = 0; k < snapshot.counters.size(); ++k) {
+        out << (k == 0 ? "" : ", ");
+        writeJsonString(out, snapshot.counters[k].first);
+        out << ": " << snapshot.counters[k].second;
+    }
+    out << "}, \"stages\": {";
+    for (size_t k = 0; k < snapshot.stages.size(); ++k) {
+        const StatsSnapshot::Stage &stage = snapshot.stages[k];
+        out << (k == 0 ? "" : ", ");
+        writeJsonString(out, stage.name);
+        out << ": {\"calls\": " << stage.calls
+            << ", \"seconds\": " << stage.seconds << "}";
+    }
+    out << "}}";
+    return out.str();
+}
+
+void writeStatsJson(const std::string &path) {
+    if (path == "-") {
+        std::cerr << statsJson() << "\n";
+        return;
+    }
+    std::ofstream out(path);
+    out << statsJson() << "\n";
+    if (!out)
+        throw std::runtime_error("Cannot write stats to " + path);
+}
+
+void resetStats() {
+    for (PaddedCounter &counter : gCounters)
+        counter.value.store(0, std::memory_order_relaxed);
+    const std::lock_guard<std::mutex> lock(gStagesMutex);
+    for (StageStats &stage : gStages) {
+        stage.calls.store(0, std::memory_order_relaxed);
+        stage.nanoseconds.store(0, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,138 @@
+#include "MappedFile.h"
+
+// Thin RAII wrapper over the platform mapping APIs. Failure is reported via
+// `isOpen()` rather than exceptions so callers can fall back to stream I/O.
+
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string &filename) {
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                              nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                              nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return;
+    if (GetFileType(file) != FILE_TYPE_DISK) {
+        CloseHandle(file);
+        return;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize)) {
+        CloseHandle(file);
+        return;
+    }
+    fileHandle_ = file;
+    size_ = static_cast<size_t>(fileSize.QuadPart);
+    if (size_ == 0) {
+        // Zero-length files cannot be mapped, but they are still valid input.
+        open_ = true;
+        return;
+    }
+
+    HANDLE mapping =
+        CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        release();
+        return;
+    }
+    mappingHandle_ = mapping;
+    void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        release();
+        return;
+    }
+    data_ = static_cast<const unsigned char *>(view);
+    open_ = true;
+}
+
+void MappedFile::release() {
+    if (data_)
+        UnmapViewOfFile(data_);
+    if (mappingHandle_)
+        CloseHandle(static_cast<HANDLE>(mappingHandle_));
+    if (fileHandle_)
+        CloseHandle(static_cast<HANDLE>(fileHandle_));
+    data_ = nullptr;
+    mappingHandle_ = nullptr;
+    fileHandle_ = nullptr;
+    size_ = 0;
+    open_ = false;
+}
+
+#else
+
+MappedFile::MappedFile(const std::string &filename) {
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+
+    struct stat st {};
+    if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        ::close(fd);
+        return;
+    }
+
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ == 0) {
+        // mmap rejects zero-length mappings; report an open, empty file.
+        ::close(fd);
+        open_ = true;
+        return;
+    }
+
+    void *addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file.
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        size_ = 0;
+        return;
+    }
+#ifdef MADV_SEQUENTIAL
+    ::madvise(addr, size_, MADV_SEQUENTIAL);
+#endif
+    data_ = static_cast<const unsigned char *>(addr);
+    open_ = true;
+}
+
+void MappedFile::release() {
+    if (data_)
+        ::munmap(const_cast<unsigned char *>(data_), size_);
+    data_ = nullptr;
+    size_ = 0;
+    open_ = false;
+}
+
+#endif
+
+MappedFile::~MappedFile() { release(); }
+
+MappedFile::MappedFile(MappedFile &&other) noexcept { *this = std::move(other); }
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+    if (this != &other) {
+        release();
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        open_ = std::exchange(other.open_, false);
+#ifdef _WIN32
+        fileHandle_ = std::exchange(other.fileHandle_, nullptr);
+        mappingHandle_ = std::exchange(other.mappingHandle_, nullptr);
+#endif
+    }
+    return *this;
+}
@@ -0,0 +1,64 @@
+#include "OrderedBlockWriter.h"
+
+// Reordering happens only on the writer thread, so `pending_`, `next_` and
+// `failed_` need no locking; producers touch nothing but the queue.
+
+#include <stdexcept>
+#include <utility>
+
+#include "Instrumentation.h"
+
+OrderedBlockWriter::OrderedBlockWriter(const std::string &filename,
+                                       const std::string &preamble,
+                                       size_t queueCapacity)
+    : filename_(filename), out_(filename, std::ios::binary | std::ios::trunc),
+      queue_(queueCapacity) {
+    if (!out_.is_open())
+        throw std::runtime_error("Cannot open output file: " + filename);
+    out_.write(preamble.data(), static_cast<std::streamsize>(preamble.size()));
+    COINCFINDER_COUNT(BytesWritten, preamble.size());
+    worker_ = std::thread([this] { run(); });
+}
+
+OrderedBlockWriter::~OrderedBlockWriter() {
+    try {
+        finish();
+    } catch (...) {
+        // Destructors must not throw; call finish() to observe errors.
+    }
+}
+
+void OrderedBlockWriter::submit(size_t sequence, std::string bytes) {
+    queue_.push({sequence, std::move(bytes)});
+}
+
+void OrderedBlockWriter::run() {
+    while (auto block = queue_.pop()) {
+        pending_.emplace(block->sequence, std::move(block->bytes));
+        for (auto it = pending_.find(next_); it != pending_.end();
+             it = pending_.find(next_)) {
+            if (!failed_) {
+                out_.write(it->second.data(),
+                           static_cast<std::streamsize>(it->second.size()));
+                failed_ = !out_;
+                COINCFINDER_COUNT(BytesWritten, it->second.size());
+            }
+            pending_.erase(it);
+            ++next_;
+        }
+    }
+}
+
+void OrderedBlockWriter::finish() {
+    if (finished_)
+        return;
+    finished_ = true;
+    queue_.close();
+    if (worker_.joinable())
+        worker_.join();
+    out_.close();
+    if (failed_ || !out_)
+        throw std::runtime_error("Failed writing " + filename_);
+    if (!pending_.empty())
+        throw std::runtime_error("Missing output blocks for " + filename_);
+}
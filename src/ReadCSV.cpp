@@ -1,7 +1,8 @@
 #include "ReadCSV.h"
 
-// CSV/BIN ingestion helpers. They construct `Singles` objects in-place so the
-// rest of the pipeline can treat every per-second bucket as an owning vector.
+// CSV/BIN ingestion helpers. Every reader feeds one flat array per channel;
+// the result is handed out either as `FlatSingles` directly or expanded into
+// `Singles` so existing callers keep their per-second owning vectors.
 
 #include <algorithm>
 #include <array>
@@ -9,13 +10,27 @@
 #include <cctype>
 #include <charconv>
 #include <cmath>
+#include <cstring>
 #include <string_view>
 #include <utility>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "Instrumentation.h"
+#include "MappedFile.h"
 
 namespace {
 
 constexpr long long kPicosecondsPerSecond = 1'000'000'000'000LL;
 constexpr int kMaxChannels = 8;
+// Qutools BIN layout: fixed header followed by packed (uint64 ts, uint16 ch).
+constexpr size_t kBinHeaderBytes = 40;
+constexpr size_t kBinRecordBytes = 10;
+// Below this size the parallel CSV reader parses on a single range.
+constexpr size_t kMinParallelCsvBytes = 1 << 20;
 
 std::atomic<double> gBucketSeconds{1.0};
 
@@ -26,18 +41,36 @@ inline long long bucketIndex(Timestamp ts, Timestamp firstTimestamp,
   return static_cast<long long>((ts - firstTimestamp) / bucketWidthPs);
 }
 
-inline void appendTimestamp(Singles &singles, long long second, Timestamp ts) {
-  // Buckets must stay sorted because the coincidence scan assumes monotonic
-  // timestamps. `ensureSecond` gives us a mutable reference to the bucket.
-  auto &bucket = ensureSecond(singles, second);
-  if (!bucket.empty() && ts < bucket.back()) {
-    const auto pos = std::upper_bound(bucket.begin(), bucket.end(), ts);
-    bucket.insert(pos, ts);
-  } else {
-    bucket.push_back(ts);
+} // namespace
+
+// Each ascending run is merged into the sorted prefix starting at the first
+// element it displaces, so interleaved sources and bounded jitter stay
+// near-linear. Fragmented input that would exceed the move budget falls
+// back to a single std::sort.
+void restoreOrder(std::vector<Timestamp> &v, size_t firstDescent) {
+  const auto at = [&](size_t idx) {
+    return v.begin() + static_cast<std::ptrdiff_t>(idx);
+  };
+  const size_t moveBudget = 8 * v.size() + 1024;
+  size_t moved = 0;
+  size_t sortedEnd = firstDescent;
+  while (sortedEnd < v.size()) {
+    size_t runEnd = sortedEnd + 1;
+    while (runEnd < v.size() && v[runEnd] >= v[runEnd - 1])
+      ++runEnd;
+    const auto first = std::upper_bound(v.begin(), at(sortedEnd), v[sortedEnd]);
+    moved += static_cast<size_t>(at(runEnd) - first);
+    if (moved > moveBudget) {
+      std::sort(v.begin(), v.end());
+      return;
+    }
+    std::inplace_merge(first, at(sortedEnd), at(runEnd));
+    sortedEnd = runEnd;
   }
 }
 
+namespace {
+
 template <typename T> bool parseIntegral(std::string_view token, T &value) {
   // Lightweight, locale-free parser so the loop stays allocation-free.
   const char *begin = token.data();
@@ -56,15 +89,238 @@ template <typename T> bool parseIntegral(std::string_view token, T &value) {
   return result.ec == std::errc() && result.ptr == end;
 }
 
-std::map<int, Singles>
-finalizeSingles(std::array<Singles, kMaxChannels + 1> &channels) {
-  std::map<int, Singles> result;
-  for (int ch = 1; ch <= kMaxChannels; ++ch) {
-    if (!channels[ch].eventsPerSecond.empty()) {
-      result.emplace(ch, std::move(channels[ch]));
+// Splits one CSV line into (timestamp, channel). Extra columns are ignored.
+bool parseCsvLine(std::string_view line, Timestamp &ts, int &ch) {
+  if (line.empty())
+    return false;
+
+  const size_t firstComma = line.find(',');
+  if (firstComma == std::string_view::npos)
+    return false;
+  size_t secondComma = line.find(',', firstComma + 1);
+  if (secondComma == std::string_view::npos)
+    secondComma = line.size();
+
+  std::string_view timestampToken = line.substr(0, firstComma);
+  std::string_view channelToken =
+      line.substr(firstComma + 1, secondComma - firstComma - 1);
+  return parseIntegral(timestampToken, ts) && parseIntegral(channelToken, ch);
+}
+
+// Calls `fn(line)` for every '\n'-terminated line in [begin, end); a final
+// unterminated line is included, matching std::getline.
+template <typename Fn>
+void forEachLine(const char *begin, const char *end, Fn &&fn) {
+  while (begin < end) {
+    const void *nl = std::memchr(begin, '\n', static_cast<size_t>(end - begin));
+    const char *lineEnd = nl ? static_cast<const char *>(nl) : end;
+    if (!fn(std::string_view(begin, static_cast<size_t>(lineEnd - begin))))
+      return;
+    begin = lineEnd + 1;
+  }
+}
+
+// Per-record state shared by every reader: validates the channel, rebases
+// timestamps onto the first accepted event and tracks the measurement span.
+// Events are appended to one flat array per channel in arrival order; the
+// array is put back in order once in `finishFlat`, and bucket offsets are
+// derived from the sorted timestamps (bucket index is monotonic in time).
+class SinglesAccumulator {
+public:
+  /// Buckets of the process default width.
+  SinglesAccumulator() : SinglesAccumulator(bucketWidthForExposure(-1.0)) {}
+
+  /// `bucketWidthPs == 0` picks the width from the events in `finishFlat`;
+  /// range restrictions then count whole seconds.
+  explicit SinglesAccumulator(long long bucketWidthPs)
+      : bucketWidthPs_(bucketWidthPs),
+        rangeWidthPs_(bucketWidthPs > 0 ? bucketWidthPs : kPicosecondsPerSecond) {}
+
+  /// Starts with a fixed origin, used when several accumulators each see a
+  /// slice of one file and must agree on bucket numbering.
+  SinglesAccumulator(long long bucketWidthPs, Timestamp origin)
+      : SinglesAccumulator(bucketWidthPs) {
+    firstTimestamp_ = origin;
+    first_ = false;
+  }
+
+  static bool accepts(Timestamp ts, int ch) {
+    return ch >= 1 && ch <= kMaxChannels && ts != 0;
+  }
+
+  void add(Timestamp ts, int ch) {
+    if (!accepts(ts, ch))
+      return;
+
+    if (first_) {
+      firstTimestamp_ = ts;
+      first_ = false;
+    }
+    extendSpan(ts);
+    const Timestamp rel = ts - firstTimestamp_;
+    if (restricted_) {
+      const long long bucket = bucketIndex(rel, 0, rangeWidthPs_);
+      if (bucket < firstBucket_ || bucket > lastBucket_)
+        return;
+    }
+    // Append unconditionally; an out-of-order event only records where the
+    // sorted prefix ends instead of paying an insert per event.
+    ChannelEvents &events = channels_[ch];
+    if (!events.timestamps.empty() && rel < events.timestamps.back()) {
+      ++outOfOrder_;
+      if (events.firstDescent == kSorted)
+        events.firstDescent = events.timestamps.size();
     }
+    events.timestamps.push_back(rel);
+  }
+
+  /// Keeps only events of buckets `firstBucket..lastBucket` (seconds when the
+  /// width is chosen automatically); the others still count towards the
+  /// measurement span.
+  void restrictToBuckets(long long firstBucket, long long lastBucket) {
+    restricted_ = true;
+    firstBucket_ = firstBucket;
+    lastBucket_ = lastBucket;
+  }
+
+  /// Widens the measurement span without storing an event. Range readers
+  /// pass the capture's first and last records so `duration_sec` still
+  /// describes the whole file.
+  void extendSpan(Timestamp ts) {
+    if (ts < minTime_)
+      minTime_ = ts;
+    if (ts > maxTime_)
+      maxTime_ = ts;
+  }
+
+  /// Width the range restriction is expressed in.
+  long long rangeWidthPs() const { return rangeWidthPs_; }
+
+  /// Appends everything `later` collected. `later` must cover a later slice
+  /// of the same input (same origin); arrays are concatenated in order and
+  /// the seam is checked for order like any other append.
+  void absorb(SinglesAccumulator &later) {
+    for (int ch = 1; ch <= kMaxChannels; ++ch) {
+      ChannelEvents &dst = channels_[ch];
+      ChannelEvents &src = later.channels_[ch];
+      if (src.timestamps.empty())
+        continue;
+      const size_t seam = dst.timestamps.size();
+      size_t descent = src.firstDescent == kSorted ? kSorted
+                                                   : seam + src.firstDescent;
+      if (seam > 0 && src.timestamps.front() < dst.timestamps.back()) {
+        descent = seam;
+        ++outOfOrder_;
+      }
+      dst.firstDescent = std::min(dst.firstDescent, descent);
+      if (dst.timestamps.empty())
+        dst.timestamps = std::move(src.timestamps);
+      else
+        dst.timestamps.insert(dst.timestamps.end(), src.timestamps.begin(),
+                              src.timestamps.end());
+    }
+    minTime_ = std::min(minTime_, later.minTime_);
+    maxTime_ = std::max(maxTime_, later.maxTime_);
+    outOfOrder_ += later.outOfOrder_;
+  }
+
+  std::map<int, FlatSingles> finishFlat(double &duration_sec) {
+    duration_sec =
+        (maxTime_ > minTime_) ? (maxTime_ - minTime_) * 1e-12 : 0.0;
+    std::map<int, FlatSingles> result;
+    COINCFINDER_COUNT(OutOfOrderInserts, outOfOrder_);
+    // Sorted buckets are what `countCoincidencesWithDelay` and
+    // `computeCoincidencesForRange` rely on.
+    size_t busiest = 0;
+    Timestamp earliest = LLONG_MAX;
+    Timestamp latest = LLONG_MIN;
+    for (ChannelEvents &events : channels_) {
+      if (events.timestamps.empty())
+        continue;
+      if (events.firstDescent != kSorted)
+        restoreOrder(events.timestamps, events.firstDescent);
+      busiest = std::max(busiest, events.timestamps.size());
+      earliest = std::min(earliest, events.timestamps.front());
+      latest = std::max(latest, events.timestamps.back());
+    }
+    // Every channel of a capture shares one width so bucket k means the same
+    // time span on all of them.
+    const long long width =
+        bucketWidthPs_ > 0 ? bucketWidthPs_
+                           : chooseBucketWidthPs(busiest, busiest ? latest - earliest : 0);
+    for (int ch = 1; ch <= kMaxChannels; ++ch) {
+      ChannelEvents &events = channels_[ch];
+      if (events.timestamps.empty())
+        continue;
+      COINCFINDER_COUNT(EventsIngested, events.timestamps.size());
+
+      FlatSingles flat;
+      flat.channel = ch;
+      flat.bucketWidthPs = width;
+      flat.timestamps = std::move(events.timestamps);
+      flat.baseSecond = bucketIndex(flat.timestamps.front(), 0, width);
+      const long long lastSecond = bucketIndex(flat.timestamps.back(), 0, width);
+      flat.bucketOffsets.reserve(
+          static_cast<size_t>(lastSecond - flat.baseSecond) + 2);
+      flat.bucketOffsets.push_back(0);
+      long long second = flat.baseSecond;
+      for (size_t idx = 0; idx < flat.timestamps.size(); ++idx) {
+        const long long sec = bucketIndex(flat.timestamps[idx], 0, width);
+        for (; second < sec; ++second)
+          flat.bucketOffsets.push_back(idx);
+      }
+      flat.bucketOffsets.push_back(flat.timestamps.size());
+      result.emplace(ch, std::move(flat));
+    }
+    return result;
+  }
+
+  std::map<int, Singles> finish(double &duration_sec) {
+    std::map<int, Singles> result;
+    for (auto &[ch, flat] : finishFlat(duration_sec)) {
+      result.emplace(ch, expandSingles(flat));
+      // Release each flat array as soon as it has been expanded.
+      flat = FlatSingles{};
+    }
+    return result;
+  }
+
+private:
+  static constexpr size_t kSorted = static_cast<size_t>(-1);
+
+  struct ChannelEvents {
+    std::vector<Timestamp> timestamps;
+    size_t firstDescent = kSorted;
+  };
+
+  std::array<ChannelEvents, kMaxChannels + 1> channels_;
+  Timestamp firstTimestamp_ = 0;
+  bool first_ = true;
+  long long minTime_ = LLONG_MAX;
+  long long maxTime_ = 0;
+  long long bucketWidthPs_; // 0: chosen in finishFlat
+  long long rangeWidthPs_;
+  size_t outOfOrder_ = 0; // stored events older than their predecessor
+  bool restricted_ = false;
+  long long firstBucket_ = 0;
+  long long lastBucket_ = 0;
+};
+
+// Decodes packed BIN records from memory. memcpy keeps the unaligned loads
+// well-defined; compilers lower it to plain moves.
+void decodeBinRecords(const unsigned char *data, size_t size,
+                      SinglesAccumulator &acc) {
+  if (size <= kBinHeaderBytes)
+    return;
+  const size_t records = (size - kBinHeaderBytes) / kBinRecordBytes;
+  const unsigned char *rec = data + kBinHeaderBytes;
+  for (size_t i = 0; i < records; ++i, rec += kBinRecordBytes) {
+    uint64_t t_raw = 0;
+    uint16_t c_raw = 0;
+    std::memcpy(&t_raw, rec, sizeof(t_raw));
+    std::memcpy(&c_raw, rec + sizeof(t_raw), sizeof(c_raw));
+    acc.add(static_cast<long long>(t_raw), static_cast<int>(c_raw) + 1);
   }
-  return result;
 }
 
 } // namespace
@@ -83,121 +339,409 @@ double bucketDurationSeconds() {
   return gBucketSeconds.load(std::memory_order_relaxed);
 }
 
-std::map<int, Singles> readFileAuto(const std::string &filename,
-                                    double &duration_sec,
-                                    double exposure_seconds) {
-  if (exposure_seconds > 1e-9)
-    setBucketDurationSeconds(exposure_seconds);
-  if (hasEnding(filename, ".bin"))
-    return readBINtoSingles(filename, duration_sec);
-  return readCSVtoSingles(filename, duration_sec);
+long long chooseBucketWidthPs(size_t busiestEvents, long long spanPs) {
+  long long perSecond = 1;
+  if (busiestEvents > kAutoBucketEvents) {
+    // Events per second of the busiest channel; a capture shorter than a
+    // second holds them all in its first bucket.
+    const double rate =
+        spanPs >= kPicosecondsPerSecond
+            ? static_cast<double>(busiestEvents) * 1e12 / static_cast<double>(spanPs)
+            : static_cast<double>(busiestEvents);
+    while (perSecond < kMaxAutoBucketsPerSecond &&
+           rate / static_cast<double>(perSecond) > static_cast<double>(kAutoBucketEvents))
+      perSecond *= 2;
+  }
+  return kPicosecondsPerSecond / perSecond;
 }
 
-std::map<int, Singles> readCSVtoSingles(const std::string &filename,
-                                        double &duration_sec) {
+long long bucketWidthForExposure(double exposure_seconds) {
+  if (exposure_seconds == kAutoExposure)
+    return 0;
+  const double seconds = exposure_seconds > 1e-9 ? exposure_seconds
+                                                 : bucketDurationSeconds();
+  return std::max<long long>(1, std::llround(seconds * kPicosecondsPerSecond));
+}
+
+namespace {
+
+SinglesAccumulator accumulateCSV(const std::string &filename,
+                                 SinglesAccumulator acc = SinglesAccumulator()) {
   std::ifstream file(filename);
   if (!file.is_open())
     throw std::runtime_error("Cannot open CSV file: " + filename);
 
-  std::array<Singles, kMaxChannels + 1> channels;
-  for (int ch = 1; ch <= kMaxChannels; ++ch)
-    channels[ch].channel = ch;
-
   std::string line;
-  Timestamp firstTimestamp = 0;
-  bool first = true;
-  long long minTime = LLONG_MAX;
-  long long maxTime = 0;
-  const long long bucketWidthPs = static_cast<long long>(
-      std::llround(bucketDurationSeconds() * kPicosecondsPerSecond));
 
   while (std::getline(file, line)) {
-    if (line.empty())
-      continue;
+    Timestamp ts = 0;
+    int ch = 0;
+    if (parseCsvLine(line, ts, ch))
+      acc.add(ts, ch);
+  }
+  return acc;
+}
 
-    const size_t firstComma = line.find(',');
-    if (firstComma == std::string::npos)
-      continue;
-    size_t secondComma = line.find(',', firstComma + 1);
-    if (secondComma == std::string::npos)
-      secondComma = line.size();
+SinglesAccumulator accumulateCSVParallel(const std::string &filename,
+                                         long long bucketWidthPs) {
+  MappedFile mapped(filename);
+  if (!mapped.isOpen())
+    return accumulateCSV(filename, SinglesAccumulator(bucketWidthPs));
 
-    std::string_view lineView(line);
-    std::string_view timestampToken = lineView.substr(0, firstComma);
-    std::string_view channelToken =
-        lineView.substr(firstComma + 1, secondComma - firstComma - 1);
+  const char *const text = reinterpret_cast<const char *>(mapped.data());
+  const char *const textEnd = text + mapped.size();
 
+  // Every slice rebases onto the same origin: the first accepted record.
+  Timestamp origin = 0;
+  bool haveOrigin = false;
+  forEachLine(text, textEnd, [&](std::string_view line) {
     Timestamp ts = 0;
     int ch = 0;
-    if (!parseIntegral(timestampToken, ts) ||
-        !parseIntegral(channelToken, ch)) {
-      continue;
-    }
-    if (ch < 1 || ch > kMaxChannels || ts == 0)
-      continue;
-
-    if (first) {
-      firstTimestamp = ts;
-      first = false;
+    if (parseCsvLine(line, ts, ch) && SinglesAccumulator::accepts(ts, ch)) {
+      origin = ts;
+      haveOrigin = true;
+      return false;
     }
-    const long long sec = bucketIndex(ts, firstTimestamp, bucketWidthPs);
-
-    appendTimestamp(channels[ch], sec, ts - firstTimestamp);
+    return true;
+  });
+  if (!haveOrigin)
+    return SinglesAccumulator(bucketWidthPs);
+
+  int ranges = 1;
+#ifdef _OPENMP
+  if (mapped.size() >= kMinParallelCsvBytes)
+    ranges = std::max(1, omp_get_max_threads());
+#endif
+
+  // Byte ranges start right after a newline so no line is split.
+  std::vector<const char *> bounds(static_cast<size_t>(ranges) + 1, textEnd);
+  bounds[0] = text;
+  for (int r = 1; r < ranges; ++r) {
+    const char *guess = text + mapped.size() / static_cast<size_t>(ranges) *
+                                   static_cast<size_t>(r);
+    guess = std::max(guess, bounds[static_cast<size_t>(r) - 1]);
+    const void *nl =
+        std::memchr(guess, '\n', static_cast<size_t>(textEnd - guess));
+    bounds[static_cast<size_t>(r)] =
+        nl ? static_cast<const char *>(nl) + 1 : textEnd;
+  }
 
-    if (ts < minTime)
-      minTime = ts;
-    if (ts > maxTime)
-      maxTime = ts;
+  std::vector<SinglesAccumulator> partial(static_cast<size_t>(ranges),
+                                          SinglesAccumulator(bucketWidthPs, origin));
+#pragma omp parallel for schedule(static, 1)
+  for (int r = 0; r < ranges; ++r) {
+    SinglesAccumulator &acc = partial[static_cast<size_t>(r)];
+    forEachLine(bounds[static_cast<size_t>(r)],
+                bounds[static_cast<size_t>(r) + 1], [&](std::string_view line) {
+                  Timestamp ts = 0;
+                  int ch = 0;
+                  if (parseCsvLine(line, ts, ch))
+                    acc.add(ts, ch);
+                  return true;
+                });
   }
 
-  duration_sec = (maxTime > minTime) ? (maxTime - minTime) * 1e-12 : 0.0;
-  return finalizeSingles(channels);
+  for (size_t r = 1; r < partial.size(); ++r)
+    partial.front().absorb(partial[r]);
+  return std::move(partial.front());
 }
 
-std::map<int, Singles> readBINtoSingles(const std::string &filename,
-                                        double &duration_sec) {
+SinglesAccumulator
+accumulateBINStream(const std::string &filename,
+                    SinglesAccumulator acc = SinglesAccumulator()) {
   std::ifstream file(filename, std::ios::binary);
   if (!file.is_open())
     throw std::runtime_error("Cannot open BIN file: " + filename);
 
-  file.seekg(40, std::ios::beg);
-
-  std::array<Singles, kMaxChannels + 1> channels;
-  for (int ch = 1; ch <= kMaxChannels; ++ch)
-    channels[ch].channel = ch;
+  // ignore() rather than seekg() so non-seekable inputs (pipes) work too.
+  file.ignore(static_cast<std::streamsize>(kBinHeaderBytes));
 
   uint64_t t_raw = 0;
   uint16_t c_raw = 0;
-  Timestamp firstTimestamp = 0;
-  bool first = true;
-  long long minTime = LLONG_MAX;
-  long long maxTime = 0;
-  const long long bucketWidthPs = static_cast<long long>(
-      std::llround(bucketDurationSeconds() * kPicosecondsPerSecond));
 
   while (file.read(reinterpret_cast<char *>(&t_raw), sizeof(t_raw))) {
     if (!file.read(reinterpret_cast<char *>(&c_raw), sizeof(c_raw)))
       break;
+    acc.add(static_cast<long long>(t_raw), static_cast<int>(c_raw) + 1);
+  }
+  return acc;
+}
+
+SinglesAccumulator accumulateBIN(const std::string &filename,
+                                 long long bucketWidthPs) {
+  MappedFile mapped(filename);
+  if (!mapped.isOpen()) {
+    // Pipes and other unmappable inputs go through the stream reader.
+    return accumulateBINStream(filename, SinglesAccumulator(bucketWidthPs));
+  }
+
+  SinglesAccumulator acc(bucketWidthPs);
+  decodeBinRecords(mapped.data(), mapped.size(), acc);
+  return acc;
+}
 
-    Timestamp ts = static_cast<long long>(t_raw);
-    int ch = static_cast<int>(c_raw) + 1;
-    if (ch < 1 || ch > kMaxChannels || ts == 0)
-      continue;
+// Raw timestamp bounds of a range read: decoding starts at the first record
+// at or after `seekPs` and stops at the first one at or after `stopPs`. One
+// bucket of slack on each side absorbs jitter around the seek points.
+struct RangeBounds {
+  Timestamp seekPs = 0;
+  Timestamp stopPs = LLONG_MAX;
+};
+
+RangeBounds rangeBounds(Timestamp origin, long long bucketWidthPs,
+                        long long firstBucket, long long lastBucket) {
+  RangeBounds bounds;
+  const long long headroom = (LLONG_MAX - origin) / bucketWidthPs;
+  const long long seekBucket = std::max(firstBucket - 1, 0LL);
+  bounds.seekPs =
+      seekBucket >= headroom ? LLONG_MAX : origin + seekBucket * bucketWidthPs;
+  if (lastBucket < headroom - 2)
+    bounds.stopPs = origin + (lastBucket + 2) * bucketWidthPs;
+  return bounds;
+}
+
+// Smallest position in [0, count) whose first accepted entry at or after it
+// has a timestamp >= `target` (or `count`). `nextAccepted(pos, ts)` reports
+// that entry and returns false when none is left. Timestamps ascend, so this
+// is a lower bound over the accepted entries.
+template <typename NextFn>
+size_t lowerBoundAccepted(size_t count, Timestamp target, NextFn &&nextAccepted) {
+  size_t lo = 0;
+  size_t hi = count;
+  while (lo < hi) {
+    const size_t mid = lo + (hi - lo) / 2;
+    Timestamp ts = 0;
+    if (!nextAccepted(mid, ts) || ts >= target)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  return lo;
+}
+
+bool decodeBinRecord(const unsigned char *records, size_t idx, Timestamp &ts,
+                     int &ch) {
+  uint64_t t_raw = 0;
+  uint16_t c_raw = 0;
+  const unsigned char *rec = records + idx * kBinRecordBytes;
+  std::memcpy(&t_raw, rec, sizeof(t_raw));
+  std::memcpy(&c_raw, rec + sizeof(t_raw), sizeof(c_raw));
+  ts = static_cast<Timestamp>(t_raw);
+  ch = static_cast<int>(c_raw) + 1;
+  return SinglesAccumulator::accepts(ts, ch);
+}
 
-    if (first) {
-      firstTimestamp = ts;
-      first = false;
+SinglesAccumulator accumulateBINRange(const std::string &filename,
+                                      long long bucketWidthPs,
+                                      long long firstBucket,
+                                      long long lastBucket) {
+  MappedFile mapped(filename);
+  if (!mapped.isOpen()) {
+    // Pipes cannot seek: decode everything, keep only the range.
+    SinglesAccumulator acc(bucketWidthPs);
+    acc.restrictToBuckets(firstBucket, lastBucket);
+    return accumulateBINStream(filename, std::move(acc));
+  }
+
+  const size_t count = mapped.size() > kBinHeaderBytes
+                           ? (mapped.size() - kBinHeaderBytes) / kBinRecordBytes
+                           : 0;
+  const unsigned char *records = mapped.data() + kBinHeaderBytes;
+  const auto nextAccepted = [&](size_t idx, Timestamp &ts) {
+    int ch = 0;
+    for (; idx < count; ++idx)
+      if (decodeBinRecord(records, idx, ts, ch))
+        return true;
+    return false;
+  };
+
+  // Bucket numbering and the span refer to the whole capture: its first
+  // and last accepted records.
+  Timestamp origin = 0;
+  if (!nextAccepted(0, origin))
+    return SinglesAccumulator(bucketWidthPs);
+  SinglesAccumulator acc(bucketWidthPs, origin);
+  acc.restrictToBuckets(firstBucket, lastBucket);
+  acc.extendSpan(origin);
+  for (size_t idx = count; idx-- > 0;) {
+    Timestamp ts = 0;
+    int ch = 0;
+    if (decodeBinRecord(records, idx, ts, ch)) {
+      acc.extendSpan(ts);
+      break;
     }
+  }
 
-    const long long sec = bucketIndex(ts, firstTimestamp, bucketWidthPs);
-    appendTimestamp(channels[ch], sec, ts - firstTimestamp);
+  const RangeBounds bounds =
+      rangeBounds(origin, acc.rangeWidthPs(), firstBucket, lastBucket);
+  for (size_t idx = lowerBoundAccepted(count, bounds.seekPs, nextAccepted);
+       idx < count; ++idx) {
+    Timestamp ts = 0;
+    int ch = 0;
+    if (decodeBinRecord(records, idx, ts, ch) && ts >= bounds.stopPs)
+      break;
+    acc.add(ts, ch);
+  }
+  return acc;
+}
 
-    if (ts < minTime)
-      minTime = ts;
-    if (ts > maxTime)
-      maxTime = ts;
+SinglesAccumulator accumulateCSVRange(const std::string &filename,
+                                      long long bucketWidthPs,
+                                      long long firstBucket,
+                                      long long lastBucket) {
+  MappedFile mapped(filename);
+  if (!mapped.isOpen()) {
+    SinglesAccumulator acc(bucketWidthPs);
+    acc.restrictToBuckets(firstBucket, lastBucket);
+    return accumulateCSV(filename, std::move(acc));
   }
 
-  duration_sec = (maxTime > minTime) ? (maxTime - minTime) * 1e-12 : 0.0;
-  return finalizeSingles(channels);
+  const char *const text = reinterpret_cast<const char *>(mapped.data());
+  const size_t size = mapped.size();
+  const auto lineEnd = [&](size_t pos) {
+    const void *nl = std::memchr(text + pos, '\n', size - pos);
+    return nl ? static_cast<size_t>(static_cast<const char *>(nl) - text) : size;
+  };
+  // Byte positions stand for the first line starting at or after them.
+  const auto nextAcceptedLine = [&](size_t pos, Timestamp &ts, int &ch) {
+    if (pos > 0 && pos < size && text[pos - 1] != '\n')
+      pos = lineEnd(pos) + 1;
+    while (pos < size) {
+      const size_t end = lineEnd(pos);
+      if (parseCsvLine(std::string_view(text + pos, end - pos), ts, ch) &&
+          SinglesAccumulator::accepts(ts, ch))
+        return pos;
+      pos = end + 1;
+    }
+    return size;
+  };
+  const auto nextAccepted = [&](size_t pos, Timestamp &ts) {
+    int ch = 0;
+    return nextAcceptedLine(pos, ts, ch) < size;
+  };
+
+  Timestamp origin = 0;
+  if (!nextAccepted(0, origin))
+    return SinglesAccumulator(bucketWidthPs);
+  SinglesAccumulator acc(bucketWidthPs, origin);
+  acc.restrictToBuckets(firstBucket, lastBucket);
+  acc.extendSpan(origin);
+  for (size_t end = size; end > 0;) {
+    size_t begin = end;
+    while (begin > 0 && text[begin - 1] != '\n')
+      --begin;
+    Timestamp ts = 0;
+    int ch = 0;
+    if (parseCsvLine(std::string_view(text + begin, end - begin), ts, ch) &&
+        SinglesAccumulator::accepts(ts, ch)) {
+      acc.extendSpan(ts);
+      break;
+    }
+    end = begin > 0 ? begin - 1 : 0;
+  }
+
+  const RangeBounds bounds =
+      rangeBounds(origin, acc.rangeWidthPs(), firstBucket, lastBucket);
+  Timestamp seekTs = 0;
+  int seekCh = 0;
+  const size_t start = nextAcceptedLine(
+      lowerBoundAccepted(size, bounds.seekPs, nextAccepted), seekTs, seekCh);
+  forEachLine(text + start, text + size, [&](std::string_view line) {
+    Timestamp ts = 0;
+    int ch = 0;
+    if (!parseCsvLine(line, ts, ch))
+      return true;
+    if (SinglesAccumulator::accepts(ts, ch) && ts >= bounds.stopPs)
+      return false;
+    acc.add(ts, ch);
+    return true;
+  });
+  return acc;
+}
+
+SinglesAccumulator accumulateAutoRange(const std::string &filename,
+                                       double exposure_seconds,
+                                       long long startSec, long long stopSec) {
+  const long long width = bucketWidthForExposure(exposure_seconds);
+  const long long firstBucket = std::max(startSec, 0LL);
+  const long long lastBucket = stopSec < 0 ? LLONG_MAX : stopSec;
+  if (hasEnding(filename, ".bin"))
+    return accumulateBINRange(filename, width, firstBucket, lastBucket);
+  return accumulateCSVRange(filename, width, firstBucket, lastBucket);
+}
+
+SinglesAccumulator accumulateAuto(const std::string &filename,
+                                  double exposure_seconds) {
+  const long long width = bucketWidthForExposure(exposure_seconds);
+  if (hasEnding(filename, ".bin"))
+    return accumulateBIN(filename, width);
+  return accumulateCSVParallel(filename, width);
+}
+
+} // namespace
+
+std::map<int, Singles> readFileAuto(const std::string &filename,
+                                    double &duration_sec,
+                                    double exposure_seconds) {
+  COINCFINDER_TIME_SCOPE("read");
+  return accumulateAuto(filename, exposure_seconds).finish(duration_sec);
+}
+
+std::map<int, FlatSingles> readFileAutoFlat(const std::string &filename,
+                                            double &duration_sec,
+                                            double exposure_seconds) {
+  COINCFINDER_TIME_SCOPE("read");
+  return accumulateAuto(filename, exposure_seconds).finishFlat(duration_sec);
+}
+
+std::map<int, Singles> readFileAuto(const std::string &filename,
+                                    double &duration_sec,
+                                    double exposure_seconds, long long startSec,
+                                    long long stopSec) {
+  COINCFINDER_TIME_SCOPE("read");
+  return accumulateAutoRange(filename, exposure_seconds, startSec, stopSec)
+      .finish(duration_sec);
+}
+
+std::map<int, FlatSingles> readFileAutoFlat(const std::string &filename,
+                                            double &duration_sec,
+                                            double exposure_seconds,
+                                            long long startSec,
+                                            long long stopSec) {
+  COINCFINDER_TIME_SCOPE("read");
+  return accumulateAutoRange(filename, exposure_seconds, startSec, stopSec)
+      .finishFlat(duration_sec);
+}
+
+double captureDurationSeconds(const std::string &filename) {
+  // A range past every bucket keeps no events; mapped inputs then only
+  // decode their first and last records.
+  double duration_sec = 0.0;
+  accumulateAutoRange(filename, -1.0, LLONG_MAX, LLONG_MAX).finishFlat(duration_sec);
+  return duration_sec;
+}
+
+std::map<int, Singles> readCSVtoSingles(const std::string &filename,
+                                        double &duration_sec) {
+  COINCFINDER_TIME_SCOPE("read");
+  return accumulateCSV(filename).finish(duration_sec);
+}
+
+std::map<int, Singles> readCSVtoSinglesParallel(const std::string &filename,
+                                                double &duration_sec) {
+  COINCFINDER_TIME_SCOPE("read");
+  return accumulateCSVParallel(filename, bucketWidthForExposure(-1.0))
+      .finish(duration_sec);
+}
+
+std::map<int, Singles> readBINtoSingles(const std::string &filename,
+                                        double &duration_sec) {
+  COINCFINDER_TIME_SCOPE("read");
+  return accumulateBIN(filename, bucketWidthForExposure(-1.0)).finish(duration_sec);
+}
+
+std::map<int, Singles> readBINStreamToSingles(const std::string &filename,
+                                              double &duration_sec) {
+  COINCFINDER_TIME_SCOPE("read");
+  return accumulateBINStream(filename).finish(duration_sec);
 }
@@ -0,0 +1,109 @@
+#include "RollingDelayHistogram.h"
+
+// Per-second histograms are exactly what CoincFinder writes for one second
+// (bucket plus the first event of the next one on channel 2), so the window
+// total equals the sum of those sweeps.
+
+#include <limits>
+#include <stdexcept>
+
+#include "Coincidences.h"
+
+RollingDelayHistogram::RollingDelayHistogram(
+    std::vector<std::pair<int, int>> pairs, long long coincWindowPs,
+    long long delayStartPs, long long delayEndPs, long long delayStepPs)
+    : pairs_(std::move(pairs)), states_(pairs_.size()),
+      coincWindowPs_(coincWindowPs), delayStartPs_(delayStartPs),
+      delayEndPs_(delayEndPs), delayStepPs_(delayStepPs), bins_(0) {
+    if (delayStepPs <= 0)
+        throw std::invalid_argument("delayStep must be positive in ps");
+    if (coincWindowPs <= 0)
+        throw std::invalid_argument("Coincidence window must be positive");
+    if (delayEndPs < delayStartPs)
+        throw std::invalid_argument("delayEnd must be >= delayStart");
+    bins_ = static_cast<size_t>((delayEndPs - delayStartPs) / delayStepPs + 1);
+    for (PairState &state : states_)
+        state.total.assign(bins_, 0);
+}
+
+void RollingDelayHistogram::subtract(PairState &state,
+                                     const SecondHistogram &entry) {
+    for (size_t b = 0; b < bins_; ++b)
+        state.total[b] -= entry.counts[b];
+}
+
+size_t RollingDelayHistogram::update(const RollingSingles &rolling) {
+    const long long latest = rolling.latestSecond();
+    if (latest == std::numeric_limits<long long>::min())
+        return 0;
+    // The per-second entries key buckets as seconds.
+    if (rolling.bucketWidthPs() != 0 && rolling.bucketWidthPs() != kDefaultBucketWidthPs)
+        throw std::invalid_argument("RollingDelayHistogram needs one-second buckets");
+    const long long oldest = latest - rolling.windowSeconds() + 1;
+
+    size_t recomputed = 0;
+    std::vector<std::pair<float, int>> results;
+    for (size_t p = 0; p < pairs_.size(); ++p) {
+        PairState &state = states_[p];
+        // Retire seconds that fell out of the window.
+        for (auto it = state.seconds.begin();
+             it != state.seconds.end() && it->first < oldest;
+             it = state.seconds.erase(it))
+            subtract(state, it->second);
+
+        for (long long sec = oldest; sec <= latest; ++sec) {
+            const auto events1 = rolling.eventsForSecond(pairs_[p].first, sec);
+            const auto current2 = rolling.eventsForSecond(pairs_[p].second, sec);
+            const auto next2 = rolling.eventsForSecond(pairs_[p].second, sec + 1);
+            const Fingerprint source{events1.size(), current2.size(),
+                                     !next2.empty(),
+                                     next2.empty() ? 0 : next2.front()};
+
+            auto it = state.seconds.find(sec);
+            if (it != state.seconds.end()) {
+                if (it->second.source == source)
+                    continue;
+                subtract(state, it->second);
+                state.seconds.erase(it);
+            }
+            const SegmentedSpan channel2 = withNextFirstEvent(current2, next2);
+            if (events1.empty() || channel2.empty())
+                continue;
+
+            computeCoincidencesForRange(SegmentedSpan(events1), channel2,
+                                        coincWindowPs_, delayStartPs_,
+                                        delayEndPs_, delayStepPs_, results);
+            SecondHistogram entry;
+            entry.source = source;
+            entry.counts.resize(bins_);
+            for (size_t b = 0; b < bins_; ++b) {
+                entry.counts[b] = results[b].second;
+                state.total[b] += results[b].second;
+            }
+            state.seconds.emplace(sec, std::move(entry));
+            ++recomputed;
+        }
+    }
+    return recomputed;
+}
+
+const std::vector<long long> &
+RollingDelayHistogram::windowHistogram(size_t pairIndex) const {
+    return states_.at(pairIndex).total;
+}
+
+long long RollingDelayHistogram::bestDelayPs(size_t pairIndex) const {
+    const std::vector<long long> &total = windowHistogram(pairIndex);
+    size_t best = 0;
+    for (size_t b = 1; b < total.size(); ++b)
+        if (total[b] > total[best])
+            best = b;
+    return delayForBin(best);
+}
+
+const std::vector<int32_t> *
+RollingDelayHistogram::secondHistogram(size_t pairIndex, long long second) const {
+    const auto &seconds = states_.at(pairIndex).seconds;
+    const auto it = seconds.find(second);
+    return it != seconds.end() ? &it->second.counts : nullptr;
+}
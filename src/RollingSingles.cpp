@@ -2,75 +2,312 @@
 
 #include <algorithm>
 #include <limits>
+#include <stdexcept>
+
+#include "ReadCSV.h"
+
+namespace {
+
+// Same acceptance rule as the file readers.
+constexpr int kMaxChannels = 8;
+
+// Appends `src` to `bucket`, merging when a later chunk overlaps the tail
+// (e.g. a live feed whose channels arrive slightly out of step).
+void appendSorted(std::vector<Timestamp> &bucket,
+                  std::span<const Timestamp> src) {
+    if (src.empty())
+        return;
+    const bool ordered = bucket.empty() || bucket.back() <= src.front();
+    const auto mid = static_cast<std::ptrdiff_t>(bucket.size());
+    bucket.insert(bucket.end(), src.begin(), src.end());
+    if (!ordered)
+        std::inplace_merge(bucket.begin(), bucket.begin() + mid, bucket.end());
+}
+
+constexpr size_t kNoChunkView = std::numeric_limits<size_t>::max();
+
+size_t slotIndex(long long second, size_t slots) {
+    const auto n = static_cast<long long>(slots);
+    return static_cast<size_t>(((second % n) + n) % n);
+}
+
+} // namespace
 
 RollingSingles::RollingSingles(long long windowSeconds)
-    : windowSeconds_(windowSeconds),
+    : windowSeconds_(std::max<long long>(1, windowSeconds)),
       latestSecond_(std::numeric_limits<long long>::min()) {}
 
-void RollingSingles::appendChunk(const std::map<int, Singles> &chunk) {
-    for (const auto &entry : chunk) {
-        int channel = entry.first;
-        const Singles &incoming = entry.second;
-        if (incoming.eventsPerSecond.empty())
-            continue;
+RollingSingles::ChannelRing &RollingSingles::ring(int channel) {
+    ChannelRing &r = rings_[channel];
+    if (r.slots.empty()) {
+        r.channel = channel;
+        r.slots.resize(static_cast<size_t>(windowSeconds_));
+    }
+    return r;
+}
 
-        Singles &target = channels_[channel];
-        if (target.eventsPerSecond.empty())
-            target.channel = incoming.channel;
+bool RollingSingles::inWindow(long long second) const {
+    return latestSecond_ != std::numeric_limits<long long>::min() &&
+           second <= latestSecond_ && second > latestSecond_ - windowSeconds_;
+}
 
-        auto &chunkSnapshot = latestChunks_[channel];
-        chunkSnapshot = incoming.eventsPerSecond;
+const RollingSingles::Bucket *
+RollingSingles::findBucket(const ChannelRing &r, long long second) const {
+    if (r.slots.empty() || !inWindow(second))
+        return nullptr;
+    const Bucket &b = r.slots[slotIndex(second, r.slots.size())];
+    return (b.used && b.second == second) ? &b : nullptr;
+}
 
-        for (size_t idx = 0; idx < incoming.eventsPerSecond.size(); ++idx) {
-            long long second = incoming.baseSecond + static_cast<long long>(idx);
-            latestSecond_ = std::max(latestSecond_, second);
-            auto &bucket = ensureSecond(target, second);
-            const auto &src = incoming.eventsPerSecond[idx];
-            bucket.insert(bucket.end(), src.begin(), src.end());
-        }
+std::vector<Timestamp> &RollingSingles::bucketFor(ChannelRing &r,
+                                                  long long second) {
+    Bucket &b = r.slots[slotIndex(second, r.slots.size())];
+    if (!b.used || b.second != second) {
+        // Retire whatever second held this slot; clear() keeps the capacity.
+        b.events.clear();
+        b.second = second;
+        b.used = true;
     }
+    return b.events;
+}
 
-    prune();
+void RollingSingles::advanceLatest(long long second) {
+    latestSecond_ = std::max(latestSecond_, second);
 }
 
-const Singles &RollingSingles::channelSingles(int channel) const {
-    static const Singles kEmpty;
-    auto it = channels_.find(channel);
-    return it != channels_.end() ? it->second : kEmpty;
+void RollingSingles::invalidateViews() {
+    materialised_.clear();
+    allMaterialised_ = false;
 }
 
-const std::vector<std::vector<Timestamp>> &RollingSingles::latestChunk(int channel) const {
-    static const std::vector<std::vector<Timestamp>> kEmpty;
-    auto it = latestChunks_.find(channel);
-    return it != latestChunks_.end() ? it->second : kEmpty;
+void RollingSingles::appendBuckets(
+    int channel, long long baseSecond,
+    std::span<const std::span<const Timestamp>> buckets) {
+    ChannelRing &r = ring(channel);
+    r.chunkFirstSecond = baseSecond;
+    r.chunkOffsets.assign(buckets.size(), kNoChunkView);
+    for (size_t idx = 0; idx < buckets.size(); ++idx) {
+        const long long second = baseSecond + static_cast<long long>(idx);
+        // Seconds that already fell out of the window are dropped outright.
+        if (!inWindow(second))
+            continue;
+        const auto src = buckets[idx];
+        auto &bucket = bucketFor(r, second);
+        size_t offset = bucket.size();
+        if (!src.empty() && !bucket.empty() && src.front() < bucket.back())
+            offset = static_cast<size_t>(
+                std::upper_bound(bucket.begin(), bucket.end(), src.front()) -
+                bucket.begin());
+        appendSorted(bucket, src);
+        r.chunkOffsets[idx] = offset;
+        if (!src.empty()) {
+            r.minSecond = std::min(r.minSecond, second);
+            r.maxSecond = std::max(r.maxSecond, second);
+        }
+    }
 }
 
-void RollingSingles::prune() {
-    if (latestSecond_ == std::numeric_limits<long long>::min())
-        return;
-    const long long minSecond = latestSecond_ - windowSeconds_ + 1;
-    for (auto &entry : channels_) {
-        Singles &s = entry.second;
-        if (s.eventsPerSecond.empty())
+void RollingSingles::appendChunk(const std::map<int, Singles> &chunk) {
+    // Move the window first so the whole chunk is judged against its end,
+    // as if every bucket had been appended and then pruned.
+    for (const auto &[channel, incoming] : chunk)
+        if (!incoming.eventsPerSecond.empty())
+            adoptBucketWidth(incoming.bucketWidthPs);
+    for (const auto &[channel, incoming] : chunk)
+        if (!incoming.eventsPerSecond.empty())
+            advanceLatest(incoming.baseSecond +
+                          static_cast<long long>(incoming.eventsPerSecond.size()) - 1);
+
+    std::vector<std::span<const Timestamp>> buckets;
+    for (const auto &[channel, incoming] : chunk) {
+        if (incoming.eventsPerSecond.empty())
             continue;
-        long long maxSecond = s.baseSecond + static_cast<long long>(s.eventsPerSecond.size()) - 1;
-        if (maxSecond < minSecond)
+        buckets.assign(incoming.eventsPerSecond.begin(),
+                       incoming.eventsPerSecond.end());
+        appendBuckets(channel, incoming.baseSecond, buckets);
+    }
+    invalidateViews();
+}
+
+void RollingSingles::appendChunk(const std::map<int, FlatSingles> &chunk) {
+    for (const auto &[channel, incoming] : chunk)
+        if (incoming.bucketCount() != 0)
+            adoptBucketWidth(incoming.bucketWidthPs);
+    for (const auto &[channel, incoming] : chunk)
+        if (incoming.bucketCount() != 0)
+            advanceLatest(incoming.baseSecond +
+                          static_cast<long long>(incoming.bucketCount()) - 1);
+
+    std::vector<std::span<const Timestamp>> buckets;
+    for (const auto &[channel, incoming] : chunk) {
+        if (incoming.bucketCount() == 0)
             continue;
-        if (s.baseSecond >= minSecond)
+        buckets.resize(incoming.bucketCount());
+        for (size_t idx = 0; idx < buckets.size(); ++idx)
+            buckets[idx] = ::eventsForBucket(
+                incoming, incoming.baseSecond + static_cast<long long>(idx));
+        appendBuckets(channel, incoming.baseSecond, buckets);
+    }
+    invalidateViews();
+}
+
+void RollingSingles::adoptBucketWidth(long long bucketWidthPs) {
+    if (bucketWidthPs_ == 0)
+        bucketWidthPs_ = bucketWidthPs;
+    else if (bucketWidthPs != bucketWidthPs_)
+        throw std::invalid_argument(
+            "RollingSingles chunk has a different bucket width");
+}
+
+void RollingSingles::setOrigin(Timestamp origin) {
+    if (hasOrigin_)
+        throw std::logic_error("RollingSingles origin is already fixed");
+    origin_ = origin;
+    hasOrigin_ = true;
+}
+
+size_t RollingSingles::ingest(std::span<const RawRecord> records) {
+    if (bucketWidthPs_ == 0)
+        bucketWidthPs_ = bucketWidthForExposure(-1.0);
+
+    // Bucket the batch per channel first, then merge it like any other
+    // chunk so the window, pruning and latestChunk snapshots stay uniform.
+    std::map<int, Singles> batch;
+    size_t accepted = 0;
+    const long long oldestKept =
+        latestSecond_ == std::numeric_limits<long long>::min()
+            ? std::numeric_limits<long long>::min()
+            : latestSecond_ - windowSeconds_ + 1;
+    for (const RawRecord &rec : records) {
+        const int channel = static_cast<int>(rec.channel) + 1;
+        const auto ts = static_cast<Timestamp>(rec.timestamp);
+        if (channel > kMaxChannels || ts == 0)
             continue;
-        long long dropCount = minSecond - s.baseSecond;
-        if (dropCount <= 0)
+        if (!hasOrigin_) {
+            origin_ = ts;
+            hasOrigin_ = true;
+        }
+        const Timestamp rel = ts - origin_;
+        if (rel < 0)
             continue;
-        if (static_cast<size_t>(dropCount) >= s.eventsPerSecond.size()) {
-            s.eventsPerSecond.clear();
+        const long long second = rel / bucketWidthPs_;
+        if (second < oldestKept)
             continue;
+
+        Singles &dst = batch[channel];
+        dst.channel = channel;
+        dst.bucketWidthPs = bucketWidthPs_;
+        ensureSecond(dst, second).push_back(rel);
+        ++accepted;
+    }
+    // Late records were appended in arrival order; sort each bucket that
+    // needs it once, as the readers do, instead of inserting per event.
+    for (auto &[channel, singles] : batch)
+        for (auto &bucket : singles.eventsPerSecond) {
+            const auto descent = std::is_sorted_until(bucket.begin(), bucket.end());
+            if (descent != bucket.end())
+                restoreOrder(bucket, static_cast<size_t>(descent - bucket.begin()));
         }
-        s.eventsPerSecond.erase(s.eventsPerSecond.begin(), s.eventsPerSecond.begin() + dropCount);
-        s.baseSecond = minSecond;
+    if (!batch.empty())
+        appendChunk(batch);
+    return accepted;
+}
+
+std::span<const Timestamp> RollingSingles::eventsForSecond(int channel,
+                                                           long long second) const {
+    const auto it = rings_.find(channel);
+    if (it == rings_.end())
+        return {};
+    const Bucket *b = findBucket(it->second, second);
+    return b ? std::span<const Timestamp>(b->events) : std::span<const Timestamp>();
+}
+
+void RollingSingles::materialise(const ChannelRing &r, Singles &out) const {
+    out.channel = r.channel;
+    out.bucketWidthPs = bucketWidthPs_ != 0 ? bucketWidthPs_ : kDefaultBucketWidthPs;
+    out.baseSecond = 0;
+    out.eventsPerSecond.clear();
+    if (r.minSecond > r.maxSecond || !inWindow(latestSecond_))
+        return;
+    const long long first = std::max(r.minSecond, latestSecond_ - windowSeconds_ + 1);
+    const long long last = std::min(r.maxSecond, latestSecond_);
+    if (first > last)
+        return;
+    out.baseSecond = first;
+    out.eventsPerSecond.resize(static_cast<size_t>(last - first + 1));
+    for (long long sec = first; sec <= last; ++sec)
+        if (const Bucket *b = findBucket(r, sec))
+            out.eventsPerSecond[static_cast<size_t>(sec - first)] = b->events;
+}
+
+FlatSingles RollingSingles::flatChannel(int channel) const {
+    return flattenSingles(channelSingles(channel));
+}
+
+const Singles &RollingSingles::channelSingles(int channel) const {
+    static const Singles kEmpty;
+    const auto it = rings_.find(channel);
+    if (it == rings_.end())
+        return kEmpty;
+    auto cached = materialised_.find(channel);
+    if (cached == materialised_.end()) {
+        cached = materialised_.emplace(channel, Singles{}).first;
+        materialise(it->second, cached->second);
+    }
+    return cached->second;
+}
+
+const std::map<int, Singles> &RollingSingles::allChannels() const {
+    if (!allMaterialised_) {
+        for (const auto &entry : rings_)
+            channelSingles(entry.first);
+        allMaterialised_ = true;
     }
+    return materialised_;
+}
+
+std::vector<std::span<const Timestamp>>
+RollingSingles::latestChunk(int channel) const {
+    std::vector<std::span<const Timestamp>> views;
+    const auto it = rings_.find(channel);
+    if (it == rings_.end())
+        return views;
+    const ChannelRing &r = it->second;
+    views.resize(r.chunkOffsets.size());
+    for (size_t idx = 0; idx < views.size(); ++idx) {
+        const Bucket *b =
+            findBucket(r, r.chunkFirstSecond + static_cast<long long>(idx));
+        const size_t offset = r.chunkOffsets[idx];
+        if (b && offset != kNoChunkView && offset <= b->events.size())
+            views[idx] = std::span<const Timestamp>(b->events).subspan(offset);
+    }
+    return views;
+}
+
+void RollingSingles::prune() {
+    for (auto &entry : rings_)
+        for (Bucket &b : entry.second.slots)
+            if (b.used && !inWindow(b.second)) {
+                b.events.clear();
+                b.used = false;
+            }
+    invalidateViews();
 }
 
 void RollingSingles::setWindow(long long seconds) {
-    windowSeconds_ = std::max<long long>(1, seconds);
-    prune();
+    const long long window = std::max<long long>(1, seconds);
+    if (window == windowSeconds_)
+        return;
+    windowSeconds_ = window;
+    // Re-seat live buckets in rings of the new size; anything that no longer
+    // fits the window is dropped.
+    for (auto &entry : rings_) {
+        ChannelRing &r = entry.second;
+        std::vector<Bucket> slots(static_cast<size_t>(window));
+        for (Bucket &b : r.slots)
+            if (b.used && inWindow(b.second))
+                slots[slotIndex(b.second, slots.size())] = std::move(b);
+        r.slots = std::move(slots);
+    }
+    invalidateViews();
 }
@@ -0,0 +1,101 @@
+#pragma once
+#include <cstddef>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+// Private to the kernel translation units. Everything here has internal
+// linkage on purpose: the AVX2/AVX-512 files are compiled with wider ISA flags,
+// and sharing an inline symbol with the baseline build would let the linker
+// pick an AVX copy for code that must run everywhere. For the same reason the
+// kernels use raw pointers and no standard-library templates.
+
+namespace {
+
+inline unsigned countTrailingZeros(unsigned mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long idx = 0;
+    _BitScanForward(&idx, mask);
+    return static_cast<unsigned>(idx);
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+// First index in [k, n) with p[idx] >= threshold (p ascending), or n.
+// `Probe::lessMask(ptr, threshold)` returns one bit per lane for lanes below
+// the threshold; `Probe::kLanes` is the vector width in elements.
+template <typename Probe>
+inline size_t seekAtLeast(const long long *p, size_t k, size_t n,
+                          long long threshold) {
+    // Balanced rates: the very next element usually qualifies.
+    if (k >= n || p[k] >= threshold)
+        return k;
+    ++k;
+
+    constexpr size_t kLanes = Probe::kLanes;
+    constexpr unsigned kFull = (1u << kLanes) - 1u;
+    constexpr int kLinearBlocks = 2;
+    for (int block = 0; block < kLinearBlocks && k + kLanes <= n; ++block) {
+        const unsigned below = Probe::lessMask(p + k, threshold);
+        if (below != kFull)
+            return k + countTrailingZeros(~below & kFull);
+        k += kLanes;
+    }
+
+    // Long singles-only run: gallop to bracket the answer, then bisect.
+    size_t lo = k;
+    size_t hi = k;
+    size_t step = kLanes;
+    while (hi < n && p[hi] < threshold) {
+        lo = hi + 1;
+        hi += step;
+        step <<= 1;
+    }
+    if (hi > n)
+        hi = n;
+    while (hi - lo > kLanes) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (p[mid] < threshold)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    while (lo < hi && p[lo] < threshold)
+        ++lo;
+    return lo;
+}
+
+// Greedy merge identical to the scalar reference: whenever ch1 lags it is
+// advanced to the first event that can still pair with ch2[j], and vice
+// versa, so the sequence of matches is unchanged.
+template <typename Probe>
+inline int seekMergeCount(const long long *ch1, size_t size1,
+                          const long long *ch2, size_t size2,
+                          long long coincWindowPs, long long delayPs,
+                          size_t &iRef, size_t &jRef) {
+    const long long lowerBound = -coincWindowPs;
+    const long long upperBound = coincWindowPs;
+    size_t i = iRef;
+    size_t j = jRef;
+    int count = 0;
+    while (i < size1 && j < size2) {
+        const long long shifted = ch1[i] - delayPs;
+        const long long diff = shifted - ch2[j];
+        if (diff < lowerBound) {
+            i = seekAtLeast<Probe>(ch1, i + 1, size1,
+                                  ch2[j] + delayPs + lowerBound);
+        } else if (diff > upperBound) {
+            j = seekAtLeast<Probe>(ch2, j + 1, size2, shifted - upperBound);
+        } else {
+            ++count;
+            ++i;
+            ++j;
+        }
+    }
+    iRef = i;
+    jRef = j;
+    return count;
+}
+
+} // namespace
@@ -0,0 +1,385 @@
+#include "SinglesCache.h"
+
+// Writer/reader for the pre-bucketed capture cache. The arrays are stored in
+// host layout on little-endian machines, so the reader hands out spans into
+// the mapping and only the pages of the requested seconds are faulted in.
+
+#include <algorithm>
+#include <bit>
+#include <climits>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "Instrumentation.h"
+#include "ReadCSV.h"
+
+namespace {
+
+constexpr uint64_t kDataAlignment = 64;
+constexpr bool kNativeLittleEndian = std::endian::native == std::endian::little;
+
+static_assert(sizeof(Timestamp) == sizeof(int64_t));
+
+template <typename T>
+void putLittleEndian(std::vector<char> &out, size_t offset, T value) {
+    using U = std::make_unsigned_t<T>;
+    U bits = static_cast<U>(value);
+    for (size_t b = 0; b < sizeof(T); ++b) {
+        out[offset + b] = static_cast<char>(bits & 0xFFu);
+        bits = static_cast<U>(bits >> 8);
+    }
+}
+
+template <typename T>
+T getLittleEndian(const unsigned char *in) {
+    using U = std::make_unsigned_t<T>;
+    U bits = 0;
+    for (size_t b = sizeof(T); b-- > 0;)
+        bits = static_cast<U>((bits << 8) | in[b]);
+    return static_cast<T>(bits);
+}
+
+uint64_t alignUp(uint64_t pos) {
+    return (pos + kDataAlignment - 1) / kDataAlignment * kDataAlignment;
+}
+
+void writePadding(std::ofstream &out, uint64_t &pos, uint64_t target) {
+    static const char kZeros[kDataAlignment] = {};
+    out.write(kZeros, static_cast<std::streamsize>(target - pos));
+    pos = target;
+}
+
+// Temporary for one writer: pid plus a random suffix, so concurrent rebuilds
+// of the same cache never truncate or interleave into a shared file and
+// the last rename simply wins.
+std::string uniqueTempName(const std::string &filename) {
+#ifdef _WIN32
+    const long long pid = _getpid();
+#else
+    const long long pid = getpid();
+#endif
+    std::random_device random;
+    const uint64_t suffix = (uint64_t{random()} << 32) | random();
+    std::ostringstream name;
+    name << filename << ".tmp." << pid << '.' << std::hex << suffix;
+    return name.str();
+}
+
+// Copies buckets `lo..hi` of one channel into owning per-second vectors.
+template <typename Offset>
+Singles sliceSingles(int channel, long long baseSecond, long long bucketWidthPs,
+                     const Offset *offsets, const Timestamp *timestamps, size_t lo,
+                     size_t hi) {
+    Singles singles;
+    singles.channel = channel;
+    singles.bucketWidthPs = bucketWidthPs;
+    singles.baseSecond = baseSecond + static_cast<long long>(lo);
+    singles.eventsPerSecond.resize(hi - lo + 1);
+    for (size_t idx = lo; idx <= hi; ++idx)
+        singles.eventsPerSecond[idx - lo].assign(timestamps + offsets[idx],
+                                                 timestamps + offsets[idx + 1]);
+    return singles;
+}
+
+// Bucket indices of `firstSecond..lastSecond` inside a channel, false when
+// the range misses it.
+bool clampBuckets(long long baseSecond, size_t bucketCount, long long firstSecond,
+                  long long lastSecond, size_t &lo, size_t &hi) {
+    if (bucketCount == 0 || lastSecond < baseSecond)
+        return false;
+    const long long buckets = static_cast<long long>(bucketCount);
+    const long long first = std::max(firstSecond - baseSecond, 0LL);
+    // Compare before subtracting so an open-ended LLONG_MAX cannot overflow.
+    const long long last =
+        lastSecond - baseSecond >= buckets ? buckets - 1 : lastSecond - baseSecond;
+    if (first > last)
+        return false;
+    lo = static_cast<size_t>(first);
+    hi = static_cast<size_t>(last);
+    return true;
+}
+
+} // namespace
+
+SinglesCacheSource SinglesCacheSource::of(const std::string &filename) {
+    std::error_code ec;
+    const auto size = std::filesystem::file_size(filename, ec);
+    if (ec)
+        throw std::runtime_error("Cannot stat capture: " + filename);
+    const auto mtime = std::filesystem::last_write_time(filename, ec);
+    if (ec)
+        throw std::runtime_error("Cannot stat capture: " + filename);
+    SinglesCacheSource source;
+    source.size = static_cast<uint64_t>(size);
+    source.mtime = static_cast<int64_t>(mtime.time_since_epoch().count());
+    return source;
+}
+
+void writeSinglesCache(const std::string &filename,
+                       const std::map<int, FlatSingles> &channels,
+                       double durationSec, long long bucketWidthPs,
+                       const SinglesCacheSource &source) {
+    if constexpr (!kNativeLittleEndian)
+        throw std::runtime_error("Singles cache requires a little-endian host");
+
+    const uint64_t tableEnd =
+        kSinglesCacheHeaderBytes + kSinglesCacheChannelBytes * channels.size();
+    std::vector<char> head(alignUp(tableEnd), 0);
+    std::memcpy(head.data(), kSinglesCacheMagic, sizeof(kSinglesCacheMagic));
+    putLittleEndian<uint32_t>(head, 8, kSinglesCacheVersion);
+    putLittleEndian<uint32_t>(head, 12, static_cast<uint32_t>(channels.size()));
+    putLittleEndian<int64_t>(head, 16, bucketWidthPs);
+    putLittleEndian<uint64_t>(head, 24, std::bit_cast<uint64_t>(durationSec));
+    putLittleEndian<uint64_t>(head, 32, source.size);
+    putLittleEndian<int64_t>(head, 40, source.mtime);
+
+    uint64_t pos = head.size();
+    size_t entry = kSinglesCacheHeaderBytes;
+    for (const auto &[ch, flat] : channels) {
+        const uint64_t offsetsPos = pos;
+        pos = alignUp(pos + 8 * flat.bucketOffsets.size());
+        const uint64_t timestampsPos = pos;
+        pos = alignUp(pos + 8 * flat.timestamps.size());
+        putLittleEndian<int32_t>(head, entry, ch);
+        putLittleEndian<int64_t>(head, entry + 8, flat.baseSecond);
+        putLittleEndian<uint64_t>(head, entry + 16, flat.bucketCount());
+        putLittleEndian<uint64_t>(head, entry + 24, flat.timestamps.size());
+        putLittleEndian<uint64_t>(head, entry + 32, offsetsPos);
+        putLittleEndian<uint64_t>(head, entry + 40, timestampsPos);
+        entry += kSinglesCacheChannelBytes;
+    }
+
+    const std::string tmpName = uniqueTempName(filename);
+    {
+        std::ofstream out(tmpName, std::ios::binary | std::ios::trunc);
+        if (!out)
+            throw std::runtime_error("Cannot create singles cache: " + tmpName);
+        out.write(head.data(), static_cast<std::streamsize>(head.size()));
+        pos = head.size();
+        std::vector<uint64_t> offsets;
+        for (const auto &[ch, flat] : channels) {
+            offsets.assign(flat.bucketOffsets.begin(), flat.bucketOffsets.end());
+            out.write(reinterpret_cast<const char *>(offsets.data()),
+                      static_cast<std::streamsize>(8 * offsets.size()));
+            pos += 8 * offsets.size();
+            writePadding(out, pos, alignUp(pos));
+            out.write(reinterpret_cast<const char *>(flat.timestamps.data()),
+                      static_cast<std::streamsize>(8 * flat.timestamps.size()));
+            pos += 8 * flat.timestamps.size();
+            writePadding(out, pos, alignUp(pos));
+        }
+        out.flush();
+        if (!out) {
+            out.close();
+            std::error_code ec;
+            std::filesystem::remove(tmpName, ec);
+            throw std::runtime_error("Failed writing singles cache: " + tmpName);
+        }
+        COINCFINDER_COUNT(BytesWritten, pos);
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmpName, filename, ec);
+    if (ec) {
+        std::filesystem::remove(tmpName, ec);
+        throw std::runtime_error("Cannot move singles cache into place: " +
+                                 filename);
+    }
+}
+
+SinglesCache::SinglesCache(const std::string &filename) : file_(filename) {
+    if constexpr (!kNativeLittleEndian)
+        throw std::runtime_error("Singles cache requires a little-endian host");
+    if (!file_.isOpen())
+        throw std::runtime_error("Cannot open singles cache: " + filename);
+
+    const unsigned char *data = file_.data();
+    const uint64_t size = file_.size();
+    if (size < kSinglesCacheHeaderBytes ||
+        std::memcmp(data, kSinglesCacheMagic, sizeof(kSinglesCacheMagic)) != 0)
+        throw std::runtime_error("Not a singles cache file: " + filename);
+    if (getLittleEndian<uint32_t>(data + 8) != kSinglesCacheVersion)
+        throw std::runtime_error("Unsupported singles cache version: " + filename);
+
+    const uint32_t channelCount = getLittleEndian<uint32_t>(data + 12);
+    bucketWidthPs_ = getLittleEndian<int64_t>(data + 16);
+    durationSec_ = std::bit_cast<double>(getLittleEndian<uint64_t>(data + 24));
+    source_.size = getLittleEndian<uint64_t>(data + 32);
+    source_.mtime = getLittleEndian<int64_t>(data + 40);
+    if (kSinglesCacheHeaderBytes +
+            uint64_t{kSinglesCacheChannelBytes} * channelCount > size)
+        throw std::runtime_error("Truncated singles cache: " + filename);
+
+    // The table and the bucket offsets (8 bytes a bucket) are validated here;
+    // the timestamps stay untouched until a range asks for them.
+    for (uint32_t c = 0; c < channelCount; ++c) {
+        const unsigned char *entry =
+            data + kSinglesCacheHeaderBytes + kSinglesCacheChannelBytes * c;
+        const int ch = getLittleEndian<int32_t>(entry);
+        Channel channel;
+        channel.baseSecond = getLittleEndian<int64_t>(entry + 8);
+        const uint64_t buckets = getLittleEndian<uint64_t>(entry + 16);
+        const uint64_t events = getLittleEndian<uint64_t>(entry + 24);
+        const uint64_t offsetsPos = getLittleEndian<uint64_t>(entry + 32);
+        const uint64_t timestampsPos = getLittleEndian<uint64_t>(entry + 40);
+        const uint64_t offsetCount = buckets == 0 ? 0 : buckets + 1;
+        if (offsetsPos % 8 != 0 || timestampsPos % 8 != 0 ||
+            offsetsPos > size || (size - offsetsPos) / 8 < offsetCount ||
+            timestampsPos > size || (size - timestampsPos) / 8 < events)
+            throw std::runtime_error("Corrupt singles cache: " + filename);
+        channel.bucketCount = static_cast<size_t>(buckets);
+        channel.offsets = reinterpret_cast<const uint64_t *>(data + offsetsPos);
+        channel.timestamps = reinterpret_cast<const Timestamp *>(data + timestampsPos);
+        if (buckets > 0 && channel.offsets[buckets] != events)
+            throw std::runtime_error("Corrupt singles cache: " + filename);
+        // Non-decreasing offsets ending at `events` keep every slice inside
+        // the timestamps, whoever wrote the file.
+        for (uint64_t b = 0; b < buckets; ++b)
+            if (channel.offsets[b] > channel.offsets[b + 1])
+                throw std::runtime_error("Corrupt singles cache: " + filename);
+        channels_.emplace(ch, channel);
+    }
+}
+
+std::vector<int> SinglesCache::channels() const {
+    std::vector<int> result;
+    result.reserve(channels_.size());
+    for (const auto &[ch, channel] : channels_)
+        result.push_back(ch);
+    return result;
+}
+
+const SinglesCache::Channel *SinglesCache::find(int channel) const {
+    const auto it = channels_.find(channel);
+    return it == channels_.end() ? nullptr : &it->second;
+}
+
+std::span<const Timestamp> SinglesCache::eventsForSeconds(int channel,
+                                                          long long firstSecond,
+                                                          long long lastSecond) const {
+    const Channel *c = find(channel);
+    size_t lo = 0;
+    size_t hi = 0;
+    if (!c || !clampBuckets(c->baseSecond, c->bucketCount, firstSecond,
+                            lastSecond, lo, hi))
+        return {};
+    const uint64_t begin = c->offsets[lo];
+    const uint64_t end = c->offsets[hi + 1];
+    return std::span<const Timestamp>(c->timestamps + begin,
+                                      static_cast<size_t>(end - begin));
+}
+
+std::map<int, FlatSingles> SinglesCache::readFlat(long long firstSecond,
+                                                  long long lastSecond) const {
+    std::map<int, FlatSingles> result;
+    for (const auto &[ch, c] : channels_) {
+        size_t lo = 0;
+        size_t hi = 0;
+        if (!clampBuckets(c.baseSecond, c.bucketCount, firstSecond, lastSecond,
+                          lo, hi))
+            continue;
+        FlatSingles flat;
+        flat.channel = ch;
+        flat.bucketWidthPs = bucketWidthPs_;
+        flat.baseSecond = c.baseSecond + static_cast<long long>(lo);
+        const uint64_t begin = c.offsets[lo];
+        flat.timestamps.assign(c.timestamps + begin, c.timestamps + c.offsets[hi + 1]);
+        flat.bucketOffsets.reserve(hi - lo + 2);
+        for (size_t idx = lo; idx <= hi + 1; ++idx)
+            flat.bucketOffsets.push_back(static_cast<size_t>(c.offsets[idx] - begin));
+        result.emplace(ch, std::move(flat));
+    }
+    return result;
+}
+
+std::map<int, Singles> SinglesCache::read(long long firstSecond,
+                                          long long lastSecond) const {
+    std::map<int, Singles> result;
+    for (const auto &[ch, c] : channels_) {
+        size_t lo = 0;
+        size_t hi = 0;
+        if (clampBuckets(c.baseSecond, c.bucketCount, firstSecond, lastSecond,
+                         lo, hi))
+            result.emplace(ch, sliceSingles(ch, c.baseSecond, bucketWidthPs_,
+                                            c.offsets, c.timestamps, lo, hi));
+    }
+    return result;
+}
+
+std::string singlesCachePath(const std::string &filename) {
+    return filename + ".cfcache";
+}
+
+std::map<int, Singles> readFileCached(const std::string &filename,
+                                      double &duration_sec,
+                                      long long firstSecond,
+                                      long long lastSecond,
+                                      double exposure_seconds) {
+    COINCFINDER_TIME_SCOPE("read_cache");
+    const long long bucketWidthPs = bucketWidthForExposure(exposure_seconds);
+    if (bucketWidthPs == 0)
+        throw std::invalid_argument(
+            "readFileCached needs a fixed bucket width, not kAutoExposure");
+    if (lastSecond < 0)
+        lastSecond = LLONG_MAX;
+    const std::string cachePath = singlesCachePath(filename);
+
+    // Pipes and other inputs without a stable size/mtime are never cached.
+    SinglesCacheSource source;
+    bool cacheable = kNativeLittleEndian;
+    try {
+        source = SinglesCacheSource::of(filename);
+    } catch (const std::runtime_error &) {
+        cacheable = false;
+    }
+
+    if (cacheable) {
+        try {
+            const SinglesCache cache(cachePath);
+            if (cache.source() == source && cache.bucketWidthPs() == bucketWidthPs) {
+                duration_sec = cache.durationSeconds();
+                auto singles = cache.read(firstSecond, lastSecond);
+                size_t events = 0;
+                for (const auto &[ch, s] : singles)
+                    for (const auto &bucket : s.eventsPerSecond)
+                        events += bucket.size();
+                COINCFINDER_COUNT(EventsIngested, events);
+                return singles;
+            }
+        } catch (const std::runtime_error &) {
+            // Missing or unreadable cache: rebuild it below.
+        }
+    }
+
+    const auto flat = readFileAutoFlat(filename, duration_sec, exposure_seconds);
+    if (cacheable) {
+        try {
+            writeSinglesCache(cachePath, flat, duration_sec, bucketWidthPs, source);
+        } catch (const std::exception &ex) {
+            std::cerr << "Warning: " << ex.what() << "\n";
+        }
+    }
+
+    std::map<int, Singles> result;
+    for (const auto &[ch, channel] : flat) {
+        size_t lo = 0;
+        size_t hi = 0;
+        if (clampBuckets(channel.baseSecond, channel.bucketCount(), firstSecond,
+                         lastSecond, lo, hi))
+            result.emplace(ch, sliceSingles(ch, channel.baseSecond, bucketWidthPs,
+                                            channel.bucketOffsets.data(),
+                                            channel.timestamps.data(), lo, hi));
+    }
+    return result;
+}
@@ -0,0 +1,198 @@
+#include "SweepTensorFile.h"
+
+// Writer/reader for the consolidated sweep tensor. The file is sized once up
+// front and every sweep is written at its computed offset, so the layout is
+// final from the start and partially written runs are still readable.
+
+#include <bit>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <type_traits>
+
+#include "Instrumentation.h"
+
+namespace {
+
+constexpr uint64_t kDataAlignment = 64;
+
+template <typename T>
+void putLittleEndian(std::vector<char> &out, size_t offset, T value) {
+    using U = std::make_unsigned_t<T>;
+    U bits = static_cast<U>(value);
+    for (size_t b = 0; b < sizeof(T); ++b) {
+        out[offset + b] = static_cast<char>(bits & 0xFFu);
+        bits = static_cast<U>(bits >> 8);
+    }
+}
+
+template <typename T>
+T getLittleEndian(const unsigned char *in) {
+    using U = std::make_unsigned_t<T>;
+    U bits = 0;
+    for (size_t b = sizeof(T); b-- > 0;)
+        bits = static_cast<U>((bits << 8) | in[b]);
+    return static_cast<T>(bits);
+}
+
+uint64_t dataOffsetFor(const SweepTensorHeader &header) {
+    const uint64_t validEnd =
+        header.validOffset() +
+        static_cast<uint64_t>(header.pairs.size()) * header.secondCount;
+    return (validEnd + kDataAlignment - 1) / kDataAlignment * kDataAlignment;
+}
+
+std::vector<char> encodeHeader(const SweepTensorHeader &header) {
+    std::vector<char> bytes(header.validOffset(), 0);
+    std::memcpy(bytes.data(), kSweepTensorMagic, sizeof(kSweepTensorMagic));
+    putLittleEndian<uint32_t>(bytes, 8, kSweepTensorVersion);
+    putLittleEndian<uint32_t>(bytes, 12,
+                              static_cast<uint32_t>(header.pairs.size()));
+    putLittleEndian<uint32_t>(bytes, 16, header.secondCount);
+    putLittleEndian<uint32_t>(bytes, 20, header.delayBins);
+    putLittleEndian<int64_t>(bytes, 24, header.startSec);
+    putLittleEndian<int64_t>(bytes, 32, header.delayStartPs);
+    putLittleEndian<int64_t>(bytes, 40, header.delayStepPs);
+    putLittleEndian<int64_t>(bytes, 48, header.coincWindowPs);
+    putLittleEndian<uint64_t>(bytes, 56, header.dataOffset);
+    for (size_t p = 0; p < header.pairs.size(); ++p) {
+        putLittleEndian<int32_t>(bytes, kSweepTensorHeaderBytes + 8 * p,
+                                 header.pairs[p].first);
+        putLittleEndian<int32_t>(bytes, kSweepTensorHeaderBytes + 8 * p + 4,
+                                 header.pairs[p].second);
+    }
+    return bytes;
+}
+
+} // namespace
+
+SweepTensorHeader readSweepTensorHeader(const std::string &filename) {
+    std::ifstream in(filename, std::ios::binary);
+    if (!in)
+        throw std::runtime_error("Cannot open sweep tensor: " + filename);
+
+    unsigned char fixed[kSweepTensorHeaderBytes];
+    if (!in.read(reinterpret_cast<char *>(fixed), sizeof(fixed)) ||
+        std::memcmp(fixed, kSweepTensorMagic, sizeof(kSweepTensorMagic)) != 0)
+        throw std::runtime_error("Not a sweep tensor file: " + filename);
+    if (getLittleEndian<uint32_t>(fixed + 8) != kSweepTensorVersion)
+        throw std::runtime_error("Unsupported sweep tensor version: " + filename);
+
+    SweepTensorHeader header;
+    const uint32_t pairCount = getLittleEndian<uint32_t>(fixed + 12);
+    header.secondCount = getLittleEndian<uint32_t>(fixed + 16);
+    header.delayBins = getLittleEndian<uint32_t>(fixed + 20);
+    header.startSec = getLittleEndian<int64_t>(fixed + 24);
+    header.delayStartPs = getLittleEndian<int64_t>(fixed + 32);
+    header.delayStepPs = getLittleEndian<int64_t>(fixed + 40);
+    header.coincWindowPs = getLittleEndian<int64_t>(fixed + 48);
+    header.dataOffset = getLittleEndian<uint64_t>(fixed + 56);
+
+    std::vector<unsigned char> pairBytes(8ull * pairCount);
+    if (!in.read(reinterpret_cast<char *>(pairBytes.data()),
+                 static_cast<std::streamsize>(pairBytes.size())))
+        throw std::runtime_error("Truncated sweep tensor header: " + filename);
+    header.pairs.reserve(pairCount);
+    for (uint32_t p = 0; p < pairCount; ++p)
+        header.pairs.emplace_back(
+            getLittleEndian<int32_t>(pairBytes.data() + 8 * p),
+            getLittleEndian<int32_t>(pairBytes.data() + 8 * p + 4));
+    return header;
+}
+
+SweepTensorWriter::SweepTensorWriter(const std::string &filename,
+                                     SweepTensorHeader header,
+                                     size_t queueCapacity)
+    : header_(std::move(header)), queue_(queueCapacity) {
+    if (header_.delayBins == 0 || header_.secondCount == 0 ||
+        header_.pairs.empty())
+        throw std::invalid_argument("Sweep tensor dimensions must be non-zero");
+    header_.dataOffset = dataOffsetFor(header_);
+
+    {
+        std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+        const std::vector<char> bytes = encodeHeader(header_);
+        if (!out.write(bytes.data(), static_cast<std::streamsize>(bytes.size())))
+            throw std::runtime_error("Failed to write sweep tensor: " + filename);
+        COINCFINDER_COUNT(BytesWritten, bytes.size());
+    }
+    const uint64_t totalBytes =
+        header_.dataOffset + static_cast<uint64_t>(header_.pairs.size()) *
+                                 header_.secondCount * header_.delayBins *
+                                 sizeof(int32_t);
+    std::error_code ec;
+    // Zero-filled (sparse where supported); unwritten sweeps read as zeros.
+    std::filesystem::resize_file(filename, totalBytes, ec);
+    if (ec)
+        throw std::runtime_error("Failed to size sweep tensor " + filename +
+                                 ": " + ec.message());
+
+    file_.open(filename, std::ios::binary | std::ios::in | std::ios::out);
+    if (!file_)
+        throw std::runtime_error("Failed to reopen sweep tensor: " + filename);
+    worker_ = std::thread([this] { run(); });
+}
+
+SweepTensorWriter::~SweepTensorWriter() {
+    try {
+        finish();
+    } catch (...) {
+        // Destructors must not throw; call finish() to observe errors.
+    }
+}
+
+void SweepTensorWriter::submit(size_t pairIndex, size_t secondIndex,
+                               std::vector<int32_t> counts) {
+    if (pairIndex >= header_.pairs.size() || secondIndex >= header_.secondCount)
+        throw std::out_of_range("Sweep index outside the tensor");
+    if (counts.size() != header_.delayBins)
+        throw std::invalid_argument("Sweep length does not match delayBins");
+    if constexpr (std::endian::native != std::endian::little) {
+        for (int32_t &value : counts) {
+            uint32_t bits = static_cast<uint32_t>(value);
+            bits = (bits >> 24) | ((bits >> 8) & 0xFF00u) |
+                   ((bits << 8) & 0xFF0000u) | (bits << 24);
+            value = static_cast<int32_t>(bits);
+        }
+    }
+    queue_.push({pairIndex, secondIndex, std::move(counts)});
+}
+
+void SweepTensorWriter::run() {
+    const char written = 1;
+    while (auto sweep = queue_.pop()) {
+        if (error_)
+            continue; // keep draining so producers never stall
+        const uint64_t cell =
+            static_cast<uint64_t>(sweep->pairIndex) * header_.secondCount +
+            sweep->secondIndex;
+        file_.seekp(static_cast<std::streamoff>(header_.dataOffset +
+                                                cell * header_.delayBins *
+                                                    sizeof(int32_t)));
+        file_.write(reinterpret_cast<const char *>(sweep->counts.data()),
+                    static_cast<std::streamsize>(sweep->counts.size() *
+                                                 sizeof(int32_t)));
+        file_.seekp(static_cast<std::streamoff>(header_.validOffset() + cell));
+        file_.write(&written, 1);
+        COINCFINDER_COUNT(BytesWritten, sweep->counts.size() * sizeof(int32_t) + 1);
+        if (!file_) {
+            std::lock_guard<std::mutex> lock(errorMutex_);
+            error_ = std::make_exception_ptr(
+                std::runtime_error("Failed writing sweep tensor data"));
+        }
+    }
+}
+
+void SweepTensorWriter::finish() {
+    if (finished_)
+        return;
+    finished_ = true;
+    queue_.close();
+    if (worker_.joinable())
+        worker_.join();
+    file_.flush();
+    file_.close();
+    std::lock_guard<std::mutex> lock(errorMutex_);
+    if (error_)
+        std::rethrow_exception(error_);
+}
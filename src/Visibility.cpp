@@ -0,0 +1,250 @@
+#include "Visibility.h"
+
+// Polarization metrics. Off-peak samples are extra entries of the same
+// coincidence matrix as the peaks, so the background costs two more merges
+// per pair over events already in cache rather than another pass.
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+
+#include "ReadCSV.h"
+
+BasisMetrics basisMetrics(double same, double opposite, double accidentalsSame,
+                          double accidentalsOpposite) {
+    BasisMetrics m;
+    m.same = same;
+    m.opposite = opposite;
+    m.accidentalsSame = accidentalsSame;
+    m.accidentalsOpposite = accidentalsOpposite;
+    const double total = same + opposite;
+    if (total > 0.0) {
+        m.visibility = (same - opposite) / total;
+        m.qber = opposite / total;
+    }
+    const double sameCorrected = std::max(0.0, same - accidentalsSame);
+    const double oppositeCorrected = std::max(0.0, opposite - accidentalsOpposite);
+    const double totalCorrected = sameCorrected + oppositeCorrected;
+    if (totalCorrected > 0.0) {
+        m.visibilityCorrected = (sameCorrected - oppositeCorrected) / totalCorrected;
+        m.qberCorrected = oppositeCorrected / totalCorrected;
+    }
+    return m;
+}
+
+BasisMetrics basisMetrics(std::span<const PairCounts> counts, const BasisPairs &basis) {
+    const auto sum = [&](const std::vector<size_t> &indices, bool accidentals) {
+        double total = 0.0;
+        for (size_t i : indices) {
+            if (i >= counts.size())
+                throw std::invalid_argument("basis refers to a missing pair");
+            total += accidentals ? counts[i].accidentals
+                                 : static_cast<double>(counts[i].coincidences);
+        }
+        return total;
+    };
+    return basisMetrics(sum(basis.same, false), sum(basis.opposite, false),
+                        sum(basis.same, true), sum(basis.opposite, true));
+}
+
+std::vector<BasisPairs> polarizationBases(std::span<const AnalysisPair> pairs) {
+    struct Layout {
+        const char *name;
+        const char *same[2];
+        const char *opposite[2];
+    };
+    static constexpr Layout kLayouts[] = {
+        {"HV", {"HH", "VV"}, {"HV", "VH"}},
+        {"DA", {"DD", "AA"}, {"DA", "AD"}},
+    };
+    const auto find = [&](const char *label, std::vector<size_t> &into) {
+        for (size_t i = 0; i < pairs.size(); ++i) {
+            if (pairs[i].label == label) {
+                into.push_back(i);
+                return true;
+            }
+        }
+        return false;
+    };
+
+    std::vector<BasisPairs> bases;
+    for (const Layout &layout : kLayouts) {
+        BasisPairs basis;
+        basis.name = layout.name;
+        bool complete = true;
+        for (const char *label : layout.same)
+            complete = find(label, basis.same) && complete;
+        for (const char *label : layout.opposite)
+            complete = find(label, basis.opposite) && complete;
+        if (complete)
+            bases.push_back(std::move(basis));
+    }
+    return bases;
+}
+
+double singlesProductAccidentals(size_t n1, size_t n2, long long coincWindowPs,
+                                 long long bucketPs) {
+    if (bucketPs <= 0)
+        return 0.0;
+    return static_cast<double>(n1) * static_cast<double>(n2) *
+           static_cast<double>(2 * coincWindowPs + 1) / static_cast<double>(bucketPs);
+}
+
+VisibilityAnalysis::VisibilityAnalysis(std::vector<AnalysisPair> pairs,
+                                       std::vector<BasisPairs> bases,
+                                       long long coincWindowPs,
+                                       AccidentalsOptions options)
+    : pairs_(std::move(pairs)), bases_(std::move(bases)),
+      coincWindowPs_(coincWindowPs), options_(options) {
+    if (coincWindowPs_ <= 0)
+        throw std::invalid_argument("coincidence window must be positive");
+    if (options_.offPeakOffsetPs < 0)
+        throw std::invalid_argument("off-peak offset must not be negative");
+    for (const BasisPairs &basis : bases_)
+        for (const auto *indices : {&basis.same, &basis.opposite})
+            for (size_t i : *indices)
+                if (i >= pairs_.size())
+                    throw std::invalid_argument("basis refers to a missing pair");
+
+    const auto indexOf = [&](int ch) {
+        const auto it = std::find(channels_.begin(), channels_.end(), ch);
+        if (it != channels_.end())
+            return static_cast<size_t>(it - channels_.begin());
+        channels_.push_back(ch);
+        return channels_.size() - 1;
+    };
+    for (const AnalysisPair &p : pairs_) {
+        const size_t first = indexOf(p.ch1);
+        const size_t second = indexOf(p.ch2);
+        matrixPairs_.push_back({first, second, p.delayPs});
+    }
+
+    if (options_.method == AccidentalsMethod::OffPeak) {
+        offsetPs_ = options_.offPeakOffsetPs > 0
+                        ? options_.offPeakOffsetPs
+                        : kDefaultOffPeakWindows * coincWindowPs_;
+        const size_t peaks = matrixPairs_.size();
+        for (const long long sign : {-1LL, 1LL})
+            for (size_t k = 0; k < peaks; ++k) {
+                CoincidencePair offPeak = matrixPairs_[k];
+                offPeak.delayPs += sign * offsetPs_;
+                matrixPairs_.push_back(offPeak);
+            }
+    } else if (options_.method == AccidentalsMethod::SinglesProduct) {
+        bucketPs_ = options_.bucketPs;
+    }
+}
+
+SecondMetrics VisibilityAnalysis::analyzeSecond(long long second,
+                                                std::span<const SegmentedSpan> spans) const {
+    return analyzeSecond(second, spans,
+                         bucketPs_ > 0 ? bucketPs_ : bucketWidthForExposure(-1.0));
+}
+
+SecondMetrics VisibilityAnalysis::analyzeSecond(long long second,
+                                                std::span<const SegmentedSpan> spans,
+                                                long long bucketPs) const {
+    if (spans.size() != channels_.size())
+        throw std::invalid_argument("one span per analysis channel is required");
+
+    SecondMetrics metrics;
+    metrics.second = second;
+    metrics.pairs.resize(pairs_.size());
+    const std::vector<int> counts =
+        computeCoincidenceMatrix(spans, matrixPairs_, coincWindowPs_);
+    const size_t peaks = pairs_.size();
+    for (size_t k = 0; k < peaks; ++k) {
+        PairCounts &pair = metrics.pairs[k];
+        pair.coincidences = counts[k];
+        if (options_.method == AccidentalsMethod::OffPeak) {
+            pair.accidentals = 0.5 * (static_cast<double>(counts[peaks + k]) +
+                                      static_cast<double>(counts[2 * peaks + k]));
+        } else if (options_.method == AccidentalsMethod::SinglesProduct) {
+            const CoincidencePair &p = matrixPairs_[k];
+            pair.accidentals = singlesProductAccidentals(
+                spans[p.first].head.size(), spans[p.second].head.size(),
+                coincWindowPs_, bucketPs);
+        }
+    }
+
+    metrics.bases.reserve(bases_.size());
+    double same = 0.0, opposite = 0.0, accSame = 0.0, accOpposite = 0.0;
+    double visSum = 0.0, qberSum = 0.0, visCorrSum = 0.0, qberCorrSum = 0.0;
+    int withRatio = 0, withCorrected = 0;
+    for (const BasisPairs &basis : bases_) {
+        const BasisMetrics m = basisMetrics(metrics.pairs, basis);
+        same += m.same;
+        opposite += m.opposite;
+        accSame += m.accidentalsSame;
+        accOpposite += m.accidentalsOpposite;
+        if (!std::isnan(m.visibility)) {
+            visSum += m.visibility;
+            qberSum += m.qber;
+            ++withRatio;
+        }
+        if (!std::isnan(m.visibilityCorrected)) {
+            visCorrSum += m.visibilityCorrected;
+            qberCorrSum += m.qberCorrected;
+            ++withCorrected;
+        }
+        metrics.bases.push_back(m);
+    }
+    metrics.total.same = same;
+    metrics.total.opposite = opposite;
+    metrics.total.accidentalsSame = accSame;
+    metrics.total.accidentalsOpposite = accOpposite;
+    if (withRatio > 0) {
+        metrics.total.visibility = visSum / withRatio;
+        metrics.total.qber = qberSum / withRatio;
+    }
+    if (withCorrected > 0) {
+        metrics.total.visibilityCorrected = visCorrSum / withCorrected;
+        metrics.total.qberCorrected = qberCorrSum / withCorrected;
+    }
+    return metrics;
+}
+
+std::vector<SecondMetrics> VisibilityAnalysis::analyze(const std::map<int, Singles> &singles,
+                                                       long long firstSecond,
+                                                       long long lastSecond) const {
+    std::vector<const Singles *> sources;
+    sources.reserve(channels_.size());
+    for (int ch : channels_) {
+        const auto it = singles.find(ch);
+        sources.push_back(it == singles.end() ? nullptr : &it->second);
+    }
+    return analyze(sources, firstSecond, lastSecond);
+}
+
+std::vector<SecondMetrics> VisibilityAnalysis::analyze(std::span<const Singles *const> sources,
+                                                       long long firstSecond,
+                                                       long long lastSecond) const {
+    if (sources.size() != channels_.size())
+        throw std::invalid_argument("one source per analysis channel is required");
+    if (lastSecond < firstSecond)
+        return {};
+    // Counts span one capture second whatever the bucket width.
+    const long long bucketPs = bucketPs_ > 0 ? bucketPs_ : kDefaultBucketWidthPs;
+
+    const long long seconds = lastSecond - firstSecond + 1;
+    std::vector<SecondMetrics> out(static_cast<size_t>(seconds));
+#pragma omp parallel
+    {
+        std::vector<SegmentedSpan> spans(channels_.size());
+        std::vector<std::vector<Timestamp>> scratch(channels_.size());
+
+#pragma omp for schedule(dynamic, 1)
+        for (long long idx = 0; idx < seconds; ++idx) {
+            const long long sec = firstSecond + idx;
+            for (size_t c = 0; c < sources.size(); ++c)
+                spans[c] = sources[c]
+                               ? withNextFirstEvent(
+                                     eventsForCaptureSecond(*sources[c], sec, scratch[c]),
+                                     firstEventOfCaptureSecond(*sources[c], sec + 1))
+                               : SegmentedSpan();
+            out[static_cast<size_t>(idx)] = analyzeSecond(sec, spans, bucketPs);
+        }
+    }
+    return out;
+}
@@ -1,13 +1,24 @@
+#include <algorithm>
 #include <cmath>
+#include <limits>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 #include <pybind11/numpy.h>
 #include <span>
+#include <tuple>
 
+#include "BinTailReader.h"
 #include "Coincidences.h"
+#include "CompactSingles.h"
+#include "DelaySweeps.h"
+#include "FftCorrelation.h"
+#include "Instrumentation.h"
 #include "ReadCSV.h"
+#include "RollingDelayHistogram.h"
 #include "RollingSingles.h"
 #include "Singles.h"
+#include "SinglesCache.h"
+#include "Visibility.h"
 
 // Pybind11 module that mirrors the C++ CLI surface area. The bindings keep the
 // docstrings short and defer to the underlying headers for deep detail, but the
@@ -15,6 +26,34 @@
 
 namespace py = pybind11;
 
+namespace {
+// Shared by find_best_delay_ps/_np: rounds the ps arguments and picks the
+// full or coarse-to-fine search.
+long long bestDelay(std::span<const long long> reference,
+                    std::span<const long long> target, double coinc_window_ps,
+                    double delay_start_ps, double delay_end_ps,
+                    double delay_step_ps, bool coarse_to_fine) {
+  const long long window = static_cast<long long>(std::llround(coinc_window_ps));
+  const long long start = static_cast<long long>(std::llround(delay_start_ps));
+  const long long end = static_cast<long long>(std::llround(delay_end_ps));
+  const long long step = static_cast<long long>(std::llround(delay_step_ps));
+  return coarse_to_fine
+             ? findBestDelayCoarseToFine(reference, target, window, start, end, step)
+             : findBestDelayPicoseconds(reference, target, window, start, end, step);
+}
+
+// Read-only NumPy view over `events`; `owner` (the Python object holding the
+// storage) is kept alive by the array. No copy is made.
+py::array_t<long long> readOnlyView(std::span<const Timestamp> events,
+                                    py::handle owner) {
+  py::array_t<long long> view({static_cast<py::ssize_t>(events.size())},
+                              {static_cast<py::ssize_t>(sizeof(Timestamp))},
+                              events.data(), owner);
+  view.attr("setflags")(py::arg("write") = false);
+  return view;
+}
+} // namespace
+
 PYBIND11_MODULE(coincfinder, m) {
   m.doc() = "Python bindings for the CoincFinder C++ library";
 
@@ -23,30 +62,244 @@ PYBIND11_MODULE(coincfinder, m) {
       .def(py::init<>())
       .def_readwrite("channel", &Singles::channel)
       .def_readwrite("base_second", &Singles::baseSecond)
-      .def_readwrite("events_per_second", &Singles::eventsPerSecond)
+      .def_readonly("events_per_second", &Singles::eventsPerSecond)
+      .def_readwrite("bucket_width_ps", &Singles::bucketWidthPs)
+      .def("bucket_count",
+           [](const Singles &s) { return s.eventsPerSecond.size(); })
+      // Buffer-protocol accessors: unlike events_per_second they do not
+      // convert buckets into Python lists. The bucket storage is read-only
+      // from Python, so a view stays valid as long as it keeps the Singles
+      // alive.
+      .def(
+          "second_array",
+          [](py::object self, long long second) {
+            const auto &bucket =
+                eventsForSecond(self.cast<const Singles &>(), second);
+            return readOnlyView(bucket, self);
+          },
+          py::arg("second"),
+          "Read-only int64 view of the bucket for `second` (empty when out "
+          "of range). Raises ValueError unless buckets are one second wide.")
+      .def(
+          "bucket_array",
+          [](py::object self, long long bucket) {
+            return readOnlyView(eventsForBucket(self.cast<const Singles &>(), bucket),
+                                self);
+          },
+          py::arg("bucket"),
+          "Read-only int64 view of bucket `bucket`, whatever its width.")
+      .def(
+          "flat_array",
+          [](const Singles &s) {
+            size_t total = 0;
+            for (const auto &bucket : s.eventsPerSecond)
+              total += bucket.size();
+            py::array_t<long long> out(static_cast<py::ssize_t>(total));
+            long long *dst = out.mutable_data();
+            for (const auto &bucket : s.eventsPerSecond)
+              dst = std::copy(bucket.begin(), bucket.end(), dst);
+            return out;
+          },
+          "All timestamps of the channel as one int64 array. The buckets are "
+          "separate allocations, so this is one copy; read_file_auto_flat "
+          "gives a zero-copy FlatSingles.flat_array instead.")
       .def("__repr__", [](const Singles &s) {
         return "<Singles channel=" + std::to_string(s.channel) +
                ", seconds=" + std::to_string(s.eventsPerSecond.size()) + ">";
       });
 
+  // Contiguous layout: one timestamp array plus bucket offsets per channel.
+  // Both are read-only so no assignment can free memory behind a live view.
+  py::class_<FlatSingles>(m, "FlatSingles")
+      .def(py::init<>())
+      .def_readwrite("channel", &FlatSingles::channel)
+      .def_readwrite("base_second", &FlatSingles::baseSecond)
+      .def_readonly("timestamps", &FlatSingles::timestamps)
+      .def_readonly("bucket_offsets", &FlatSingles::bucketOffsets)
+      .def_readwrite("bucket_width_ps", &FlatSingles::bucketWidthPs)
+      .def("bucket_count", &FlatSingles::bucketCount)
+      .def(
+          "events_for_second",
+          [](const FlatSingles &s, long long second) {
+            const auto events = eventsForSecond(s, second);
+            return std::vector<Timestamp>(events.begin(), events.end());
+          },
+          py::arg("second"))
+      .def(
+          "second_array",
+          [](py::object self, long long second) {
+            return readOnlyView(eventsForSecond(self.cast<const FlatSingles &>(),
+                                                second),
+                                self);
+          },
+          py::arg("second"),
+          "Read-only int64 view of the bucket for `second` (no copy). Raises "
+          "ValueError unless buckets are one second wide.")
+      .def(
+          "bucket_array",
+          [](py::object self, long long bucket) {
+            return readOnlyView(
+                eventsForBucket(self.cast<const FlatSingles &>(), bucket), self);
+          },
+          py::arg("bucket"),
+          "Read-only int64 view of bucket `bucket`, whatever its width (no "
+          "copy).")
+      .def(
+          "capture_seconds_array",
+          [](py::object self, long long first_second, long long last_second) {
+            return readOnlyView(
+                eventsForCaptureSeconds(self.cast<const FlatSingles &>(),
+                                        first_second, last_second),
+                self);
+          },
+          py::arg("first_second"), py::arg("last_second"),
+          "Read-only int64 view of capture seconds first_second..last_second "
+          "whatever the bucket width (no copy).")
+      .def(
+          "flat_array",
+          [](py::object self) {
+            return readOnlyView(self.cast<const FlatSingles &>().timestamps, self);
+          },
+          "Read-only int64 view of all timestamps of the channel (no copy).")
+      .def("__repr__", [](const FlatSingles &s) {
+        return "<FlatSingles channel=" + std::to_string(s.channel) +
+               ", seconds=" + std::to_string(s.bucketCount()) +
+               ", events=" + std::to_string(s.timestamps.size()) + ">";
+      });
+
+  py::class_<CompactSingles>(m, "CompactSingles")
+      .def(py::init<>())
+      .def_readonly("channel", &CompactSingles::channel)
+      .def_readonly("base_second", &CompactSingles::baseSecond)
+      .def_readonly("bucket_width_ps", &CompactSingles::bucketWidthPs)
+      .def("bucket_count", &CompactSingles::bucketCount)
+      .def("size", &CompactSingles::size)
+      .def("memory_bytes", &CompactSingles::memoryBytes)
+      .def(
+          "second_array",
+          [](const CompactSingles &s, long long second) {
+            std::vector<Timestamp> events;
+            decodeCompact(eventsForSecond(s, second), events);
+            return py::array_t<long long>(static_cast<py::ssize_t>(events.size()),
+                                          events.data());
+          },
+          py::arg("second"),
+          "Decoded int64 copy of the bucket for `second`.")
+      .def("__repr__", [](const CompactSingles &s) {
+        return "<CompactSingles channel=" + std::to_string(s.channel) +
+               ", seconds=" + std::to_string(s.bucketCount()) +
+               ", events=" + std::to_string(s.size()) + ">";
+      });
+
+  m.def("compact_singles", &compactSingles, py::arg("flat"),
+        "Pack a FlatSingles into 32-bit block offsets (CompactSingles).");
+  m.def("expand_compact_singles", &expandCompactSingles, py::arg("compact"),
+        "Expand a CompactSingles back into a FlatSingles.");
+  m.def(
+      "count_coincidences_compact",
+      [](const CompactSingles &ch1, const CompactSingles &ch2,
+         double coinc_window_ps, double delay_ps, long long first_second,
+         long long last_second) {
+        const auto coinc_window_ll =
+            static_cast<long long>(std::llround(coinc_window_ps));
+        const auto delay_ll = static_cast<long long>(std::llround(delay_ps));
+        py::gil_scoped_release release;
+        return countCoincidencesWithDelay(
+            eventsForSeconds(ch1, first_second, last_second),
+            eventsForSeconds(ch2, first_second, last_second), coinc_window_ll,
+            delay_ll);
+      },
+      py::arg("ch1"), py::arg("ch2"), py::arg("coinc_window_ps"),
+      py::arg("delay_ps"),
+      py::arg("first_second") = std::numeric_limits<long long>::min(),
+      py::arg("last_second") = std::numeric_limits<long long>::max(),
+      "Count coincidences (picoseconds) between two CompactSingles over "
+      "buckets first_second..last_second (default: all).");
+
+  m.def("flatten_singles", &flattenSingles, py::arg("singles"),
+        "Pack a Singles into the contiguous FlatSingles layout.");
+  m.def("expand_singles", &expandSingles, py::arg("flat"),
+        "Expand a FlatSingles back into per-second buckets.");
+
   // --- Bind ReadCSV.h functions ---
   // Wrap duration out-parameters so Python gets a tuple (singles_map,
   // duration).
   m.def(
       "read_file_auto",
-      [](const std::string &filename, double exposure_seconds) {
+      [](const std::string &filename, double exposure_seconds,
+         long long start_sec, long long stop_sec) {
         double duration_sec = 0.0;
-        auto singles = readFileAuto(filename, duration_sec, exposure_seconds);
+        py::gil_scoped_release release;
+        auto singles =
+            start_sec <= 0 && stop_sec < 0
+                ? readFileAuto(filename, duration_sec, exposure_seconds)
+                : readFileAuto(filename, duration_sec, exposure_seconds,
+                               start_sec, stop_sec);
         return std::make_pair(std::move(singles), duration_sec);
       },
       py::arg("filename"), py::arg("exposure_seconds") = -1.0,
+      py::arg("start_sec") = 0, py::arg("stop_sec") = -1,
       "Automatically read CSV or BIN file into a map<int, Singles>; returns "
+      "(singles_map, measurement_duration_sec). start_sec/stop_sec (inclusive, "
+      "-1 = end) seek to that bucket range instead of decoding the whole "
+      "file.");
+
+  m.def(
+      "read_file_auto_flat",
+      [](const std::string &filename, double exposure_seconds,
+         long long start_sec, long long stop_sec) {
+        double duration_sec = 0.0;
+        py::gil_scoped_release release;
+        auto singles =
+            start_sec <= 0 && stop_sec < 0
+                ? readFileAutoFlat(filename, duration_sec, exposure_seconds)
+                : readFileAutoFlat(filename, duration_sec, exposure_seconds,
+                                   start_sec, stop_sec);
+        return std::make_pair(std::move(singles), duration_sec);
+      },
+      py::arg("filename"), py::arg("exposure_seconds") = -1.0,
+      py::arg("start_sec") = 0, py::arg("stop_sec") = -1,
+      "Like read_file_auto but returns map<int, FlatSingles>; returns "
+      "(flat_map, measurement_duration_sec).");
+
+  m.def(
+      "read_file_auto_compact",
+      [](const std::string &filename, double exposure_seconds,
+         long long chunk_seconds) {
+        double duration_sec = 0.0;
+        py::gil_scoped_release release;
+        auto singles = readFileAutoCompact(filename, duration_sec,
+                                           exposure_seconds, chunk_seconds);
+        return std::make_pair(std::move(singles), duration_sec);
+      },
+      py::arg("filename"), py::arg("exposure_seconds") = -1.0,
+      py::arg("chunk_seconds") = 60,
+      "Like read_file_auto but returns map<int, CompactSingles>, packed "
+      "chunk_seconds buckets at a time; returns (compact_map, "
+      "measurement_duration_sec).");
+
+  m.def(
+      "read_file_cached",
+      [](const std::string &filename, long long first_second,
+         long long last_second, double exposure_seconds) {
+        double duration_sec = 0.0;
+        py::gil_scoped_release release;
+        auto singles = readFileCached(filename, duration_sec, first_second,
+                                      last_second, exposure_seconds);
+        return std::make_pair(std::move(singles), duration_sec);
+      },
+      py::arg("filename"), py::arg("first_second") = 0,
+      py::arg("last_second") = -1, py::arg("exposure_seconds") = -1.0,
+      "Like read_file_auto, restricted to buckets first_second..last_second "
+      "(-1 = end) and backed by <filename>.cfcache, which is written on the "
+      "first call and mapped afterwards; returns "
       "(singles_map, measurement_duration_sec).");
 
   m.def(
       "read_csv_to_singles",
       [](const std::string &filename) {
         double duration_sec = 0.0;
+        py::gil_scoped_release release;
         auto singles = readCSVtoSingles(filename, duration_sec);
         return std::make_pair(std::move(singles), duration_sec);
       },
@@ -54,10 +307,23 @@ PYBIND11_MODULE(coincfinder, m) {
       "Read CSV file into map<int, Singles>; returns "
       "(singles_map, measurement_duration_sec).");
 
+  m.def(
+      "read_csv_to_singles_parallel",
+      [](const std::string &filename) {
+        double duration_sec = 0.0;
+        py::gil_scoped_release release;
+        auto singles = readCSVtoSinglesParallel(filename, duration_sec);
+        return std::make_pair(std::move(singles), duration_sec);
+      },
+      py::arg("filename"),
+      "Read CSV file on all OpenMP threads; returns "
+      "(singles_map, measurement_duration_sec).");
+
   m.def(
       "read_bin_to_singles",
       [](const std::string &filename) {
         double duration_sec = 0.0;
+        py::gil_scoped_release release;
         auto singles = readBINtoSingles(filename, duration_sec);
         return std::make_pair(std::move(singles), duration_sec);
       },
@@ -65,15 +331,68 @@ PYBIND11_MODULE(coincfinder, m) {
       "Read binary file into map<int, Singles>; returns "
       "(singles_map, measurement_duration_sec).");
 
+  m.def(
+      "read_bin_stream_to_singles",
+      [](const std::string &filename) {
+        double duration_sec = 0.0;
+        py::gil_scoped_release release;
+        auto singles = readBINStreamToSingles(filename, duration_sec);
+        return std::make_pair(std::move(singles), duration_sec);
+      },
+      py::arg("filename"),
+      "Stream-based BIN reader (works on pipes); returns "
+      "(singles_map, measurement_duration_sec).");
+
   m.def("has_ending", &hasEnding, py::arg("string"), py::arg("ending"),
         "Check if a string ends with a given suffix");
 
   m.def("set_bucket_duration_seconds", &setBucketDurationSeconds,
         py::arg("seconds") = 1.0,
-        "Set the time bucket duration (seconds) used when ingesting singles (default 1 s)."
-        );
+        "Set the default time bucket duration (seconds) for reads without "
+        "exposure_seconds (default 1 s). Reads never change it.");
   m.def("get_bucket_duration_seconds", &bucketDurationSeconds,
         "Return the current bucket duration in seconds.");
+  // -inf: exposure_seconds of 0 or below keeps meaning the default width.
+  m.attr("AUTO_EXPOSURE") = kAutoExposure;
+  m.def("choose_bucket_width_ps", &chooseBucketWidthPs,
+        py::arg("busiest_events"), py::arg("span_ps"),
+        "Bucket width read_file_auto(exposure_seconds=AUTO_EXPOSURE) picks "
+        "for a busiest channel of busiest_events over span_ps.");
+
+  py::enum_<DelayScanEngine>(m, "DelayScanEngine")
+      .value("auto", DelayScanEngine::Auto)
+      .value("direct", DelayScanEngine::Direct)
+      .value("fft", DelayScanEngine::Fft);
+  m.def("set_delay_scan_engine", &setDelayScanEngine, py::arg("engine"),
+        "Engine behind compute_coincidences_for_range_* and find_best_delay_* "
+        "(auto: binned FFT correlation only when estimated cheaper).");
+  m.def("get_delay_scan_engine", &delayScanEngine,
+        "Return the current delay-scan engine.");
+
+  m.def(
+      "get_stats",
+      []() {
+        const StatsSnapshot snapshot = statsSnapshot();
+        py::dict counters;
+        for (const auto &[name, value] : snapshot.counters)
+          counters[py::str(name)] = value;
+        py::dict stages;
+        for (const auto &stage : snapshot.stages) {
+          py::dict entry;
+          entry["calls"] = stage.calls;
+          entry["seconds"] = stage.seconds;
+          stages[py::str(stage.name)] = entry;
+        }
+        py::dict stats;
+        stats["enabled"] = snapshot.enabled;
+        stats["counters"] = counters;
+        stats["stages"] = stages;
+        return stats;
+      },
+      "Counters and per-stage timings accumulated since import or the last "
+      "reset_stats(): {'enabled', 'counters': {name: int}, "
+      "'stages': {name: {'calls', 'seconds'}}}.");
+  m.def("reset_stats", &resetStats, "Zero all counters and stage timings.");
 
   // --- Bind Coincidences.h functions ---
   // --- Count coincidences with delay (use ps everywhere in Python)
@@ -84,6 +403,7 @@ PYBIND11_MODULE(coincfinder, m) {
         const auto coinc_window_ll =
             static_cast<long long>(std::llround(coinc_window_ps));
         const auto delay_ll = static_cast<long long>(std::llround(delay_ps));
+        py::gil_scoped_release release;
         return countCoincidencesWithDelay(std::span<const long long>(ch1),
                                           std::span<const long long>(ch2),
                                           coinc_window_ll, delay_ll);
@@ -103,12 +423,41 @@ PYBIND11_MODULE(coincfinder, m) {
         auto b2 = ch2.unchecked<1>();
         std::span<const long long> s1(b1.data(0), b1.size());
         std::span<const long long> s2(b2.data(0), b2.size());
+        py::gil_scoped_release release;
         return countCoincidencesWithDelay(s1, s2, coinc_window_ll, delay_ll);
       },
       py::arg("ch1"), py::arg("ch2"), py::arg("coinc_window_ps"),
       py::arg("delay_ps"),
       "Count coincidences (picoseconds) accepting NumPy arrays without copying when C-contiguous.");
 
+  m.def(
+      "count_coincidences_at_delays_np",
+      [](py::array_t<long long, py::array::c_style | py::array::forcecast> ch1,
+         py::array_t<long long, py::array::c_style | py::array::forcecast> ch2,
+         double coinc_window_ps,
+         py::array_t<long long, py::array::c_style | py::array::forcecast>
+             delays_ps) {
+        auto b1 = ch1.unchecked<1>();
+        auto b2 = ch2.unchecked<1>();
+        auto bd = delays_ps.unchecked<1>();
+        std::span<const long long> s1(b1.data(0), b1.size());
+        std::span<const long long> s2(b2.data(0), b2.size());
+        std::span<const long long> sd(bd.data(0), bd.size());
+        std::vector<int> counts;
+        {
+          py::gil_scoped_release release;
+          counts = countCoincidencesAtDelays(
+              s1, s2, static_cast<long long>(std::llround(coinc_window_ps)), sd);
+        }
+        py::array_t<int> out(static_cast<py::ssize_t>(counts.size()));
+        std::copy(counts.begin(), counts.end(), out.mutable_data());
+        return out;
+      },
+      py::arg("ch1"), py::arg("ch2"), py::arg("coinc_window_ps"),
+      py::arg("delays_ps"),
+      "Coincidence counts for an arbitrary set of delays (picoseconds) in one "
+      "pass; returns an int32 array aligned with delays_ps.");
+
   m.def(
       "collect_coincidences_with_delay_ps",
       [](const std::vector<long long> &ch1, const std::vector<long long> &ch2,
@@ -116,6 +465,7 @@ PYBIND11_MODULE(coincfinder, m) {
         const auto coinc_window_ll =
             static_cast<long long>(std::llround(coinc_window_ps));
         const auto delay_ll = static_cast<long long>(std::llround(delay_ps));
+        py::gil_scoped_release release;
         return collectCoincidencesWithDelay(std::span<const long long>(ch1),
                                             std::span<const long long>(ch2),
                                             coinc_window_ll, delay_ll);
@@ -132,16 +482,24 @@ PYBIND11_MODULE(coincfinder, m) {
             static_cast<long long>(std::llround(coinc_window_ps));
         const auto delay_ll = static_cast<long long>(std::llround(delay_ps));
         if (collect) {
-          auto hits = collectCoincidencesWithDelay(
+          std::vector<std::pair<long long, long long>> hits;
+          {
+            py::gil_scoped_release release;
+            hits = collectCoincidencesWithDelay(
+                std::span<const long long>(ch1),
+                std::span<const long long>(ch2),
+                coinc_window_ll, delay_ll);
+          }
+          return py::cast(hits);
+        }
+        int count = 0;
+        {
+          py::gil_scoped_release release;
+          count = countCoincidencesWithDelay(
               std::span<const long long>(ch1),
               std::span<const long long>(ch2),
               coinc_window_ll, delay_ll);
-          return py::cast(hits);
         }
-        int count = countCoincidencesWithDelay(
-            std::span<const long long>(ch1),
-            std::span<const long long>(ch2),
-            coinc_window_ll, delay_ll);
         return py::cast(count);
       },
       py::arg("ch1"), py::arg("ch2"), py::arg("coinc_window_ps"),
@@ -156,6 +514,7 @@ PYBIND11_MODULE(coincfinder, m) {
          double coinc_window_ps, double delay_start_ps, double delay_end_ps,
          double delay_step_ps) {
         std::vector<std::pair<float, int>> results;
+        py::gil_scoped_release release;
         computeCoincidencesForRange(
             std::span<const long long>(ch1), std::span<const long long>(ch2),
             static_cast<long long>(std::llround(coinc_window_ps)),
@@ -180,6 +539,7 @@ PYBIND11_MODULE(coincfinder, m) {
         std::span<const long long> s1(b1.data(0), b1.size());
         std::span<const long long> s2(b2.data(0), b2.size());
         std::vector<std::pair<float, int>> results;
+        py::gil_scoped_release release;
         computeCoincidencesForRange(
             s1, s2,
             static_cast<long long>(std::llround(coinc_window_ps)),
@@ -199,6 +559,7 @@ PYBIND11_MODULE(coincfinder, m) {
          double coinc_window_ps, double delay_start_ps, double delay_end_ps,
          double delay_step_ps) {
         std::vector<std::pair<float, int>> results;
+        py::gil_scoped_release release;
         computeCoincidencesForRangeHistogram(
             std::span<const long long>(ch1), std::span<const long long>(ch2),
             static_cast<long long>(std::llround(coinc_window_ps)),
@@ -223,6 +584,7 @@ PYBIND11_MODULE(coincfinder, m) {
         std::span<const long long> s1(b1.data(0), b1.size());
         std::span<const long long> s2(b2.data(0), b2.size());
         std::vector<std::pair<float, int>> results;
+        py::gil_scoped_release release;
         computeCoincidencesForRangeHistogram(
             s1, s2,
             static_cast<long long>(std::llround(coinc_window_ps)),
@@ -244,6 +606,7 @@ PYBIND11_MODULE(coincfinder, m) {
         spans.reserve(channels.size());
         for (const auto &ch : channels)
           spans.emplace_back(ch.data(), ch.size());
+        py::gil_scoped_release release;
         return countNFoldCoincidences(
             spans, static_cast<long long>(std::llround(coinc_window_ps)),
             std::span<const long long>(offsets_ps.data(), offsets_ps.size()));
@@ -258,90 +621,401 @@ PYBIND11_MODULE(coincfinder, m) {
       [](py::list channels,
          double coinc_window_ps,
          py::array_t<long long, py::array::c_style | py::array::forcecast> offsets) {
+        // Keep converted arrays alive (and owned here, not only by the
+        // caller's list) for as long as the spans point at them.
+        std::vector<py::array_t<long long, py::array::c_style | py::array::forcecast>>
+            arrays;
         std::vector<std::span<const long long>> spans;
+        arrays.reserve(py::len(channels));
         spans.reserve(py::len(channels));
         for (auto item : channels) {
-          py::array_t<long long, py::array::c_style | py::array::forcecast> arr =
-              py::cast<py::array>(item);
-          auto b = arr.unchecked<1>();
-          spans.emplace_back(b.data(0), b.size());
+          arrays.push_back(
+              py::array_t<long long, py::array::c_style | py::array::forcecast>::
+                  ensure(item));
+          if (!arrays.back())
+            throw py::type_error("channels must be 1-D integer arrays");
+          spans.emplace_back(arrays.back().data(),
+                             static_cast<size_t>(arrays.back().size()));
         }
-        auto off = offsets.unchecked<1>();
-        std::span<const long long> offsets_span(off.data(0), off.size());
-        return countNFoldCoincidences(
-            spans, static_cast<long long>(std::llround(coinc_window_ps)),
-            offsets_span);
+        std::span<const long long> offsets_span(offsets.data(),
+                                                static_cast<size_t>(offsets.size()));
+        int counts = 0;
+        {
+          py::gil_scoped_release release;
+          counts = countNFoldCoincidences(
+              spans, static_cast<long long>(std::llround(coinc_window_ps)),
+              offsets_span);
+        }
+        return counts;
       },
       py::arg("channels"), py::arg("coinc_window_ps"),
       py::arg("offsets") = py::array_t<long long>(),
       "N-fold coincidences with channels/offsets as NumPy arrays.");
 
+  m.def(
+      "compute_coincidence_matrix_np",
+      [](py::list channels,
+         const std::vector<std::tuple<size_t, size_t, double>> &pairs,
+         double coinc_window_ps) {
+        // Keep converted arrays alive for as long as the spans point at them.
+        std::vector<py::array_t<long long, py::array::c_style | py::array::forcecast>>
+            arrays;
+        std::vector<std::span<const long long>> spans;
+        arrays.reserve(py::len(channels));
+        for (auto item : channels) {
+          arrays.push_back(
+              py::array_t<long long, py::array::c_style | py::array::forcecast>::
+                  ensure(item));
+          if (!arrays.back())
+            throw py::type_error("channels must be 1-D integer arrays");
+          spans.emplace_back(arrays.back().data(),
+                             static_cast<size_t>(arrays.back().size()));
+        }
+        std::vector<CoincidencePair> requests;
+        requests.reserve(pairs.size());
+        for (const auto &[first, second, delay_ps] : pairs)
+          requests.push_back(
+              {first, second, static_cast<long long>(std::llround(delay_ps))});
+        std::vector<int> counts;
+        {
+          py::gil_scoped_release release;
+          counts = computeCoincidenceMatrix(
+              std::span<const std::span<const long long>>(spans), requests,
+              static_cast<long long>(std::llround(coinc_window_ps)));
+        }
+        py::array_t<int> out(static_cast<py::ssize_t>(counts.size()));
+        std::copy(counts.begin(), counts.end(), out.mutable_data());
+        return out;
+      },
+      py::arg("channels"), py::arg("pairs"), py::arg("coinc_window_ps"),
+      "Coincidence counts for every (first_idx, second_idx, delay_ps) entry of "
+      "`pairs` over the given channel arrays, in one sweep.");
+
+  m.def(
+      "compute_coincidences_for_range_batch",
+      [](py::dict singles_map, const std::vector<std::pair<int, int>> &pairs,
+         long long start_sec, long long stop_sec, double coinc_window_ps,
+         double delay_start_ps, double delay_end_ps, double delay_step_ps) {
+        // Borrow the Singles held by the dict (no bucket is copied) and keep
+        // them referenced while the GIL is released.
+        std::vector<py::object> owners;
+        const auto borrow = [&](int channel) -> const Singles * {
+          const py::int_ key(channel);
+          if (!singles_map.contains(key))
+            return nullptr;
+          owners.push_back(singles_map[key]);
+          return &owners.back().cast<const Singles &>();
+        };
+        owners.reserve(2 * pairs.size());
+        std::vector<SweepChannels> channels;
+        channels.reserve(pairs.size());
+        for (const auto &[ch1, ch2] : pairs)
+          channels.push_back({borrow(ch1), borrow(ch2)});
+
+        const long long start = static_cast<long long>(std::llround(delay_start_ps));
+        const long long end = static_cast<long long>(std::llround(delay_end_ps));
+        const long long step = static_cast<long long>(std::llround(delay_step_ps));
+        if (stop_sec < start_sec)
+          throw py::value_error("stop_sec must be >= start_sec");
+        const size_t bins = delaySweepBins(start, end, step);
+        const size_t seconds = static_cast<size_t>(stop_sec - start_sec + 1);
+        py::array_t<int32_t> out({static_cast<py::ssize_t>(pairs.size()),
+                                  static_cast<py::ssize_t>(seconds),
+                                  static_cast<py::ssize_t>(bins)});
+        std::span<int32_t> view(out.mutable_data(),
+                                static_cast<size_t>(out.size()));
+        {
+          py::gil_scoped_release release;
+          computeDelaySweeps(channels, start_sec, stop_sec,
+                             static_cast<long long>(std::llround(coinc_window_ps)),
+                             start, end, step, view);
+        }
+        return out;
+      },
+      py::arg("singles_map"), py::arg("pairs"), py::arg("start_sec"),
+      py::arg("stop_sec"), py::arg("coinc_window_ps"), py::arg("delay_start_ps"),
+      py::arg("delay_end_ps"), py::arg("delay_step_ps"),
+      "Delay scans for every (ch1, ch2) pair and second start_sec..stop_sec "
+      "on OpenMP threads, as an int32 array [pair, second, delay_bin]; "
+      "seconds are capture seconds at any bucket width and channels missing "
+      "from singles_map give zero counts.");
+
+  py::enum_<AccidentalsMethod>(m, "AccidentalsMethod")
+      .value("none", AccidentalsMethod::None)
+      .value("off_peak", AccidentalsMethod::OffPeak)
+      .value("singles_product", AccidentalsMethod::SinglesProduct);
+  m.def(
+      "analyze_visibility",
+      [](py::dict singles_map,
+         const std::vector<std::tuple<std::string, int, int, long long>> &pairs,
+         long long start_sec, long long stop_sec, double coinc_window_ps,
+         AccidentalsMethod accidentals, double off_peak_offset_ps) {
+        std::vector<AnalysisPair> analysisPairs;
+        analysisPairs.reserve(pairs.size());
+        for (const auto &[label, ch1, ch2, delay] : pairs)
+          analysisPairs.push_back({label, ch1, ch2, delay});
+        std::vector<BasisPairs> bases = polarizationBases(analysisPairs);
+        AccidentalsOptions options;
+        options.method = accidentals;
+        options.offPeakOffsetPs =
+            static_cast<long long>(std::llround(off_peak_offset_ps));
+        const VisibilityAnalysis analysis(
+            std::move(analysisPairs), std::move(bases),
+            static_cast<long long>(std::llround(coinc_window_ps)), options);
+
+        // Borrow the Singles held by the dict, as the batch scan does.
+        std::vector<py::object> owners;
+        std::vector<const Singles *> sources;
+        for (int channel : analysis.channels()) {
+          const py::int_ key(channel);
+          if (!singles_map.contains(key)) {
+            sources.push_back(nullptr);
+            continue;
+          }
+          owners.push_back(singles_map[key]);
+          sources.push_back(&owners.back().cast<const Singles &>());
+        }
+        if (stop_sec < start_sec)
+          throw py::value_error("stop_sec must be >= start_sec");
+        std::vector<SecondMetrics> metrics;
+        {
+          py::gil_scoped_release release;
+          metrics = analysis.analyze(sources, start_sec, stop_sec);
+        }
+
+        const auto seconds = static_cast<py::ssize_t>(metrics.size());
+        const auto column = [&](auto &&value) {
+          py::array_t<double> out(seconds);
+          double *data = out.mutable_data();
+          for (py::ssize_t i = 0; i < seconds; ++i)
+            data[i] = value(metrics[static_cast<size_t>(i)]);
+          return out;
+        };
+        const auto basisDict = [&](auto &&select) {
+          py::dict d;
+          d["same"] = column([&](const SecondMetrics &s) { return select(s).same; });
+          d["opposite"] =
+              column([&](const SecondMetrics &s) { return select(s).opposite; });
+          d["accidentals_same"] = column(
+              [&](const SecondMetrics &s) { return select(s).accidentalsSame; });
+          d["accidentals_opposite"] = column(
+              [&](const SecondMetrics &s) { return select(s).accidentalsOpposite; });
+          d["visibility"] =
+              column([&](const SecondMetrics &s) { return select(s).visibility; });
+          d["qber"] = column([&](const SecondMetrics &s) { return select(s).qber; });
+          d["visibility_corrected"] = column(
+              [&](const SecondMetrics &s) { return select(s).visibilityCorrected; });
+          d["qber_corrected"] = column(
+              [&](const SecondMetrics &s) { return select(s).qberCorrected; });
+          return d;
+        };
+
+        py::array_t<long long> secondsOut(seconds);
+        for (py::ssize_t i = 0; i < seconds; ++i)
+          secondsOut.mutable_data()[i] = metrics[static_cast<size_t>(i)].second;
+        py::dict pairsOut;
+        for (size_t k = 0; k < analysis.pairs().size(); ++k) {
+          py::dict d;
+          d["coincidences"] = column([&](const SecondMetrics &s) {
+            return static_cast<double>(s.pairs[k].coincidences);
+          });
+          d["accidentals"] =
+              column([&](const SecondMetrics &s) { return s.pairs[k].accidentals; });
+          pairsOut[py::str(analysis.pairs()[k].label)] = d;
+        }
+        py::dict basesOut;
+        for (size_t b = 0; b < analysis.bases().size(); ++b)
+          basesOut[py::str(analysis.bases()[b].name)] =
+              basisDict([b](const SecondMetrics &s) -> const BasisMetrics & {
+                return s.bases[b];
+              });
+
+        py::dict result;
+        result["seconds"] = secondsOut;
+        result["pairs"] = pairsOut;
+        result["bases"] = basesOut;
+        result["total"] = basisDict(
+            [](const SecondMetrics &s) -> const BasisMetrics & { return s.total; });
+        return result;
+      },
+      py::arg("singles_map"), py::arg("pairs"), py::arg("start_sec"),
+      py::arg("stop_sec"), py::arg("coinc_window_ps"),
+      py::arg("accidentals") = AccidentalsMethod::OffPeak,
+      py::arg("off_peak_offset_ps") = 0.0,
+      "Per-second accidentals, visibility and QBER for pairs given as "
+      "(label, ch1, ch2, delay_ps); labels HH/VV/HV/VH and DD/AA/DA/AD form "
+      "the HV and DA bases. Returns {'seconds', 'pairs': {label: "
+      "{'coincidences', 'accidentals'}}, 'bases': {name: {...}}, 'total': "
+      "{...}} with NumPy columns; off_peak_offset_ps=0 means 100 windows.");
+
   m.def(
       "find_best_delay_ps",
       [](const std::vector<long long> &reference,
          const std::vector<long long> &target, double coinc_window_ps,
-         double delay_start_ps, double delay_end_ps, double delay_step_ps) {
-        return findBestDelayPicoseconds(
+         double delay_start_ps, double delay_end_ps, double delay_step_ps,
+         bool coarse_to_fine) {
+        py::gil_scoped_release release;
+        return bestDelay(
             std::span<const long long>(reference.data(), reference.size()),
             std::span<const long long>(target.data(), target.size()),
-            static_cast<long long>(std::llround(coinc_window_ps)),
-            static_cast<long long>(std::llround(delay_start_ps)),
-            static_cast<long long>(std::llround(delay_end_ps)),
-            static_cast<long long>(std::llround(delay_step_ps)));
+            coinc_window_ps, delay_start_ps, delay_end_ps, delay_step_ps,
+            coarse_to_fine);
       },
       py::arg("reference"), py::arg("target"), py::arg("coinc_window_ps"),
       py::arg("delay_start_ps"), py::arg("delay_end_ps"),
-      py::arg("delay_step_ps"),
+      py::arg("delay_step_ps"), py::arg("coarse_to_fine") = false,
       "Return the delay (picoseconds) that maximizes coincidences between two "
-      "channels.");
+      "channels. coarse_to_fine=True locates the peak on a coarse histogram "
+      "first and refines around it (full scan when ambiguous).");
 
   m.def(
       "find_best_delay_np",
       [](py::array_t<long long, py::array::c_style | py::array::forcecast> reference,
          py::array_t<long long, py::array::c_style | py::array::forcecast> target,
          double coinc_window_ps, double delay_start_ps, double delay_end_ps,
-         double delay_step_ps) {
+         double delay_step_ps, bool coarse_to_fine) {
         auto r = reference.unchecked<1>();
         auto t = target.unchecked<1>();
         std::span<const long long> sref(r.data(0), r.size());
         std::span<const long long> stgt(t.data(0), t.size());
-        return findBestDelayPicoseconds(
-            sref, stgt,
-            static_cast<long long>(std::llround(coinc_window_ps)),
-            static_cast<long long>(std::llround(delay_start_ps)),
-            static_cast<long long>(std::llround(delay_end_ps)),
-            static_cast<long long>(std::llround(delay_step_ps)));
+        py::gil_scoped_release release;
+        return bestDelay(sref, stgt, coinc_window_ps, delay_start_ps,
+                         delay_end_ps, delay_step_ps, coarse_to_fine);
       },
       py::arg("reference"), py::arg("target"), py::arg("coinc_window_ps"),
       py::arg("delay_start_ps"), py::arg("delay_end_ps"),
-      py::arg("delay_step_ps"),
+      py::arg("delay_step_ps"), py::arg("coarse_to_fine") = false,
       "Return best delay (ps); NumPy input accepted without copying when contiguous.");
 
   py::class_<RollingSingles>(m, "RollingSingles")
       .def(py::init<long long>(), py::arg("window_seconds") = 200)
-      .def("append_chunk", &RollingSingles::appendChunk, py::arg("chunk"))
+      .def("append_chunk",
+           py::overload_cast<const std::map<int, Singles> &>(
+               &RollingSingles::appendChunk),
+           py::arg("chunk"))
+      .def("append_chunk",
+           py::overload_cast<const std::map<int, FlatSingles> &>(
+               &RollingSingles::appendChunk),
+           py::arg("chunk"))
+      .def("flat_channel", &RollingSingles::flatChannel, py::arg("channel"))
+      .def(
+          "ingest",
+          [](RollingSingles &self,
+             py::array_t<uint64_t, py::array::c_style | py::array::forcecast>
+                 timestamps,
+             py::array_t<uint16_t, py::array::c_style | py::array::forcecast>
+                 channels) {
+            auto ts = timestamps.unchecked<1>();
+            auto ch = channels.unchecked<1>();
+            if (ts.shape(0) != ch.shape(0))
+              throw std::invalid_argument(
+                  "timestamps and channels must have the same length");
+            std::vector<RawRecord> records(static_cast<size_t>(ts.shape(0)));
+            for (py::ssize_t i = 0; i < ts.shape(0); ++i)
+              records[static_cast<size_t>(i)] = {ts(i), ch(i)};
+            return self.ingest(records);
+          },
+          py::arg("timestamps"), py::arg("channels"),
+          "Feed raw tagger records (absolute ps timestamps, 0-based tagger "
+          "inputs). Returns the number of accepted records.")
+      .def("has_origin", &RollingSingles::hasOrigin)
+      .def("origin", &RollingSingles::origin)
+      .def("set_origin", &RollingSingles::setOrigin, py::arg("origin_ps"))
+      // Singles views are rebuilt from the ring after every mutation, so
+      // Python receives copies rather than references that could dangle.
       .def(
           "channel_singles",
-          [](RollingSingles &self, int channel) -> const Singles & {
+          [](const RollingSingles &self, int channel) {
             return self.channelSingles(channel);
           },
-          py::return_value_policy::reference_internal, py::arg("channel"))
+          py::arg("channel"))
+      .def(
+          "events_for_second",
+          [](const RollingSingles &self, int channel, long long second) {
+            const auto events = self.eventsForSecond(channel, second);
+            return std::vector<Timestamp>(events.begin(), events.end());
+          },
+          py::arg("channel"), py::arg("second"))
       .def(
           "latest_chunk",
-          [](RollingSingles &self,
-             int channel) -> const std::vector<std::vector<Timestamp>> & {
-            return self.latestChunk(channel);
+          [](const RollingSingles &self, int channel) {
+            std::vector<std::vector<Timestamp>> out;
+            for (const auto view : self.latestChunk(channel))
+              out.emplace_back(view.begin(), view.end());
+            return out;
           },
-          py::return_value_policy::reference_internal, py::arg("channel"))
+          py::arg("channel"))
       .def("set_window_seconds", &RollingSingles::setWindow, py::arg("seconds"))
       .def("window_seconds", &RollingSingles::windowSeconds)
       .def("latest_second", &RollingSingles::latestSecond)
+      .def("all_channels", [](const RollingSingles &self) {
+        return self.allChannels();
+      });
+
+  py::class_<RollingDelayHistogram>(m, "RollingDelayHistogram")
+      .def(py::init([](const std::vector<std::pair<int, int>> &pairs,
+                       double coinc_window_ps, double delay_start_ps,
+                       double delay_end_ps, double delay_step_ps) {
+             return RollingDelayHistogram(
+                 pairs, static_cast<long long>(std::llround(coinc_window_ps)),
+                 static_cast<long long>(std::llround(delay_start_ps)),
+                 static_cast<long long>(std::llround(delay_end_ps)),
+                 static_cast<long long>(std::llround(delay_step_ps)));
+           }),
+           py::arg("pairs"), py::arg("coinc_window_ps"),
+           py::arg("delay_start_ps"), py::arg("delay_end_ps"),
+           py::arg("delay_step_ps"))
+      .def("update", &RollingDelayHistogram::update, py::arg("rolling"),
+           "Rescan changed seconds of the rolling window; returns how many "
+           "(pair, second) histograms were recomputed")
+      .def(
+          "window_histogram",
+          [](const RollingDelayHistogram &self, size_t pair_index) {
+            const auto &total = self.windowHistogram(pair_index);
+            py::array_t<long long> out(static_cast<py::ssize_t>(total.size()));
+            std::copy(total.begin(), total.end(), out.mutable_data());
+            return out;
+          },
+          py::arg("pair_index"))
+      .def("best_delay_ps", &RollingDelayHistogram::bestDelayPs,
+           py::arg("pair_index"))
+      .def(
+          "delays_ps",
+          [](const RollingDelayHistogram &self) {
+            py::array_t<long long> out(
+                static_cast<py::ssize_t>(self.binCount()));
+            auto view = out.mutable_unchecked<1>();
+            for (size_t b = 0; b < self.binCount(); ++b)
+              view(static_cast<py::ssize_t>(b)) = self.delayForBin(b);
+            return out;
+          })
+      .def_property_readonly("pairs", &RollingDelayHistogram::pairs);
+
+  py::class_<BinTailReader>(m, "BinTailReader")
+      .def(py::init<std::string>(), py::arg("filename"))
       .def(
-          "all_channels",
-          [](RollingSingles &self) -> const std::map<int, Singles> & {
-            return self.allChannels();
+          "poll",
+          [](BinTailReader &self, size_t max_records) {
+            std::vector<RawRecord> records;
+            self.poll(records, max_records);
+            py::array_t<uint64_t> ts(static_cast<py::ssize_t>(records.size()));
+            py::array_t<uint16_t> ch(static_cast<py::ssize_t>(records.size()));
+            auto tsOut = ts.mutable_unchecked<1>();
+            auto chOut = ch.mutable_unchecked<1>();
+            for (size_t i = 0; i < records.size(); ++i) {
+              tsOut(static_cast<py::ssize_t>(i)) = records[i].timestamp;
+              chOut(static_cast<py::ssize_t>(i)) = records[i].channel;
+            }
+            return py::make_tuple(ts, ch);
           },
-          py::return_value_policy::reference_internal);
+          py::arg("max_records") = std::numeric_limits<size_t>::max(),
+          "New complete records as (timestamps uint64, channels uint16)")
+      .def("poll_into", &BinTailReader::pollInto, py::arg("rolling"),
+           py::arg("max_records") = std::numeric_limits<size_t>::max(),
+           "Read new records straight into a RollingSingles; returns the "
+           "number read")
+      .def("offset", &BinTailReader::offset)
+      .def_property_readonly("filename", &BinTailReader::filename);
 
   m.def("write_results_to_file", &writeResultsToFile, py::arg("results"),
         py::arg("filename"), "Write coincidence results to CSV");
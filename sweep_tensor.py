@@ -0,0 +1,49 @@
+"""Reader for the consolidated CoincFinder sweep tensor (``--tensor``).
+
+The layout is documented in ``include/SweepTensorFile.h``; the count block is
+memory-mapped, so opening a day-long run is instant and only the slices that
+are touched get paged in.
+"""
+import struct
+from pathlib import Path
+
+import numpy as np
+
+MAGIC = b"CFSWEEP1"
+_HEADER = struct.Struct("<8sIIIIqqqqQ")
+
+
+class SweepTensor:
+    def __init__(self, path):
+        path = Path(path)
+        with open(path, "rb") as f:
+            fields = _HEADER.unpack(f.read(_HEADER.size))
+            (magic, version, n_pairs, n_seconds, n_bins, start_sec,
+             delay_start_ps, delay_step_ps, window_ps, data_offset) = fields
+            if magic != MAGIC or version != 1:
+                raise ValueError(f"{path} is not a version-1 sweep tensor")
+            pair_arr = np.frombuffer(f.read(8 * n_pairs), dtype="<i4").reshape(n_pairs, 2)
+        self.path = path
+        self.pairs = [tuple(int(c) for c in p) for p in pair_arr]
+        self.start_sec = start_sec
+        self.coinc_window_ps = window_ps
+        self.delays_ns = (delay_start_ps + delay_step_ps * np.arange(n_bins)) / 1000.0
+        self.valid = np.memmap(path, dtype=np.uint8, mode="r", offset=_HEADER.size + 8 * n_pairs,
+                               shape=(n_pairs, n_seconds)).astype(bool)
+        self.counts = np.memmap(path, dtype="<i4", mode="r", offset=data_offset,
+                                shape=(n_pairs, n_seconds, n_bins))
+
+    def sweep(self, ch1, ch2, second):
+        """Counts for one pair/second, or None when that sweep was not written."""
+        try:
+            p = self.pairs.index((ch1, ch2))
+        except ValueError:
+            return None
+        s = second - self.start_sec
+        if s < 0 or s >= self.counts.shape[1] or not self.valid[p, s]:
+            return None
+        return self.counts[p, s]
+
+
+def load_sweep_tensor(path):
+    return SweepTensor(path)
@@ -46,11 +46,7 @@ def main():
     print(f"Loaded duration: {duration:.2f}s; channels: {list(singles_map.keys())}")
 
     def flatten(ch):
-        v = singles_map[ch]
-        flat = []
-        for bucket in v.events_per_second:
-            flat.extend(bucket)
-        return np.array(flat, dtype=np.int64)
+        return singles_map[ch].flat_array()
 
     delay_start_ps = int(DELAY_START_NS * 1000)
     delay_end_ps = int(DELAY_END_NS * 1000)